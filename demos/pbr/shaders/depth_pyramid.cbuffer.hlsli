@@ -0,0 +1,20 @@
+#define CBUFFER_DEPTH_PYRAMID_REGISTER 0
+
+#if defined(__cplusplus)
+#define CBUFFER_DECLARE(X,N) __declspec(align(16)) struct X
+#else
+#define CBUFFER_DECLARE(X,N) cbuffer X : register(b ## N)
+#endif
+
+// One per mip since they're all reduced in the same frame
+CBUFFER_DECLARE(constant_buffer_depth_pyramid_data, CBUFFER_DEPTH_PYRAMID_REGISTER)
+{
+	int source_width = 0;
+	int source_height = 0;
+	int source_offset = -1;		// Into the pyramid, or -1 to read the depth buffer
+	int mip_width = 0;
+	int mip_height = 0;
+	int mip_offset = 0;
+};
+
+#undef CBUFFER_DECLARE
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include "depth_pyramid.cbuffer.hlsli"
+
+// Reduces one mip of the depth pyramid, the same way sp_depth_pyramid_build does
+
+Texture2D<float> depth_texture : register(t0);
+
+RWStructuredBuffer<float> depth_pyramid : register(u0);
+
+float source_load(int x, int y)
+{
+	if (source_offset < 0)
+	{
+		return depth_texture.Load(int3(x, y, 0));
+	}
+
+	return depth_pyramid[source_offset + y * source_width + x];
+}
+
+[numthreads(8, 8, 1)]
+void cs_main(uint3 thread_id : SV_DispatchThreadID)
+{
+	const int x = thread_id.x;
+	const int y = thread_id.y;
+
+	if (x >= mip_width || y >= mip_height)
+	{
+		return;
+	}
+
+	// The last row and column of an odd sized source go to the last row and column of the mip
+	const int source_x_begin = min(x * 2, source_width - 1);
+	const int source_x_end = x == mip_width - 1 ? source_width - 1 : min(x * 2 + 1, source_width - 1);
+	const int source_y_begin = min(y * 2, source_height - 1);
+	const int source_y_end = y == mip_height - 1 ? source_height - 1 : min(y * 2 + 1, source_height - 1);
+
+	float depth_max = source_load(source_x_begin, source_y_begin);
+	for (int source_y = source_y_begin; source_y <= source_y_end; ++source_y)
+	{
+		for (int source_x = source_x_begin; source_x <= source_x_end; ++source_x)
+		{
+			depth_max = max(depth_max, source_load(source_x, source_y));
+		}
+	}
+
+	depth_pyramid[mip_offset + y * mip_width + x] = depth_max;
+}
\ No newline at end of file
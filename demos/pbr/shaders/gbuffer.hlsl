@@ -10,21 +10,48 @@ Texture2D metalness_roughness_texture : register(t1);
 
 SamplerState default_sampler : register(s0);
 
-cbuffer per_object_cbuffer : register(b1)
+// Positions are quantized inside the model's bounds
+cbuffer per_mesh_cbuffer : register(b1)
 {
-	float4x4 world_matrix;
+	float4 position_scale;
+	float4 position_offset;
+}
+
+#define MATERIAL_COUNT_MAX 128 // Must match k_material_count_max
 
-	// TODO: Move to per_draw_cbuffer
+struct material
+{
 	float4 base_color_factor;
 	float4 metalness_roughness_factor;
+};
+
+cbuffer materials_cbuffer : register(b2)
+{
+	material materials[MATERIAL_COUNT_MAX];
 }
 
+// Octahedral, the lower half of the sphere is folded out over the corners
+float3 normal_decode(float2 encoded)
+{
+	float3 normal = float3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float fold = saturate(-normal.z);
+	normal.xy += normal.xy >= 0.0f ? -fold : fold;
+	return normalize(normal);
+}
+
+// Constant vertex colors are folded into base_color_factor when loading and varying ones aren't used
 struct vs_input
 {
-	float3 position_os : POSITION;
-	float3 normal_os : NORMAL;
+	float3 position_qs : POSITION;
+	float2 normal_os : NORMAL;
 	float2 texcoord : TEXCOORD;
-	float4 color : COLOR;
+
+	// Per instance, from the second vertex buffer
+	float4 world_matrix_0 : WORLD0;
+	float4 world_matrix_1 : WORLD1;
+	float4 world_matrix_2 : WORLD2;
+	float4 world_matrix_3 : WORLD3;
+	uint material_index : MATERIAL;
 };
 
 struct vs_output
@@ -32,19 +59,22 @@ struct vs_output
 	float4 position_cs : SV_Position;
 	float3 normal_ws : NORMAL;
 	float2 texcoord : TEXCOORD;
-	float4 color : COLOR;
+	nointerpolation uint material_index : MATERIAL;
 };
 
 vs_output vs_main(vs_input input)
 {
+	float4x4 world_matrix = float4x4(input.world_matrix_0, input.world_matrix_1, input.world_matrix_2, input.world_matrix_3);
 	float4x4 world_view_projection_matrix = mul(world_matrix, view_projection_matrix);
 
 	vs_output output;
 
-	output.position_cs = mul(float4(input.position_os, 1.0f), world_view_projection_matrix);
-	output.normal_ws = mul(float4(input.normal_os, 0.0f), world_matrix).xyz;
+	float3 position_os = input.position_qs * position_scale.xyz + position_offset.xyz;
+
+	output.position_cs = mul(float4(position_os, 1.0f), world_view_projection_matrix);
+	output.normal_ws = mul(float4(normal_decode(input.normal_os), 0.0f), world_matrix).xyz;
 	output.texcoord = input.texcoord;
-	output.color = input.color;
+	output.material_index = input.material_index;
 
 	return output;
 }
@@ -54,7 +84,7 @@ struct ps_input
 	float4 position_ss : SV_Position;
 	float3 normal_ws : NORMAL;
 	float2 texcoord : TEXCOORD;
-	float4 color : COLOR;
+	nointerpolation uint material_index : MATERIAL;
 };
 
 struct ps_output
@@ -70,17 +100,17 @@ ps_output ps_main(ps_input input)
 
 #if BINDLESS_TEXTURES
 	// TODO: If we were really using bindless then we'd want to pass the texture index
-	// in a constant buffer instead (since all textures would share the same array). 
-	// e.g. textures_2d[per_object_cbuffer.base_color_texture_index].Sample(...);
-	output.base_color = srgb_to_linear(textures_2d[0].Sample(default_sampler, input.texcoord)) * input.color;
+	// per material instead (since all textures would share the same array). 
+	// e.g. textures_2d[materials[input.material_index].base_color_texture_index].Sample(...);
+	output.base_color = srgb_to_linear(textures_2d[0].Sample(default_sampler, input.texcoord));
 	output.metalness_roughness = textures_2d[1].Sample(default_sampler, input.texcoord).bgra;
 #else
-	output.base_color = srgb_to_linear(base_color_texture.Sample(default_sampler, input.texcoord)) * input.color;
+	output.base_color = srgb_to_linear(base_color_texture.Sample(default_sampler, input.texcoord));
 	output.metalness_roughness = metalness_roughness_texture.Sample(default_sampler, input.texcoord).bgra;
 #endif
 
-	output.base_color *= base_color_factor;
-	output.metalness_roughness *= metalness_roughness_factor;
+	output.base_color *= materials[input.material_index].base_color_factor;
+	output.metalness_roughness *= materials[input.material_index].metalness_roughness_factor;
 
 	output.normal_ws = float4((normalize(input.normal_ws) + 1) / 2, 1.0);
 
@@ -0,0 +1,31 @@
+#define CBUFFER_INDIRECT_CULL_REGISTER 0
+
+#if defined(__cplusplus)
+#define CBUFFER_DECLARE(X,N) __declspec(align(16)) struct X
+#else
+#define CBUFFER_DECLARE(X,N) cbuffer X : register(b ## N)
+#endif
+
+#define DEPTH_PYRAMID_MIP_COUNT_MAX 16 // Must match k_depth_pyramid_mip_count_max
+
+CBUFFER_DECLARE(constant_buffer_indirect_cull_data, CBUFFER_INDIRECT_CULL_REGISTER)
+{
+	// Arrays first so the C++ and HLSL packing agree
+#if defined(__cplusplus)
+	float frustum_planes[6][4] = {};
+	float previous_view_projection_matrix[4][4] = {};		// The depth pyramid's
+	int depth_pyramid_mips[DEPTH_PYRAMID_MIP_COUNT_MAX][4] = {};		// Width, height and offset of each mip
+#else
+	float4 frustum_planes[6];
+	float4x4 previous_view_projection_matrix;
+	int4 depth_pyramid_mips[DEPTH_PYRAMID_MIP_COUNT_MAX];
+#endif
+
+	int instance_count = 0;
+	int occlusion_culling = 0;		// Only when last frame built a depth pyramid
+	int depth_width = 0;
+	int depth_height = 0;
+	int depth_pyramid_mip_count = 0;
+};
+
+#undef CBUFFER_DECLARE
\ No newline at end of file
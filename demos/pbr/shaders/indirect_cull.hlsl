@@ -0,0 +1,138 @@
+#include "indirect_cull.cbuffer.hlsli"
+
+// Culls every instance against the frustum and last frame's depth pyramid and appends the ones that survive to their draw's
+// range of the visible instance stream, counting them into the draw's arguments. Does the same arithmetic in the same order as
+// sp_indirect_cull_reference so the counts match it. Keep them in sync.
+
+struct cull_instance
+{
+	float3 center;
+	uint draw;
+	float3 extent;
+	uint data;
+};
+
+// D3D12_DRAW_INDEXED_ARGUMENTS
+struct draw_arguments
+{
+	uint index_count;
+	uint instance_count;
+	uint first_index;
+	int base_vertex;
+	uint first_instance;
+};
+
+// Must match instance_data
+struct instance
+{
+	float4x4 world_matrix;
+	uint material_index;
+};
+
+StructuredBuffer<cull_instance> cull_instances : register(t0);
+StructuredBuffer<instance> instances : register(t1);
+StructuredBuffer<float> depth_pyramid : register(t2);
+
+RWStructuredBuffer<draw_arguments> draws : register(u0);
+RWStructuredBuffer<instance> visible_instances : register(u1);
+
+bool outside_frustum(cull_instance cull)
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		const float4 plane = frustum_planes[i];
+		precise float distance = plane.x * cull.center.x + plane.y * cull.center.y + plane.z * cull.center.z + plane.w;
+		precise float reach = abs(plane.x) * cull.extent.x + abs(plane.y) * cull.extent.y + abs(plane.z) * cull.extent.z;
+		if (distance + reach < 0.0f)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool occluded(cull_instance cull)
+{
+	precise float3 ndc_min = float3(1.0f, 1.0f, 1.0f);
+	precise float3 ndc_max = float3(-1.0f, -1.0f, -1.0f);
+
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		precise float3 position = float3(
+			cull.center.x + ((corner & 1) ? cull.extent.x : -cull.extent.x),
+			cull.center.y + ((corner & 2) ? cull.extent.y : -cull.extent.y),
+			cull.center.z + ((corner & 4) ? cull.extent.z : -cull.extent.z));
+
+		precise float4 clip;
+		for (int k = 0; k < 4; ++k)
+		{
+			clip[k] = position.x * previous_view_projection_matrix[0][k] + position.y * previous_view_projection_matrix[1][k] + position.z * previous_view_projection_matrix[2][k] + previous_view_projection_matrix[3][k];
+		}
+
+		// Projecting a corner behind the camera would flip it to the other side of the screen
+		if (clip.w <= 0.0f)
+		{
+			return false;
+		}
+
+		precise float3 ndc = clip.xyz / clip.w;
+		ndc_min = min(ndc_min, ndc);
+		ndc_max = max(ndc_max, ndc);
+	}
+
+	precise float u_min = min(max(ndc_min.x * 0.5f + 0.5f, 0.0f), 1.0f);
+	precise float u_max = min(max(ndc_max.x * 0.5f + 0.5f, 0.0f), 1.0f);
+	precise float v_min = min(max(0.5f - ndc_max.y * 0.5f, 0.0f), 1.0f);
+	precise float v_max = min(max(0.5f - ndc_min.y * 0.5f, 0.0f), 1.0f);
+
+	int x_min = min((int)(u_min * depth_width), depth_width - 1);
+	int x_max = min((int)(u_max * depth_width), depth_width - 1);
+	int y_min = min((int)(v_min * depth_height), depth_height - 1);
+	int y_max = min((int)(v_max * depth_height), depth_height - 1);
+
+	int mip = -1;
+	do
+	{
+		++mip;
+		x_min = min(x_min / 2, depth_pyramid_mips[mip].x - 1);
+		x_max = min(x_max / 2, depth_pyramid_mips[mip].x - 1);
+		y_min = min(y_min / 2, depth_pyramid_mips[mip].y - 1);
+		y_max = min(y_max / 2, depth_pyramid_mips[mip].y - 1);
+	} while ((x_max - x_min > 1 || y_max - y_min > 1) && mip + 1 < depth_pyramid_mip_count);
+
+	const int offset = depth_pyramid_mips[mip].z;
+	const int width = depth_pyramid_mips[mip].x;
+
+	const float depth_max = max(
+		max(depth_pyramid[offset + y_min * width + x_min], depth_pyramid[offset + y_min * width + x_max]),
+		max(depth_pyramid[offset + y_max * width + x_min], depth_pyramid[offset + y_max * width + x_max]));
+
+	return ndc_min.z > depth_max;
+}
+
+[numthreads(64, 1, 1)]
+void cs_main(uint3 thread_id : SV_DispatchThreadID)
+{
+	if ((int)thread_id.x >= instance_count)
+	{
+		return;
+	}
+
+	const cull_instance cull = cull_instances[thread_id.x];
+
+	if (outside_frustum(cull))
+	{
+		return;
+	}
+
+	if (occlusion_culling && occluded(cull))
+	{
+		return;
+	}
+
+	uint slot;
+	InterlockedAdd(draws[cull.draw].instance_count, 1, slot);
+
+	visible_instances[draws[cull.draw].first_instance + slot] = instances[cull.data];
+}
\ No newline at end of file
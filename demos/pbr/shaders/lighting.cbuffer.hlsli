@@ -8,8 +8,14 @@
 
 CBUFFER_DECLARE(constant_buffer_lighting_per_frame_data, CBUFFER_LIGHTING_REGISTER)
 {
+	// Environment irradiance from sp_image_ibl_bake, RGB in xyz. First so the C++ and HLSL packing agree.
+#if defined(__cplusplus)
+	float irradiance_sh9[9][4] = {};
+#else
+	float4 irradiance_sh9[9];
+#endif
+
 	float image_based_lighting_scale = 1.0f;
-	int sampling_method = 0;
 };
 
 #undef CBUFFER_DECLARE
\ No newline at end of file
@@ -10,7 +10,8 @@ Texture2D gbuffer_metalness_roughness_texture : register(t1);
 Texture2D gbuffer_normal_map_texture : register(t2);
 Texture2D gbuffer_depth_texture : register(t3);
 
-Texture2D environment_specular_texture : register(t4);
+Texture2D environment_specular_texture : register(t4);	// GGX prefiltered, level i for perceptual roughness i / (levels - 1)
+Texture2D environment_brdf_lut_texture : register(t5);	// Split sum scale and bias for F0, n_dot_v along u and roughness along v
 
 SamplerState default_sampler : register(s0);
 
@@ -61,69 +62,21 @@ struct directional_light
 	float3 irradiance;	// Power per unit area received by surface with normal facing direction
 };
 
-// https://blog.selfshadow.com/publications/s2013-shading-course/karis/s2013_pbs_epic_notes_v2.pdf
-float3 importance_sample_ggx(float2 Xi, float alpha)
+// Evaluates irradiance stored as 9 spherical harmonic coefficients, with the same basis sp_image_ibl_bake projects onto
+float3 irradiance_sh9_evaluate(float3 n)
 {
-	// Returns samples in tangent space (Z)
-	float alpha2 = alpha * alpha;
-	float phi = 2.0 * PI * Xi.x;
-	float cos_theta2 = (1.0 - Xi.y) / (1.0 + (alpha2 - 1.0) * Xi.y);
-	float cos_theta = sqrt(cos_theta2);
-	float sin_theta = sqrt(1.0 - cos_theta2);
-	return float3(cos(phi) * sin_theta, sin(phi) * sin_theta, cos_theta); 
-}
-
-float importance_sample_ggx_inverse_pdf(float l_dot_h, float n_dot_h, float alpha)
-{
-	return (4.0 * l_dot_h) / (distribution(n_dot_h, alpha) * n_dot_h); // TODO: Specify d_ggx instead of distribution 
-}
-
-float3 uniform_sample_hemisphere(float2 Xi)
-{
-	float z = Xi.x;
-	float r = sqrt(max(0.0, 1.0 - z * z));
-	float phi = 2.0 * PI * Xi.y;
-	return float3(r * cos(phi), r * sin(phi), z);
-}
-
-float uniform_sample_hemisphere_inverse_pdf()
-{
-	return 2.0 * PI;
-}
-
-float3 uniform_sample_sphere(float2 Xi)
-{
-	float z = 1.0 - 2.0 * Xi.x;
-	float r = sqrt(max(0.0, 1.0 - z * z));
-	float phi = 2.0 * PI * Xi.y;
-	return float3(r * cos(phi), r * sin(phi), z);
-}
-
-float uniform_sample_sphere_inverse_pdf()
-{
-	return 4.0 * PI;
-}
-
-float3x3 orthonormal_basis(float3 n)
-{
-	float3 up = abs(n.z) < (1 - EPSILON) ? float3(0.0, 0.0, 1.0) : float3(1.0, 0.0, 0.0);
-
-	float3 v = normalize(cross(up, n));
-	float3 u = normalize(cross(n, v));
-
-	return float3x3(v, u, n);
-}
-
-// http://holger.dammertz.org/stuff/notes_HammersleyOnHemisphere.html
-float2 hammersley(uint i, uint N)
-{
-	uint bits = i;
-	bits = (bits << 16u) | (bits >> 16u);
-	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
-	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
-	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
-	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
-	return float2(float(i) / float(N), float(bits) * 2.3283064365386963e-10);
+	float3 irradiance = irradiance_sh9[0].rgb * 0.282095;
+	irradiance += irradiance_sh9[1].rgb * 0.488603 * n.y;
+	irradiance += irradiance_sh9[2].rgb * 0.488603 * n.z;
+	irradiance += irradiance_sh9[3].rgb * 0.488603 * n.x;
+	irradiance += irradiance_sh9[4].rgb * 1.092548 * n.x * n.y;
+	irradiance += irradiance_sh9[5].rgb * 1.092548 * n.y * n.z;
+	irradiance += irradiance_sh9[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0);
+	irradiance += irradiance_sh9[7].rgb * 1.092548 * n.x * n.z;
+	irradiance += irradiance_sh9[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+
+	// Ringing can take it below zero opposite very bright lights
+	return max(irradiance, 0.0);
 }
 
 float2 spherical_map(float3 direction_ws)
@@ -184,68 +137,31 @@ float4 ps_main(ps_input input) : SV_Target0
 
 	float3 indirect_lighting = float3(0.0, 0.0, 0.0);
 	{
-		const float3x3 tangent_to_world = orthonormal_basis(normal_ws);
-
-		const int sample_count = 64;
-		const float inverse_sample_count = 1.0f / (float)sample_count;
-
-		for (int i = 0; i < sample_count; ++i)
-		{
-			const float2 x = hammersley(i, sample_count);
-
-			float3 direction_to_light_ws;
-			float3 half_vector_ws;
-			if (sampling_method == 0)
-			{
-				// In the case of importance_sample_ggx I'm getting back the half vector...
-				const float3 half_vector_ts = importance_sample_ggx(x, disney_roughness);
-				half_vector_ws = mul(half_vector_ts, tangent_to_world);
-				direction_to_light_ws = reflect(-direction_to_camera_ws, half_vector_ws);
-			}
-			else if (sampling_method == 1)
-			{
-				const float3 direction_to_light_ts = uniform_sample_sphere(x);
-				direction_to_light_ws = mul(direction_to_light_ts, tangent_to_world);
-				half_vector_ws = normalize(direction_to_light_ws + direction_to_camera_ws);
-			}
-			else
-			{
-				const float3 direction_to_light_ts = uniform_sample_hemisphere(x);
-				direction_to_light_ws = mul(direction_to_light_ts, tangent_to_world);
-				half_vector_ws = normalize(direction_to_light_ws + direction_to_camera_ws);
-			}
-
-			const float n_dot_l = saturate(dot(normal_ws, direction_to_light_ws));
-			const float n_dot_h = saturate(dot(normal_ws, half_vector_ws));
-			const float l_dot_h = saturate(dot(direction_to_light_ws, half_vector_ws));
-
-			float inverse_pdf;
-			if (sampling_method == 0)
-			{
-				inverse_pdf = importance_sample_ggx_inverse_pdf(l_dot_h, n_dot_h, disney_roughness);
-			}
-			else if (sampling_method == 1)
-			{
-				inverse_pdf = uniform_sample_sphere_inverse_pdf();
-			}
-			else
-			{
-				inverse_pdf = uniform_sample_hemisphere_inverse_pdf();
-			}
-
-			float2 texcoord = spherical_map(direction_to_light_ws);
-
-			uint width, height, levels;
-			environment_specular_texture.GetDimensions(0, width, height, levels);
-
-			float lod = 1.5 - (((1.0 + 24.0 * disney_roughness) - 1.0) / 4.0) * (levels - 1);
-
-			float3 radiance = environment_specular_texture.SampleLevel(default_sampler, texcoord, 0).rgb * inverse_pdf * inverse_sample_count;
-
-			const float3 f_s = specular(specular_color, n_dot_v, n_dot_l, n_dot_h, l_dot_h, disney_roughness);
-
-			indirect_lighting += f_s * n_dot_l * radiance * PI * image_based_lighting_scale;
-		}
+		// Split sum approximation. https://blog.selfshadow.com/publications/s2013-shading-course/karis/s2013_pbs_epic_notes_v2.pdf
+		const float perceptual_roughness = metalness_roughness.g;
+
+		uint width, height, levels;
+		environment_specular_texture.GetDimensions(0, width, height, levels);
+
+		// The static sampler doesn't filter between mips so blend the two closest levels by hand
+		const float3 reflection_ws = reflect(-direction_to_camera_ws, normal_ws);
+		const float2 reflection_texcoord = spherical_map(reflection_ws);
+		const float lod = perceptual_roughness * (levels - 1);
+		const float3 prefiltered_radiance = lerp(
+			environment_specular_texture.SampleLevel(default_sampler, reflection_texcoord, floor(lod)).rgb,
+			environment_specular_texture.SampleLevel(default_sampler, reflection_texcoord, ceil(lod)).rgb,
+			frac(lod));
+
+		// Kept away from the edges so the wrapping sampler doesn't blend in the other side
+		uint lut_width, lut_height, lut_levels;
+		environment_brdf_lut_texture.GetDimensions(0, lut_width, lut_height, lut_levels);
+		const float2 lut_texcoord = (float2(n_dot_v, perceptual_roughness) * (float2(lut_width, lut_height) - 1.0) + 0.5) / float2(lut_width, lut_height);
+		const float2 brdf_scale_bias = environment_brdf_lut_texture.SampleLevel(default_sampler, lut_texcoord, 0).rg;
+
+		const float3 f_s = prefiltered_radiance * (specular_color * brdf_scale_bias.x + brdf_scale_bias.y);
+		const float3 f_d = diffuse(diffuse_color) * irradiance_sh9_evaluate(normal_ws);
+
+		indirect_lighting += (f_s + f_d) * image_based_lighting_scale;
 	}
 
 	float3 lighting = direct_lighting + indirect_lighting;
@@ -8,4 +8,5 @@ cbuffer per_frame_cbuffer : register(b0) // per_batch, per_instance, per_materia
 	float4x4 inverse_view_projection_matrix;
 	float3 camera_position_ws;
 	float3 sun_direction_ws;
+	float4x4 previous_view_projection_matrix;
 };
\ No newline at end of file
@@ -0,0 +1,15 @@
+#define CBUFFER_TEMPORAL_RESOLVE_REGISTER 1
+
+#if defined(__cplusplus)
+#define CBUFFER_DECLARE(X,N) __declspec(align(16)) struct X
+#else
+#define CBUFFER_DECLARE(X,N) cbuffer X : register(b ## N)
+#endif
+
+CBUFFER_DECLARE(constant_buffer_temporal_resolve_per_frame_data, CBUFFER_TEMPORAL_RESOLVE_REGISTER)
+{
+	float history_weight = 0.9f;
+	int history_valid = 0;
+};
+
+#undef CBUFFER_DECLARE
\ No newline at end of file
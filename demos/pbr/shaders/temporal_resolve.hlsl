@@ -0,0 +1,59 @@
+#include "per_frame_cbuffer.hlsli"
+#include "fullscreen_triangle.hlsli"
+#include "position_from_depth.hlsli"
+#include "temporal_resolve.cbuffer.hlsli"
+
+// The lighting texture may be lower resolution than the render targets. It's bilinearly upsampled here and then
+// accumulated with the reprojected result from the previous frame.
+Texture2D lighting_texture : register(t0);
+Texture2D gbuffer_depth_texture : register(t1);
+Texture2D history_texture : register(t2);
+
+SamplerState default_sampler : register(s0);
+
+struct ps_output
+{
+	float4 history : SV_Target0;
+	float4 color : SV_Target1;
+};
+
+ps_output ps_main(ps_input input)
+{
+	float2 lighting_texture_size;
+	lighting_texture.GetDimensions(lighting_texture_size.x, lighting_texture_size.y);
+	const float2 lighting_texel_size = 1.0f / lighting_texture_size;
+
+	const float3 current = lighting_texture.SampleLevel(default_sampler, input.texcoord, 0).rgb;
+
+	// Neighborhood clamp to reject history that no longer matches what's on screen
+	float3 neighborhood_min = current;
+	float3 neighborhood_max = current;
+	for (int y = -1; y <= 1; ++y)
+	{
+		for (int x = -1; x <= 1; ++x)
+		{
+			const float3 neighbor = lighting_texture.SampleLevel(default_sampler, input.texcoord + float2(x, y) * lighting_texel_size, 0).rgb;
+			neighborhood_min = min(neighborhood_min, neighbor);
+			neighborhood_max = max(neighborhood_max, neighbor);
+		}
+	}
+
+	// Reproject using depth and last frame's camera. There are no motion vectors so anything that moves on its own will smear
+	// until the clamp catches it.
+	const float depth = gbuffer_depth_texture.Load(int3(input.position_ss.xy, 0)).r;
+	const float3 position_ws = position_ws_from_depth(depth, input.texcoord, inverse_view_projection_matrix);
+	const float4 previous_position_cs = mul(float4(position_ws, 1.0f), previous_view_projection_matrix);
+	const float2 previous_texcoord = previous_position_cs.xy / previous_position_cs.w * float2(0.5f, -0.5f) + 0.5f;
+
+	float3 result = current;
+	if (history_valid && all(previous_texcoord >= 0.0f) && all(previous_texcoord <= 1.0f))
+	{
+		const float3 history = clamp(history_texture.SampleLevel(default_sampler, previous_texcoord, 0).rgb, neighborhood_min, neighborhood_max);
+		result = lerp(current, history, history_weight);
+	}
+
+	ps_output output;
+	output.history = float4(result, 1.0f);
+	output.color = float4(result, 1.0f);
+	return output;
+}
\ No newline at end of file
@@ -13,7 +13,10 @@
 #include <sparky/sparky.h>
 
 #include "../shaders/clouds.cbuffer.hlsli"
+#include "../shaders/depth_pyramid.cbuffer.hlsli"
+#include "../shaders/indirect_cull.cbuffer.hlsli"
 #include "../shaders/lighting.cbuffer.hlsli"
+#include "../shaders/temporal_resolve.cbuffer.hlsli"
 
 #include <string>
 #include <cassert>
@@ -23,6 +26,10 @@
 #include <utility>
 #include <iostream>
 #include <algorithm>
+#include <cfloat>
+#include <numeric>
+#include <chrono>
+#include <filesystem>
 
 #include <wrl.h>
 #include <shellapi.h>
@@ -124,14 +131,27 @@ struct model
 
 	struct mesh
 	{
-		int vertex_count = -1;
 		sp_vertex_buffer_handle vertex_buffer_handle;
+		sp_index_buffer_handle index_buffer_handle;
+		int index_count = -1;
+		int first_index = 0;
+		int base_vertex = 0;
 		int material_index = -1;
+
+		// Simplified versions of the mesh in the same index buffer, coarsest last
+		std::vector<sp_mesh_lod> lods;
+
+		// Around every vertex, in object space, for culling and picking and for how big the mesh is on screen
+		math::vec<3> bounds_min = { 0.0f, 0.0f, 0.0f };
+		math::vec<3> bounds_max = { 0.0f, 0.0f, 0.0f };
 	};
 
 	std::vector<mesh> meshes;
 	std::vector<material> materials;
 	std::vector<sp_texture_handle> textures;
+
+	// Every mesh shares the one vertex buffer so they share this too
+	sp_mesh_vertex_format vertex_format;
 };
 
 model model_create_cube(const char* name, sp_texture_handle base_color_texture_handle, sp_texture_handle metalness_roughness_texture_handle)
@@ -153,15 +173,7 @@ model model_create_cube(const char* name, sp_texture_handle base_color_texture_h
 
 	model::mesh mesh;
 	{
-		struct cube_vertex
-		{
-			math::vec<3> position;
-			math::vec<3> normal;
-			math::vec<2> texcoord;
-			math::vec<4> color;
-		};
-
-		cube_vertex cube_vertices[] =
+		const sp_mesh_vertex cube_vertices[] =
 		{
 			// Front
 			{ { -0.5f, -0.5f,  0.5f }, {  0.0f,  0.0f,  1.0f }, { 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 1.0f } },
@@ -212,12 +224,31 @@ model model_create_cube(const char* name, sp_texture_handle base_color_texture_h
 			{ {  0.5f, -0.5f, -0.5f }, {  0.0f, -1.0f, -1.0f }, { 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 1.0f } },
 		};
 
-		mesh.vertex_buffer_handle = sp_vertex_buffer_create("cube", { sizeof(cube_vertices), sizeof(cube_vertex) });
-		sp_vertex_buffer_update(mesh.vertex_buffer_handle, cube_vertices, sizeof(cube_vertices));
+		sp_mesh cube_mesh;
+		cube_mesh._vertices.assign(std::begin(cube_vertices), std::end(cube_vertices));
+
+		for (uint32_t i = 0; i < std::size(cube_vertices); ++i)
+		{
+			cube_mesh._indices.push_back(i);
+		}
+
+		// Same packing as cooked models so it can share their pipeline states
+		const sp_mesh_quantized_vertices quantized_vertices = sp_mesh_quantize(cube_mesh, sp_mesh_quantize_desc());
+
+		model.vertex_format = quantized_vertices._format;
+
+		mesh.vertex_buffer_handle = sp_vertex_buffer_create("cube", { static_cast<int>(quantized_vertices._data.size()), static_cast<int>(quantized_vertices._format._stride_bytes) });
+		sp_vertex_buffer_update(mesh.vertex_buffer_handle, quantized_vertices._data.data(), static_cast<int>(quantized_vertices._data.size()));
 
-		mesh.vertex_count = static_cast<int>(std::size(cube_vertices));
+		mesh.index_buffer_handle = sp_index_buffer_create("cube", { static_cast<int>(cube_mesh._indices.size() * sizeof(uint32_t)), static_cast<int>(sizeof(uint32_t)) });
+		sp_index_buffer_update(mesh.index_buffer_handle, cube_mesh._indices.data(), static_cast<int>(cube_mesh._indices.size() * sizeof(uint32_t)));
+
+		mesh.index_count = static_cast<int>(cube_mesh._indices.size());
 
 		mesh.material_index = 0;
+
+		mesh.bounds_min = { -0.5f, -0.5f, -0.5f };
+		mesh.bounds_max = { 0.5f, 0.5f, 0.5f };
 	}
 
 	model.meshes.push_back(mesh);
@@ -225,251 +256,268 @@ model model_create_cube(const char* name, sp_texture_handle base_color_texture_h
 	return model;
 }
 
-namespace detail
+// Every level goes up in one batch
+void texture_update_from_mip_chain(sp_texture_handle texture_handle, const sp_image_mip_chain& mip_chain)
 {
-	int get_stride_bytes(const fx::gltf::Accessor& accessor)
-	{
-		int element_size_bytes = 0;
-		switch (accessor.componentType)
-		{
-		case fx::gltf::Accessor::ComponentType::Byte:
-		case fx::gltf::Accessor::ComponentType::UnsignedByte:
-			element_size_bytes = 1;
-			break;
-		case fx::gltf::Accessor::ComponentType::Short:
-		case fx::gltf::Accessor::ComponentType::UnsignedShort:
-			element_size_bytes = 2;
-			break;
-		case fx::gltf::Accessor::ComponentType::Float:
-		case fx::gltf::Accessor::ComponentType::UnsignedInt:
-			element_size_bytes = 4;
-			break;
-		}
-
-		int element_count = 0;
-		switch (accessor.type)
-		{
-		case fx::gltf::Accessor::Type::Mat2:
-			element_count = 4;
-			break;
-		case fx::gltf::Accessor::Type::Mat3:
-			element_count = 9;
-			break;
-		case fx::gltf::Accessor::Type::Mat4:
-			element_count = 16;
-			break;
-		case fx::gltf::Accessor::Type::Scalar:
-			element_count = 1;
-			break;
-		case fx::gltf::Accessor::Type::Vec2:
-			element_count = 2;
-			break;
-		case fx::gltf::Accessor::Type::Vec3:
-			element_count = 3;
-			break;
-		case fx::gltf::Accessor::Type::Vec4:
-			element_count = 4;
-			break;
-		}
+	std::array<sp_texture_subresource_data, k_image_mip_count_max> subresources;
 
-		return element_size_bytes * element_count;
+	for (int mip = 0; mip < mip_chain._mip_count; ++mip)
+	{
+		subresources[mip].mip_level = mip;
+		subresources[mip].data_cpu = sp_image_mip_chain_get_data(mip_chain, mip);
+		subresources[mip].row_pitch_bytes = mip_chain._mips[mip]._row_pitch_bytes;
 	}
+
+	sp_texture_update_subresources(texture_handle, subresources.data(), mip_chain._mip_count);
 }
 
 model model_create_from_gltf(const char* path)
 {
-	const fx::gltf::ReadQuotas read_quotas_fx = {
-		fx::gltf::detail::DefaultMaxBufferCount,
-		fx::gltf::detail::DefaultMaxMemoryAllocation * 2,
-		fx::gltf::detail::DefaultMaxMemoryAllocation * 2,
-	};
-	fx::gltf::Document doc_fx = fx::gltf::LoadFromText(path, read_quotas_fx);
+	const auto mesh_start_time = std::chrono::high_resolution_clock::now();
+
+	// Cooked next to the source, e.g. foo.gltf -> foo.spmesh, and cooked again whenever the source is newer
+	const std::string path_without_extension = std::string(path).substr(0, std::string(path).find_last_of('.'));
+	const std::string cooked_path = path_without_extension + ".spmesh";
 
-	std::vector<const char*> image_paths;
-	for (const auto& texture_fx : doc_fx.textures)
+	std::error_code error;
+	const auto cooked_write_time = std::filesystem::last_write_time(cooked_path, error);
+	bool cooked = !error && cooked_write_time >= std::filesystem::last_write_time(path);
+
+	sp_mesh_file mesh_file;
+	if (!cooked || !sp_mesh_file_open(cooked_path.c_str(), mesh_file))
 	{
-		const fx::gltf::Image& image_fx = doc_fx.images[texture_fx.source];
+		sp_mesh mesh = sp_mesh_create_from_gltf(path);
 
-		if (!image_fx.uri.empty() && !image_fx.IsEmbeddedResource())
-		{
-			image_paths.push_back(image_fx.uri.c_str());
-		}
-		else
-		{
-			assert(false);
-		}
-	}
+		const sp_mesh_vertex_cache_stats source_stats = sp_mesh_analyze_vertex_cache(mesh);
 
-	// Create materials
-	std::vector<model::material> materials;
-	materials.resize(doc_fx.materials.size());
-	std::transform(doc_fx.materials.begin(), doc_fx.materials.end(), materials.begin(), [](const fx::gltf::Material& material_fx) {
-		model::material material;
-		strcpy(material.name, material_fx.name.c_str());
-		material.base_color_texture_index = material_fx.pbrMetallicRoughness.baseColorTexture.index;
-		material.metalness_roughness_texture_index = material_fx.pbrMetallicRoughness.metallicRoughnessTexture.index;
-		material.base_color_factor = material_fx.pbrMetallicRoughness.baseColorFactor;
-		material.metalness_factor = material_fx.pbrMetallicRoughness.metallicFactor;
-		material.roughness_factor = material_fx.pbrMetallicRoughness.roughnessFactor;
-		material.double_sided = material_fx.doubleSided;
-		return material;
-	});
+		sp_mesh_optimize(mesh, sp_mesh_optimize_desc());
 
-	// XXX: We collapse glTF primitives and meshes into one type
-	std::vector<model::mesh> meshes;
-	for (const auto& mesh_fx : doc_fx.meshes)
-	{
-		for (const auto& primitive_fx : mesh_fx.primitives)
-		{
-			std::vector<unsigned> indices;
-			{
-				const auto& index_buffer_accessor_fx = doc_fx.accessors[primitive_fx.indices];
-				const auto& index_buffer_view_fx = doc_fx.bufferViews[index_buffer_accessor_fx.bufferView];
-				const auto& index_buffer_fx = doc_fx.buffers[index_buffer_view_fx.buffer];
+		const sp_mesh_vertex_cache_stats optimized_stats = sp_mesh_analyze_vertex_cache(mesh);
 
-				indices.resize(index_buffer_accessor_fx.count);
+		sp_log("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", path, source_stats._acmr, optimized_stats._acmr, source_stats._atvr, optimized_stats._atvr);
 
-				if (index_buffer_accessor_fx.componentType == fx::gltf::Accessor::ComponentType::UnsignedByte)
-				{
-					const uint8_t* index = reinterpret_cast<const uint8_t*>(&index_buffer_fx.data[index_buffer_view_fx.byteOffset + index_buffer_accessor_fx.byteOffset]);
-					for (auto i = 0; i < indices.size(); ++i)
-					{
-						indices[i] = *index++;
-					}
-				}
-				else if (index_buffer_accessor_fx.componentType == fx::gltf::Accessor::ComponentType::UnsignedShort)
-				{
-					const uint16_t* index = reinterpret_cast<const uint16_t*>(&index_buffer_fx.data[index_buffer_view_fx.byteOffset + index_buffer_accessor_fx.byteOffset]);
-					for (auto i = 0; i < indices.size(); ++i)
-					{
-						indices[i] = *index++;
-					}
-				}
-				else if (index_buffer_accessor_fx.componentType == fx::gltf::Accessor::ComponentType::UnsignedInt)
-				{
-					memcpy(indices.data(), &index_buffer_fx.data[index_buffer_view_fx.byteOffset + index_buffer_accessor_fx.byteOffset], indices.size() * sizeof(unsigned));
-				}
-				else
-				{
-					assert(false);
-				}
-			}
+		const int triangle_count = static_cast<int>(mesh._indices.size() / 3);
 
-			std::vector<math::vec<3>> positions;
-			std::vector<math::vec<3>> normals;
-			std::vector<math::vec<4>> tangents;
-			std::vector<math::vec<2>> texcoords;
+		sp_mesh_generate_lods(mesh, sp_mesh_lod_desc());
 
-			// TODO: How to handle models that are missing expected vertex attributes?
-			for (const auto& attrib_fx : primitive_fx.attributes)
-			{
-				if (attrib_fx.first == "POSITION")
-				{
-					const auto& position_buffer_accessor_fx = doc_fx.accessors[attrib_fx.second];
-					const auto& position_buffer_view_fx = doc_fx.bufferViews[position_buffer_accessor_fx.bufferView];
-					const auto& position_buffer_fx = doc_fx.buffers[position_buffer_view_fx.buffer];
+		sp_log("%s: %d LODs adding %d triangles to %d", path, static_cast<int>(mesh._lods.size()),
+			static_cast<int>(mesh._indices.size() / 3) - triangle_count, triangle_count);
 
-					positions.resize(position_buffer_accessor_fx.count);
+		sp_mesh_quantize_report quantize_report;
+		const sp_mesh_quantized_vertices quantized_vertices = sp_mesh_quantize(mesh, sp_mesh_quantize_desc(), &quantize_report);
 
-					memcpy(
-						positions.data(), 
-						&position_buffer_fx.data[position_buffer_view_fx.byteOffset + position_buffer_accessor_fx.byteOffset], 
-						detail::get_stride_bytes(position_buffer_accessor_fx) * position_buffer_accessor_fx.count);
-				}
-				else if (attrib_fx.first == "NORMAL")
-				{
-					const auto& normal_buffer_accessor_fx = doc_fx.accessors[attrib_fx.second];
-					const auto& normal_buffer_view_fx = doc_fx.bufferViews[normal_buffer_accessor_fx.bufferView];
-					const auto& normal_buffer_fx = doc_fx.buffers[normal_buffer_view_fx.buffer];
+		sp_log("%s: %d -> %u bytes per vertex, position error %g (%g of the bounds), normal error %.3f degrees, texcoord error %g",
+			path, static_cast<int>(sizeof(sp_mesh_vertex)), quantized_vertices._format._stride_bytes, quantize_report._position_error_max,
+			quantize_report._position_error_max_relative, quantize_report._normal_error_max_degrees, quantize_report._texcoord_error_max);
 
-					normals.resize(normal_buffer_accessor_fx.count);
+		sp_mesh_dequantize(mesh, quantized_vertices);
+		sp_mesh_build_meshlets(mesh, sp_mesh_meshlet_desc());
 
-					memcpy(
-						normals.data(), 
-						&normal_buffer_fx.data[normal_buffer_view_fx.byteOffset + normal_buffer_accessor_fx.byteOffset],
-						detail::get_stride_bytes(normal_buffer_accessor_fx) * normal_buffer_accessor_fx.count);
-				}
-				else if (attrib_fx.first == "TANGENT")
-				{
-					const auto& tangent_buffer_accessor_fx = doc_fx.accessors[attrib_fx.second];
-					const auto& tangent_buffer_view_fx = doc_fx.bufferViews[tangent_buffer_accessor_fx.bufferView];
-					const auto& tangent_buffer_fx = doc_fx.buffers[tangent_buffer_view_fx.buffer];
+		const sp_mesh_meshlet_stats meshlet_stats = sp_mesh_analyze_meshlets(mesh);
 
-					tangents.resize(tangent_buffer_accessor_fx.count);
+		sp_log("%s: %d meshlets, %.0f%% vertex and %.0f%% triangle fill, cones %.1f degrees, %.1f%% backface culled",
+			path, meshlet_stats._meshlet_count, meshlet_stats._vertex_fill * 100.0f, meshlet_stats._triangle_fill * 100.0f,
+			meshlet_stats._cone_angle_degrees, meshlet_stats._backface_culled * 100.0f);
 
-					memcpy(
-						tangents.data(), 
-						&tangent_buffer_fx.data[tangent_buffer_view_fx.byteOffset + tangent_buffer_accessor_fx.byteOffset],
-						detail::get_stride_bytes(tangent_buffer_accessor_fx) * tangent_buffer_accessor_fx.count);
-				}
-				else if (attrib_fx.first == "TEXCOORD_0")
-				{
-					const auto& texcoord_buffer_accessor_fx = doc_fx.accessors[attrib_fx.second];
-					const auto& texcoord_buffer_view_fx = doc_fx.bufferViews[texcoord_buffer_accessor_fx.bufferView];
-					const auto& texcoord_buffer_fx = doc_fx.buffers[texcoord_buffer_view_fx.buffer];
+		const bool written = sp_mesh_file_write(cooked_path.c_str(), mesh, quantized_vertices);
+		assert(written);
 
-					texcoords.resize(texcoord_buffer_accessor_fx.count);
+		const bool opened = sp_mesh_file_open(cooked_path.c_str(), mesh_file);
+		assert(opened);
 
-					memcpy(
-						texcoords.data(), 
-						&texcoord_buffer_fx.data[texcoord_buffer_view_fx.byteOffset + texcoord_buffer_accessor_fx.byteOffset],
-						detail::get_stride_bytes(texcoord_buffer_accessor_fx) * texcoord_buffer_accessor_fx.count);
-				}
-			}
+		cooked = false;
+	}
 
-			// TODO: Handle missing required required vertex attributes
-			if (positions.empty() || texcoords.empty() || normals.empty())
-			{
-				continue;
-			}
+	// The whole model goes up in one vertex and one index buffer straight out of the mapping
+	const sp_mesh_vertex_format vertex_format = mesh_file._vertex_format;
+	const int vertices_size_bytes = mesh_file._vertex_count * static_cast<int>(vertex_format._stride_bytes);
 
-			struct vertex
-			{
-				math::vec<3> position;
-				math::vec<3> normal;
-				math::vec<2> texcoord;
-				math::vec<4> color;
-			};
+	const sp_vertex_buffer_handle vertex_buffer_handle = sp_vertex_buffer_create(path, { vertices_size_bytes, static_cast<int>(vertex_format._stride_bytes) });
+	sp_vertex_buffer_update(vertex_buffer_handle, mesh_file._vertices, vertices_size_bytes);
+
+	const sp_index_buffer_handle index_buffer_handle = sp_index_buffer_create(path, { static_cast<int>(mesh_file._index_count * sizeof(uint32_t)), static_cast<int>(sizeof(uint32_t)) });
+	sp_index_buffer_update(index_buffer_handle, mesh_file._indices, static_cast<int>(mesh_file._index_count * sizeof(uint32_t)));
+
+	std::vector<model::mesh> meshes;
+	meshes.reserve(mesh_file._submesh_count);
+	for (int i = 0; i < mesh_file._submesh_count; ++i)
+	{
+		const sp_mesh_submesh& submesh = mesh_file._submeshes[i];
+
+		model::mesh mesh;
+		mesh.vertex_buffer_handle = vertex_buffer_handle;
+		mesh.index_buffer_handle = index_buffer_handle;
+		mesh.index_count = static_cast<int>(submesh._index_count);
+		mesh.first_index = static_cast<int>(submesh._first_index);
+		mesh.base_vertex = static_cast<int>(submesh._base_vertex);
+		mesh.material_index = submesh._material_index;
+		mesh.lods.assign(mesh_file._lods + submesh._first_lod, mesh_file._lods + submesh._first_lod + submesh._lod_count);
+
+		mesh.bounds_min = { submesh._bounds_min[0], submesh._bounds_min[1], submesh._bounds_min[2] };
+		mesh.bounds_max = { submesh._bounds_max[0], submesh._bounds_max[1], submesh._bounds_max[2] };
+
+		meshes.push_back(mesh);
+	}
 
-			std::vector<vertex> vertices;
-			vertices.reserve(indices.size());
+	// Create materials. Submeshes without one get a default added at the end.
+	std::vector<model::material> materials;
+	materials.resize(mesh_file._material_count);
+	std::transform(mesh_file._materials, mesh_file._materials + mesh_file._material_count, materials.begin(), [](const sp_mesh_material& mesh_material) {
+		model::material material;
+		strcpy(material.name, mesh_material._name);
+		material.base_color_texture_index = mesh_material._base_color_texture_index;
+		material.metalness_roughness_texture_index = mesh_material._metalness_roughness_texture_index;
+		std::copy(std::begin(mesh_material._base_color_factor), std::end(mesh_material._base_color_factor), material.base_color_factor.begin());
+		material.metalness_factor = mesh_material._metalness_factor;
+		material.roughness_factor = mesh_material._roughness_factor;
+		material.double_sided = mesh_material._double_sided != 0;
+		return material;
+	});
 
-			for (const auto& index : indices)
+	for (auto& mesh : meshes)
+	{
+		if (mesh.material_index < 0)
+		{
+			if (materials.size() == static_cast<size_t>(mesh_file._material_count))
 			{
-				vertices.push_back({ positions[index], normals[index], texcoords[index], { 1.0f, 1.0f, 1.0f, 1.0f } });
+				materials.push_back(model::material());
 			}
 
-			model::mesh mesh;
+			mesh.material_index = mesh_file._material_count;
+		}
+	}
+
+	// The gbuffer shader has no vertex color so a constant one goes into the materials instead
+	if (vertex_format._color == sp_mesh_attribute_format::none)
+	{
+		for (auto& material : materials)
+		{
+			for (int i = 0; i < 4; ++i)
 			{
-				mesh.vertex_buffer_handle = sp_vertex_buffer_create(mesh_fx.name.c_str(), { static_cast<int>(vertices.size() * sizeof(vertex)), static_cast<int>(sizeof(vertex)) });
-				sp_vertex_buffer_update(mesh.vertex_buffer_handle, vertices.data(), static_cast<int>(vertices.size() * sizeof(vertex)));
-				mesh.vertex_count = static_cast<int>(vertices.size());
-				mesh.material_index = primitive_fx.material;
+				material.base_color_factor[i] *= vertex_format._color_constant[i];
 			}
-			meshes.push_back(mesh);
 		}
 	}
+	else
+	{
+		sp_log("%s: vertex colors aren't supported and will be ignored", path);
+	}
+
+	// Base color is the only one that's sRGB. The rest have to be filtered as they are.
+	std::vector<std::string> image_paths;
+	std::vector<bool> textures_srgb;
+	for (int i = 0; i < mesh_file._texture_count; ++i)
+	{
+		image_paths.push_back(mesh_file._textures[i]._path);
+		textures_srgb.push_back(mesh_file._textures[i]._srgb != 0);
+	}
+
+	const int vertex_count = mesh_file._vertex_count;
+	const int index_count = mesh_file._index_count;
+
+	sp_mesh_file_close(mesh_file);
+
+	sp_log("%s: %s %d vertices and %d indices in %d submeshes in %.1f ms", path, cooked ? "loaded" : "cooked and loaded",
+		vertex_count, index_count, static_cast<int>(meshes.size()),
+		std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - mesh_start_time).count() * 1000.0);
 
 	std::vector<sp_texture_handle> textures;
 	textures.reserve(image_paths.size() + 1 /* Plus one because we always add default below */);
 
-	// Load all references
-	for (const auto& image_path : image_paths)
+	// Cooked files only need copying into staging so they're done here. Everything else is decoded and has mips built on the
+	// job system, one job per image, and each job uploads its image as soon as it's ready. Textures can only be created on the
+	// main thread so the sizes come from the image headers up front.
+	struct image_decode
+	{
+		std::string path_with_root;
+		bool srgb = false;
+		sp_texture_handle texture_handle;
+	};
+
+	std::vector<image_decode> image_decodes;
+
+	int cooked_texture_count = 0;
+	double cooked_seconds = 0.0;
+
+	const auto load_start_time = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < static_cast<int>(image_paths.size()); ++i)
 	{
+		const char* image_path = image_paths[i].c_str();
+
 		std::string image_path_with_root = fx::gltf::detail::GetDocumentRootPath(path) + "/" + std::string(image_path);
 
+		// Anything cooked with tools/texture_cooker, e.g. foo.jpg -> foo.dds
+		const std::string image_path_without_extension = image_path_with_root.substr(0, image_path_with_root.find_last_of('.'));
+
+		const auto cooked_start_time = std::chrono::high_resolution_clock::now();
+
+		sp_image_file image_file;
+		if (sp_image_file_open((image_path_without_extension + ".ktx2").c_str(), image_file) || sp_image_file_open((image_path_without_extension + ".dds").c_str(), image_file))
+		{
+			textures.push_back(sp_texture_create_from_image_file(image_path, image_file));
+
+			sp_image_file_close(image_file);
+
+			cooked_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - cooked_start_time).count();
+			++cooked_texture_count;
+
+			continue;
+		}
+
+		int image_width, image_height, image_channels;
+		const int image_info_result = stbi_info(image_path_with_root.c_str(), &image_width, &image_height, &image_channels);
+		assert(image_info_result);
+
+		textures.push_back(sp_texture_create(image_path, { image_width, image_height, 1, sp_texture_format::r8g8b8a8, sp_texture_flags::none }));
+
+		image_decode decode;
+		decode.path_with_root = std::move(image_path_with_root);
+		decode.srgb = textures_srgb[i];
+		decode.texture_handle = textures.back();
+		image_decodes.push_back(std::move(decode));
+	}
+
+	const auto decode_start_time = std::chrono::high_resolution_clock::now();
+
+	// tools/sparky_benchmark times decoding and building mips on one thread against the job system
+	const auto decode_image = [](image_decode& decode) {
 		int image_width, image_height, image_channels;
-		stbi_uc* image_data = stbi_load(image_path_with_root.c_str(), &image_width, &image_height, &image_channels, STBI_rgb_alpha);
+		stbi_uc* image_data = stbi_load(decode.path_with_root.c_str(), &image_width, &image_height, &image_channels, STBI_rgb_alpha);
 		assert(image_data);
 
-		sp_texture_handle texture_handle = sp_texture_create(image_path, { image_width, image_height, 1, sp_texture_format::r8g8b8a8, sp_texture_flags::none });
-		sp_texture_update(texture_handle, image_data, image_width * image_height * STBI_rgb_alpha, 4);
+		sp_image_mip_chain_desc mip_chain_desc;
+		mip_chain_desc.format = sp_image_format::r8g8b8a8;
+		mip_chain_desc.color_space = decode.srgb ? sp_image_color_space::srgb : sp_image_color_space::linear;
+
+		const sp_image_mip_chain mip_chain = sp_image_mip_chain_create(image_data, image_width, image_height, mip_chain_desc);
 
 		stbi_image_free(image_data);
 
-		textures.push_back(texture_handle);
+		// The upload context is thread safe and this is the only job touching this texture
+		texture_update_from_mip_chain(decode.texture_handle, mip_chain);
+	};
+
+	sp_job_counter decode_counter;
+
+	for (image_decode& decode : image_decodes)
+	{
+		sp_job_run([&decode_image, &decode]() { decode_image(decode); }, &decode_counter);
+	}
+
+	sp_job_wait(decode_counter);
+
+	const auto load_end_time = std::chrono::high_resolution_clock::now();
+
+	if (!image_decodes.empty())
+	{
+		sp_log("%s: decoded %d images on %d workers in %.1f ms", path, static_cast<int>(image_decodes.size()),
+			sp_job_system_get_worker_count(), std::chrono::duration<double>(load_end_time - decode_start_time).count() * 1000.0);
 	}
 
+	sp_log("%s: loaded %d textures in %.1f ms, %d of them cooked in %.1f ms", path, static_cast<int>(textures.size()),
+		std::chrono::duration<double>(load_end_time - load_start_time).count() * 1000.0, cooked_texture_count, cooked_seconds * 1000.0);
+
 	// Fill in any still missing textures with a default
 	for (auto& material : materials)
 	{
@@ -492,10 +540,34 @@ model model_create_from_gltf(const char* path)
 	model.meshes = std::move(meshes);
 	model.materials = std::move(materials);
 	model.textures = std::move(textures);
+	model.vertex_format = vertex_format;
 
 	return model;
 }
 
+// Around the corners of the bounds once they're transformed, without transforming all eight (Arvo, "Transforming Axis-Aligned
+// Bounding Boxes")
+sp_bvh_bounds bounds_transform(const math::vec<3>& bounds_min, const math::vec<3>& bounds_max, const math::mat<4>& transform)
+{
+	sp_bvh_bounds bounds;
+
+	for (int j = 0; j < 3; ++j)
+	{
+		bounds._min[j] = transform[3][j];
+		bounds._max[j] = transform[3][j];
+
+		for (int i = 0; i < 3; ++i)
+		{
+			const float a = transform[i][j] * bounds_min[i];
+			const float b = transform[i][j] * bounds_max[i];
+			bounds._min[j] += std::min(a, b);
+			bounds._max[j] += std::max(a, b);
+		}
+	}
+
+	return bounds;
+}
+
 // TASK GRAPH MUSINGS
 //
 // gbuffer_render_task = {
@@ -589,84 +661,10 @@ gbuffer_task->add_output("depth");
 
 */
 
-/*
-void sp_texture_generate_mipmaps(sp_texture_handle texture_handle)
-{
-	const sp_texture& texture = detail::resource_pools::textures[texture_handle.index];
-
-	sp_compute_shader_handle generate_mipmaps_shader_handle = sp_compute_shader_create({ "shaders/generate_mipmaps.hlsl" });
-
-	sp_compute_pipeline_state_handle generate_mipmaps_pipeline_state_handle = sp_compute_pipeline_state_create("generate_mipmaps", { generate_mipmaps_shader_handle });
-
-	sp_compute_command_list compute_command_list = sp_compute_command_list_create(texture._name, {});
-
-	for (int i = 1; i < texture._num_mip_levels; ++i)
-	{
-		sp_compute_command_list_begin(compute_command_list);
-
-		compute_command_list._command_list_d3d12->SetComputeRootSignature(detail::_sp._root_signature.Get());
-
-		compute_command_list._command_list_d3d12->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(texture._resource.Get()));
-
-		sp_descriptor_handle unordered_access_view = detail::sp_descriptor_alloc(detail::_sp._descriptor_heap_cbv_srv_uav_cpu_transient);
-
-		D3D12_UNORDERED_ACCESS_VIEW_DESC unordered_access_view_desc_d3d12 = {};
-		unordered_access_view_desc_d3d12.Format = detail::sp_texture_format_get_srv_format_d3d12(texture._format);
-		unordered_access_view_desc_d3d12.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
-		unordered_access_view_desc_d3d12.Texture2D.MipSlice = i;
-
-		detail::_sp._device->CreateUnorderedAccessView(texture._resource.Get(), nullptr, &unordered_access_view_desc_d3d12, unordered_access_view._handle_cpu_d3d12);
-
-		sp_descriptor_handle shader_resource_view = detail::sp_descriptor_alloc(detail::_sp._descriptor_heap_cbv_srv_uav_cpu_transient);
-
-		D3D12_SHADER_RESOURCE_VIEW_DESC shader_resource_view_desc_d3d12 = {};
-		shader_resource_view_desc_d3d12.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		shader_resource_view_desc_d3d12.Format = detail::sp_texture_format_get_srv_format_d3d12(texture._format);
-		shader_resource_view_desc_d3d12.Texture2D.MipLevels = -1;
-		shader_resource_view_desc_d3d12.Texture2D.MostDetailedMip = (i - 1);
-
-		if (texture._depth == 1)
-		{
-			shader_resource_view_desc_d3d12.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		}
-		else
-		{
-			shader_resource_view_desc_d3d12.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE3D;
-		}
-
-		detail::_sp._device->CreateShaderResourceView(texture._resource.Get(), &shader_resource_view_desc_d3d12, shader_resource_view._handle_cpu_d3d12);
-
-		compute_command_list._command_list_d3d12->SetComputeRootDescriptorTable(0, sp_descriptor_heap_get_head(detail::_sp._descriptor_heap_cbv_srv_uav_gpu)._handle_gpu_d3d12);
-		sp_descriptor_copy_to_heap(
-			detail::_sp._descriptor_heap_cbv_srv_uav_gpu,
-			{
-				shader_resource_view,
-			});
-		compute_command_list._command_list_d3d12->SetComputeRootDescriptorTable(2, sp_descriptor_heap_get_head(detail::_sp._descriptor_heap_cbv_srv_uav_gpu)._handle_gpu_d3d12);
-		sp_descriptor_copy_to_heap(
-			detail::_sp._descriptor_heap_cbv_srv_uav_gpu,
-			{
-				unordered_access_view,
-			});
-
-		sp_compute_command_list_set_pipeline_state(compute_command_list, generate_mipmaps_pipeline_state_handle);
-		sp_compute_command_list_dispatch(compute_command_list, texture._width >> 1, texture._height >> 1, 1);
-
-		sp_compute_command_list_end(compute_command_list);
-
-		sp_compute_queue_execute(compute_command_list);
-
-		sp_compute_queue_wait_for_idle();
-	}
-
-	sp_compute_command_list_destroy(compute_command_list);
-}*/
-
 int main()
 {
 	const int window_width = 1280;
 	const int window_height = 720;
-	const float aspect_ratio = window_width / static_cast<float>(window_height);
 
 	camera camera{ { 0, 0, 10 }, {0, 0, 0} };
 
@@ -697,10 +695,21 @@ int main()
 		},
 		nullptr);
 
+	// Resizing the swap chain has to wait until we're outside of the window message pump
+	struct window_resize
+	{
+		bool pending = false;
+		int width = 0;
+		int height = 0;
+	} resize;
+
 	sp_window_event_set_resize_callback(
 		[](void* user_data, int width, int height) {
+			static_cast<window_resize*>(user_data)->pending = true;
+			static_cast<window_resize*>(user_data)->width = width;
+			static_cast<window_resize*>(user_data)->height = height;
 		},
-		nullptr);
+		&resize);
 
 	sp_window window = sp_window_create("demo", { window_width, window_height });
 
@@ -722,52 +731,141 @@ int main()
 	sp_texture_update(cloud_weather_texture_handle, cloud_weather_image_data, 512 * 512 * 4, 4);
 #endif
 
-	const void* environment_diffuse_image_data = sp_image_create_from_file_hdr("environments/Factory_Catwalk/Factory_Catwalk_Env.hdr");
-	sp_texture_handle environment_diffuse_texture = sp_texture_create("environment_diffuse", { 512, 256, 1, sp_texture_format::r32g32b32a32, sp_texture_flags::none });
+	// Baked from the reflection image the sIBL descriptor points at and cached next to it. The cache is baked again whenever it's
+	// older than the image or the descriptor.
+	float environment_irradiance_sh9[9][3];
+	sp_texture_handle environment_specular_texture;
+	sp_texture_handle environment_brdf_lut_texture;
+	{
+		const char* ibl_descriptor_path = "environments/Factory_Catwalk/Factory_Catwalk.ibl";
+
+		sp_image_ibl_descriptor ibl_descriptor;
+		const bool ibl_descriptor_read = sp_image_ibl_descriptor_read(ibl_descriptor_path, ibl_descriptor);
+		assert(ibl_descriptor_read);
+
+		const std::string ibl_cache_path = ibl_descriptor._reflection_path + ".ibl_cache";
+
+		std::error_code error;
+		const std::filesystem::file_time_type ibl_cache_time = std::filesystem::last_write_time(ibl_cache_path, error);
+		const bool ibl_cache_fresh = !error &&
+			ibl_cache_time >= std::filesystem::last_write_time(ibl_descriptor._reflection_path) &&
+			ibl_cache_time >= std::filesystem::last_write_time(ibl_descriptor_path);
+
+		sp_image_ibl ibl;
+		if (!ibl_cache_fresh || !sp_image_ibl_read(ibl_cache_path.c_str(), ibl))
+		{
+			const auto bake_start_time = std::chrono::high_resolution_clock::now();
+
+			int image_width, image_height, image_channels;
+			float* image_data = stbi_loadf(ibl_descriptor._reflection_path.c_str(), &image_width, &image_height, &image_channels, STBI_rgb_alpha);
+			assert(image_data);
 
-	const void* environment_specular_image_data = sp_image_create_from_file_hdr("environments/Factory_Catwalk/Factory_Catwalk_2k.hdr");
-	sp_texture_handle environment_specular_texture = sp_texture_create("environment_specular", { 2048, 1024, 1, sp_texture_format::r32g32b32a32, sp_texture_flags::none });
-	sp_texture_update(environment_specular_texture, environment_specular_image_data, 2048 * 1024 * 4 * 4, 4 * 4);
-	//sp_texture_generate_mipmaps(environment_specular_texture);
+			sp_image_ibl_desc ibl_desc;
+			ibl_desc.scale = ibl_descriptor._reflection_multiplier;
+
+			ibl = sp_image_ibl_bake(image_data, image_width, image_height, ibl_desc);
+
+			stbi_image_free(image_data);
+
+			sp_image_ibl_write(ibl_cache_path.c_str(), ibl);
+
+			sp_log("%s: baked image based lighting in %.1f ms", ibl_descriptor._reflection_path.c_str(),
+				std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - bake_start_time).count() * 1000.0);
+		}
+
+		memcpy(environment_irradiance_sh9, ibl._irradiance_sh9, sizeof(environment_irradiance_sh9));
+
+		environment_specular_texture = sp_texture_create("environment_specular", {
+			ibl._specular._mips[0]._width,
+			ibl._specular._mips[0]._height,
+			1,
+			detail::sp_texture_format_from_image_format(ibl._specular._format),
+			sp_texture_flags::none,
+			1,
+			ibl._specular._mip_count
+		});
+		texture_update_from_mip_chain(environment_specular_texture, ibl._specular);
+
+		environment_brdf_lut_texture = sp_texture_create("environment_brdf_lut", {
+			ibl._brdf_lut._mips[0]._width,
+			ibl._brdf_lut._mips[0]._height,
+			1,
+			detail::sp_texture_format_from_image_format(ibl._brdf_lut._format),
+			sp_texture_flags::none,
+			1,
+			1
+		});
+		texture_update_from_mip_chain(environment_brdf_lut_texture, ibl._brdf_lut);
+	}
 
 	sp_vertex_shader_handle gbuffer_vertex_shader_handle = sp_vertex_shader_create({ "shaders/gbuffer.hlsl" });
 	sp_pixel_shader_handle gbuffer_pixel_shader_handle = sp_pixel_shader_create({ "shaders/gbuffer.hlsl" });
 
-	sp_graphics_pipeline_state_handle gbuffer_single_sided_pipeline_state_handle = sp_graphics_pipeline_state_create("gbuffer_single_sided", {
-		gbuffer_vertex_shader_handle,
-		gbuffer_pixel_shader_handle,
-		{
-			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT },
-			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT },
-			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT },
-			{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT }
-		},
-		{
-			sp_texture_format::r10g10b10a2,
-			sp_texture_format::r10g10b10a2,
-			sp_texture_format::r10g10b10a2,
-		},
-		sp_texture_format::d32,
-		sp_rasterizer_cull_face::back,
-	});
+	// Everything that differs between entities drawing the same mesh comes in a per instance stream next to the vertices, so
+	// entities that share a mesh, LOD and pipeline state are drawn with one instanced draw
+	struct instance_data
+	{
+		math::mat<4> world_matrix;
+		uint32_t material_index;		// Into constant_buffer_materials_data
+	};
 
-	sp_graphics_pipeline_state_handle gbuffer_double_sided_pipeline_state_handle = sp_graphics_pipeline_state_create("gbuffer_double_sided", {
-		gbuffer_vertex_shader_handle,
-		gbuffer_pixel_shader_handle,
-		{
-			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT },
-			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT },
-			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT },
-			{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT }
-		},
+	const sp_input_element_desc instance_input_layout[] = {
+		{ "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 1 },
+		{ "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 1 },
+		{ "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 1 },
+		{ "WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 1 },
+		{ "MATERIAL", 0, DXGI_FORMAT_R32_UINT, 1, 1 },
+	};
+
+	// The input layout follows how each model's vertices were quantized, so there's a pair of pipeline states per vertex format
+	// shared by every model that ended up with the same one
+	struct gbuffer_pipeline_states
+	{
+		sp_mesh_vertex_format vertex_format;
+		sp_graphics_pipeline_state_handle single_sided;
+		sp_graphics_pipeline_state_handle double_sided;
+	};
+
+	std::vector<gbuffer_pipeline_states> gbuffer_pipeline_states_by_vertex_format;
+
+	auto gbuffer_pipeline_state_get = [&](const sp_mesh_vertex_format& vertex_format, bool double_sided) {
+		for (const auto& pipeline_states : gbuffer_pipeline_states_by_vertex_format)
 		{
-			sp_texture_format::r10g10b10a2,
-			sp_texture_format::r10g10b10a2,
-			sp_texture_format::r10g10b10a2,
-		},
-		sp_texture_format::d32,
-		sp_rasterizer_cull_face::none,
-	});
+			if (pipeline_states.vertex_format._position == vertex_format._position &&
+				pipeline_states.vertex_format._texcoord == vertex_format._texcoord &&
+				pipeline_states.vertex_format._color == vertex_format._color &&
+				pipeline_states.vertex_format._normal == vertex_format._normal)
+			{
+				return double_sided ? pipeline_states.double_sided : pipeline_states.single_sided;
+			}
+		}
+
+		sp_graphics_pipeline_state_desc pipeline_state_desc = {
+			gbuffer_vertex_shader_handle,
+			gbuffer_pixel_shader_handle,
+			{},
+			{
+				sp_texture_format::r10g10b10a2,
+				sp_texture_format::r10g10b10a2,
+				sp_texture_format::r10g10b10a2,
+			},
+			sp_texture_format::d32,
+			sp_rasterizer_cull_face::back,
+		};
+		sp_graphics_pipeline_state_desc_set_input_layout(pipeline_state_desc, vertex_format);
+		sp_graphics_pipeline_state_desc_append_input_layout(pipeline_state_desc, instance_input_layout, static_cast<int>(std::size(instance_input_layout)));
+
+		gbuffer_pipeline_states pipeline_states;
+		pipeline_states.vertex_format = vertex_format;
+		pipeline_states.single_sided = sp_graphics_pipeline_state_create("gbuffer_single_sided", pipeline_state_desc);
+
+		pipeline_state_desc.cull_face = sp_rasterizer_cull_face::none;
+		pipeline_states.double_sided = sp_graphics_pipeline_state_create("gbuffer_double_sided", pipeline_state_desc);
+
+		gbuffer_pipeline_states_by_vertex_format.push_back(pipeline_states);
+
+		return double_sided ? pipeline_states.double_sided : pipeline_states.single_sided;
+	};
 
 	sp_compute_shader_handle low_freq_noise_shader_handle = sp_compute_shader_create({ "shaders/low_freq_noise.hlsl" });
 
@@ -797,6 +895,19 @@ int main()
 		},
 	});
 
+	sp_vertex_shader_handle temporal_resolve_vertex_shader_handle = sp_vertex_shader_create({ "shaders/temporal_resolve.hlsl" });
+	sp_pixel_shader_handle temporal_resolve_pixel_shader_handle = sp_pixel_shader_create({ "shaders/temporal_resolve.hlsl" });
+
+	sp_graphics_pipeline_state_handle temporal_resolve_pipeline_state_handle = sp_graphics_pipeline_state_create("temporal_resolve", {
+		temporal_resolve_vertex_shader_handle,
+		temporal_resolve_pixel_shader_handle,
+		{},
+		{
+			sp_texture_format::r10g10b10a2,
+			sp_texture_format::r10g10b10a2,
+		},
+	});
+
 	__declspec(align(16)) struct
 	{
 		math::mat<4> view_matrix;
@@ -810,6 +921,7 @@ int main()
 		// TODO: Not sure if I want this in scene constants or a seprate lighting constants
 		math::vec<3> sun_direction_ws;
 		float dummy2 = 0;
+		math::mat<4> previous_view_projection_matrix;
 
 	} constant_buffer_per_frame_data;
 
@@ -818,142 +930,713 @@ int main()
 	sp_graphics_command_list graphics_command_list = sp_graphics_command_list_create("graphics_command_list", {});
 	sp_compute_command_list compute_command_list = sp_compute_command_list_create("compute_command_list", {});
 
-	sp_texture_handle gbuffer_base_color_texture_handle = sp_texture_create("gbuffer_base_color", { window_width, window_height, 1, sp_texture_format::r10g10b10a2, sp_texture_flags::render_target });
-	sp_texture_handle gbuffer_metalness_roughness_texture_handle = sp_texture_create("gbuffer_metalness_roughness", { window_width, window_height, 1, sp_texture_format::r10g10b10a2, sp_texture_flags::render_target });
-	sp_texture_handle gbuffer_normals_texture_handle = sp_texture_create("gbuffer_normals", { window_width, window_height, 1, sp_texture_format::r10g10b10a2, sp_texture_flags::render_target });
-	sp_texture_handle gbuffer_depth_texture_handle = sp_texture_create("gbuffer_depth", { window_width, window_height, 1, sp_texture_format::d32 });
-
 	constant_buffer_clouds_per_frame_data clouds_per_frame_data;
 	constant_buffer_lighting_per_frame_data lighting_per_frame_data;
+	for (int i = 0; i < 9; ++i)
+	{
+		lighting_per_frame_data.irradiance_sh9[i][0] = environment_irradiance_sh9[i][0];
+		lighting_per_frame_data.irradiance_sh9[i][1] = environment_irradiance_sh9[i][1];
+		lighting_per_frame_data.irradiance_sh9[i][2] = environment_irradiance_sh9[i][2];
+	}
 
 	sp_constant_buffer constant_buffer_per_frame_clouds = sp_constant_buffer_create(sizeof(constant_buffer_clouds_per_frame_data));
 	sp_constant_buffer constant_buffer_per_frame_lighting = sp_constant_buffer_create(sizeof(constant_buffer_lighting_per_frame_data));
 
-	sp_descriptor_table descriptor_table_lighting_srv = sp_descriptor_table_create(sp_descriptor_table_type::srv, {
-			detail::sp_texture_pool_get(gbuffer_base_color_texture_handle)._shader_resource_view,
-			detail::sp_texture_pool_get(gbuffer_metalness_roughness_texture_handle)._shader_resource_view,
-			detail::sp_texture_pool_get(gbuffer_normals_texture_handle)._shader_resource_view,
-			detail::sp_texture_pool_get(gbuffer_depth_texture_handle)._shader_resource_view,
-			detail::sp_texture_pool_get(environment_specular_texture)._shader_resource_view,
-		});
+	constant_buffer_temporal_resolve_per_frame_data temporal_resolve_per_frame_data;
+	sp_constant_buffer constant_buffer_per_frame_temporal_resolve = sp_constant_buffer_create(sizeof(constant_buffer_temporal_resolve_per_frame_data));
+
+	// The frame graph owns the gbuffer and lighting textures and recreates them when the window is resized, so these tables are
+	// filled in as the tasks execute. One per back buffer so we never overwrite a table the GPU could still be reading.
+	std::vector<sp_descriptor_table> descriptor_tables_lighting_srv;
+	std::vector<sp_descriptor_table> descriptor_tables_temporal_resolve_srv;
+	for (int back_buffer_index = 0; back_buffer_index < k_back_buffer_count; ++back_buffer_index)
+	{
+		descriptor_tables_lighting_srv.push_back(sp_descriptor_table_create(sp_descriptor_table_type::srv, 6));
+		descriptor_tables_temporal_resolve_srv.push_back(sp_descriptor_table_create(sp_descriptor_table_type::srv, 3));
+	}
 
 	sp_descriptor_table descriptor_table_lighting_cbv = sp_descriptor_table_create(sp_descriptor_table_type::cbv, {
 		constant_buffer_per_frame._constant_buffer_view,
 		constant_buffer_per_frame_lighting._constant_buffer_view
 	});
 
+	sp_descriptor_table descriptor_table_temporal_resolve_cbv = sp_descriptor_table_create(sp_descriptor_table_type::cbv, {
+		constant_buffer_per_frame._constant_buffer_view,
+		constant_buffer_per_frame_temporal_resolve._constant_buffer_view
+	});
+
 	math::vec<3> sun_direction_ws = math::normalize<3>({ 0.25f, -1.0f, -0.5f });
 
-	__declspec(align(16)) struct constant_buffer_per_object_data
+	// Positions are quantized inside the model's bounds so this is shared by every entity drawing the mesh
+	__declspec(align(16)) struct constant_buffer_per_mesh_data
 	{
-		math::mat<4> world_matrix;
-		math::vec<4> base_color_factor;
-		math::vec<4> metalness_roughness_factor;
+		math::vec<4> position_scale;
+		math::vec<4> position_offset;
 	};
 
+	// Instances pick theirs by index so entities with different materials can still be drawn together
+	const int k_material_count_max = 128;		// Must match gbuffer.hlsl
+
+	__declspec(align(16)) struct constant_buffer_materials_data
+	{
+		struct
+		{
+			math::vec<4> base_color_factor;
+			math::vec<4> metalness_roughness_factor;
+		} materials[k_material_count_max];
+	};
+
+	sp_constant_buffer constant_buffer_materials = sp_constant_buffer_create(sizeof(constant_buffer_materials_data));
+
+	std::vector<model::material> materials;
+
 	struct entity
 	{
-		model::material material;
+		int mesh_id = -1;		// Entities with the same one draw the same mesh with the same textures and can be instanced
 		model::mesh mesh;
+		int material_index = -1;		// Into materials
 		math::mat<4> transform;
 		sp_descriptor_table descriptor_table_srv;
 		sp_descriptor_table descriptor_table_cbv;
-		sp_constant_buffer constant_buffer_per_object;
+		sp_graphics_pipeline_state_handle pipeline_state_handle;
+		int lod = 0;		// Picked every frame, 0 is the full detail mesh and otherwise it's mesh.lods[lod - 1]
 	};
 
 	std::vector<entity> entities;
+	int mesh_count = 0;
 
-	{
-		//model model = model_create_from_gltf("models/littlest_tokyo/scene.gltf", nullptr), math::create_rotation_x(-math::pi_div_2) },
-		//model model = model_create_from_gltf("models/smashy_craft_city/scene.gltf", nullptr), math::create_rotation_x(0) },
-		//model model = model_create_from_gltf("models/MetalRoughSpheres/MetalRoughSpheres.gltf", sp_texture_defaults_white(), sp_texture_defaults_white()),
-		//model model = model_create_from_gltf("models/TextureCoordinateTest/TextureCoordinateTest.gltf", sp_texture_defaults_white(), sp_texture_defaults_white()),
-		//model model = model_create_cube(sp_texture_defaults_checkerboard(), sp_texture_defaults_white()),
-		//model model = model_create_from_gltf("models/shader_ball/shader_ball.gltf", shader_ball_material_loaded_callback), math::create_rotation_x(math::pi_div_2) },
+	// An entity for every mesh of the model at each of the transforms. The descriptor tables and the per mesh constant buffer are
+	// made once per mesh and shared by its entities.
+	auto entities_add_model = [&](const model& model, const std::vector<math::mat<4>>& transforms) {
+		const int first_material_index = static_cast<int>(materials.size());
+		materials.insert(materials.end(), model.materials.begin(), model.materials.end());
 
-		{
-			model model = model_create_from_gltf("models/shader_ball/shader_ball.gltf");
-			math::mat<4> transform = math::create_rotation_x(math::pi_div_2);
-			for (const auto& mesh : model.meshes)
+		assert(materials.size() <= k_material_count_max);
+
+		constant_buffer_per_mesh_data per_mesh_data = {
+			{ model.vertex_format._position_scale[0], model.vertex_format._position_scale[1], model.vertex_format._position_scale[2], 0.0f },
+			{ model.vertex_format._position_offset[0], model.vertex_format._position_offset[1], model.vertex_format._position_offset[2], 0.0f }
+		};
+
+		// Every mesh of a model has the same vertex format so they can all share one
+		sp_constant_buffer constant_buffer_per_mesh = sp_constant_buffer_create(sizeof(constant_buffer_per_mesh_data));
+		sp_constant_buffer_update(constant_buffer_per_mesh, &per_mesh_data);
+
+		sp_descriptor_table descriptor_table_cbv = sp_descriptor_table_create(
+			sp_descriptor_table_type::cbv,
 			{
-				const model::material& material = model.materials[mesh.material_index];
+				constant_buffer_per_frame._constant_buffer_view,
+				constant_buffer_per_mesh._constant_buffer_view,
+				constant_buffer_materials._constant_buffer_view
+			}
+		);
 
-				constant_buffer_per_object_data per_object_data{
-					transform,
-					{ material.base_color_factor[0], material.base_color_factor[1], material.base_color_factor[2], material.base_color_factor[3] },
-					{ material.metalness_factor, material.roughness_factor, 0.0f, 0.0f }
-				};
+		for (const auto& mesh : model.meshes)
+		{
+			const model::material& material = model.materials[mesh.material_index];
 
-				sp_constant_buffer constant_buffer_per_object = sp_constant_buffer_create(sizeof(constant_buffer_per_object_data));
+			sp_descriptor_table descriptor_table_srv = sp_descriptor_table_create(
+				sp_descriptor_table_type::srv,
+				{
+					detail::sp_texture_pool_get(model.textures[material.base_color_texture_index])._shader_resource_view,
+					detail::sp_texture_pool_get(model.textures[material.metalness_roughness_texture_index])._shader_resource_view,
+				}
+			);
 
+			for (const auto& transform : transforms)
+			{
 				entity entity = {
-					material,
+					mesh_count,
 					mesh,
+					first_material_index + mesh.material_index,
 					transform,
-					sp_descriptor_table_create(
-						sp_descriptor_table_type::srv,
-						{
-							detail::sp_texture_pool_get(model.textures[material.base_color_texture_index])._shader_resource_view,
-							detail::sp_texture_pool_get(model.textures[material.metalness_roughness_texture_index])._shader_resource_view,
-						}
-					),
-					sp_descriptor_table_create(
-						sp_descriptor_table_type::cbv,
-						{
-							constant_buffer_per_frame._constant_buffer_view,
-							constant_buffer_per_object._constant_buffer_view
-						}
-					),
-					constant_buffer_per_object
+					descriptor_table_srv,
+					descriptor_table_cbv,
+					gbuffer_pipeline_state_get(model.vertex_format, material.double_sided)
 				};
 
 				entities.push_back(entity);
 			}
+
+			++mesh_count;
 		}
+	};
+
+	// How many pixels of simplification error an entity's LOD is allowed to show
+	float lod_pixel_error_max = 1.0f;
+	int lod_triangle_count = 0;
+	int lod_triangle_count_full_detail = 0;
+
+	{
+		//model model = model_create_from_gltf("models/littlest_tokyo/scene.gltf", nullptr), math::create_rotation_x(-math::pi_div_2) },
+		//model model = model_create_from_gltf("models/smashy_craft_city/scene.gltf", nullptr), math::create_rotation_x(0) },
+		//model model = model_create_from_gltf("models/MetalRoughSpheres/MetalRoughSpheres.gltf", sp_texture_defaults_white(), sp_texture_defaults_white()),
+		//model model = model_create_from_gltf("models/TextureCoordinateTest/TextureCoordinateTest.gltf", sp_texture_defaults_white(), sp_texture_defaults_white()),
+		//model model = model_create_cube(sp_texture_defaults_checkerboard(), sp_texture_defaults_white()),
+		//model model = model_create_from_gltf("models/shader_ball/shader_ball.gltf", shader_ball_material_loaded_callback), math::create_rotation_x(math::pi_div_2) },
 
 		{
-			model model = model_create_from_gltf("models/MetalRoughSpheres/MetalRoughSpheres.gltf");
-			math::mat<4> transform = math::create_identity<4>();
+			model model = model_create_from_gltf("models/shader_ball/shader_ball.gltf");
+
+			// A grid of them around the one at the origin, spaced by the model's largest extent, to have something to instance
+			math::vec<3> model_bounds_min = { FLT_MAX, FLT_MAX, FLT_MAX };
+			math::vec<3> model_bounds_max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
 			for (const auto& mesh : model.meshes)
 			{
-				const model::material& material = model.materials[mesh.material_index];
+				for (int k = 0; k < 3; ++k)
+				{
+					model_bounds_min[k] = std::min(model_bounds_min[k], mesh.bounds_min[k]);
+					model_bounds_max[k] = std::max(model_bounds_max[k], mesh.bounds_max[k]);
+				}
+			}
 
-				constant_buffer_per_object_data per_object_data{
-					transform,
-					{ material.base_color_factor[0], material.base_color_factor[1], material.base_color_factor[2], material.base_color_factor[3] },
-					{ material.metalness_factor, material.roughness_factor, 0.0f, 0.0f }
-				};
+			const math::vec<3> model_extent = model_bounds_max - model_bounds_min;
+			const float spacing = std::max({ model_extent.x, model_extent.y, model_extent.z }) * 1.5f;
 
-				sp_constant_buffer constant_buffer_per_object = sp_constant_buffer_create(sizeof(constant_buffer_per_object_data));
+			const int grid_size = 3;
+			std::vector<math::mat<4>> transforms;
+			for (int z = 0; z < grid_size; ++z)
+			{
+				for (int x = 0; x < grid_size; ++x)
+				{
+					const math::vec<3> translation = { (x - grid_size / 2) * spacing, 0.0f, (z - grid_size / 2) * spacing };
+					transforms.push_back(math::create_rotation_x(math::pi_div_2) * math::create_translation(translation));
+				}
+			}
 
-				entity entity = {
-					material,
-					mesh,
-					transform,
-					sp_descriptor_table_create(
-						sp_descriptor_table_type::srv,
-						{
-							detail::sp_texture_pool_get(model.textures[material.base_color_texture_index])._shader_resource_view,
-							detail::sp_texture_pool_get(model.textures[material.metalness_roughness_texture_index])._shader_resource_view,
-						}
-					),
-					sp_descriptor_table_create(
-						sp_descriptor_table_type::cbv,
-						{
-							constant_buffer_per_frame._constant_buffer_view,
-							constant_buffer_per_object._constant_buffer_view
-						}
-					),
-					constant_buffer_per_object
-				};
+			entities_add_model(model, transforms);
+		}
 
-				entities.push_back(entity);
+		{
+			model model = model_create_from_gltf("models/MetalRoughSpheres/MetalRoughSpheres.gltf");
+			entities_add_model(model, { math::create_identity<4>() });
+		}
+	}
+
+	// Every visible entity's draw, sorted by pipeline state, mesh and LOD so entities that can be instanced are next to each
+	// other, and front to back within that. The payload is the entity index.
+	sp_render_queue gbuffer_queue;
+
+	// Filled in every frame from the sorted queue
+	struct instanced_draw
+	{
+		uint32_t entity_index = 0;		// The first instance's, every instance shares its mesh, LOD and pipeline state
+		int first_instance = 0;
+		int instance_count = 0;
+	};
+
+	std::vector<instance_data> instances;
+	std::vector<instanced_draw> instanced_draws;
+	double render_queue_sort_ms = 0.0;
+
+	sp_vertex_buffer_handle instance_buffer_handle = sp_vertex_buffer_create("instances", {
+		static_cast<int>(sizeof(instance_data) * entities.size()),
+		static_cast<int>(sizeof(instance_data)),
+		true
+	});
+
+	// Nothing moves so the tree is built once. Entities that did would refit it with their new bounds every frame.
+	std::vector<sp_bvh_bounds> entity_bounds_ws;
+	for (const auto& entity : entities)
+	{
+		entity_bounds_ws.push_back(bounds_transform(entity.mesh.bounds_min, entity.mesh.bounds_max, entity.transform));
+	}
+
+	sp_bvh scene_bvh;
+	sp_bvh_build(scene_bvh, entity_bounds_ws.data(), static_cast<int>(entity_bounds_ws.size()), sp_bvh_desc());
+
+	// The same bounds a component to an array for culling the entities as a flat list
+	std::vector<float> entity_centers_ws[3];
+	std::vector<float> entity_extents_ws[3];
+	for (const auto& bounds : entity_bounds_ws)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			entity_centers_ws[k].push_back((bounds._min[k] + bounds._max[k]) * 0.5f);
+			entity_extents_ws[k].push_back((bounds._max[k] - bounds._min[k]) * 0.5f);
+		}
+	}
+
+	const math::aabb_soa entity_aabbs_ws = {
+		{ entity_centers_ws[0].data(), entity_centers_ws[1].data(), entity_centers_ws[2].data() },
+		{ entity_extents_ws[0].data(), entity_extents_ws[1].data(), entity_extents_ws[2].data() }
+	};
+
+	int frustum_culling = 2;		// Off, flat, through the hierarchy or GPU driven
+	double frustum_culling_ms = 0.0;
+	std::vector<uint32_t> visible_entities;
+	int picked_entity = -1;
+
+	// GPU driven drawing keeps every entity's bounds and instance data on the GPU. A compute shader culls them against the
+	// frustum and last frame's depth pyramid and counts the survivors into one indirect draw per mesh, so the CPU does the same
+	// work however many entities there are. LODs are picked on the CPU so these always draw the full detail mesh.
+	std::vector<sp_indirect_cull_instance> cull_instances(entities.size());
+	std::vector<instance_data> cull_instance_data(entities.size());
+	std::vector<sp_indirect_draw_args> cull_draw_args(mesh_count);
+	std::vector<uint32_t> cull_draw_entities(mesh_count);		// An entity drawing the mesh, for its state
+
+	{
+		// Each mesh's visible instances go in a range with room for all of its entities
+		std::vector<uint32_t> mesh_entity_counts(mesh_count, 0);
+		for (const auto& entity : entities)
+		{
+			++mesh_entity_counts[entity.mesh_id];
+		}
+
+		uint32_t first_instance = 0;
+		for (int mesh_id = 0; mesh_id < mesh_count; ++mesh_id)
+		{
+			cull_draw_args[mesh_id]._first_instance = first_instance;
+			first_instance += mesh_entity_counts[mesh_id];
+		}
+
+		for (size_t entity_index = 0; entity_index < entities.size(); ++entity_index)
+		{
+			const auto& entity = entities[entity_index];
+
+			sp_indirect_draw_args& draw_args = cull_draw_args[entity.mesh_id];
+			draw_args._index_count = static_cast<uint32_t>(entity.mesh.index_count);
+			draw_args._first_index = static_cast<uint32_t>(entity.mesh.first_index);
+			draw_args._base_vertex = entity.mesh.base_vertex;
+			cull_draw_entities[entity.mesh_id] = static_cast<uint32_t>(entity_index);
+
+			sp_indirect_cull_instance& cull_instance = cull_instances[entity_index];
+			for (int k = 0; k < 3; ++k)
+			{
+				cull_instance._center[k] = entity_centers_ws[k][entity_index];
+				cull_instance._extent[k] = entity_extents_ws[k][entity_index];
+			}
+			cull_instance._draw = static_cast<uint32_t>(entity.mesh_id);
+			cull_instance._data = static_cast<uint32_t>(entity_index);
+
+			cull_instance_data[entity_index] = { entity.transform, static_cast<uint32_t>(entity.material_index) };
+		}
+	}
+
+	sp_buffer_handle cull_instance_buffer_handle = sp_buffer_create("cull_instances", {
+		static_cast<int>(sizeof(sp_indirect_cull_instance) * cull_instances.size()),
+		static_cast<int>(sizeof(sp_indirect_cull_instance))
+	});
+	sp_buffer_update(cull_instance_buffer_handle, cull_instances.data(), static_cast<int>(sizeof(sp_indirect_cull_instance) * cull_instances.size()));
+
+	sp_buffer_handle cull_instance_data_buffer_handle = sp_buffer_create("cull_instance_data", {
+		static_cast<int>(sizeof(instance_data) * cull_instance_data.size()),
+		static_cast<int>(sizeof(instance_data))
+	});
+	sp_buffer_update(cull_instance_data_buffer_handle, cull_instance_data.data(), static_cast<int>(sizeof(instance_data) * cull_instance_data.size()));
+
+	// Copied over the arguments every frame to zero the instance counts before culling
+	sp_buffer_handle cull_draw_args_template_buffer_handle = sp_buffer_create("cull_draw_args_template", {
+		static_cast<int>(sizeof(sp_indirect_draw_args) * cull_draw_args.size()),
+		static_cast<int>(sizeof(sp_indirect_draw_args))
+	});
+	sp_buffer_update(cull_draw_args_template_buffer_handle, cull_draw_args.data(), static_cast<int>(sizeof(sp_indirect_draw_args) * cull_draw_args.size()));
+
+	sp_buffer_handle cull_draw_args_buffer_handle = sp_buffer_create("cull_draw_args", {
+		static_cast<int>(sizeof(sp_indirect_draw_args) * cull_draw_args.size()),
+		static_cast<int>(sizeof(sp_indirect_draw_args)),
+		sp_buffer_flags::unordered_access
+	});
+
+	// Written by the culling and read as the per instance vertex stream
+	sp_buffer_handle visible_instance_buffer_handle = sp_buffer_create("visible_instances", {
+		static_cast<int>(sizeof(instance_data) * entities.size()),
+		static_cast<int>(sizeof(instance_data)),
+		sp_buffer_flags::unordered_access
+	});
+
+	sp_compute_shader_handle indirect_cull_shader_handle = sp_compute_shader_create({ "shaders/indirect_cull.hlsl" });
+	sp_compute_pipeline_state_handle indirect_cull_pipeline_state_handle = sp_compute_pipeline_state_create("indirect_cull", { indirect_cull_shader_handle });
+
+	sp_compute_shader_handle depth_pyramid_shader_handle = sp_compute_shader_create({ "shaders/depth_pyramid.hlsl" });
+	sp_compute_pipeline_state_handle depth_pyramid_pipeline_state_handle = sp_compute_pipeline_state_create("depth_pyramid", { depth_pyramid_shader_handle });
+
+	static_assert(DEPTH_PYRAMID_MIP_COUNT_MAX == k_depth_pyramid_mip_count_max, "indirect_cull.cbuffer.hlsli is out of date");
+
+	bool occlusion_culling = true;
+
+	constant_buffer_indirect_cull_data indirect_cull_data;
+	sp_constant_buffer constant_buffer_indirect_cull = sp_constant_buffer_create(sizeof(constant_buffer_indirect_cull_data));
+
+	sp_descriptor_table descriptor_table_indirect_cull_srv = sp_descriptor_table_create(sp_descriptor_table_type::srv, 3);
+	sp_descriptor_table descriptor_table_indirect_cull_cbv = sp_descriptor_table_create(sp_descriptor_table_type::cbv, { constant_buffer_indirect_cull._constant_buffer_view });
+	sp_descriptor_table descriptor_table_indirect_cull_uav = sp_descriptor_table_create(sp_descriptor_table_type::uav, {
+		detail::sp_buffer_pool_get(cull_draw_args_buffer_handle)._unordered_access_view,
+		detail::sp_buffer_pool_get(visible_instance_buffer_handle)._unordered_access_view
+	});
+
+	// Built from the depth buffer after the gbuffer is drawn for the next frame's culling, so it's the size of the back buffer
+	sp_depth_pyramid depth_pyramid;
+	sp_buffer_handle depth_pyramid_buffer_handle;
+	int depth_pyramid_frame_num = -1;		// The frame that last built it
+
+	// Every mip is reduced in the same frame so each gets its own constant buffer
+	std::vector<sp_constant_buffer> constant_buffers_depth_pyramid;
+	std::vector<sp_descriptor_table> descriptor_tables_depth_pyramid_cbv;
+	for (int mip = 0; mip < k_depth_pyramid_mip_count_max; ++mip)
+	{
+		constant_buffers_depth_pyramid.push_back(sp_constant_buffer_create(sizeof(constant_buffer_depth_pyramid_data)));
+		descriptor_tables_depth_pyramid_cbv.push_back(sp_descriptor_table_create(sp_descriptor_table_type::cbv, { constant_buffers_depth_pyramid.back()._constant_buffer_view }));
+	}
+
+	std::vector<sp_descriptor_table> descriptor_tables_depth_pyramid_srv;
+	for (int back_buffer_index = 0; back_buffer_index < k_back_buffer_count; ++back_buffer_index)
+	{
+		descriptor_tables_depth_pyramid_srv.push_back(sp_descriptor_table_create(sp_descriptor_table_type::srv, 1));
+	}
+
+	sp_descriptor_table descriptor_table_depth_pyramid_uav = sp_descriptor_table_create(sp_descriptor_table_type::uav, 1);
+
+	// GPU driven culling can be checked against sp_indirect_cull_reference. A frame copies back the draw arguments it wrote and
+	// the pyramid it culled against, and once the GPU is done with it the CPU culls the same instances with the same inputs.
+	struct cull_readback
+	{
+		sp_buffer_handle draw_args_buffer_handle;
+		sp_buffer_handle depth_pyramid_buffer_handle;
+		constant_buffer_indirect_cull_data cull_data;		// What the GPU culled with
+		int frame_num = -1;
+		bool pending = false;
+	};
+
+	bool cull_readback_enabled = false;
+	int cull_readback_frame_num = -1;			// The last frame checked
+	int cull_readback_mismatch_count = 0;		// Draws in it whose instance count wasn't the reference's
+
+	std::vector<cull_readback> cull_readbacks(k_back_buffer_count);
+	for (auto& readback : cull_readbacks)
+	{
+		readback.draw_args_buffer_handle = sp_buffer_create("cull_draw_args_readback", {
+			static_cast<int>(sizeof(sp_indirect_draw_args) * cull_draw_args.size()),
+			static_cast<int>(sizeof(sp_indirect_draw_args)),
+			sp_buffer_flags::readback
+		});
+	}
+
+	auto cull_readback_check = [&](const cull_readback& readback) {
+		std::vector<sp_indirect_draw_args> gpu_draw_args(cull_draw_args.size());
+		sp_buffer_read(readback.draw_args_buffer_handle, gpu_draw_args.data(), static_cast<int>(sizeof(sp_indirect_draw_args) * gpu_draw_args.size()));
+
+		sp_indirect_cull_desc desc;
+		memcpy(desc.planes, readback.cull_data.frustum_planes, sizeof(desc.planes));
+		memcpy(desc.view_projection, readback.cull_data.previous_view_projection_matrix, sizeof(desc.view_projection));
+
+		sp_depth_pyramid pyramid;
+		if (readback.cull_data.occlusion_culling)
+		{
+			sp_depth_pyramid_init(pyramid, readback.cull_data.depth_width, readback.cull_data.depth_height);
+			pyramid._depths.resize(pyramid._depth_count);
+			sp_buffer_read(readback.depth_pyramid_buffer_handle, pyramid._depths.data(), static_cast<int>(sizeof(float)) * pyramid._depth_count);
+			desc.depth_pyramid = &pyramid;
+		}
+
+		// The template has every draw's first instance
+		std::vector<sp_indirect_draw_args> reference_draw_args = cull_draw_args;
+		std::vector<uint32_t> reference_visible(cull_instances.size());
+		sp_indirect_cull_reference(desc, cull_instances.data(), static_cast<int>(cull_instances.size()), reference_draw_args.data(), static_cast<int>(reference_draw_args.size()), reference_visible.data());
+
+		int first_mismatch = -1;
+		cull_readback_mismatch_count = 0;
+		for (int mesh_id = 0; mesh_id < mesh_count; ++mesh_id)
+		{
+			if (gpu_draw_args[mesh_id]._instance_count != reference_draw_args[mesh_id]._instance_count)
+			{
+				if (first_mismatch < 0)
+				{
+					first_mismatch = mesh_id;
+				}
+				++cull_readback_mismatch_count;
 			}
 		}
+
+		cull_readback_frame_num = readback.frame_num;
+
+		if (first_mismatch >= 0)
+		{
+			sp_log("gpu driven culling: frame %d counted different instances than the reference for %d of %d draws, e.g. %u instead of %u for mesh %d",
+				readback.frame_num, cull_readback_mismatch_count, mesh_count, gpu_draw_args[first_mismatch]._instance_count, reference_draw_args[first_mismatch]._instance_count, first_mismatch);
+		}
+	};
+
+	// Only called when nothing is in flight, on the first frame and after the swap chain is resized, so the tables and constant
+	// buffers can be rewritten in place
+	auto depth_pyramid_resize = [&](int width, int height) {
+		if (depth_pyramid_buffer_handle)
+		{
+			sp_buffer_destroy(depth_pyramid_buffer_handle);
+		}
+
+		sp_depth_pyramid_init(depth_pyramid, width, height);
+
+		depth_pyramid_buffer_handle = sp_buffer_create("depth_pyramid", {
+			static_cast<int>(sizeof(float)) * depth_pyramid._depth_count,
+			static_cast<int>(sizeof(float)),
+			sp_buffer_flags::unordered_access
+		});
+
+		for (auto& readback : cull_readbacks)
+		{
+			if (readback.depth_pyramid_buffer_handle)
+			{
+				sp_buffer_destroy(readback.depth_pyramid_buffer_handle);
+			}
+
+			readback.depth_pyramid_buffer_handle = sp_buffer_create("depth_pyramid_readback", {
+				static_cast<int>(sizeof(float)) * depth_pyramid._depth_count,
+				static_cast<int>(sizeof(float)),
+				sp_buffer_flags::readback
+			});
+			readback.pending = false;
+		}
+
+		// What was in the last one is gone
+		depth_pyramid_frame_num = -1;
+
+		const sp_buffer& depth_pyramid_buffer = detail::sp_buffer_pool_get(depth_pyramid_buffer_handle);
+
+		sp_descriptor_copy_to_table(descriptor_table_indirect_cull_srv, {
+			detail::sp_buffer_pool_get(cull_instance_buffer_handle)._shader_resource_view,
+			detail::sp_buffer_pool_get(cull_instance_data_buffer_handle)._shader_resource_view,
+			depth_pyramid_buffer._shader_resource_view,
+		});
+		sp_descriptor_copy_to_table(descriptor_table_depth_pyramid_uav, { depth_pyramid_buffer._unordered_access_view });
+
+		indirect_cull_data.depth_width = depth_pyramid._depth_width;
+		indirect_cull_data.depth_height = depth_pyramid._depth_height;
+		indirect_cull_data.depth_pyramid_mip_count = depth_pyramid._mip_count;
+
+		for (int mip = 0; mip < depth_pyramid._mip_count; ++mip)
+		{
+			indirect_cull_data.depth_pyramid_mips[mip][0] = depth_pyramid._mip_widths[mip];
+			indirect_cull_data.depth_pyramid_mips[mip][1] = depth_pyramid._mip_heights[mip];
+			indirect_cull_data.depth_pyramid_mips[mip][2] = depth_pyramid._mip_offsets[mip];
+
+			constant_buffer_depth_pyramid_data depth_pyramid_data;
+			depth_pyramid_data.source_width = mip > 0 ? depth_pyramid._mip_widths[mip - 1] : depth_pyramid._depth_width;
+			depth_pyramid_data.source_height = mip > 0 ? depth_pyramid._mip_heights[mip - 1] : depth_pyramid._depth_height;
+			depth_pyramid_data.source_offset = mip > 0 ? depth_pyramid._mip_offsets[mip - 1] : -1;
+			depth_pyramid_data.mip_width = depth_pyramid._mip_widths[mip];
+			depth_pyramid_data.mip_height = depth_pyramid._mip_heights[mip];
+			depth_pyramid_data.mip_offset = depth_pyramid._mip_offsets[mip];
+
+			sp_constant_buffer_update(constant_buffers_depth_pyramid[mip], &depth_pyramid_data);
+		}
+	};
+
+	// Lighting is the most expensive pass by far so it's shaded at a fraction of the back buffer resolution. The temporal
+	// resolve upsamples it and accumulates with last frame's result.
+	const float lighting_resolution_scale = 0.5f;
+
+	sp_frame_graph frame_graph = sp_frame_graph_create("pbr");
+
+	sp_frame_graph_resource_handle gbuffer_base_color = sp_frame_graph_create_texture(frame_graph, "gbuffer_base_color", { 0, 0, sp_texture_format::r10g10b10a2, sp_frame_graph_texture_size::relative_to_back_buffer });
+	sp_frame_graph_resource_handle gbuffer_metalness_roughness = sp_frame_graph_create_texture(frame_graph, "gbuffer_metalness_roughness", { 0, 0, sp_texture_format::r10g10b10a2, sp_frame_graph_texture_size::relative_to_back_buffer });
+	sp_frame_graph_resource_handle gbuffer_normals = sp_frame_graph_create_texture(frame_graph, "gbuffer_normals", { 0, 0, sp_texture_format::r10g10b10a2, sp_frame_graph_texture_size::relative_to_back_buffer });
+	sp_frame_graph_resource_handle gbuffer_depth = sp_frame_graph_create_texture(frame_graph, "gbuffer_depth", { 0, 0, sp_texture_format::d32, sp_frame_graph_texture_size::relative_to_back_buffer });
+	sp_frame_graph_resource_handle lighting = sp_frame_graph_create_texture(frame_graph, "lighting", { 0, 0, sp_texture_format::r10g10b10a2, sp_frame_graph_texture_size::relative_to_back_buffer, lighting_resolution_scale });
+	sp_frame_graph_resource_handle temporal_history = sp_frame_graph_create_history_texture(frame_graph, "temporal_history", { 0, 0, sp_texture_format::r10g10b10a2, sp_frame_graph_texture_size::relative_to_back_buffer });
+	sp_frame_graph_resource_handle temporal_history_previous = sp_frame_graph_get_history(frame_graph, temporal_history);
+	sp_frame_graph_resource_handle back_buffer = sp_frame_graph_import_back_buffer(frame_graph);
+
+	{
+		sp_frame_graph_task_handle gbuffer_task = sp_frame_graph_add_graphics_task(frame_graph, "gbuffer", [&](sp_graphics_command_list& command_list) {
+			if (frustum_culling == 3)
+			{
+				// Start every draw's instance count from zero
+				sp_graphics_command_list_transition_buffer(command_list, cull_draw_args_template_buffer_handle, sp_resource_state::none, sp_resource_state::copy_source);
+				sp_graphics_command_list_transition_buffer(command_list, cull_draw_args_buffer_handle, sp_resource_state::none, sp_resource_state::copy_dest);
+				sp_graphics_command_list_copy_buffer(command_list, cull_draw_args_buffer_handle, cull_draw_args_template_buffer_handle);
+				sp_graphics_command_list_transition_buffer(command_list, cull_draw_args_template_buffer_handle, sp_resource_state::copy_source, sp_resource_state::none);
+				sp_graphics_command_list_transition_buffer(command_list, cull_draw_args_buffer_handle, sp_resource_state::copy_dest, sp_resource_state::unordered_access);
+
+				sp_graphics_command_list_transition_buffer(command_list, visible_instance_buffer_handle, sp_resource_state::none, sp_resource_state::unordered_access);
+				sp_graphics_command_list_transition_buffer(command_list, depth_pyramid_buffer_handle, sp_resource_state::none, sp_resource_state::shader_resource);
+
+				sp_graphics_command_list_set_compute_pipeline_state(command_list, indirect_cull_pipeline_state_handle);
+				sp_graphics_command_list_set_compute_descriptor_table(command_list, 0, descriptor_table_indirect_cull_srv);
+				sp_graphics_command_list_set_compute_descriptor_table(command_list, 1, descriptor_table_indirect_cull_cbv);
+				sp_graphics_command_list_set_compute_descriptor_table(command_list, 2, descriptor_table_indirect_cull_uav);
+				sp_graphics_command_list_dispatch(command_list, (static_cast<int>(entities.size()) + 63) / 64, 1, 1);
+
+				// The pyramid it culled against is rebuilt later this frame so it's copied back now
+				cull_readback& readback = cull_readbacks[detail::_sp._back_buffer_index];
+				if (cull_readback_enabled && indirect_cull_data.occlusion_culling)
+				{
+					sp_graphics_command_list_transition_buffer(command_list, depth_pyramid_buffer_handle, sp_resource_state::shader_resource, sp_resource_state::copy_source);
+					sp_graphics_command_list_copy_buffer(command_list, readback.depth_pyramid_buffer_handle, depth_pyramid_buffer_handle);
+					sp_graphics_command_list_transition_buffer(command_list, depth_pyramid_buffer_handle, sp_resource_state::copy_source, sp_resource_state::none);
+				}
+				else
+				{
+					sp_graphics_command_list_transition_buffer(command_list, depth_pyramid_buffer_handle, sp_resource_state::shader_resource, sp_resource_state::none);
+				}
+
+				sp_graphics_command_list_transition_buffer(command_list, visible_instance_buffer_handle, sp_resource_state::unordered_access, sp_resource_state::vertex_buffer);
+				sp_graphics_command_list_transition_buffer(command_list, cull_draw_args_buffer_handle, sp_resource_state::unordered_access, sp_resource_state::indirect_argument);
+
+				// One indirect draw per mesh, however many of its entities there are
+				for (int mesh_id = 0; mesh_id < mesh_count; ++mesh_id)
+				{
+					const auto& entity = entities[cull_draw_entities[mesh_id]];
+
+					sp_graphics_command_list_set_pipeline_state(command_list, entity.pipeline_state_handle);
+
+					sp_graphics_command_list_set_descriptor_table(command_list, 0, entity.descriptor_table_srv);
+					sp_graphics_command_list_set_descriptor_table(command_list, 1, entity.descriptor_table_cbv);
+
+					sp_graphics_command_list_set_vertex_buffers(command_list, &entity.mesh.vertex_buffer_handle, 1);
+					sp_graphics_command_list_set_buffer_as_vertex_buffer(command_list, 1, visible_instance_buffer_handle);
+					sp_graphics_command_list_set_index_buffer(command_list, entity.mesh.index_buffer_handle);
+					sp_graphics_command_list_draw_indexed_indirect(command_list, cull_draw_args_buffer_handle, mesh_id * static_cast<int>(sizeof(sp_indirect_draw_args)), 1);
+				}
+
+				sp_graphics_command_list_transition_buffer(command_list, visible_instance_buffer_handle, sp_resource_state::vertex_buffer, sp_resource_state::none);
+
+				if (cull_readback_enabled)
+				{
+					sp_graphics_command_list_transition_buffer(command_list, cull_draw_args_buffer_handle, sp_resource_state::indirect_argument, sp_resource_state::copy_source);
+					sp_graphics_command_list_copy_buffer(command_list, readback.draw_args_buffer_handle, cull_draw_args_buffer_handle);
+					sp_graphics_command_list_transition_buffer(command_list, cull_draw_args_buffer_handle, sp_resource_state::copy_source, sp_resource_state::none);
+
+					readback.cull_data = indirect_cull_data;
+					readback.frame_num = frame_num;
+					readback.pending = true;
+				}
+				else
+				{
+					sp_graphics_command_list_transition_buffer(command_list, cull_draw_args_buffer_handle, sp_resource_state::indirect_argument, sp_resource_state::none);
+				}
+
+				return;
+			}
+
+			for (const auto& draw : instanced_draws)
+			{
+				const auto& entity = entities[draw.entity_index];
+
+				sp_graphics_command_list_set_pipeline_state(command_list, entity.pipeline_state_handle);
+
+				sp_graphics_command_list_set_descriptor_table(command_list, 0, entity.descriptor_table_srv);
+				sp_graphics_command_list_set_descriptor_table(command_list, 1, entity.descriptor_table_cbv);
+
+				const sp_vertex_buffer_handle vertex_buffer_handles[] = { entity.mesh.vertex_buffer_handle, instance_buffer_handle };
+				sp_graphics_command_list_set_vertex_buffers(command_list, vertex_buffer_handles, 2);
+				sp_graphics_command_list_set_index_buffer(command_list, entity.mesh.index_buffer_handle);
+				if (entity.lod > 0)
+				{
+					const sp_mesh_lod& lod = entity.mesh.lods[entity.lod - 1];
+					sp_graphics_command_list_draw_indexed_instanced(command_list, lod._index_count, draw.instance_count, lod._first_index, entity.mesh.base_vertex, draw.first_instance);
+				}
+				else
+				{
+					sp_graphics_command_list_draw_indexed_instanced(command_list, entity.mesh.index_count, draw.instance_count, entity.mesh.first_index, entity.mesh.base_vertex, draw.first_instance);
+				}
+			}
+		});
+		sp_frame_graph_task_add_render_target(frame_graph, gbuffer_task, gbuffer_base_color);
+		sp_frame_graph_task_add_render_target(frame_graph, gbuffer_task, gbuffer_metalness_roughness);
+		sp_frame_graph_task_add_render_target(frame_graph, gbuffer_task, gbuffer_normals);
+		sp_frame_graph_task_set_depth_stencil(frame_graph, gbuffer_task, gbuffer_depth);
+
+		sp_frame_graph_task_handle depth_pyramid_task = sp_frame_graph_add_compute_task(frame_graph, "depth_pyramid", [&](sp_graphics_command_list& command_list) {
+			if (frustum_culling != 3)
+			{
+				return;
+			}
+
+			const sp_texture_handle depth_texture_handle = sp_frame_graph_get_texture(frame_graph, gbuffer_depth);
+
+			sp_descriptor_table& descriptor_table_depth_pyramid_srv = descriptor_tables_depth_pyramid_srv[detail::_sp._back_buffer_index];
+			sp_descriptor_copy_to_table(descriptor_table_depth_pyramid_srv, { detail::sp_texture_pool_get(depth_texture_handle)._shader_resource_view });
+
+			sp_graphics_command_list_transition_buffer(command_list, depth_pyramid_buffer_handle, sp_resource_state::none, sp_resource_state::unordered_access);
+
+			sp_graphics_command_list_set_compute_pipeline_state(command_list, depth_pyramid_pipeline_state_handle);
+			sp_graphics_command_list_set_compute_descriptor_table(command_list, 0, descriptor_table_depth_pyramid_srv);
+			sp_graphics_command_list_set_compute_descriptor_table(command_list, 2, descriptor_table_depth_pyramid_uav);
+
+			// Each mip reads the one before it
+			for (int mip = 0; mip < depth_pyramid._mip_count; ++mip)
+			{
+				sp_graphics_command_list_set_compute_descriptor_table(command_list, 1, descriptor_tables_depth_pyramid_cbv[mip]);
+				sp_graphics_command_list_dispatch(command_list, (depth_pyramid._mip_widths[mip] + 7) / 8, (depth_pyramid._mip_heights[mip] + 7) / 8, 1);
+				sp_graphics_command_list_unordered_access_barrier(command_list, depth_pyramid_buffer_handle);
+			}
+
+			sp_graphics_command_list_transition_buffer(command_list, depth_pyramid_buffer_handle, sp_resource_state::unordered_access, sp_resource_state::none);
+
+			depth_pyramid_frame_num = frame_num;
+		});
+		sp_frame_graph_task_add_shader_resource(frame_graph, depth_pyramid_task, gbuffer_depth);
+
+#if !DEMO_CLOUDS
+		sp_frame_graph_task_handle lighting_task = sp_frame_graph_add_graphics_task(frame_graph, "lighting", [&](sp_graphics_command_list& command_list) {
+			sp_graphics_command_list_set_pipeline_state(command_list, lighting_pipeline_state_handle);
+
+			sp_descriptor_table& descriptor_table_lighting_srv = descriptor_tables_lighting_srv[detail::_sp._back_buffer_index];
+			sp_descriptor_copy_to_table(descriptor_table_lighting_srv, {
+				detail::sp_texture_pool_get(sp_frame_graph_get_texture(frame_graph, gbuffer_base_color))._shader_resource_view,
+				detail::sp_texture_pool_get(sp_frame_graph_get_texture(frame_graph, gbuffer_metalness_roughness))._shader_resource_view,
+				detail::sp_texture_pool_get(sp_frame_graph_get_texture(frame_graph, gbuffer_normals))._shader_resource_view,
+				detail::sp_texture_pool_get(sp_frame_graph_get_texture(frame_graph, gbuffer_depth))._shader_resource_view,
+				detail::sp_texture_pool_get(environment_specular_texture)._shader_resource_view,
+				detail::sp_texture_pool_get(environment_brdf_lut_texture)._shader_resource_view,
+			});
+
+			sp_graphics_command_list_set_descriptor_table(command_list, 0, descriptor_table_lighting_srv);
+			sp_graphics_command_list_set_descriptor_table(command_list, 1, descriptor_table_lighting_cbv);
+
+			sp_graphics_command_list_draw_instanced(command_list, 3, 1);
+		});
+		sp_frame_graph_task_add_shader_resource(frame_graph, lighting_task, gbuffer_base_color);
+		sp_frame_graph_task_add_shader_resource(frame_graph, lighting_task, gbuffer_metalness_roughness);
+		sp_frame_graph_task_add_shader_resource(frame_graph, lighting_task, gbuffer_normals);
+		sp_frame_graph_task_add_shader_resource(frame_graph, lighting_task, gbuffer_depth);
+		sp_frame_graph_task_add_render_target(frame_graph, lighting_task, lighting, sp_render_pass_load_action::dont_care);
+
+		sp_frame_graph_task_handle temporal_resolve_task = sp_frame_graph_add_graphics_task(frame_graph, "temporal_resolve", [&](sp_graphics_command_list& command_list) {
+			temporal_resolve_per_frame_data.history_valid = sp_frame_graph_history_is_valid(frame_graph, temporal_history_previous) ? 1 : 0;
+			sp_constant_buffer_update(constant_buffer_per_frame_temporal_resolve, &temporal_resolve_per_frame_data);
+
+			sp_graphics_command_list_set_pipeline_state(command_list, temporal_resolve_pipeline_state_handle);
+
+			sp_descriptor_table& descriptor_table_temporal_resolve_srv = descriptor_tables_temporal_resolve_srv[detail::_sp._back_buffer_index];
+			sp_descriptor_copy_to_table(descriptor_table_temporal_resolve_srv, {
+				detail::sp_texture_pool_get(sp_frame_graph_get_texture(frame_graph, lighting))._shader_resource_view,
+				detail::sp_texture_pool_get(sp_frame_graph_get_texture(frame_graph, gbuffer_depth))._shader_resource_view,
+				detail::sp_texture_pool_get(sp_frame_graph_get_texture(frame_graph, temporal_history_previous))._shader_resource_view,
+			});
+
+			sp_graphics_command_list_set_descriptor_table(command_list, 0, descriptor_table_temporal_resolve_srv);
+			sp_graphics_command_list_set_descriptor_table(command_list, 1, descriptor_table_temporal_resolve_cbv);
+
+			sp_graphics_command_list_draw_instanced(command_list, 3, 1);
+		});
+		sp_frame_graph_task_add_shader_resource(frame_graph, temporal_resolve_task, lighting);
+		sp_frame_graph_task_add_shader_resource(frame_graph, temporal_resolve_task, gbuffer_depth);
+		sp_frame_graph_task_add_shader_resource(frame_graph, temporal_resolve_task, temporal_history_previous);
+		sp_frame_graph_task_add_render_target(frame_graph, temporal_resolve_task, temporal_history, sp_render_pass_load_action::dont_care);
+		sp_frame_graph_task_add_render_target(frame_graph, temporal_resolve_task, back_buffer, sp_render_pass_load_action::dont_care);
+#endif
+
+		sp_frame_graph_compile(frame_graph);
 	}
 
 	while (sp_window_poll())
 	{
+		if (resize.pending)
+		{
+			sp_swap_chain_resize(resize.width, resize.height);
+			resize.pending = false;
+		}
+
+		{
+			const sp_texture& back_buffer_texture = detail::sp_texture_pool_get(detail::_sp._back_buffer_texture_handles[detail::_sp._back_buffer_index]);
+			if (back_buffer_texture._width != depth_pyramid._depth_width || back_buffer_texture._height != depth_pyramid._depth_height)
+			{
+				depth_pyramid_resize(back_buffer_texture._width, back_buffer_texture._height);
+			}
+		}
+
 		detail::sp_debug_gui_begin_frame();
 
 		camera_update(&camera, input);
@@ -990,11 +1673,16 @@ int main()
 			const math::mat<4> jitter_matrix = math::create_identity<4>();
 #endif
 
+			int width, height;
+			sp_window_get_size(window, &width, &height);
+			const float aspect_ratio = width / static_cast<float>(std::max(height, 1));
+
 			const math::mat<4> camera_transform = camera_get_transform(camera);
 			const math::mat<4> view_matrix = math::inverse(camera_transform);
 			const math::mat<4> projection_matrix = math::create_perspective_fov_rh(math::pi / 3, aspect_ratio, 0.1f, 10000.0f);
 			const math::mat<4> view_projection_matrix = math::multiply(view_matrix, projection_matrix) * jitter_matrix;
 
+			constant_buffer_per_frame_data.previous_view_projection_matrix = frame_num > 0 ? constant_buffer_per_frame_data.view_projection_matrix : view_projection_matrix;
 			constant_buffer_per_frame_data.view_matrix = view_matrix;
 			constant_buffer_per_frame_data.projection_matrix = projection_matrix;
 			constant_buffer_per_frame_data.view_projection_matrix = view_projection_matrix;
@@ -1005,69 +1693,151 @@ int main()
 			constant_buffer_per_frame_data.sun_direction_ws = sun_direction_ws;
 
 			sp_constant_buffer_update(constant_buffer_per_frame, &constant_buffer_per_frame_data); // TODO: Maybe a type safe version of this?
-		}
 
-		{
-			sp_graphics_command_list_begin(graphics_command_list);
-			sp_compute_command_list_begin(compute_command_list);
+			// Only entities at least partly inside the frustum are drawn. The matrix starts from world space so the planes are
+			// in world space too.
+			const auto frustum_culling_start_time = std::chrono::high_resolution_clock::now();
+
+			float frustum_planes[6][4];
+			math::get_frustum_planes(view_projection_matrix, frustum_planes);
 
+			if (frustum_culling == 1)
 			{
-				int width, height;
-				sp_window_get_size(window, &width, &height);
-				sp_graphics_command_list_set_viewport(graphics_command_list, { 0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height) });
-				sp_graphics_command_list_set_scissor_rect(graphics_command_list, { 0, 0, width, height });
+				visible_entities.resize(entities.size());
+				visible_entities.resize(math::frustum_cull_aabbs(frustum_planes, entity_aabbs_ws, static_cast<int>(entities.size()), visible_entities.data()));
+			}
+			else if (frustum_culling == 2)
+			{
+				sp_bvh_cull_frustum(scene_bvh, frustum_planes, visible_entities);
 			}
+			else if (frustum_culling == 3)
+			{
+				// Culled and drawn by the GPU, nothing for the CPU to draw
+				visible_entities.clear();
+
+				memcpy(indirect_cull_data.frustum_planes, frustum_planes, sizeof(frustum_planes));
+				memcpy(indirect_cull_data.previous_view_projection_matrix, &constant_buffer_per_frame_data.previous_view_projection_matrix, sizeof(indirect_cull_data.previous_view_projection_matrix));
+				indirect_cull_data.instance_count = static_cast<int>(entities.size());
+				indirect_cull_data.occlusion_culling = occlusion_culling && depth_pyramid_frame_num == frame_num - 1 ? 1 : 0;
 
+				sp_constant_buffer_update(constant_buffer_indirect_cull, &indirect_cull_data);
+			}
+			else
 			{
-				sp_compute_command_list_set_pipeline_state(compute_command_list, low_freq_noise_pipeline_state_handle);
-				sp_compute_command_list_dispatch(compute_command_list, 8, 8, 8);
+				visible_entities.resize(entities.size());
+				std::iota(visible_entities.begin(), visible_entities.end(), 0);
 			}
 
-			// gbuffer
+			frustum_culling_ms = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - frustum_culling_start_time).count() * 1000.0;
+
+			// Right click picks the entity under the cursor, by its bounds
+			if (input.current.keys[VK_RBUTTON] && !input.previous.keys[VK_RBUTTON] && !ImGui::GetIO().WantCaptureMouse)
 			{
-				sp_graphics_command_list_debug_group_push(graphics_command_list, "gbuffer");
+				const math::vec<3> cursor_ndc = { input.current.mouse.x * 2.0f / std::max(width, 1) - 1.0f, 1.0f - input.current.mouse.y * 2.0f / std::max(height, 1), 1.0f };
+				const math::vec<3> cursor_ws = math::transform_point(constant_buffer_per_frame_data.inverse_view_projection_matrix, cursor_ndc);
 
-				sp_texture_handle gbuffer_render_target_handles[] = {
-					gbuffer_base_color_texture_handle,
-					gbuffer_metalness_roughness_texture_handle,
-					gbuffer_normals_texture_handle
-				};
-				sp_graphics_command_list_set_render_targets(graphics_command_list, gbuffer_render_target_handles, static_cast<int>(std::size(gbuffer_render_target_handles)), gbuffer_depth_texture_handle);
+				// Up to the cursor on the far plane
+				const float origin[3] = { camera.position.x, camera.position.y, camera.position.z };
+				const float direction[3] = { cursor_ws.x - camera.position.x, cursor_ws.y - camera.position.y, cursor_ws.z - camera.position.z };
 
-				sp_graphics_command_list_clear_render_target(graphics_command_list, gbuffer_base_color_texture_handle);
-				sp_graphics_command_list_clear_render_target(graphics_command_list, gbuffer_metalness_roughness_texture_handle);
-				sp_graphics_command_list_clear_render_target(graphics_command_list, gbuffer_normals_texture_handle);
-				sp_graphics_command_list_clear_depth(graphics_command_list, gbuffer_depth_texture_handle);
+				uint32_t entity_index;
+				float t;
+				picked_entity = sp_bvh_raycast(scene_bvh, origin, direction, 1.0f, &entity_index, &t) ? static_cast<int>(entity_index) : -1;
+			}
 
-				for (auto& entity : entities)
-				{
-					constant_buffer_per_object_data per_object_data{
-						entity.transform,
-						{ entity.material.base_color_factor[0], entity.material.base_color_factor[1], entity.material.base_color_factor[2], entity.material.base_color_factor[3] },
-						{ entity.material.metalness_factor, entity.material.roughness_factor, 0.0f, 0.0f }
-					};
+			// Each entity draws the coarsest LOD whose error covers no more than lod_pixel_error_max pixels at the distance to
+			// the nearest point of its bounds
+			const float projection_scale = height / (2.0f * std::tan(math::pi / 6));
 
-					sp_constant_buffer_update(entity.constant_buffer_per_object, &per_object_data);
+			lod_triangle_count = 0;
+			lod_triangle_count_full_detail = 0;
+			sp_render_queue_clear(gbuffer_queue);
+			for (uint32_t entity_index : visible_entities)
+			{
+				auto& entity = entities[entity_index];
 
-					if (entity.material.double_sided)
-					{
-						sp_graphics_command_list_set_pipeline_state(graphics_command_list, gbuffer_double_sided_pipeline_state_handle);
-					}
-					else
-					{
-						sp_graphics_command_list_set_pipeline_state(graphics_command_list, gbuffer_single_sided_pipeline_state_handle);
-					}
+				const float scale = std::max({
+					math::length(math::transform_vector(entity.transform, { 1.0f, 0.0f, 0.0f })),
+					math::length(math::transform_vector(entity.transform, { 0.0f, 1.0f, 0.0f })),
+					math::length(math::transform_vector(entity.transform, { 0.0f, 0.0f, 1.0f })) });
+				const math::vec<3> center_ws = math::transform_point(entity.transform, (entity.mesh.bounds_min + entity.mesh.bounds_max) * 0.5f);
+				const float radius = math::distance(entity.mesh.bounds_min, entity.mesh.bounds_max) * 0.5f;
+				const float distance = std::max(math::distance(camera.position, center_ws) - radius * scale, 0.0f);
 
-					sp_graphics_command_list_set_descriptor_table(graphics_command_list, 0, entity.descriptor_table_srv);
-					sp_graphics_command_list_set_descriptor_table(graphics_command_list, 1, entity.descriptor_table_cbv);
+				entity.lod = sp_mesh_lod_select(entity.mesh.lods.data(), static_cast<int>(entity.mesh.lods.size()), scale, distance, projection_scale, lod_pixel_error_max);
+
+				lod_triangle_count += (entity.lod > 0 ? static_cast<int>(entity.mesh.lods[entity.lod - 1]._index_count) : entity.mesh.index_count) / 3;
+				lod_triangle_count_full_detail += entity.mesh.index_count / 3;
+
+				// The mesh and LOD stand in for the material since they decide the descriptor tables and index range
+				const uint32_t mesh_lod = static_cast<uint32_t>(entity.mesh_id * (k_mesh_lod_count_max + 1) + entity.lod);
+				sp_render_queue_push(gbuffer_queue, sp_render_queue_key(0, entity.pipeline_state_handle.index, mesh_lod, distance, sp_render_queue_depth_order::front_to_back), entity_index);
+			}
+
+			const auto render_queue_sort_start_time = std::chrono::high_resolution_clock::now();
+
+			sp_render_queue_sort(gbuffer_queue, sp_render_queue_sort_desc());
+
+			render_queue_sort_ms = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - render_queue_sort_start_time).count() * 1000.0;
+
+			// Runs of draws with the same state become one instanced draw
+			instances.clear();
+			instanced_draws.clear();
+			for (size_t i = 0; i < gbuffer_queue._items.size(); ++i)
+			{
+				const sp_render_queue_item& item = gbuffer_queue._items[i];
 
-					sp_graphics_command_list_set_vertex_buffers(graphics_command_list, &entity.mesh.vertex_buffer_handle, 1);
-					sp_graphics_command_list_draw_instanced(graphics_command_list, entity.mesh.vertex_count, 1);
+				if (i == 0 || sp_render_queue_key_state(item._key) != sp_render_queue_key_state(gbuffer_queue._items[i - 1]._key))
+				{
+					instanced_draws.push_back({ item._payload, static_cast<int>(instances.size()), 0 });
 				}
 
-				sp_graphics_command_list_debug_group_pop(graphics_command_list);
+				instances.push_back({ entities[item._payload].transform, static_cast<uint32_t>(entities[item._payload].material_index) });
+				++instanced_draws.back().instance_count;
+			}
+
+			if (!instances.empty())
+			{
+				sp_vertex_buffer_update(instance_buffer_handle, instances.data(), static_cast<int>(sizeof(instance_data) * instances.size()));
 			}
 
+			// Materials can be edited so they're uploaded every frame
+			constant_buffer_materials_data materials_data;
+			for (size_t material_index = 0; material_index < materials.size(); ++material_index)
+			{
+				const model::material& material = materials[material_index];
+				materials_data.materials[material_index].base_color_factor = { material.base_color_factor[0], material.base_color_factor[1], material.base_color_factor[2], material.base_color_factor[3] };
+				materials_data.materials[material_index].metalness_roughness_factor = { material.metalness_factor, material.roughness_factor, 0.0f, 0.0f };
+			}
+
+			sp_constant_buffer_update(constant_buffer_materials, &materials_data);
+		}
+
+		{
+			sp_graphics_command_list_begin(graphics_command_list);
+			sp_compute_command_list_begin(compute_command_list);
+
+			// The last frame to use this back buffer is done so whatever it copied back can be checked
+			if (cull_readbacks[detail::_sp._back_buffer_index].pending)
+			{
+				cull_readback_check(cull_readbacks[detail::_sp._back_buffer_index]);
+				cull_readbacks[detail::_sp._back_buffer_index].pending = false;
+			}
+
+			{
+				int width, height;
+				sp_window_get_size(window, &width, &height);
+				sp_graphics_command_list_set_viewport(graphics_command_list, { 0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height) });
+				sp_graphics_command_list_set_scissor_rect(graphics_command_list, { 0, 0, width, height });
+			}
+
+			{
+				sp_compute_command_list_set_pipeline_state(compute_command_list, low_freq_noise_pipeline_state_handle);
+				sp_compute_command_list_dispatch(compute_command_list, 8, 8, 8);
+			}
+
+			sp_frame_graph_execute(frame_graph, graphics_command_list);
+
 #if DEMO_CLOUDS
 			// clouds
 			{
@@ -1083,7 +1853,7 @@ int main()
 				sp_descriptor_copy_to_heap(
 					detail::_sp._descriptor_heap_cbv_srv_uav_gpu,
 					{
-						detail::sp_texture_pool_get(gbuffer_depth_texture_handle)._shader_resource_view,
+						detail::sp_texture_pool_get(sp_frame_graph_get_texture(frame_graph, gbuffer_depth))._shader_resource_view,
 						detail::sp_texture_pool_get(cloud_shape_texture_handle)._shader_resource_view,
 						detail::sp_texture_pool_get(cloud_detail_texture_handle)._shader_resource_view,
 						detail::sp_texture_pool_get(cloud_weather_texture_handle)._shader_resource_view,
@@ -1099,28 +1869,6 @@ int main()
 				sp_graphics_command_list_draw_instanced(graphics_command_list, 3, 1);
 			}
 #endif
-			
-
-#if !DEMO_CLOUDS
-			// lighting
-			{
-				sp_graphics_command_list_debug_group_push(graphics_command_list, "lighting");
-
-				sp_graphics_command_list_set_pipeline_state(graphics_command_list, lighting_pipeline_state_handle);
-
-				sp_texture_handle lighting_render_target_handles[] = {
-					detail::_sp._back_buffer_texture_handles[detail::_sp._back_buffer_index] // TODO: sp_swap_chain_get_back_buffer
-				};
-				sp_graphics_command_list_set_render_targets(graphics_command_list, lighting_render_target_handles, static_cast<int>(std::size(lighting_render_target_handles)), {});
-
-				sp_graphics_command_list_set_descriptor_table(graphics_command_list, 0, descriptor_table_lighting_srv);
-				sp_graphics_command_list_set_descriptor_table(graphics_command_list, 1, descriptor_table_lighting_cbv);
-
-				sp_graphics_command_list_draw_instanced(graphics_command_list, 3, 1);
-
-				sp_graphics_command_list_debug_group_pop(graphics_command_list);
-			}
-#endif
 
 			{
 				//sp_debug_gui_show_demo_window();
@@ -1138,22 +1886,21 @@ int main()
 
 				if (ImGui::CollapsingHeader("Lighting"))
 				{
-					ImGui::DragInt("Sampling Method", &lighting_per_frame_data.sampling_method, 0.1f, 0, 2);
 					ImGui::DragFloat("Image Based Lighting Scale", &lighting_per_frame_data.image_based_lighting_scale, 0.01f, 0.0f, 10.0f);
 					ImGui::DragFloat3("Direct Lighting", &constant_buffer_per_frame_data.sun_direction_ws[0]);
 				}
 
 				if (ImGui::CollapsingHeader("Materials"))
 				{
-					for (auto& entity : entities)
+					for (auto& material : materials)
 					{
-						ImGui::PushID(&entity);
+						ImGui::PushID(&material);
 
-						if (ImGui::TreeNode(entity.material.name))
+						if (ImGui::TreeNode(material.name))
 						{
-							ImGui::ColorEdit3("Base Color", entity.material.base_color_factor.data());
-							ImGui::DragFloat("Metalness", &entity.material.metalness_factor, 0.01f, 0.0f, 1.0f);
-							ImGui::DragFloat("Roughness", &entity.material.roughness_factor, 0.01f, 0.0f, 1.0f);
+							ImGui::ColorEdit3("Base Color", material.base_color_factor.data());
+							ImGui::DragFloat("Metalness", &material.metalness_factor, 0.01f, 0.0f, 1.0f);
+							ImGui::DragFloat("Roughness", &material.roughness_factor, 0.01f, 0.0f, 1.0f);
 
 							ImGui::TreePop();
 						}
@@ -1162,6 +1909,67 @@ int main()
 					}
 				}
 
+				if (ImGui::CollapsingHeader("Culling"))
+				{
+					ImGui::Combo("Frustum Culling", &frustum_culling, "Off\0Flat\0Hierarchy\0GPU Driven\0");
+					if (frustum_culling == 3)
+					{
+						ImGui::Checkbox("Occlusion Culling", &occlusion_culling);
+						ImGui::Text("Visible: counted on the GPU out of %d", static_cast<int>(entities.size()));
+						ImGui::Checkbox("Check Against CPU", &cull_readback_enabled);
+						if (cull_readback_enabled && cull_readback_frame_num >= 0)
+						{
+							ImGui::Text("Draws different from the CPU: %d of %d in frame %d", cull_readback_mismatch_count, mesh_count, cull_readback_frame_num);
+						}
+					}
+					else
+					{
+						ImGui::Text("Visible: %d of %d in %.3f ms", static_cast<int>(visible_entities.size()), static_cast<int>(entities.size()), frustum_culling_ms);
+					}
+					ImGui::Text("Picked: %s", picked_entity >= 0 ? materials[entities[picked_entity].material_index].name : "nothing, right click to pick");
+					if (frustum_culling == 3)
+					{
+						ImGui::Text("Draws: %d indirect, one per mesh", mesh_count);
+					}
+					else
+					{
+						ImGui::Text("Draws: %d for %d instances, sorted in %.3f ms", static_cast<int>(instanced_draws.size()), static_cast<int>(instances.size()), render_queue_sort_ms);
+					}
+				}
+
+				if (ImGui::CollapsingHeader("Level of Detail"))
+				{
+					ImGui::DragFloat("Pixel Error", &lod_pixel_error_max, 0.05f, 0.0f, 16.0f);
+					ImGui::Text("Triangles: %d of %d", lod_triangle_count, lod_triangle_count_full_detail);
+				}
+
+				if (ImGui::CollapsingHeader("Temporal"))
+				{
+					ImGui::Text("Lighting Resolution Scale: %.2f", lighting_resolution_scale);
+					ImGui::DragFloat("History Weight", &temporal_resolve_per_frame_data.history_weight, 0.01f, 0.0f, 0.99f);
+				}
+
+				if (ImGui::CollapsingHeader("Frame Graph"))
+				{
+					for (int task_index : frame_graph._execution_order)
+					{
+						const sp_frame_graph_task& task = frame_graph._tasks[task_index];
+						ImGui::Text("%-12s %-8s %.3f ms", task._name, detail::sp_frame_graph_queue_get_name(task._queue), task._cpu_record_duration_us / 1000.0);
+					}
+
+					if (ImGui::Button("Export Graphviz"))
+					{
+						sp_frame_graph_export_graphviz(frame_graph, "frame_graph.dot");
+					}
+
+					ImGui::SameLine();
+
+					if (ImGui::Button("Export Chrome Trace"))
+					{
+						sp_frame_graph_export_chrome_trace(frame_graph, "frame_graph.json");
+					}
+				}
+
 				ImGui::End();
 			}
 
@@ -1215,6 +2023,8 @@ int main()
 
 	sp_device_wait_for_idle();
 
+	sp_frame_graph_destroy(frame_graph);
+
 	sp_shutdown();
 
 	return 0;
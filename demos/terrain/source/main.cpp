@@ -468,13 +468,12 @@ int main()
 				sp_graphics_command_list_set_viewport(graphics_command_list, { 0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height) });
 				sp_graphics_command_list_set_scissor_rect(graphics_command_list, { 0, 0, width, height });
 
-				sp_graphics_command_list_clear_render_target(graphics_command_list, detail::_sp._back_buffer_texture_handles[detail::_sp._back_buffer_index]);
-				sp_graphics_command_list_clear_depth(graphics_command_list, depth_texture_handle);
-
-				sp_texture_handle render_target_handles[] = {
-					detail::_sp._back_buffer_texture_handles[detail::_sp._back_buffer_index]
-				};
-				sp_graphics_command_list_set_render_targets(graphics_command_list, render_target_handles, static_cast<int>(std::size(render_target_handles)), depth_texture_handle);
+				// Depth isn't needed once the frame is drawn
+				sp_render_pass_desc render_pass;
+				render_pass.render_targets[0] = { detail::_sp._back_buffer_texture_handles[detail::_sp._back_buffer_index], sp_render_pass_load_action::clear, sp_render_pass_store_action::store };
+				render_pass.render_target_count = 1;
+				render_pass.depth_stencil = { depth_texture_handle, sp_render_pass_load_action::clear, sp_render_pass_store_action::discard };
+				sp_graphics_command_list_begin_render_pass(graphics_command_list, render_pass);
 
 				sp_graphics_command_list_set_descriptor_table(graphics_command_list, 1, descriptor_table_per_frame_cbv);
 			}
@@ -540,6 +539,8 @@ int main()
 
 			detail::sp_debug_gui_record_draw_commands(graphics_command_list);
 
+			sp_graphics_command_list_end_render_pass(graphics_command_list);
+
 			sp_graphics_command_list_end(graphics_command_list);
 		}
 
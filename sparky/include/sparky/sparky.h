@@ -6,6 +6,8 @@
 #include "..\..\source\handle.h"
 #include "..\..\source\window.h"
 #include "..\..\source\vertex_buffer.h"
+#include "..\..\source\index_buffer.h"
+#include "..\..\source\buffer.h"
 #include "..\..\source\texture.h"
 #include "..\..\source\command_list.h"
 #include "..\..\source\constant_buffer.h"
@@ -16,6 +18,29 @@
 #include "..\..\source\debug_gui.h"
 #include "..\..\source\file_watch.h"
 #include "..\..\source\image.h"
+#include "..\..\source\image_mips.h"
+#include "..\..\source\image_bc.h"
+#include "..\..\source\image_convert.h"
+#include "..\..\source\image_dds.h"
+#include "..\..\source\image_ktx2.h"
+#include "..\..\source\image_file.h"
+#include "..\..\source\image_ibl.h"
+#include "..\..\source\file_map.h"
+#include "..\..\source\mesh.h"
+#include "..\..\source\mesh_file.h"
+#include "..\..\source\mesh_gltf.h"
+#include "..\..\source\mesh_lod.h"
+#include "..\..\source\mesh_meshlet.h"
+#include "..\..\source\mesh_optimize.h"
+#include "..\..\source\mesh_quantize.h"
+#include "..\..\source\bvh.h"
+#include "..\..\source\render_queue.h"
+#include "..\..\source\indirect_cull.h"
+#include "..\..\source\frame_graph.h"
+#include "..\..\source\job.h"
+#include "..\..\source\upload.h"
+#include "..\..\source\gpu_memory.h"
+#include "..\..\source\deferred_release.h"
 
 #include "..\..\source\d3dx12.h"
 
@@ -64,6 +89,8 @@ void sp_init(const sp_window& window)
 {
 	HRESULT hr = S_FALSE;
 
+	sp_job_system_init();
+
 	UINT dxgi_factory_flags = 0;
 
 #if SP_DEBUG_API_VALIDATION_LEVEL
@@ -178,6 +205,9 @@ void sp_init(const sp_window& window)
 		assert(SUCCEEDED(hr));
 	}
 
+	// Kept so resizing recreates the back buffers in the same format
+	const DXGI_FORMAT swap_chain_format = DXGI_FORMAT_R10G10B10A2_UNORM;
+
 	Microsoft::WRL::ComPtr<IDXGISwapChain3> swap_chain3;
 	{
 		RECT window_client_rect;
@@ -188,7 +218,7 @@ void sp_init(const sp_window& window)
 		swap_chain_desc.BufferCount = k_back_buffer_count;
 		swap_chain_desc.Width = window_client_rect.right;
 		swap_chain_desc.Height = window_client_rect.bottom;
-		swap_chain_desc.Format = DXGI_FORMAT_R10G10B10A2_UNORM;
+		swap_chain_desc.Format = swap_chain_format;
 		swap_chain_desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
 		swap_chain_desc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
 		swap_chain_desc.SampleDesc.Count = 1;
@@ -263,22 +293,47 @@ void sp_init(const sp_window& window)
 		assert(SUCCEEDED(hr));
 	}
 
+	Microsoft::WRL::ComPtr<ID3D12CommandSignature> command_signature_draw_indexed;
+	{
+		D3D12_INDIRECT_ARGUMENT_DESC argument_desc = {};
+		argument_desc.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+		D3D12_COMMAND_SIGNATURE_DESC command_signature_desc = {};
+		command_signature_desc.ByteStride = sizeof(D3D12_DRAW_INDEXED_ARGUMENTS);
+		command_signature_desc.NumArgumentDescs = 1;
+		command_signature_desc.pArgumentDescs = &argument_desc;
+
+		// No root signature since none of the arguments change root arguments
+		hr = device->CreateCommandSignature(&command_signature_desc, nullptr, IID_PPV_ARGS(&command_signature_draw_indexed));
+		assert(SUCCEEDED(hr));
+	}
+
 	detail::_sp._device = device;
 	detail::_sp._swap_chain = swap_chain3;
+	detail::_sp._swap_chain_format = swap_chain_format;
 	detail::_sp._back_buffer_index = swap_chain3->GetCurrentBackBufferIndex();
 	detail::_sp._graphics_queue = graphics_queue;
 	detail::_sp._compute_queue = compute_queue;
 	detail::_sp._root_signature = root_signature;
+	detail::_sp._command_signature_draw_indexed = command_signature_draw_indexed;
+
+	detail::sp_gpu_memory_init();
 
 	detail::_sp._constant_buffer_heap = detail::sp_constant_buffer_heap_create("constant_buffer_heap", { 32 * 1024 });
 
-	detail::_sp._descriptor_heap_dsv_cpu = detail::sp_descriptor_heap_create("dsv_cpu", { 16, detail::sp_descriptor_heap_visibility::cpu_only, detail::sp_descriptor_heap_type::dsv });
-	detail::_sp._descriptor_heap_rtv_cpu = detail::sp_descriptor_heap_create("rtv_cpu", { 128, detail::sp_descriptor_heap_visibility::cpu_only, detail::sp_descriptor_heap_type::rtv });
-	detail::_sp._descriptor_heap_cbv_srv_uav_cpu = detail::sp_descriptor_heap_create("cbv_srv_uav_cpu", { 4096, detail::sp_descriptor_heap_visibility::cpu_only, detail::sp_descriptor_heap_type::cbv_srv_uav });
-	detail::_sp._descriptor_heap_cbv_srv_uav_gpu = detail::sp_descriptor_heap_create("cbv_srv_uav_gpu", { 2048, detail::sp_descriptor_heap_visibility::cpu_and_gpu, detail::sp_descriptor_heap_type::cbv_srv_uav });
+	detail::sp_upload_context_init(detail::_sp._upload_context, { 64 * 1024 * 1024 });
+
+	detail::sp_deferred_release_queue_init(detail::_sp._deferred_release_queue);
+
+	detail::sp_descriptor_heap_init(detail::_sp._descriptor_heap_dsv_cpu, "dsv_cpu", { 16, detail::sp_descriptor_heap_visibility::cpu_only, detail::sp_descriptor_heap_type::dsv });
+	detail::sp_descriptor_heap_init(detail::_sp._descriptor_heap_rtv_cpu, "rtv_cpu", { 128, detail::sp_descriptor_heap_visibility::cpu_only, detail::sp_descriptor_heap_type::rtv });
+	detail::sp_descriptor_heap_init(detail::_sp._descriptor_heap_cbv_srv_uav_cpu, "cbv_srv_uav_cpu", { 4096, detail::sp_descriptor_heap_visibility::cpu_only, detail::sp_descriptor_heap_type::cbv_srv_uav });
+	detail::sp_descriptor_heap_init(detail::_sp._descriptor_heap_cbv_srv_uav_gpu, "cbv_srv_uav_gpu", { 2048, detail::sp_descriptor_heap_visibility::cpu_and_gpu, detail::sp_descriptor_heap_type::cbv_srv_uav });
 
 	detail::sp_texture_pool_create();
 	detail::sp_vertex_buffer_pool_create();
+	detail::sp_index_buffer_pool_create();
+	detail::sp_buffer_pool_create();
 	detail::sp_graphics_pipeline_state_pool_create();
 	detail::sp_compute_pipeline_state_pool_create();
 	detail::sp_pixel_shader_pool_create();
@@ -300,6 +355,7 @@ void sp_init(const sp_window& window)
 		texture._name = "swap_chain";
 		texture._width = swap_chain_desc.Width;
 		texture._height = swap_chain_desc.Height;
+		texture._format = sp_texture_format::r10g10b10a2;
 
 		texture._default_state = D3D12_RESOURCE_STATE_PRESENT;
 
@@ -315,6 +371,8 @@ void sp_init(const sp_window& window)
 
 void sp_shutdown()
 {
+	sp_job_system_shutdown();
+
 	for (int back_buffer_index = 0; back_buffer_index < k_back_buffer_count; ++back_buffer_index)
 	{
 		sp_texture_destroy(detail::_sp._back_buffer_texture_handles[back_buffer_index]);
@@ -325,6 +383,8 @@ void sp_shutdown()
 
 	detail::sp_texture_pool_destroy();
 	detail::sp_vertex_buffer_pool_destroy();
+	detail::sp_index_buffer_pool_destroy();
+	detail::sp_buffer_pool_destroy();
 	detail::sp_graphics_pipeline_state_pool_destroy();
 	detail::sp_compute_pipeline_state_pool_destroy();
 	detail::sp_pixel_shader_pool_destroy();
@@ -333,6 +393,12 @@ void sp_shutdown()
 
 	detail::sp_constant_buffer_heap_destroy(detail::_sp._constant_buffer_heap);
 
+	// Anything above might have released something through it
+	detail::sp_deferred_release_queue_destroy(detail::_sp._deferred_release_queue);
+	detail::sp_upload_context_destroy(detail::_sp._upload_context);
+
+	detail::sp_gpu_memory_destroy();
+
 	sp_descriptor_heap_destroy(detail::_sp._descriptor_heap_dsv_cpu);
 	sp_descriptor_heap_destroy(detail::_sp._descriptor_heap_rtv_cpu);
 	sp_descriptor_heap_destroy(detail::_sp._descriptor_heap_cbv_srv_uav_cpu);
@@ -342,6 +408,7 @@ void sp_shutdown()
 	detail::_sp._graphics_queue.Reset();
 	detail::_sp._compute_queue.Reset();
 	detail::_sp._root_signature.Reset();
+	detail::_sp._command_signature_draw_indexed.Reset();
 
 #if SP_DEBUG_SHUTDOWN_LEAK_REPORT_ENABLED
 	{
@@ -358,6 +425,8 @@ void sp_shutdown()
 
 void sp_graphics_queue_execute(const sp_graphics_command_list& command_list)
 {
+	detail::sp_upload_flush_for_queue(detail::_sp._upload_context, detail::_sp._graphics_queue.Get(), detail::_sp._upload_context._graphics_queue_wait_fence_value);
+
 	ID3D12CommandList* command_lists_d3d12[] = { command_list._command_list_d3d12.Get() };
 	detail::_sp._graphics_queue->ExecuteCommandLists(static_cast<UINT>(std::size(command_lists_d3d12)), command_lists_d3d12);
 
@@ -366,6 +435,32 @@ void sp_graphics_queue_execute(const sp_graphics_command_list& command_list)
 
 namespace detail
 {
+	// From a job on a worker this parks the job's fiber so the worker can get on with something else while the GPU catches up.
+	// Everywhere else, including the main thread, it sleeps on an event rather than polling the fence.
+	void sp_fence_wait(ID3D12Fence* fence, UINT64 fence_value)
+	{
+		if (fence->GetCompletedValue() >= fence_value)
+		{
+			return;
+		}
+
+		if (sp_job_can_park())
+		{
+			sp_job_wait_until([fence, fence_value]() { return fence->GetCompletedValue() >= fence_value; });
+		}
+		else
+		{
+			HANDLE fence_event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+			assert(fence_event);
+
+			HRESULT hr = fence->SetEventOnCompletion(fence_value, fence_event);
+			assert(SUCCEEDED(hr));
+			WaitForSingleObject(fence_event, INFINITE);
+
+			CloseHandle(fence_event);
+		}
+	}
+
 	void sp_command_queue_wait_for_idle(ID3D12CommandQueue* command_queue)
 	{
 		// Create synchronization objects and wait until assets have been uploaded to the GPU.
@@ -373,27 +468,12 @@ namespace detail
 		HRESULT hr = _sp._device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence));
 		assert(SUCCEEDED(hr));
 
-		UINT64 next_fence_value = 1;
-
-		// Create an event handle to use for frame synchronization.
-		HANDLE fence_event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-		assert(fence_event);
-
-		// Signal and increment the fence value.
-		const UINT64 fence_value = next_fence_value;
+		// Signal and wait until everything before it has finished.
+		const UINT64 fence_value = 1;
 		hr = command_queue->Signal(fence.Get(), fence_value);
 		assert(SUCCEEDED(hr));
-		next_fence_value++;
-
-		// Wait until the previous frame is finished.
-		if (fence->GetCompletedValue() < fence_value)
-		{
-			hr = fence->SetEventOnCompletion(fence_value, fence_event);
-			assert(SUCCEEDED(hr));
-			WaitForSingleObject(fence_event, INFINITE);
-		}
 
-		CloseHandle(fence_event);
+		sp_fence_wait(fence.Get(), fence_value);
 	}
 }
 
@@ -404,6 +484,8 @@ void sp_graphics_queue_wait_for_idle()
 
 void sp_compute_queue_execute(const sp_compute_command_list& command_list)
 {
+	detail::sp_upload_flush_for_queue(detail::_sp._upload_context, detail::_sp._compute_queue.Get(), detail::_sp._upload_context._compute_queue_wait_fence_value);
+
 	ID3D12CommandList* command_lists_d3d12[] = { command_list._command_list_d3d12.Get() };
 	detail::_sp._compute_queue->ExecuteCommandLists(static_cast<unsigned>(std::size(command_lists_d3d12)), command_lists_d3d12);
 }
@@ -415,6 +497,7 @@ void sp_compute_queue_wait_for_idle()
 
 void sp_device_wait_for_idle()
 {
+	sp_upload_wait_for_idle();
 	sp_graphics_queue_wait_for_idle();
 	sp_compute_queue_wait_for_idle();
 }
@@ -424,6 +507,44 @@ void sp_swap_chain_present()
 	HRESULT hr = detail::_sp._swap_chain->Present(0, 0);
 	assert(SUCCEEDED(hr));
 
+	detail::sp_deferred_release_queue_end_frame(detail::_sp._deferred_release_queue);
+
+	detail::_sp._back_buffer_index = detail::_sp._swap_chain->GetCurrentBackBufferIndex();
+}
+
+void sp_swap_chain_resize(int width, int height)
+{
+	// Minimized
+	if (width == 0 || height == 0)
+	{
+		return;
+	}
+
+	// All references to the back buffers need to be released before they can be resized
+	sp_device_wait_for_idle();
+
+	for (int back_buffer_index = 0; back_buffer_index < k_back_buffer_count; ++back_buffer_index)
+	{
+		detail::sp_texture_pool_get(detail::_sp._back_buffer_texture_handles[back_buffer_index])._resource.Reset();
+	}
+
+	HRESULT hr = detail::_sp._swap_chain->ResizeBuffers(k_back_buffer_count, width, height, detail::_sp._swap_chain_format, DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT);
+	assert(SUCCEEDED(hr));
+
+	for (int back_buffer_index = 0; back_buffer_index < k_back_buffer_count; ++back_buffer_index)
+	{
+		sp_texture& texture = detail::sp_texture_pool_get(detail::_sp._back_buffer_texture_handles[back_buffer_index]);
+
+		texture._width = width;
+		texture._height = height;
+
+		hr = detail::_sp._swap_chain->GetBuffer(back_buffer_index, IID_PPV_ARGS(&texture._resource));
+		assert(SUCCEEDED(hr));
+
+		// Reuse the existing descriptor
+		detail::_sp._device->CreateRenderTargetView(texture._resource.Get(), nullptr, texture._render_target_view._handle_cpu_d3d12);
+	}
+
 	detail::_sp._back_buffer_index = detail::_sp._swap_chain->GetCurrentBackBufferIndex();
 }
 
@@ -433,7 +554,32 @@ void sp_swap_chain_present()
 #include "..\..\source\pipeline_impl.h"
 #include "..\..\source\texture_impl.h"
 #include "..\..\source\vertex_buffer_impl.h"
+#include "..\..\source\index_buffer_impl.h"
+#include "..\..\source\buffer_impl.h"
 #include "..\..\source\shader_impl.h"
 #include "..\..\source\descriptor_impl.h"
 #include "..\..\source\debug_gui_impl.h"
+#include "..\..\source\frame_graph_impl.h"
+#include "..\..\source\job_impl.h"
+#include "..\..\source\ring_allocator_impl.h"
+#include "..\..\source\upload_impl.h"
+#include "..\..\source\gpu_memory_impl.h"
+#include "..\..\source\deferred_release_impl.h"
+#include "..\..\source\image_mips_impl.h"
+#include "..\..\source\image_bc_impl.h"
+#include "..\..\source\image_convert_impl.h"
+#include "..\..\source\image_dds_impl.h"
+#include "..\..\source\image_ktx2_impl.h"
+#include "..\..\source\image_file_impl.h"
+#include "..\..\source\image_ibl_impl.h"
+#include "..\..\source\file_map_impl.h"
+#include "..\..\source\mesh_file_impl.h"
+#include "..\..\source\mesh_gltf_impl.h"
+#include "..\..\source\mesh_lod_impl.h"
+#include "..\..\source\mesh_meshlet_impl.h"
+#include "..\..\source\mesh_optimize_impl.h"
+#include "..\..\source\mesh_quantize_impl.h"
+#include "..\..\source\bvh_impl.h"
+#include "..\..\source\render_queue_impl.h"
+#include "..\..\source\indirect_cull_impl.h"
 #endif
\ No newline at end of file
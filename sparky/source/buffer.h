@@ -0,0 +1,73 @@
+#pragma once
+
+#include "handle.h"
+#include "descriptor.h"
+#include "gpu_memory.h"
+
+#include <type_traits>
+
+#define NOMINMAX
+#include <d3d12.h>
+
+#include <wrl.h>
+
+// Structured buffers shaders read and write, like the instance data and indirect draw arguments of GPU driven drawing. Unlike
+// vertex and index buffers each one is its own resource, placed in the gpu memory placed buffer pool, since blocks of a
+// shared page can't be transitioned on their own and the shared pages aren't created for unordered access.
+
+enum class sp_buffer_flags
+{
+	none = 0x00,
+	unordered_access = 0x01,		// Shaders can write it
+	readback = 0x02,				// Copied into on the GPU and read with sp_buffer_read. Nothing else can use it.
+};
+
+inline sp_buffer_flags operator | (sp_buffer_flags lhs, sp_buffer_flags rhs)
+{
+	using T = std::underlying_type_t<sp_buffer_flags>;
+	return static_cast<sp_buffer_flags>(static_cast<T>(lhs) | static_cast<T>(rhs));
+}
+
+inline sp_buffer_flags operator & (sp_buffer_flags lhs, sp_buffer_flags rhs)
+{
+	using T = std::underlying_type_t<sp_buffer_flags>;
+	return static_cast<sp_buffer_flags>(static_cast<T>(lhs) & static_cast<T>(rhs));
+}
+
+struct sp_buffer_desc
+{
+	int size_in_bytes = 0;
+	int stride_in_bytes = 0;		// Of one structured buffer element and, if it's bound as one, one vertex
+	sp_buffer_flags flags = sp_buffer_flags::none;
+};
+
+struct sp_buffer
+{
+	const char* _name = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> _resource;		// In the common state between command lists
+	sp_gpu_memory_block _memory_block;
+	int _size_in_bytes = 0;
+	int _stride_in_bytes = 0;
+
+	sp_descriptor_handle _shader_resource_view;
+	sp_descriptor_handle _unordered_access_view;		// Only for sp_buffer_flags::unordered_access
+	bool _readback = false;		// Always in the copy dest state, readback heaps can't leave it
+
+	D3D12_VERTEX_BUFFER_VIEW _vertex_buffer_view;
+};
+
+using sp_buffer_handle = sp_handle;
+
+namespace detail
+{
+	void sp_buffer_pool_create();
+	void sp_buffer_pool_destroy();
+	sp_buffer& sp_buffer_pool_get(sp_buffer_handle buffer_handle);
+}
+
+sp_buffer_handle sp_buffer_create(const char* name, const sp_buffer_desc& desc);
+// Goes through the copy queue like sp_vertex_buffer_update
+void sp_buffer_update(const sp_buffer_handle& buffer_handle, const void* data_cpu, int size_bytes);
+// Readback buffers only. Whatever copied into it has to have finished on the GPU, e.g. k_back_buffer_count frames ago.
+void sp_buffer_read(const sp_buffer_handle& buffer_handle, void* data_cpu, int size_bytes);
+void sp_buffer_destroy(const sp_buffer_handle& buffer_handle);
\ No newline at end of file
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "buffer.h"
+
+#include "d3dx12.h"
+
+#include <array>
+#include <codecvt>
+
+namespace detail
+{
+	namespace resource_pools
+	{
+		std::array<sp_buffer, 256> buffers;
+		sp_handle_pool buffer_handles;
+	}
+
+	void sp_buffer_pool_create()
+	{
+		sp_handle_pool_create(&resource_pools::buffer_handles, static_cast<int>(resource_pools::buffers.size()));
+	}
+
+	void sp_buffer_pool_destroy()
+	{
+		sp_handle_pool_destroy(&resource_pools::buffer_handles);
+	}
+
+	sp_buffer& sp_buffer_pool_get(sp_buffer_handle buffer_handle)
+	{
+		return resource_pools::buffers[buffer_handle.index];
+	}
+}
+
+sp_buffer_handle sp_buffer_create(const char* name, const sp_buffer_desc& desc)
+{
+	assert(desc.size_in_bytes > 0);
+	assert(desc.stride_in_bytes > 0 && desc.stride_in_bytes % 4 == 0 && desc.size_in_bytes % desc.stride_in_bytes == 0);
+
+	sp_buffer_handle buffer_handle = sp_handle_alloc(&detail::resource_pools::buffer_handles);
+	sp_buffer& buffer = detail::resource_pools::buffers[buffer_handle.index];
+
+	const bool unordered_access = (desc.flags & sp_buffer_flags::unordered_access) != sp_buffer_flags::none;
+	const bool readback = (desc.flags & sp_buffer_flags::readback) != sp_buffer_flags::none;
+
+	assert(!(unordered_access && readback));
+
+	const auto resource_desc_d3dx12 = CD3DX12_RESOURCE_DESC::Buffer(desc.size_in_bytes, unordered_access ? D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS : D3D12_RESOURCE_FLAG_NONE);
+
+	buffer._name = name;
+	buffer._size_in_bytes = desc.size_in_bytes;
+	buffer._stride_in_bytes = desc.stride_in_bytes;
+	buffer._readback = readback;
+
+	if (readback)
+	{
+		// Only for debugging, so few and small enough that a committed resource is fine
+		const auto heap_properties_d3dx12 = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+		HRESULT hr = detail::_sp._device->CreateCommittedResource(
+			&heap_properties_d3dx12,
+			D3D12_HEAP_FLAG_NONE,
+			&resource_desc_d3dx12,
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&buffer._resource));
+		assert(hr == S_OK);
+
+#if SP_DEBUG_RESOURCE_NAMING_ENABLED
+		buffer._resource->SetName(std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().from_bytes(name).c_str());
+#endif
+
+		return buffer_handle;
+	}
+
+	buffer._memory_block = detail::sp_gpu_memory_alloc(sp_gpu_memory_pool_type::placed_buffers, desc.size_in_bytes, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+
+	// Common so the copy queue can write it, and it's where buffers decay to after every command list anyway
+	HRESULT hr = detail::_sp._device->CreatePlacedResource(
+		detail::sp_gpu_memory_get_heap(buffer._memory_block),
+		buffer._memory_block._offset_bytes,
+		&resource_desc_d3dx12,
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&buffer._resource));
+	assert(hr == S_OK);
+
+#if SP_DEBUG_RESOURCE_NAMING_ENABLED
+	buffer._resource->SetName(std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().from_bytes(name).c_str());
+#endif
+
+	const UINT element_count = desc.size_in_bytes / desc.stride_in_bytes;
+
+	buffer._shader_resource_view = detail::sp_descriptor_alloc(detail::_sp._descriptor_heap_cbv_srv_uav_cpu);
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC shader_resource_view_desc_d3d12 = {};
+	shader_resource_view_desc_d3d12.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	shader_resource_view_desc_d3d12.Format = DXGI_FORMAT_UNKNOWN;
+	shader_resource_view_desc_d3d12.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+	shader_resource_view_desc_d3d12.Buffer.NumElements = element_count;
+	shader_resource_view_desc_d3d12.Buffer.StructureByteStride = desc.stride_in_bytes;
+
+	detail::_sp._device->CreateShaderResourceView(buffer._resource.Get(), &shader_resource_view_desc_d3d12, buffer._shader_resource_view._handle_cpu_d3d12);
+
+	if (unordered_access)
+	{
+		buffer._unordered_access_view = detail::sp_descriptor_alloc(detail::_sp._descriptor_heap_cbv_srv_uav_cpu);
+
+		D3D12_UNORDERED_ACCESS_VIEW_DESC unordered_access_view_desc_d3d12 = {};
+		unordered_access_view_desc_d3d12.Format = DXGI_FORMAT_UNKNOWN;
+		unordered_access_view_desc_d3d12.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+		unordered_access_view_desc_d3d12.Buffer.NumElements = element_count;
+		unordered_access_view_desc_d3d12.Buffer.StructureByteStride = desc.stride_in_bytes;
+
+		detail::_sp._device->CreateUnorderedAccessView(buffer._resource.Get(), nullptr, &unordered_access_view_desc_d3d12, buffer._unordered_access_view._handle_cpu_d3d12);
+	}
+
+	buffer._vertex_buffer_view.BufferLocation = buffer._resource->GetGPUVirtualAddress();
+	buffer._vertex_buffer_view.StrideInBytes = desc.stride_in_bytes;
+	buffer._vertex_buffer_view.SizeInBytes = desc.size_in_bytes;
+
+	return buffer_handle;
+}
+
+void sp_buffer_update(const sp_buffer_handle& buffer_handle, const void* data_cpu, int size_bytes)
+{
+	sp_buffer& buffer = detail::resource_pools::buffers[buffer_handle.index];
+
+	assert(size_bytes <= buffer._size_in_bytes);
+
+	detail::sp_upload_buffer_region(detail::_sp._upload_context, buffer._resource.Get(), 0, data_cpu, size_bytes);
+}
+
+void sp_buffer_read(const sp_buffer_handle& buffer_handle, void* data_cpu, int size_bytes)
+{
+	sp_buffer& buffer = detail::resource_pools::buffers[buffer_handle.index];
+
+	assert(buffer._readback);
+	assert(size_bytes <= buffer._size_in_bytes);
+
+	const CD3DX12_RANGE read_range(0, size_bytes);
+	void* buffer_cpu = nullptr;
+	HRESULT hr = buffer._resource->Map(0, &read_range, &buffer_cpu);
+	assert(SUCCEEDED(hr));
+
+	memcpy(data_cpu, buffer_cpu, size_bytes);
+
+	const CD3DX12_RANGE written_range(0, 0);
+	buffer._resource->Unmap(0, &written_range);
+}
+
+void sp_buffer_destroy(const sp_buffer_handle& buffer_handle)
+{
+	sp_buffer& buffer = detail::resource_pools::buffers[buffer_handle.index];
+
+	detail::sp_deferred_release(std::move(buffer._resource));
+	detail::sp_deferred_release(buffer._memory_block);
+	detail::sp_deferred_release(detail::_sp._descriptor_heap_cbv_srv_uav_cpu, buffer._shader_resource_view);
+	detail::sp_deferred_release(detail::_sp._descriptor_heap_cbv_srv_uav_cpu, buffer._unordered_access_view);
+
+	sp_handle_free(&detail::resource_pools::buffer_handles, buffer_handle);
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// A bounding volume hierarchy over the axis aligned bounds of a scene's objects, for culling them against the camera's frustum
+// and picking them with rays without touching every one.
+//
+// Trees are built top down with the surface area heuristic, binning object centers along each axis and splitting where the
+// summed area of the two sides times their object count is lowest (Wald, "On fast Construction of SAH-based Bounding Volume
+// Hierarchies"). Nodes come before their children, the two children of a node are next to each other and every subtree's
+// objects are a contiguous range, so:
+//
+// - Objects that move can be refitted, every node grown or shrunk around its children in one pass backwards over the nodes,
+//   without changing the tree. The tree gets worse the further objects move from where they were built, so compare
+//   sp_bvh_cost with what it was after building and rebuild once it's grown too much.
+// - Culling tests a node against all six planes at once, four planes to an SSE register. A node outside any plane is skipped
+//   with everything under it and one inside every plane has its whole range of objects added without testing any further, so
+//   the work follows what's near the edges of the frustum rather than how many objects there are.
+//
+// Object indices are whatever the bounds were passed in as, typically entity indices.
+
+struct sp_bvh_bounds
+{
+	float _min[3];
+	float _max[3];
+};
+
+struct sp_bvh_node
+{
+	sp_bvh_bounds _bounds;
+	uint32_t _first_object = 0;		// Into sp_bvh::_objects, for the whole subtree
+	uint32_t _object_count = 0;
+	uint32_t _left_child = 0;		// The right child is right after it. 0 for leaves since the root is never a child.
+};
+
+struct sp_bvh_desc
+{
+	int leaf_object_count_max = 4;
+	int bin_count = 16;		// Per axis, no more than k_bvh_bin_count_max
+};
+
+const int k_bvh_bin_count_max = 32;
+
+struct sp_bvh
+{
+	std::vector<sp_bvh_node> _nodes;				// The root first and every node before its children
+	std::vector<uint32_t> _objects;					// Object indices in leaf order
+	std::vector<sp_bvh_bounds> _object_bounds;		// In the same order as _objects so leaves read theirs contiguously
+};
+
+// Replaces the tree with one over object_count objects
+void sp_bvh_build(sp_bvh& bvh, const sp_bvh_bounds* object_bounds, int object_count, const sp_bvh_desc& desc);
+
+// Takes new bounds for the same objects the tree was built with, indexed the same way, and fits the nodes around them
+void sp_bvh_refit(sp_bvh& bvh, const sp_bvh_bounds* object_bounds);
+
+// Expected cost of testing a ray against the tree, in object tests, by the surface area heuristic
+float sp_bvh_cost(const sp_bvh& bvh);
+
+// Replaces visible with the indices of the objects at least partly inside the planes, in leaf order. Planes are a normal and a
+// distance, with the inside where dot(normal, position) + distance >= 0, like sp_mesh_meshlet_outside_frustum.
+void sp_bvh_cull_frustum(const sp_bvh& bvh, const float (&planes)[6][4], std::vector<uint32_t>& visible);
+
+// The object whose bounds the ray enters first, counting an object the origin is inside of as entered at 0. Returns false if
+// the ray misses every object before t_max. Direction doesn't have to be normalized and t is in multiples of it.
+bool sp_bvh_raycast(const sp_bvh& bvh, const float (&origin)[3], const float (&direction)[3], float t_max, uint32_t* object, float* t);
\ No newline at end of file
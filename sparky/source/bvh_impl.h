@@ -0,0 +1,460 @@
+#pragma once
+
+#include "bvh.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <numeric>
+#include <utility>
+
+#include <immintrin.h>
+
+namespace detail
+{
+	// Of visiting a node, relative to testing an object, for sp_bvh_cost
+	const float k_bvh_node_cost = 1.0f;
+
+	struct sp_bvh_bin
+	{
+		sp_bvh_bounds _bounds;
+		uint32_t _object_count = 0;
+	};
+
+	// The six planes transposed, four to a register. The last two lanes repeat the last plane.
+	struct sp_bvh_planes
+	{
+		__m128 _x[2];
+		__m128 _y[2];
+		__m128 _z[2];
+		__m128 _w[2];
+		__m128 _abs_x[2];
+		__m128 _abs_y[2];
+		__m128 _abs_z[2];
+	};
+
+	enum class sp_bvh_cull_result
+	{
+		outside,
+		intersecting,
+		inside,
+	};
+
+	sp_bvh_bounds sp_bvh_bounds_empty()
+	{
+		return { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+	}
+
+	void sp_bvh_bounds_grow(sp_bvh_bounds& bounds, const sp_bvh_bounds& other)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			bounds._min[k] = std::min(bounds._min[k], other._min[k]);
+			bounds._max[k] = std::max(bounds._max[k], other._max[k]);
+		}
+	}
+
+	// Half of it, which is all the heuristic needs
+	float sp_bvh_bounds_area(const sp_bvh_bounds& bounds)
+	{
+		const float x = std::max(bounds._max[0] - bounds._min[0], 0.0f);
+		const float y = std::max(bounds._max[1] - bounds._min[1], 0.0f);
+		const float z = std::max(bounds._max[2] - bounds._min[2], 0.0f);
+		return x * y + y * z + z * x;
+	}
+
+	sp_bvh_planes sp_bvh_planes_load(const float (&planes)[6][4])
+	{
+		sp_bvh_planes loaded;
+
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		for (int i = 0; i < 2; ++i)
+		{
+			const float* p[4] = { planes[i * 4], planes[i * 4 + 1], planes[std::min(i * 4 + 2, 5)], planes[std::min(i * 4 + 3, 5)] };
+			loaded._x[i] = _mm_setr_ps(p[0][0], p[1][0], p[2][0], p[3][0]);
+			loaded._y[i] = _mm_setr_ps(p[0][1], p[1][1], p[2][1], p[3][1]);
+			loaded._z[i] = _mm_setr_ps(p[0][2], p[1][2], p[2][2], p[3][2]);
+			loaded._w[i] = _mm_setr_ps(p[0][3], p[1][3], p[2][3], p[3][3]);
+			loaded._abs_x[i] = _mm_andnot_ps(sign, loaded._x[i]);
+			loaded._abs_y[i] = _mm_andnot_ps(sign, loaded._y[i]);
+			loaded._abs_z[i] = _mm_andnot_ps(sign, loaded._z[i]);
+		}
+
+		return loaded;
+	}
+
+	// The distance from each plane to the center of the bounds against how far the bounds reach towards it
+	sp_bvh_cull_result sp_bvh_cull_bounds(const sp_bvh_planes& planes, const sp_bvh_bounds& bounds)
+	{
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 center_x = _mm_set1_ps((bounds._min[0] + bounds._max[0]) * 0.5f);
+		const __m128 center_y = _mm_set1_ps((bounds._min[1] + bounds._max[1]) * 0.5f);
+		const __m128 center_z = _mm_set1_ps((bounds._min[2] + bounds._max[2]) * 0.5f);
+		const __m128 extent_x = _mm_mul_ps(_mm_set1_ps(bounds._max[0] - bounds._min[0]), half);
+		const __m128 extent_y = _mm_mul_ps(_mm_set1_ps(bounds._max[1] - bounds._min[1]), half);
+		const __m128 extent_z = _mm_mul_ps(_mm_set1_ps(bounds._max[2] - bounds._min[2]), half);
+
+		__m128 outside = _mm_setzero_ps();
+		__m128 intersecting = _mm_setzero_ps();
+		for (int i = 0; i < 2; ++i)
+		{
+			const __m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(planes._x[i], center_x), _mm_mul_ps(planes._y[i], center_y)),
+				_mm_add_ps(_mm_mul_ps(planes._z[i], center_z), planes._w[i]));
+			const __m128 reach = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(planes._abs_x[i], extent_x), _mm_mul_ps(planes._abs_y[i], extent_y)),
+				_mm_mul_ps(planes._abs_z[i], extent_z));
+
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+			intersecting = _mm_or_ps(intersecting, _mm_cmplt_ps(_mm_sub_ps(distance, reach), _mm_setzero_ps()));
+		}
+
+		if (_mm_movemask_ps(outside))
+		{
+			return sp_bvh_cull_result::outside;
+		}
+
+		return _mm_movemask_ps(intersecting) ? sp_bvh_cull_result::intersecting : sp_bvh_cull_result::inside;
+	}
+
+	// Where the ray enters the bounds, or FLT_MAX if it misses them before t_max
+	float sp_bvh_ray_enter(const sp_bvh_bounds& bounds, const float (&origin)[3], const float (&direction)[3], const float (&direction_inverse)[3], float t_max)
+	{
+		float t_enter = 0.0f;
+		float t_exit = t_max;
+		for (int k = 0; k < 3; ++k)
+		{
+			if (direction[k] == 0.0f)
+			{
+				if (origin[k] < bounds._min[k] || origin[k] > bounds._max[k])
+				{
+					return FLT_MAX;
+				}
+				continue;
+			}
+
+			const float t_0 = (bounds._min[k] - origin[k]) * direction_inverse[k];
+			const float t_1 = (bounds._max[k] - origin[k]) * direction_inverse[k];
+			t_enter = std::max(t_enter, std::min(t_0, t_1));
+			t_exit = std::min(t_exit, std::max(t_0, t_1));
+		}
+
+		return t_enter <= t_exit ? t_enter : FLT_MAX;
+	}
+}
+
+void sp_bvh_build(sp_bvh& bvh, const sp_bvh_bounds* object_bounds, int object_count, const sp_bvh_desc& desc)
+{
+	assert(desc.leaf_object_count_max >= 1);
+	assert(desc.bin_count >= 2 && desc.bin_count <= k_bvh_bin_count_max);
+
+	bvh._nodes.clear();
+	bvh._objects.resize(object_count);
+	std::iota(bvh._objects.begin(), bvh._objects.end(), 0);
+	bvh._object_bounds.clear();
+
+	if (object_count == 0)
+	{
+		return;
+	}
+
+	std::vector<float> centers(object_count * 3);
+	for (int i = 0; i < object_count; ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			centers[i * 3 + k] = (object_bounds[i]._min[k] + object_bounds[i]._max[k]) * 0.5f;
+		}
+	}
+
+	// A binary tree with at least one object per leaf has fewer than twice as many nodes as objects, so node references stay valid
+	bvh._nodes.reserve(object_count * 2);
+
+	sp_bvh_node root;
+	root._object_count = object_count;
+	bvh._nodes.push_back(root);
+
+	// Only splits here, the bounds are fitted bottom up at the end
+	std::vector<uint32_t> stack = { 0 };
+	while (!stack.empty())
+	{
+		sp_bvh_node& node = bvh._nodes[stack.back()];
+		stack.pop_back();
+
+		if (node._object_count <= static_cast<uint32_t>(desc.leaf_object_count_max))
+		{
+			continue;
+		}
+
+		uint32_t* const objects = bvh._objects.data() + node._first_object;
+
+		sp_bvh_bounds center_bounds = detail::sp_bvh_bounds_empty();
+		for (uint32_t i = 0; i < node._object_count; ++i)
+		{
+			const float* center = &centers[objects[i] * 3];
+			detail::sp_bvh_bounds_grow(center_bounds, { { center[0], center[1], center[2] }, { center[0], center[1], center[2] } });
+		}
+
+		int split_axis = -1;
+		int split_bin = 0;
+		float split_cost = FLT_MAX;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float extent = center_bounds._max[axis] - center_bounds._min[axis];
+			if (extent <= 0.0f)
+			{
+				continue;
+			}
+
+			const float scale = desc.bin_count / extent;
+
+			detail::sp_bvh_bin bins[k_bvh_bin_count_max];
+			for (int b = 0; b < desc.bin_count; ++b)
+			{
+				bins[b]._bounds = detail::sp_bvh_bounds_empty();
+			}
+
+			for (uint32_t i = 0; i < node._object_count; ++i)
+			{
+				const int b = std::min(static_cast<int>((centers[objects[i] * 3 + axis] - center_bounds._min[axis]) * scale), desc.bin_count - 1);
+				bins[b]._object_count++;
+				detail::sp_bvh_bounds_grow(bins[b]._bounds, object_bounds[objects[i]]);
+			}
+
+			// Everything below bin b on the left, the left side's cost swept up and the right side's added sweeping down
+			float left_cost[k_bvh_bin_count_max];
+			sp_bvh_bounds left_bounds = detail::sp_bvh_bounds_empty();
+			uint32_t left_count = 0;
+			for (int b = 1; b < desc.bin_count; ++b)
+			{
+				detail::sp_bvh_bounds_grow(left_bounds, bins[b - 1]._bounds);
+				left_count += bins[b - 1]._object_count;
+				left_cost[b] = left_count > 0 ? detail::sp_bvh_bounds_area(left_bounds) * left_count : -1.0f;
+			}
+
+			sp_bvh_bounds right_bounds = detail::sp_bvh_bounds_empty();
+			uint32_t right_count = 0;
+			for (int b = desc.bin_count - 1; b > 0; --b)
+			{
+				detail::sp_bvh_bounds_grow(right_bounds, bins[b]._bounds);
+				right_count += bins[b]._object_count;
+
+				if (right_count == 0 || left_cost[b] < 0.0f)
+				{
+					continue;
+				}
+
+				const float cost = left_cost[b] + detail::sp_bvh_bounds_area(right_bounds) * right_count;
+				if (cost < split_cost)
+				{
+					split_axis = axis;
+					split_bin = b;
+					split_cost = cost;
+				}
+			}
+		}
+
+		// Every center is in the same place if there's no split, so any half is as good as another
+		uint32_t left_object_count = node._object_count / 2;
+		if (split_axis >= 0)
+		{
+			const float min = center_bounds._min[split_axis];
+			const float scale = desc.bin_count / (center_bounds._max[split_axis] - min);
+			uint32_t* const middle = std::partition(objects, objects + node._object_count, [&](uint32_t object) {
+				return std::min(static_cast<int>((centers[object * 3 + split_axis] - min) * scale), desc.bin_count - 1) < split_bin;
+			});
+			left_object_count = static_cast<uint32_t>(middle - objects);
+		}
+
+		sp_bvh_node left;
+		left._first_object = node._first_object;
+		left._object_count = left_object_count;
+
+		sp_bvh_node right;
+		right._first_object = node._first_object + left_object_count;
+		right._object_count = node._object_count - left_object_count;
+
+		node._left_child = static_cast<uint32_t>(bvh._nodes.size());
+		stack.push_back(node._left_child);
+		stack.push_back(node._left_child + 1);
+		bvh._nodes.push_back(left);
+		bvh._nodes.push_back(right);
+	}
+
+	bvh._object_bounds.resize(object_count);
+	sp_bvh_refit(bvh, object_bounds);
+}
+
+void sp_bvh_refit(sp_bvh& bvh, const sp_bvh_bounds* object_bounds)
+{
+	for (size_t i = 0; i < bvh._objects.size(); ++i)
+	{
+		bvh._object_bounds[i] = object_bounds[bvh._objects[i]];
+	}
+
+	for (size_t i = bvh._nodes.size(); i-- > 0;)
+	{
+		sp_bvh_node& node = bvh._nodes[i];
+		if (node._left_child)
+		{
+			node._bounds = bvh._nodes[node._left_child]._bounds;
+			detail::sp_bvh_bounds_grow(node._bounds, bvh._nodes[node._left_child + 1]._bounds);
+		}
+		else
+		{
+			node._bounds = detail::sp_bvh_bounds_empty();
+			for (uint32_t j = 0; j < node._object_count; ++j)
+			{
+				detail::sp_bvh_bounds_grow(node._bounds, bvh._object_bounds[node._first_object + j]);
+			}
+		}
+	}
+}
+
+float sp_bvh_cost(const sp_bvh& bvh)
+{
+	if (bvh._nodes.empty())
+	{
+		return 0.0f;
+	}
+
+	const float root_area = detail::sp_bvh_bounds_area(bvh._nodes[0]._bounds);
+	if (root_area <= 0.0f)
+	{
+		return static_cast<float>(bvh._objects.size());
+	}
+
+	double cost = 0.0;
+	for (const sp_bvh_node& node : bvh._nodes)
+	{
+		cost += detail::sp_bvh_bounds_area(node._bounds) * (node._left_child ? detail::k_bvh_node_cost : static_cast<float>(node._object_count));
+	}
+
+	return static_cast<float>(cost / root_area);
+}
+
+void sp_bvh_cull_frustum(const sp_bvh& bvh, const float (&planes)[6][4], std::vector<uint32_t>& visible)
+{
+	visible.clear();
+
+	if (bvh._nodes.empty())
+	{
+		return;
+	}
+
+	const detail::sp_bvh_planes loaded_planes = detail::sp_bvh_planes_load(planes);
+
+	std::vector<uint32_t> stack = { 0 };
+	while (!stack.empty())
+	{
+		const sp_bvh_node& node = bvh._nodes[stack.back()];
+		stack.pop_back();
+
+		const detail::sp_bvh_cull_result result = detail::sp_bvh_cull_bounds(loaded_planes, node._bounds);
+		if (result == detail::sp_bvh_cull_result::outside)
+		{
+			continue;
+		}
+
+		if (result == detail::sp_bvh_cull_result::inside)
+		{
+			visible.insert(visible.end(), bvh._objects.begin() + node._first_object, bvh._objects.begin() + node._first_object + node._object_count);
+		}
+		else if (node._left_child)
+		{
+			// Right first so the left comes off the stack first and objects come out in leaf order
+			stack.push_back(node._left_child + 1);
+			stack.push_back(node._left_child);
+		}
+		else
+		{
+			for (uint32_t i = node._first_object; i < node._first_object + node._object_count; ++i)
+			{
+				if (detail::sp_bvh_cull_bounds(loaded_planes, bvh._object_bounds[i]) != detail::sp_bvh_cull_result::outside)
+				{
+					visible.push_back(bvh._objects[i]);
+				}
+			}
+		}
+	}
+}
+
+bool sp_bvh_raycast(const sp_bvh& bvh, const float (&origin)[3], const float (&direction)[3], float t_max, uint32_t* object, float* t)
+{
+	if (bvh._nodes.empty())
+	{
+		return false;
+	}
+
+	float direction_inverse[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		direction_inverse[k] = direction[k] != 0.0f ? 1.0f / direction[k] : 0.0f;
+	}
+
+	float t_nearest = t_max;
+	uint32_t nearest_object = 0;
+	bool hit = false;
+
+	// Nodes with where the ray enters them, so ones entered past the nearest hit so far can be skipped when they come off
+	std::vector<std::pair<uint32_t, float>> stack;
+
+	const float t_root = detail::sp_bvh_ray_enter(bvh._nodes[0]._bounds, origin, direction, direction_inverse, t_nearest);
+	if (t_root != FLT_MAX)
+	{
+		stack.push_back({ 0, t_root });
+	}
+
+	while (!stack.empty())
+	{
+		const std::pair<uint32_t, float> entry = stack.back();
+		stack.pop_back();
+
+		if (entry.second > t_nearest)
+		{
+			continue;
+		}
+
+		const sp_bvh_node& node = bvh._nodes[entry.first];
+		if (node._left_child)
+		{
+			std::pair<uint32_t, float> near = { node._left_child, detail::sp_bvh_ray_enter(bvh._nodes[node._left_child]._bounds, origin, direction, direction_inverse, t_nearest) };
+			std::pair<uint32_t, float> far = { node._left_child + 1, detail::sp_bvh_ray_enter(bvh._nodes[node._left_child + 1]._bounds, origin, direction, direction_inverse, t_nearest) };
+			if (far.second < near.second)
+			{
+				std::swap(near, far);
+			}
+
+			// The nearer child goes on last so it's searched first and the nearest hit shrinks as soon as it can
+			if (far.second != FLT_MAX)
+			{
+				stack.push_back(far);
+			}
+			if (near.second != FLT_MAX)
+			{
+				stack.push_back(near);
+			}
+		}
+		else
+		{
+			for (uint32_t i = node._first_object; i < node._first_object + node._object_count; ++i)
+			{
+				const float t_object = detail::sp_bvh_ray_enter(bvh._object_bounds[i], origin, direction, direction_inverse, t_nearest);
+				if (t_object != FLT_MAX && (!hit || t_object < t_nearest))
+				{
+					t_nearest = t_object;
+					nearest_object = bvh._objects[i];
+					hit = true;
+				}
+			}
+		}
+	}
+
+	if (hit)
+	{
+		*object = nearest_object;
+		*t = t_nearest;
+	}
+
+	return hit;
+}
\ No newline at end of file
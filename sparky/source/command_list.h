@@ -13,6 +13,8 @@
 struct sp_descriptor_heap;
 
 using sp_vertex_buffer_handle = sp_handle;
+using sp_index_buffer_handle = sp_handle;
+using sp_buffer_handle = sp_handle;
 using sp_texture_handle = sp_handle;
 using sp_graphics_pipeline_state_handle = sp_handle;
 using sp_compute_pipeline_state_handle = sp_handle;
@@ -27,6 +29,45 @@ struct sp_compute_command_list_desc
 	sp_compute_pipeline_state_handle pipeline_state_handle;
 };
 
+enum class sp_render_pass_load_action
+{
+	load,			// Keep whatever the attachment already contains
+	clear,			// Clear to the texture's optimized clear value
+	dont_care,		// Contents are undefined. Use when every pixel is about to be overwritten anyway.
+};
+
+enum class sp_render_pass_store_action
+{
+	store,
+	discard,		// Nothing reads the attachment after the pass
+};
+
+// For transitions recorded by hand, of resources the frame graph doesn't know about or uses it doesn't track
+enum class sp_resource_state
+{
+	none,					// Where it is between command lists, its default state for textures and common for buffers
+	vertex_buffer,
+	indirect_argument,
+	shader_resource,		// From any stage
+	unordered_access,
+	copy_source,
+	copy_dest,
+};
+
+struct sp_render_pass_attachment
+{
+	sp_texture_handle texture_handle;
+	sp_render_pass_load_action load_action = sp_render_pass_load_action::clear;
+	sp_render_pass_store_action store_action = sp_render_pass_store_action::store;
+};
+
+struct sp_render_pass_desc
+{
+	sp_render_pass_attachment render_targets[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+	int render_target_count = 0;
+	sp_render_pass_attachment depth_stencil;
+};
+
 struct sp_graphics_command_list
 {
 	const char* _name;
@@ -42,6 +83,10 @@ struct sp_graphics_command_list
 
 	D3D12_RESOURCE_BARRIER _resource_transition_records[64];
 	int _resource_transition_records_count = 0;
+
+	// Store actions are applied when the pass ends
+	sp_render_pass_desc _render_pass;
+	bool _render_pass_active = false;
 };
 
 struct sp_compute_command_list
@@ -72,7 +117,10 @@ struct sp_scissor_rect
 sp_graphics_command_list sp_graphics_command_list_create(const char* name, const sp_graphics_command_list_desc& desc);
 void sp_graphics_command_list_begin(sp_graphics_command_list& command_list);
 void sp_graphics_command_list_set_vertex_buffers(sp_graphics_command_list& command_list, const sp_vertex_buffer_handle* vertex_buffer_handles, int vertex_buffer_count);
+void sp_graphics_command_list_set_index_buffer(sp_graphics_command_list& command_list, const sp_index_buffer_handle& index_buffer_handle);
 void sp_graphics_command_list_set_render_targets(sp_graphics_command_list& command_list, const sp_texture_handle* render_target_handles, int render_target_count, sp_texture_handle depth_stencil_handle);
+void sp_graphics_command_list_begin_render_pass(sp_graphics_command_list& command_list, const sp_render_pass_desc& render_pass);
+void sp_graphics_command_list_end_render_pass(sp_graphics_command_list& command_list);
 void sp_graphics_command_list_close(sp_graphics_command_list& command_list);
 void sp_graphics_command_list_set_viewport(sp_graphics_command_list& command_list, const sp_viewport& viewport);
 void sp_graphics_command_list_set_scissor_rect(sp_graphics_command_list& command_list, const sp_scissor_rect& scissor);
@@ -81,8 +129,28 @@ void sp_graphics_command_list_clear_depth_stencil(sp_graphics_command_list& comm
 void sp_graphics_command_list_clear_depth(sp_graphics_command_list& command_list, sp_texture_handle depth_stencil_handle);
 void sp_graphics_command_list_clear_stencil(sp_graphics_command_list& command_list, sp_texture_handle depth_stencil_handle);
 void sp_graphics_command_list_draw_instanced(sp_graphics_command_list& command_list, int vertex_count, int instance_count);
+// base_vertex is added to every index before it reads the vertex buffer and first_instance to the instance index before it reads
+// per instance data
+void sp_graphics_command_list_draw_indexed_instanced(sp_graphics_command_list& command_list, int index_count, int instance_count, int first_index, int base_vertex, int first_instance);
+// Draws draw_count sets of sp_indirect_draw_args read from the buffer starting at offset_bytes, with the vertex and index buffers
+// and descriptor tables that are bound. The buffer has to be in sp_resource_state::indirect_argument.
+void sp_graphics_command_list_draw_indexed_indirect(sp_graphics_command_list& command_list, const sp_buffer_handle& argument_buffer_handle, int offset_bytes, int draw_count);
 void sp_graphics_command_list_set_pipeline_state(sp_graphics_command_list& command_list, const sp_graphics_pipeline_state_handle& pipeline_state_handle);
 void sp_graphics_command_list_set_descriptor_table(sp_graphics_command_list& command_list, int root_parameter_index, const sp_descriptor_table& table);
+// Binds the buffer to one vertex buffer slot, leaving the others as they are. The buffer has to be in sp_resource_state::vertex_buffer.
+void sp_graphics_command_list_set_buffer_as_vertex_buffer(sp_graphics_command_list& command_list, int slot, const sp_buffer_handle& buffer_handle);
+// Compute work that has to happen in order with the draws around it, e.g. culling that writes the arguments of the draws after
+// it. Replaces the graphics pipeline state so set it again before drawing.
+void sp_graphics_command_list_set_compute_pipeline_state(sp_graphics_command_list& command_list, const sp_compute_pipeline_state_handle& pipeline_state_handle);
+void sp_graphics_command_list_set_compute_descriptor_table(sp_graphics_command_list& command_list, int root_parameter_index, const sp_descriptor_table& table);
+void sp_graphics_command_list_dispatch(sp_graphics_command_list& command_list, int thread_group_count_x, int thread_group_count_y, int thread_group_count_z);
+void sp_graphics_command_list_transition_buffer(sp_graphics_command_list& command_list, const sp_buffer_handle& buffer_handle, sp_resource_state state_before, sp_resource_state state_after);
+void sp_graphics_command_list_transition_texture(sp_graphics_command_list& command_list, const sp_texture_handle& texture_handle, sp_resource_state state_before, sp_resource_state state_after);
+// Waits for every write to the buffer before it to finish before anything after it reads or writes it
+void sp_graphics_command_list_unordered_access_barrier(sp_graphics_command_list& command_list, const sp_buffer_handle& buffer_handle);
+// The whole of source, which has to be in sp_resource_state::copy_source, to the start of destination, in sp_resource_state::copy_dest
+// unless it's a readback buffer, which always is
+void sp_graphics_command_list_copy_buffer(sp_graphics_command_list& command_list, const sp_buffer_handle& destination_handle, const sp_buffer_handle& source_handle);
 void sp_graphics_command_list_debug_group_push(sp_graphics_command_list& command_list, const char* format, ...);
 void sp_graphics_command_list_debug_group_pop(sp_graphics_command_list& command_list);
 void sp_graphics_command_list_end(sp_graphics_command_list& command_list);
@@ -95,4 +163,13 @@ void sp_compute_command_list_set_descriptor_table(sp_compute_command_list& comma
 void sp_compute_command_list_debug_group_push(sp_compute_command_list& command_list, const char* format, ...);
 void sp_compute_command_list_debug_group_pop(sp_compute_command_list& command_list);
 void sp_compute_command_list_dispatch(sp_compute_command_list& command_list, int thread_group_count_x, int thread_group_count_y, int thread_group_count_z);
-void sp_compute_command_list_end(sp_compute_command_list& command_list);
\ No newline at end of file
+void sp_compute_command_list_end(sp_compute_command_list& command_list);
+
+namespace detail
+{
+	// For the frame graph, which records the transitions of the attachments itself and hands the command list the ones that put
+	// them back in their default state
+	void sp_graphics_command_list_set_render_targets(sp_graphics_command_list& command_list, const sp_texture_handle* render_target_handles, int render_target_count, sp_texture_handle depth_stencil_handle, bool transition_attachments);
+	void sp_graphics_command_list_begin_render_pass(sp_graphics_command_list& command_list, const sp_render_pass_desc& render_pass, bool transition_attachments);
+	void sp_graphics_command_list_restore_default_resource_states(sp_graphics_command_list& command_list);
+}
\ No newline at end of file
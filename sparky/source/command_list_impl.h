@@ -2,6 +2,8 @@
 
 #include "command_list.h"
 #include "vertex_buffer.h"
+#include "index_buffer.h"
+#include "buffer.h"
 #include "pipeline.h"
 
 #include "d3dx12.h"
@@ -126,57 +128,149 @@ void sp_graphics_command_list_set_vertex_buffers(sp_graphics_command_list& comma
 	command_list._command_list_d3d12->IASetVertexBuffers(0, vertex_buffer_count, vertex_buffer_views);
 }
 
-void sp_graphics_command_list_set_render_targets(sp_graphics_command_list& command_list, const sp_texture_handle* render_target_handles, int render_target_count, sp_texture_handle depth_stencil_handle)
+void sp_graphics_command_list_set_index_buffer(sp_graphics_command_list& command_list, const sp_index_buffer_handle& index_buffer_handle)
 {
-	detail::sp_graphics_command_list_restore_default_resource_states(command_list);
+	const sp_index_buffer& buffer = detail::sp_index_buffer_pool_get(index_buffer_handle);
 
-	D3D12_CPU_DESCRIPTOR_HANDLE render_target_views[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
+	command_list._command_list_d3d12->IASetIndexBuffer(&buffer._index_buffer_view);
+}
 
-	for (int i = 0; i < render_target_count; ++i)
+namespace detail
+{
+	void sp_graphics_command_list_set_render_targets(sp_graphics_command_list& command_list, const sp_texture_handle* render_target_handles, int render_target_count, sp_texture_handle depth_stencil_handle, bool transition_attachments)
 	{
-		const sp_texture& texture = detail::sp_texture_pool_get(render_target_handles[i]);
+		sp_graphics_command_list_restore_default_resource_states(command_list);
+
+		D3D12_CPU_DESCRIPTOR_HANDLE render_target_views[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
+
+		for (int i = 0; i < render_target_count; ++i)
+		{
+			const sp_texture& texture = sp_texture_pool_get(render_target_handles[i]);
+
+			render_target_views[i] = texture._render_target_view._handle_cpu_d3d12;
+		}
+
+		const D3D12_CPU_DESCRIPTOR_HANDLE* depth_stencil_view = depth_stencil_handle ? &sp_texture_pool_get(depth_stencil_handle)._depth_stencil_view._handle_cpu_d3d12 : nullptr;
+
+		if (transition_attachments)
+		{
+			// XXX: How do I track previous state? I can't put it on the resource itself because we might be touching it from multiple threads.
+			// So put it on the command list? But those can be recorded in any order. Right now I just assume everything is in default state 
+			// and transition from there. The command list records any transitions from the default state and we restore them before any new
+			// ones. This means some wasted transitions but maybe we don't care. Next would probably be a frame graph?
+			D3D12_RESOURCE_BARRIER render_target_transitions[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT + 1];
+
+			for (int i = 0; i < render_target_count; ++i)
+			{
+				const sp_texture& texture = sp_texture_pool_get(render_target_handles[i]);
 
-		render_target_views[i] = texture._render_target_view._handle_cpu_d3d12;
+				render_target_transitions[i] = CD3DX12_RESOURCE_BARRIER::Transition(texture._resource.Get(), texture._default_state, D3D12_RESOURCE_STATE_RENDER_TARGET);
+			}
+
+			int set_render_target_transitions_count = render_target_count;
+
+			if (depth_stencil_handle)
+			{
+				const sp_texture& texture = sp_texture_pool_get(depth_stencil_handle);
+
+				render_target_transitions[set_render_target_transitions_count] = CD3DX12_RESOURCE_BARRIER::Transition(texture._resource.Get(), texture._default_state, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+				++set_render_target_transitions_count;
+			}
+
+			memcpy(&command_list._resource_transition_records, render_target_transitions, set_render_target_transitions_count * sizeof(D3D12_RESOURCE_BARRIER));
+			command_list._resource_transition_records_count = set_render_target_transitions_count;
+
+			command_list._command_list_d3d12->ResourceBarrier(set_render_target_transitions_count, &render_target_transitions[0]);
+		}
+
+		command_list._command_list_d3d12->OMSetRenderTargets(
+			render_target_count,
+			render_target_views,
+			false,
+			depth_stencil_view);
 	}
+}
 
-	// XXX: How do I track previous state? I can't put it on the resource itself because we might be touching it from multiple threads.
-	// So put it on the command list? But those can be recorded in any order. Right now I just assume everything is in default state 
-	// and transition from there. The command list records any transitions from the default state and we restore them before any new
-	// ones. This means some wasted transitions but maybe we don't care. Next would probably be a frame graph?
-	D3D12_RESOURCE_BARRIER render_target_transitions[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT + 1];
+void sp_graphics_command_list_set_render_targets(sp_graphics_command_list& command_list, const sp_texture_handle* render_target_handles, int render_target_count, sp_texture_handle depth_stencil_handle)
+{
+	detail::sp_graphics_command_list_set_render_targets(command_list, render_target_handles, render_target_count, depth_stencil_handle, true);
+}
 
-	for (int i = 0; i < render_target_count; ++i)
+namespace detail
+{
+	// Load actions are applied after the attachments have been transitioned. The attachments stay bound after the pass ends so
+	// anything recorded afterwards (e.g. the debug gui) still draws into them.
+	void sp_graphics_command_list_begin_render_pass(sp_graphics_command_list& command_list, const sp_render_pass_desc& render_pass, bool transition_attachments)
 	{
-		const sp_texture& texture = detail::sp_texture_pool_get(render_target_handles[i]);
+		assert(!command_list._render_pass_active && "render passes can't be nested");
 
-		render_target_transitions[i] = CD3DX12_RESOURCE_BARRIER::Transition(texture._resource.Get(), texture._default_state, D3D12_RESOURCE_STATE_RENDER_TARGET);
-	}
+		sp_texture_handle render_target_handles[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+		for (int i = 0; i < render_pass.render_target_count; ++i)
+		{
+			render_target_handles[i] = render_pass.render_targets[i].texture_handle;
+		}
 
-	int set_render_target_transitions_count = render_target_count;
+		sp_graphics_command_list_set_render_targets(command_list, render_target_handles, render_pass.render_target_count, render_pass.depth_stencil.texture_handle, transition_attachments);
 
-	const D3D12_CPU_DESCRIPTOR_HANDLE* depth_stencil_view = nullptr;
+		for (int i = 0; i < render_pass.render_target_count; ++i)
+		{
+			const sp_render_pass_attachment& attachment = render_pass.render_targets[i];
 
-	if (depth_stencil_handle)
-	{
-		const sp_texture& texture = detail::sp_texture_pool_get(depth_stencil_handle);
+			if (attachment.load_action == sp_render_pass_load_action::clear)
+			{
+				sp_graphics_command_list_clear_render_target(command_list, attachment.texture_handle);
+			}
+			else if (attachment.load_action == sp_render_pass_load_action::dont_care)
+			{
+				command_list._command_list_d3d12->DiscardResource(sp_texture_pool_get(attachment.texture_handle)._resource.Get(), nullptr);
+			}
+		}
 
-		render_target_transitions[set_render_target_transitions_count] = CD3DX12_RESOURCE_BARRIER::Transition(texture._resource.Get(), texture._default_state, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+		if (render_pass.depth_stencil.texture_handle)
+		{
+			const sp_render_pass_attachment& attachment = render_pass.depth_stencil;
 
-		++set_render_target_transitions_count;
+			if (attachment.load_action == sp_render_pass_load_action::clear)
+			{
+				sp_graphics_command_list_clear_depth(command_list, attachment.texture_handle);
+			}
+			else if (attachment.load_action == sp_render_pass_load_action::dont_care)
+			{
+				command_list._command_list_d3d12->DiscardResource(sp_texture_pool_get(attachment.texture_handle)._resource.Get(), nullptr);
+			}
+		}
 
-		depth_stencil_view = &texture._depth_stencil_view._handle_cpu_d3d12;
+		command_list._render_pass = render_pass;
+		command_list._render_pass_active = true;
 	}
+}
+
+void sp_graphics_command_list_begin_render_pass(sp_graphics_command_list& command_list, const sp_render_pass_desc& render_pass)
+{
+	detail::sp_graphics_command_list_begin_render_pass(command_list, render_pass, true);
+}
+
+void sp_graphics_command_list_end_render_pass(sp_graphics_command_list& command_list)
+{
+	assert(command_list._render_pass_active);
 
-	memcpy(&command_list._resource_transition_records, render_target_transitions, set_render_target_transitions_count * sizeof(D3D12_RESOURCE_BARRIER));
-	command_list._resource_transition_records_count = set_render_target_transitions_count;
+	const sp_render_pass_desc& render_pass = command_list._render_pass;
+
+	for (int i = 0; i < render_pass.render_target_count; ++i)
+	{
+		if (render_pass.render_targets[i].store_action == sp_render_pass_store_action::discard)
+		{
+			command_list._command_list_d3d12->DiscardResource(detail::sp_texture_pool_get(render_pass.render_targets[i].texture_handle)._resource.Get(), nullptr);
+		}
+	}
 
-	command_list._command_list_d3d12->ResourceBarrier(set_render_target_transitions_count, &render_target_transitions[0]);
+	if (render_pass.depth_stencil.texture_handle && render_pass.depth_stencil.store_action == sp_render_pass_store_action::discard)
+	{
+		command_list._command_list_d3d12->DiscardResource(detail::sp_texture_pool_get(render_pass.depth_stencil.texture_handle)._resource.Get(), nullptr);
+	}
 
-	command_list._command_list_d3d12->OMSetRenderTargets(
-		render_target_count,
-		render_target_views,
-		false,
-		depth_stencil_view);
+	command_list._render_pass_active = false;
 }
 
 void sp_graphics_command_list_set_viewport(sp_graphics_command_list& command_list, const sp_viewport& viewport)
@@ -246,6 +340,20 @@ void sp_graphics_command_list_draw_instanced(sp_graphics_command_list& command_l
 	command_list._command_list_d3d12->DrawInstanced(vertex_count, instance_count, 0, 0);
 }
 
+void sp_graphics_command_list_draw_indexed_instanced(sp_graphics_command_list& command_list, int index_count, int instance_count, int first_index, int base_vertex, int first_instance)
+{
+	command_list._command_list_d3d12->DrawIndexedInstanced(index_count, instance_count, first_index, base_vertex, first_instance);
+}
+
+void sp_graphics_command_list_draw_indexed_indirect(sp_graphics_command_list& command_list, const sp_buffer_handle& argument_buffer_handle, int offset_bytes, int draw_count)
+{
+	const sp_buffer& buffer = detail::sp_buffer_pool_get(argument_buffer_handle);
+
+	assert(offset_bytes + draw_count * static_cast<int>(sizeof(D3D12_DRAW_INDEXED_ARGUMENTS)) <= buffer._size_in_bytes);
+
+	command_list._command_list_d3d12->ExecuteIndirect(detail::_sp._command_signature_draw_indexed.Get(), draw_count, buffer._resource.Get(), offset_bytes, nullptr, 0);
+}
+
 void sp_graphics_command_list_set_pipeline_state(sp_graphics_command_list& command_list, const sp_graphics_pipeline_state_handle& pipeline_state_handle)
 {
 	const sp_graphics_pipeline_state& pipeline_state = detail::sp_graphics_pipeline_state_pool_get(pipeline_state_handle);
@@ -259,6 +367,94 @@ void sp_graphics_command_list_set_descriptor_table(sp_graphics_command_list& com
 	command_list._command_list_d3d12->SetGraphicsRootDescriptorTable(root_parameter_index, table._descriptor._handle_gpu_d3d12);
 }
 
+void sp_graphics_command_list_set_buffer_as_vertex_buffer(sp_graphics_command_list& command_list, int slot, const sp_buffer_handle& buffer_handle)
+{
+	const sp_buffer& buffer = detail::sp_buffer_pool_get(buffer_handle);
+
+	command_list._command_list_d3d12->IASetVertexBuffers(slot, 1, &buffer._vertex_buffer_view);
+}
+
+void sp_graphics_command_list_set_compute_pipeline_state(sp_graphics_command_list& command_list, const sp_compute_pipeline_state_handle& pipeline_state_handle)
+{
+	// Compute has its own root signature binding, tables bound for drawing don't carry over
+	command_list._command_list_d3d12->SetComputeRootSignature(detail::_sp._root_signature.Get());
+	command_list._command_list_d3d12->SetPipelineState(detail::sp_compute_pipeline_state_pool_get(pipeline_state_handle)._impl.Get());
+}
+
+void sp_graphics_command_list_set_compute_descriptor_table(sp_graphics_command_list& command_list, int root_parameter_index, const sp_descriptor_table& table)
+{
+	command_list._command_list_d3d12->SetComputeRootDescriptorTable(root_parameter_index, table._descriptor._handle_gpu_d3d12);
+}
+
+void sp_graphics_command_list_dispatch(sp_graphics_command_list& command_list, int thread_group_count_x, int thread_group_count_y, int thread_group_count_z)
+{
+	command_list._command_list_d3d12->Dispatch(thread_group_count_x, thread_group_count_y, thread_group_count_z);
+}
+
+namespace detail
+{
+	D3D12_RESOURCE_STATES sp_resource_state_get_d3d12(sp_resource_state state, D3D12_RESOURCE_STATES default_state)
+	{
+		switch (state)
+		{
+		case sp_resource_state::none: return default_state;
+		case sp_resource_state::vertex_buffer: return D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
+		case sp_resource_state::indirect_argument: return D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT;
+		case sp_resource_state::shader_resource: return D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+		case sp_resource_state::unordered_access: return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		case sp_resource_state::copy_source: return D3D12_RESOURCE_STATE_COPY_SOURCE;
+		case sp_resource_state::copy_dest: return D3D12_RESOURCE_STATE_COPY_DEST;
+		default:
+			assert(false);
+			return default_state;
+		}
+	}
+}
+
+void sp_graphics_command_list_transition_buffer(sp_graphics_command_list& command_list, const sp_buffer_handle& buffer_handle, sp_resource_state state_before, sp_resource_state state_after)
+{
+	const sp_buffer& buffer = detail::sp_buffer_pool_get(buffer_handle);
+
+	// Readback buffers can only ever be copied into so they're never transitioned
+	assert(!buffer._readback);
+
+	const auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+		buffer._resource.Get(),
+		detail::sp_resource_state_get_d3d12(state_before, D3D12_RESOURCE_STATE_COMMON),
+		detail::sp_resource_state_get_d3d12(state_after, D3D12_RESOURCE_STATE_COMMON));
+	command_list._command_list_d3d12->ResourceBarrier(1, &barrier);
+}
+
+void sp_graphics_command_list_transition_texture(sp_graphics_command_list& command_list, const sp_texture_handle& texture_handle, sp_resource_state state_before, sp_resource_state state_after)
+{
+	// Render targets and depth stencils are only put back in their default state when the next ones are set
+	detail::sp_graphics_command_list_restore_default_resource_states(command_list);
+
+	const sp_texture& texture = detail::sp_texture_pool_get(texture_handle);
+
+	const auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+		texture._resource.Get(),
+		detail::sp_resource_state_get_d3d12(state_before, texture._default_state),
+		detail::sp_resource_state_get_d3d12(state_after, texture._default_state));
+	command_list._command_list_d3d12->ResourceBarrier(1, &barrier);
+}
+
+void sp_graphics_command_list_unordered_access_barrier(sp_graphics_command_list& command_list, const sp_buffer_handle& buffer_handle)
+{
+	const auto barrier = CD3DX12_RESOURCE_BARRIER::UAV(detail::sp_buffer_pool_get(buffer_handle)._resource.Get());
+	command_list._command_list_d3d12->ResourceBarrier(1, &barrier);
+}
+
+void sp_graphics_command_list_copy_buffer(sp_graphics_command_list& command_list, const sp_buffer_handle& destination_handle, const sp_buffer_handle& source_handle)
+{
+	const sp_buffer& destination = detail::sp_buffer_pool_get(destination_handle);
+	const sp_buffer& source = detail::sp_buffer_pool_get(source_handle);
+
+	assert(source._size_in_bytes <= destination._size_in_bytes);
+
+	command_list._command_list_d3d12->CopyBufferRegion(destination._resource.Get(), 0, source._resource.Get(), 0, source._size_in_bytes);
+}
+
 void sp_graphics_command_list_debug_group_push(sp_graphics_command_list& command_list, const char* format, ...)
 {
 	char buf[1024];
@@ -278,6 +474,8 @@ void sp_graphics_command_list_debug_group_pop(sp_graphics_command_list& command_
 
 void sp_graphics_command_list_end(sp_graphics_command_list& command_list)
 {
+	assert(!command_list._render_pass_active && "missing sp_graphics_command_list_end_render_pass");
+
 	detail::sp_graphics_command_list_restore_default_resource_states(command_list);
 
 	HRESULT hr = command_list._command_list_d3d12->Close();
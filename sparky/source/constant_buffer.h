@@ -1,5 +1,7 @@
 #pragma once
 
+#include "gpu_memory.h"
+
 #include <array>
 
 #define NOMINMAX
@@ -15,7 +17,8 @@ namespace detail
 	struct sp_constant_buffer_heap
 	{
 		const char* _name = nullptr;
-		Microsoft::WRL::ComPtr<ID3D12Resource> _resource;
+		sp_gpu_memory_block _memory_block;
+		uint8_t* _data_cpu = nullptr;
 		int _size_in_bytes = 0;
 		int _head = 0;
 	};
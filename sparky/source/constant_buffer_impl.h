@@ -22,24 +22,13 @@ namespace detail
 		// A constant buffer is expected to be 256 byte aligned so the heap should as well
 		const int size_in_bytes_aligned = (desc.size_in_bytes + 255) & ~255;
 
-		const auto heap_properties_d3dx12 = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-		const auto resource_desc_d3dx12 = CD3DX12_RESOURCE_DESC::Buffer(size_in_bytes_aligned);
-		HRESULT hr = detail::_sp._device->CreateCommittedResource(
-			&heap_properties_d3dx12,
-			D3D12_HEAP_FLAG_NONE,
-			&resource_desc_d3dx12,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&constant_buffer_heap._resource));
-		assert(SUCCEEDED(hr));
+		// Upload heap memory stays mapped so updates are just a memcpy
+		constant_buffer_heap._memory_block = sp_gpu_memory_alloc(sp_gpu_memory_pool_type::upload_buffers, size_in_bytes_aligned, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+		constant_buffer_heap._data_cpu = sp_gpu_memory_get_cpu_address(constant_buffer_heap._memory_block);
 
 		constant_buffer_heap._head = 0;
 		constant_buffer_heap._size_in_bytes = size_in_bytes_aligned;
 
-#if SP_DEBUG_RESOURCE_NAMING_ENABLED
-		constant_buffer_heap._resource->SetName(std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().from_bytes(name).c_str());
-#endif
-
 		return constant_buffer_heap;
 	}
 
@@ -52,7 +41,8 @@ namespace detail
 	{
 		constant_buffer_heap._head = 0;
 		constant_buffer_heap._size_in_bytes = 0;
-		constant_buffer_heap._resource = nullptr;
+		constant_buffer_heap._data_cpu = nullptr;
+		sp_deferred_release(constant_buffer_heap._memory_block);
 	}
 }
 
@@ -65,7 +55,7 @@ sp_constant_buffer sp_constant_buffer_create(int size_in_bytes)
 	sp_descriptor_handle constant_buffer_view = detail::sp_descriptor_alloc(detail::_sp._descriptor_heap_cbv_srv_uav_cpu);
 
 	D3D12_CONSTANT_BUFFER_VIEW_DESC constant_buffer_view_desc = {
-		detail::_sp._constant_buffer_heap._resource->GetGPUVirtualAddress() + detail::_sp._constant_buffer_heap._head,
+		detail::sp_gpu_memory_get_gpu_address(detail::_sp._constant_buffer_heap._memory_block) + detail::_sp._constant_buffer_heap._head,
 		static_cast<UINT>(size_in_bytes_aligned)
 	};
 
@@ -84,10 +74,5 @@ sp_constant_buffer sp_constant_buffer_create(int size_in_bytes)
 
 void sp_constant_buffer_update(sp_constant_buffer& constant_buffer, const void* data)
 {
-	void* data_gpu;
-	CD3DX12_RANGE read_range(0, 0); // A range where end <= begin indicates we do not intend to read from this resource on the CPU.
-	HRESULT hr = detail::_sp._constant_buffer_heap._resource->Map(0, &read_range, &data_gpu);
-	assert(SUCCEEDED(hr));
-	memcpy(static_cast<uint8_t*>(data_gpu) + constant_buffer._offset_in_heap, data, constant_buffer._size_in_bytes);
-	detail::_sp._constant_buffer_heap._resource->Unmap(0, nullptr);
+	memcpy(detail::_sp._constant_buffer_heap._data_cpu + constant_buffer._offset_in_heap, data, constant_buffer._size_in_bytes);
 }
\ No newline at end of file
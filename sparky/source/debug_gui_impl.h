@@ -24,7 +24,7 @@ namespace detail
 		ImGui::CreateContext();
 
 		ImGui_ImplWin32_Init(window_handle);
-		ImGui_ImplDX12_Init(_sp._device.Get(), 2, DXGI_FORMAT_R10G10B10A2_UNORM, detail::_sp._descriptor_heap_cbv_srv_uav_gpu._heap_d3d12.Get(), font_descriptor_handle._handle_cpu_d3d12, font_descriptor_handle._handle_gpu_d3d12);
+		ImGui_ImplDX12_Init(_sp._device.Get(), 2, _sp._swap_chain_format, detail::_sp._descriptor_heap_cbv_srv_uav_gpu._heap_d3d12.Get(), font_descriptor_handle._handle_cpu_d3d12, font_descriptor_handle._handle_gpu_d3d12);
 	}
 
 	void sp_debug_gui_begin_frame()
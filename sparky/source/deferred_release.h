@@ -0,0 +1,59 @@
+#pragma once
+
+#include "descriptor.h"
+#include "gpu_memory.h"
+
+#include <deque>
+#include <mutex>
+
+#define NOMINMAX
+#include <d3d12.h>
+
+#include <wrl.h>
+
+// Anything the GPU might still be using is released through here instead of straight away. Releases are tagged with the
+// current frame and the last upload and only happen once the graphics and compute queues have finished that frame and the copy
+// queue has caught up, so destroying something is safe at any point in the frame.
+
+namespace detail
+{
+	struct sp_deferred_release_entry
+	{
+		UINT64 _frame_fence_value = 0;
+		UINT64 _upload_fence_value = 0;
+
+		Microsoft::WRL::ComPtr<IUnknown> _object;
+
+		sp_gpu_memory_block _memory_block;
+
+		sp_descriptor_heap* _descriptor_heap = nullptr;
+		sp_descriptor_handle _descriptor;
+		int _descriptor_count = 0;
+	};
+
+	struct sp_deferred_release_queue
+	{
+		std::mutex _mutex;
+
+		// Signalled on both queues at the end of every frame
+		Microsoft::WRL::ComPtr<ID3D12Fence> _graphics_fence;
+		Microsoft::WRL::ComPtr<ID3D12Fence> _compute_fence;
+
+		// The value that'll be signalled at the end of the current frame
+		UINT64 _frame_fence_value = 1;
+
+		std::deque<sp_deferred_release_entry> _entries;
+	};
+
+	void sp_deferred_release_queue_init(sp_deferred_release_queue& queue);
+
+	// Waits for the GPU and releases everything
+	void sp_deferred_release_queue_destroy(sp_deferred_release_queue& queue);
+
+	// Signals the end of the frame and releases anything the GPU has finished with. Called from sp_swap_chain_present.
+	void sp_deferred_release_queue_end_frame(sp_deferred_release_queue& queue);
+
+	void sp_deferred_release(Microsoft::WRL::ComPtr<IUnknown> object);
+	void sp_deferred_release(sp_gpu_memory_block& memory_block);
+	void sp_deferred_release(sp_descriptor_heap& descriptor_heap, sp_descriptor_handle& descriptor, int descriptor_count = 1);
+}
\ No newline at end of file
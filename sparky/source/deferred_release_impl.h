@@ -0,0 +1,146 @@
+#pragma once
+
+#include "deferred_release.h"
+#include "sparky.h"
+
+#include <cassert>
+
+#define NOMINMAX
+#include <d3d12.h>
+
+namespace detail
+{
+	void sp_deferred_release_queue_init(sp_deferred_release_queue& queue)
+	{
+		HRESULT hr = _sp._device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&queue._graphics_fence));
+		assert(SUCCEEDED(hr));
+
+		hr = _sp._device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&queue._compute_fence));
+		assert(SUCCEEDED(hr));
+
+		queue._frame_fence_value = 1;
+	}
+
+	// Must hold the lock
+	void sp_deferred_release_queue_retire(sp_deferred_release_queue& queue, bool force)
+	{
+		const UINT64 graphics_completed_value = queue._graphics_fence->GetCompletedValue();
+		const UINT64 compute_completed_value = queue._compute_fence->GetCompletedValue();
+		const UINT64 upload_completed_value = _sp._upload_context._fence->GetCompletedValue();
+
+		// Entries are added in fence order so stop at the first one that's still in use
+		while (!queue._entries.empty())
+		{
+			sp_deferred_release_entry& entry = queue._entries.front();
+
+			const bool done =
+				entry._frame_fence_value <= graphics_completed_value &&
+				entry._frame_fence_value <= compute_completed_value &&
+				entry._upload_fence_value <= upload_completed_value;
+
+			if (!done && !force)
+			{
+				break;
+			}
+
+			sp_gpu_memory_free(entry._memory_block);
+
+			if (entry._descriptor_heap)
+			{
+				sp_descriptor_free(*entry._descriptor_heap, entry._descriptor, entry._descriptor_count);
+			}
+
+			queue._entries.pop_front();
+		}
+	}
+
+	void sp_deferred_release_queue_destroy(sp_deferred_release_queue& queue)
+	{
+		sp_device_wait_for_idle();
+
+		std::lock_guard<std::mutex> lock(queue._mutex);
+
+		sp_deferred_release_queue_retire(queue, true);
+
+		queue._graphics_fence.Reset();
+		queue._compute_fence.Reset();
+	}
+
+	void sp_deferred_release_queue_end_frame(sp_deferred_release_queue& queue)
+	{
+		std::lock_guard<std::mutex> lock(queue._mutex);
+
+		HRESULT hr = _sp._graphics_queue->Signal(queue._graphics_fence.Get(), queue._frame_fence_value);
+		assert(SUCCEEDED(hr));
+
+		hr = _sp._compute_queue->Signal(queue._compute_fence.Get(), queue._frame_fence_value);
+		assert(SUCCEEDED(hr));
+
+		++queue._frame_fence_value;
+
+		sp_deferred_release_queue_retire(queue, false);
+	}
+
+	void sp_deferred_release_push(sp_deferred_release_entry& entry)
+	{
+		sp_deferred_release_queue& queue = _sp._deferred_release_queue;
+
+		// The open batch could be copying into it and gets the next fence value when it's submitted. Without one nothing will
+		// signal that value until something else is uploaded, so only wait for what's already been submitted.
+		{
+			std::lock_guard<std::mutex> upload_lock(_sp._upload_context._mutex);
+			entry._upload_fence_value = _sp._upload_context._open_batch ? _sp._upload_context._next_fence_value : _sp._upload_context._next_fence_value - 1;
+		}
+
+		std::lock_guard<std::mutex> lock(queue._mutex);
+
+		entry._frame_fence_value = queue._frame_fence_value;
+
+		queue._entries.push_back(std::move(entry));
+	}
+
+	void sp_deferred_release(Microsoft::WRL::ComPtr<IUnknown> object)
+	{
+		if (!object)
+		{
+			return;
+		}
+
+		sp_deferred_release_entry entry;
+		entry._object = std::move(object);
+
+		sp_deferred_release_push(entry);
+	}
+
+	void sp_deferred_release(sp_gpu_memory_block& memory_block)
+	{
+		if (memory_block._page_index < 0)
+		{
+			return;
+		}
+
+		sp_deferred_release_entry entry;
+		entry._memory_block = memory_block;
+
+		sp_deferred_release_push(entry);
+
+		memory_block = sp_gpu_memory_block();
+	}
+
+	void sp_deferred_release(sp_descriptor_heap& descriptor_heap, sp_descriptor_handle& descriptor, int descriptor_count)
+	{
+		if (descriptor._handle_cpu_d3d12.ptr == 0)
+		{
+			return;
+		}
+
+		sp_deferred_release_entry entry;
+		entry._descriptor_heap = &descriptor_heap;
+		entry._descriptor = descriptor;
+		entry._descriptor_count = descriptor_count;
+
+		sp_deferred_release_push(entry);
+
+		descriptor = sp_descriptor_handle();
+	}
+}
\ No newline at end of file
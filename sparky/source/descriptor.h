@@ -5,6 +5,9 @@
 
 #include <wrl.h>
 
+#include <mutex>
+#include <vector>
+
 static constexpr int SP_DESCRIPTOR_TABLE_SIZE_IN_DESCRIPTORS_MAX = 32;
 
 struct sp_descriptor_handle
@@ -44,8 +47,17 @@ namespace detail
 		sp_descriptor_heap_type type = sp_descriptor_heap_type::cbv_srv_uav;
 	};
 
+	// Descriptors are freed back to the heap as ranges and reused first fit before growing the heap any further
+	struct sp_descriptor_free_range
+	{
+		int _index = 0;
+		int _count = 0;
+	};
+
+	// Can be allocated from and freed to on any thread so resources can be created and released from jobs
 	struct sp_descriptor_heap
 	{
+		std::mutex _mutex;
 		const char* _name = nullptr;
 		Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> _heap_d3d12;
 		int _descriptor_capacity = 0;
@@ -53,6 +65,7 @@ namespace detail
 		int _descriptor_size = 0;
 		sp_descriptor_handle _base;
 		sp_descriptor_handle _head;
+		std::vector<sp_descriptor_free_range> _free_ranges;
 	};
 }
 
@@ -66,13 +79,14 @@ struct sp_descriptor_table
 
 namespace detail
 {
-	sp_descriptor_heap sp_descriptor_heap_create(const char* name, const sp_descriptor_heap_desc& desc);
+	void sp_descriptor_heap_init(sp_descriptor_heap& descriptor_heap, const char* name, const sp_descriptor_heap_desc& desc);
 
 	void sp_descriptor_heap_destroy(sp_descriptor_heap& descriptor_heap);
 
 	sp_descriptor_handle sp_descriptor_alloc(sp_descriptor_heap& descriptor_heap, int descriptor_count = 1);
 
-	void sp_descriptor_free(sp_descriptor_heap& descriptor_heap, sp_descriptor_handle* descriptors, int descriptor_count);
+	// Frees descriptor_count contiguous descriptors starting at descriptor. Use sp_deferred_release if the GPU could still be using them.
+	void sp_descriptor_free(sp_descriptor_heap& descriptor_heap, const sp_descriptor_handle& descriptor, int descriptor_count);
 }
 
 sp_descriptor_table sp_descriptor_table_create(sp_descriptor_table_type type, int size_in_descriptors);
@@ -85,6 +99,8 @@ sp_descriptor_table sp_descriptor_table_create(sp_descriptor_table_type type, co
 	return sp_descriptor_table_create(type, descriptors, N);
 }
 
+void sp_descriptor_table_destroy(sp_descriptor_table& descriptor_table);
+
 void sp_descriptor_copy_to_table(sp_descriptor_table& descriptor_table, const sp_descriptor_handle* descriptors, int descriptor_count);
 
 template <int N>
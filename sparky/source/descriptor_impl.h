@@ -2,7 +2,9 @@
 
 #include "sparky.h"
 #include "descriptor.h"
+#include "deferred_release.h"
 
+#include <algorithm>
 #include <cassert>
 #include <codecvt>
 
@@ -16,6 +18,32 @@ namespace detail
 	sp_descriptor_handle sp_descriptor_alloc(sp_descriptor_heap& descriptor_heap, int descriptor_count)
 	{
 		assert(descriptor_count >= 0);
+
+		std::lock_guard<std::mutex> lock(descriptor_heap._mutex);
+
+		for (auto it = descriptor_heap._free_ranges.begin(); it != descriptor_heap._free_ranges.end(); ++it)
+		{
+			if (it->_count < descriptor_count)
+			{
+				continue;
+			}
+
+			const SIZE_T offset = static_cast<SIZE_T>(descriptor_heap._descriptor_size) * it->_index;
+
+			sp_descriptor_handle descriptor_handle = descriptor_heap._base;
+			descriptor_handle._handle_cpu_d3d12.ptr += offset;
+			descriptor_handle._handle_gpu_d3d12.ptr += offset;
+
+			it->_index += descriptor_count;
+			it->_count -= descriptor_count;
+			if (it->_count == 0)
+			{
+				descriptor_heap._free_ranges.erase(it);
+			}
+
+			return descriptor_handle;
+		}
+
 		assert(descriptor_heap._descriptor_count + descriptor_count < descriptor_heap._descriptor_capacity);
 
 		sp_descriptor_handle descriptor_handle = descriptor_heap._head;
@@ -30,15 +58,43 @@ namespace detail
 		return descriptor_handle;
 	}
 
-	void sp_descriptor_free(sp_descriptor_heap& descriptor_heap, sp_descriptor_handle* descriptors, int descriptor_count)
+	void sp_descriptor_free(sp_descriptor_heap& descriptor_heap, const sp_descriptor_handle& descriptor, int descriptor_count)
 	{
-		// TODO:
+		assert(descriptor._handle_cpu_d3d12.ptr >= descriptor_heap._base._handle_cpu_d3d12.ptr);
+
+		const int index = static_cast<int>((descriptor._handle_cpu_d3d12.ptr - descriptor_heap._base._handle_cpu_d3d12.ptr) / descriptor_heap._descriptor_size);
+
+		std::lock_guard<std::mutex> lock(descriptor_heap._mutex);
+
+		assert(index + descriptor_count <= descriptor_heap._descriptor_count);
+
+		// Kept sorted so neighbouring ranges can be merged back together
+		auto& free_ranges = descriptor_heap._free_ranges;
+		auto it = std::lower_bound(free_ranges.begin(), free_ranges.end(), index, [](const sp_descriptor_free_range& range, int index) {
+			return range._index < index;
+		});
+		it = free_ranges.insert(it, { index, descriptor_count });
+
+		auto next = it + 1;
+		if (next != free_ranges.end() && it->_index + it->_count == next->_index)
+		{
+			it->_count += next->_count;
+			free_ranges.erase(next);
+		}
+
+		if (it != free_ranges.begin())
+		{
+			auto prev = it - 1;
+			if (prev->_index + prev->_count == it->_index)
+			{
+				prev->_count += it->_count;
+				free_ranges.erase(it);
+			}
+		}
 	}
 
-	sp_descriptor_heap sp_descriptor_heap_create(const char* name, const sp_descriptor_heap_desc& desc)
+	void sp_descriptor_heap_init(sp_descriptor_heap& descriptor_heap, const char* name, const sp_descriptor_heap_desc& desc)
 	{
-		sp_descriptor_heap descriptor_heap;
-
 		descriptor_heap._name = name;
 
 		static_assert(static_cast<D3D12_DESCRIPTOR_HEAP_TYPE>(sp_descriptor_heap_type::cbv_srv_uav) == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, "sp_descriptor_heap_type::cbv_srv_uav != D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV");
@@ -67,13 +123,13 @@ namespace detail
 
 		descriptor_heap._descriptor_capacity = heap_desc_d3d12.NumDescriptors;
 		descriptor_heap._descriptor_count = 0;
-
-		return descriptor_heap;
+		descriptor_heap._free_ranges.clear();
 	}
 
 	void sp_descriptor_heap_destroy(sp_descriptor_heap& descriptor_heap)
 	{
 		descriptor_heap._heap_d3d12.Reset();
+		descriptor_heap._free_ranges.clear();
 	}
 }
 
@@ -119,6 +175,12 @@ sp_descriptor_table sp_descriptor_table_create(sp_descriptor_table_type type, co
 	return table;
 }
 
+void sp_descriptor_table_destroy(sp_descriptor_table& descriptor_table)
+{
+	sp_descriptor_handle descriptor = descriptor_table._descriptor;
+	detail::sp_deferred_release(detail::sp_get_descriptor_heap_for_table_type(descriptor_table._type), descriptor, descriptor_table._descriptor_count);
+}
+
 // TODO: I think we're going to want multiple version of this. One for textures, buffers, constant buffers, samplers, etc. Will also allow additional validation against the table type.
 void sp_descriptor_copy_to_table(sp_descriptor_table& descriptor_table, const sp_descriptor_handle* descriptors, int descriptor_count)
 {
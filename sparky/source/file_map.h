@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Read only memory mapped files, for cooked assets that are used straight out of the file. Page faults bring the file in from
+// the file cache as it's read so nothing is copied up front.
+
+// Returns false if the file doesn't exist or is empty
+bool sp_file_map(const char* path, const uint8_t*& data, size_t& size_bytes);
+void sp_file_unmap(const uint8_t* data, size_t size_bytes);
\ No newline at end of file
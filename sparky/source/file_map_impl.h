@@ -0,0 +1,83 @@
+#pragma once
+
+#include "file_map.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool sp_file_map(const char* path, const uint8_t*& data, size_t& size_bytes)
+{
+#if defined(_WIN32)
+	HANDLE file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+	{
+		CloseHandle(file_handle);
+		return false;
+	}
+
+	// The view keeps the mapping alive so neither handle is needed once it exists
+	HANDLE mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file_handle);
+	if (!mapping_handle)
+	{
+		return false;
+	}
+
+	data = static_cast<const uint8_t*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+	CloseHandle(mapping_handle);
+	if (!data)
+	{
+		return false;
+	}
+
+	size_bytes = static_cast<size_t>(file_size.QuadPart);
+#else
+	const int file_descriptor = open(path, O_RDONLY);
+	if (file_descriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat file_stat;
+	if (fstat(file_descriptor, &file_stat) != 0 || file_stat.st_size == 0)
+	{
+		close(file_descriptor);
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	close(file_descriptor);
+	if (mapping == MAP_FAILED)
+	{
+		return false;
+	}
+
+	data = static_cast<const uint8_t*>(mapping);
+	size_bytes = static_cast<size_t>(file_stat.st_size);
+#endif
+
+	return true;
+}
+
+void sp_file_unmap(const uint8_t* data, size_t size_bytes)
+{
+#if defined(_WIN32)
+	(void)size_bytes;
+	UnmapViewOfFile(data);
+#else
+	munmap(const_cast<uint8_t*>(data), size_bytes);
+#endif
+}
\ No newline at end of file
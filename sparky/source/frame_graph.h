@@ -1,7 +1,15 @@
 #pragma once
 
+#include "handle.h"
+#include "texture.h"
+#include "command_list.h"
+
 #include <optional>
+#include <vector>
+#include <functional>
+#include <chrono>
 
+// Old single-task helper. Clears every attachment. Prefer building an sp_frame_graph, which works out load and store actions per attachment.
 struct sp_graphics_task
 {
 	const char* name = nullptr;
@@ -12,44 +20,182 @@ struct sp_graphics_task
 	std::optional<sp_texture_handle> depth;
 };
 
-void sp_frame_graph_task_begin(sp_graphics_command_list& command_list, const sp_graphics_task& task)
+void sp_frame_graph_task_begin(sp_graphics_command_list& command_list, const sp_graphics_task& task);
+
+using sp_frame_graph_resource_handle = sp_handle;
+using sp_frame_graph_task_handle = sp_handle;
+
+enum class sp_frame_graph_queue
 {
-	// each task has
-	// [required] render targets / "attachments" + depth
-	// [optional] resources (constants, buffers, textures)
-
-	// bind render targets
-	// clear them (maybe)
-	// set them
-	// set resources
-
-	sp_graphics_command_list_set_render_targets(command_list, &task.render_targets[0], task.render_target_count, task.depth.value_or(sp_texture_handle{}));
-	for (int i = 0; i < task.render_target_count; ++i)
-	{
-		sp_texture_handle render_target = task.render_targets[i];
-		sp_graphics_command_list_clear_render_target(command_list, render_target);
-	}
-	if (task.depth)
-	{
-		sp_graphics_command_list_clear_depth(command_list, task.depth.value());
-	}
-}
-
-//struct sp_frame_graph_desc
-//{
-//	sp_render_task_desc render_tasks[64];
-//	int task_count = 0;
-//};
-
-//void sp_frame_graph_builder_add_render_task(sp_frame_graph_desc* desc, sp_render_task_desc& render_task_desc)
-//{
-//
-//}
+	graphics,
+	compute,
+};
+
+enum class sp_frame_graph_resource_usage
+{
+	none,				// Undefined for transient resources, the default state for imported resources
+	render_target,
+	depth_stencil,
+	shader_resource,
+	unordered_access,
+};
+
+enum class sp_frame_graph_texture_size
+{
+	absolute,
+	relative_to_back_buffer,	// width and height are ignored and the back buffer size multiplied by scale is used instead
+};
+
+struct sp_frame_graph_texture_desc
+{
+	int width = 0;
+	int height = 0;
+	sp_texture_format format = sp_texture_format::unknown;
+	sp_frame_graph_texture_size size = sp_frame_graph_texture_size::absolute;
+	float scale = 1.0f;
+};
+
+struct sp_frame_graph_resource_access
+{
+	sp_frame_graph_resource_handle resource;
+	sp_frame_graph_resource_usage usage = sp_frame_graph_resource_usage::none;
+
+	// Render targets and depth stencils only. Used if this task is the first to touch the resource in the frame.
+	sp_render_pass_load_action first_load_action = sp_render_pass_load_action::clear;
+
+	// Filled in by sp_frame_graph_compile
+	sp_render_pass_load_action load_action = sp_render_pass_load_action::load;
+	sp_render_pass_store_action store_action = sp_render_pass_store_action::store;
+};
+
+struct sp_frame_graph_barrier
+{
+	sp_frame_graph_resource_handle resource;
+	sp_frame_graph_resource_usage usage_before = sp_frame_graph_resource_usage::none;
+	sp_frame_graph_resource_usage usage_after = sp_frame_graph_resource_usage::none;
+};
+
+struct sp_frame_graph_resource
+{
+	const char* _name = nullptr;
+	sp_frame_graph_texture_desc _desc;
+
+	bool _imported = false;
+	bool _imported_back_buffer = false;
+	sp_texture_handle _imported_texture_handle;
+
+	// History resources are double buffered and never aliased. What's written this frame is what the resource returned
+	// by sp_frame_graph_get_history reads next frame.
+	bool _history = false;
+	sp_frame_graph_resource_handle _history_previous;
+	sp_frame_graph_resource_handle _history_source;
+	sp_texture_handle _history_texture_handles[2];
+	sp_frame_graph_texture_desc _history_texture_desc;
+	int _history_frame_num_created = 0;
 
-void sp_frame_graph_test()
+	// Filled in by sp_frame_graph_compile. Lifetimes are indices into _execution_order.
+	int _lifetime_begin = -1;
+	int _lifetime_end = -1;
+	int _physical_texture_index = -1;
+};
+
+struct sp_frame_graph_task
 {
+	const char* _name = nullptr;
+	sp_frame_graph_queue _queue = sp_frame_graph_queue::graphics;
+
+	std::vector<sp_frame_graph_resource_access> _accesses;
+
+	std::function<void(sp_graphics_command_list&)> _execute;
+
+	// Filled in by sp_frame_graph_compile. The barriers are recorded right before the task and are what gets exported.
+	bool _culled = false;
+	std::vector<sp_frame_graph_barrier> _barriers;
+
+	// Filled in by sp_frame_graph_execute. Microseconds since the graph was created.
+	double _cpu_record_begin_us = 0.0;
+	double _cpu_record_duration_us = 0.0;
+};
+
+// Transient textures with identical descriptions and non-overlapping lifetimes share a physical texture (an "alias group")
+struct sp_frame_graph_physical_texture
+{
+	sp_frame_graph_texture_desc _desc;
+	sp_texture_handle _texture_handle;
+	int _lifetime_end = -1;
+};
+
+struct sp_frame_graph
+{
+	const char* _name = nullptr;
+
+	std::vector<sp_frame_graph_resource> _resources;
+	std::vector<sp_frame_graph_task> _tasks;
+	std::vector<sp_frame_graph_physical_texture> _physical_textures;
+
+	std::vector<int> _execution_order;
+	std::vector<sp_frame_graph_barrier> _final_barriers;
+	bool _compiled = false;
+
+	// Back buffer size the graph was compiled against. Relative resources are recreated when it changes.
+	int _back_buffer_width = 0;
+	int _back_buffer_height = 0;
+
+	std::chrono::high_resolution_clock::time_point _epoch;
+	int _frame_num = 0;
+	double _cpu_frame_begin_us = 0.0;
+	double _cpu_frame_duration_us = 0.0;
+};
+
+sp_frame_graph sp_frame_graph_create(const char* name);
+void sp_frame_graph_destroy(sp_frame_graph& frame_graph);
+
+sp_frame_graph_resource_handle sp_frame_graph_create_texture(sp_frame_graph& frame_graph, const char* name, const sp_frame_graph_texture_desc& desc);
+sp_frame_graph_resource_handle sp_frame_graph_import_texture(sp_frame_graph& frame_graph, sp_texture_handle texture_handle);
+sp_frame_graph_resource_handle sp_frame_graph_import_back_buffer(sp_frame_graph& frame_graph);
+
+// Creates a texture that carries over between frames. Write to the returned resource and read last frame's contents from
+// the resource returned by sp_frame_graph_get_history. Until sp_frame_graph_history_is_valid returns true (the first frame
+// and whenever the texture is recreated by a resize) the previous contents are undefined.
+sp_frame_graph_resource_handle sp_frame_graph_create_history_texture(sp_frame_graph& frame_graph, const char* name, const sp_frame_graph_texture_desc& desc);
+sp_frame_graph_resource_handle sp_frame_graph_get_history(sp_frame_graph& frame_graph, sp_frame_graph_resource_handle resource_handle);
+bool sp_frame_graph_history_is_valid(const sp_frame_graph& frame_graph, sp_frame_graph_resource_handle resource_handle);
+
+sp_frame_graph_task_handle sp_frame_graph_add_graphics_task(sp_frame_graph& frame_graph, const char* name, std::function<void(sp_graphics_command_list&)> execute);
+// There's no async compute yet. Compute tasks are recorded into the graphics command list in execution order, using its compute
+// functions (sp_graphics_command_list_set_compute_pipeline_state etc.), so they run on the graphics queue and the barriers the
+// graph works out are all the synchronization they need. They just don't get a render pass.
+sp_frame_graph_task_handle sp_frame_graph_add_compute_task(sp_frame_graph& frame_graph, const char* name, std::function<void(sp_graphics_command_list&)> execute);
+
+// first_load_action only applies when the task is the first writer of the resource this frame, later writers always load. Pass
+// sp_render_pass_load_action::dont_care when the task overwrites every pixel to skip the clear. Imported textures (other than the
+// back buffer) are always loaded since the graph doesn't know what's in them.
+void sp_frame_graph_task_add_render_target(sp_frame_graph& frame_graph, sp_frame_graph_task_handle task_handle, sp_frame_graph_resource_handle resource_handle, sp_render_pass_load_action first_load_action = sp_render_pass_load_action::clear);
+void sp_frame_graph_task_set_depth_stencil(sp_frame_graph& frame_graph, sp_frame_graph_task_handle task_handle, sp_frame_graph_resource_handle resource_handle, sp_render_pass_load_action first_load_action = sp_render_pass_load_action::clear);
+void sp_frame_graph_task_add_shader_resource(sp_frame_graph& frame_graph, sp_frame_graph_task_handle task_handle, sp_frame_graph_resource_handle resource_handle);
+void sp_frame_graph_task_add_unordered_access(sp_frame_graph& frame_graph, sp_frame_graph_task_handle task_handle, sp_frame_graph_resource_handle resource_handle);
+
+// Culls tasks that don't contribute to an imported resource, computes resource lifetimes, assigns transient resources to
+// physical textures and works out the barriers between tasks and the load and store action of every attachment. Transient
+// attachments nothing reads afterwards are discarded, and every transient resource is cleared or discarded by its first writer
+// so sharing a physical texture never exposes what was in it. Must be called again after the graph is modified.
+void sp_frame_graph_compile(sp_frame_graph& frame_graph);
+
+// Records every task that survived compilation, preceded by the barriers compile worked out for it. Each graphics task is wrapped
+// in a render pass over its attachments and gets the viewport and scissor set to cover them before the execute callback is called.
+// Resources are expected in their default state when this is called. The end of frame barriers that put them back are left with
+// the command list, which records them the next time render targets are set or when it ends, so anything drawn after the graph
+// (e.g. the debug gui) can still use the back buffer. Tasks shouldn't transition the graph's resources themselves.
+void sp_frame_graph_execute(sp_frame_graph& frame_graph, sp_graphics_command_list& graphics_command_list);
+
+sp_texture_handle sp_frame_graph_get_texture(const sp_frame_graph& frame_graph, sp_frame_graph_resource_handle resource_handle);
+sp_frame_graph_texture_desc sp_frame_graph_get_texture_desc(const sp_frame_graph& frame_graph, sp_frame_graph_resource_handle resource_handle);
+
+// Writes the compiled graph as Graphviz DOT. Output only depends on the graph so it can be diffed between builds.
+bool sp_frame_graph_export_graphviz(const sp_frame_graph& frame_graph, const char* path);
 
-}
+// Writes the most recently executed frame as Chrome trace event JSON (chrome://tracing, Perfetto).
+bool sp_frame_graph_export_chrome_trace(const sp_frame_graph& frame_graph, const char* path);
 
 // TASK GRAPH MUSINGS
 //
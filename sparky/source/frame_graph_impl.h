@@ -0,0 +1,1071 @@
+#pragma once
+
+#include "frame_graph.h"
+#include "command_list.h"
+#include "texture.h"
+#include "sparky.h"
+#include "log.h"
+
+#include <cstdio>
+#include <algorithm>
+
+void sp_frame_graph_task_begin(sp_graphics_command_list& command_list, const sp_graphics_task& task)
+{
+	// each task has
+	// [required] render targets / "attachments" + depth
+	// [optional] resources (constants, buffers, textures)
+
+	// bind render targets
+	// clear them (maybe)
+	// set them
+	// set resources
+
+	sp_graphics_command_list_set_render_targets(command_list, &task.render_targets[0], task.render_target_count, task.depth.value_or(sp_texture_handle{}));
+	for (int i = 0; i < task.render_target_count; ++i)
+	{
+		sp_texture_handle render_target = task.render_targets[i];
+		sp_graphics_command_list_clear_render_target(command_list, render_target);
+	}
+	if (task.depth)
+	{
+		sp_graphics_command_list_clear_depth(command_list, task.depth.value());
+	}
+}
+
+namespace detail
+{
+	double sp_frame_graph_get_time_us(const sp_frame_graph& frame_graph)
+	{
+		return std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - frame_graph._epoch).count();
+	}
+
+	const char* sp_frame_graph_queue_get_name(sp_frame_graph_queue queue)
+	{
+		switch (queue)
+		{
+		case sp_frame_graph_queue::graphics: return "graphics";
+		case sp_frame_graph_queue::compute:  return "compute";
+		};
+
+		assert(false);
+
+		return "";
+	}
+
+	const char* sp_frame_graph_resource_usage_get_name(sp_frame_graph_resource_usage usage)
+	{
+		switch (usage)
+		{
+		case sp_frame_graph_resource_usage::none:             return "none";
+		case sp_frame_graph_resource_usage::render_target:    return "render_target";
+		case sp_frame_graph_resource_usage::depth_stencil:    return "depth_stencil";
+		case sp_frame_graph_resource_usage::shader_resource:  return "shader_resource";
+		case sp_frame_graph_resource_usage::unordered_access: return "unordered_access";
+		};
+
+		assert(false);
+
+		return "";
+	}
+
+	const char* sp_render_pass_load_action_get_name(sp_render_pass_load_action load_action)
+	{
+		switch (load_action)
+		{
+		case sp_render_pass_load_action::load:      return "load";
+		case sp_render_pass_load_action::clear:     return "clear";
+		case sp_render_pass_load_action::dont_care: return "dont_care";
+		};
+
+		assert(false);
+
+		return "";
+	}
+
+	const char* sp_render_pass_store_action_get_name(sp_render_pass_store_action store_action)
+	{
+		switch (store_action)
+		{
+		case sp_render_pass_store_action::store:   return "store";
+		case sp_render_pass_store_action::discard: return "discard";
+		};
+
+		assert(false);
+
+		return "";
+	}
+
+	bool sp_frame_graph_resource_usage_is_attachment(sp_frame_graph_resource_usage usage)
+	{
+		return usage == sp_frame_graph_resource_usage::render_target
+			|| usage == sp_frame_graph_resource_usage::depth_stencil;
+	}
+
+	bool sp_frame_graph_resource_usage_is_write(sp_frame_graph_resource_usage usage)
+	{
+		return usage == sp_frame_graph_resource_usage::render_target
+			|| usage == sp_frame_graph_resource_usage::depth_stencil
+			|| usage == sp_frame_graph_resource_usage::unordered_access;
+	}
+
+	bool sp_frame_graph_resource_usage_is_read(sp_frame_graph_resource_usage usage)
+	{
+		return usage == sp_frame_graph_resource_usage::shader_resource
+			|| usage == sp_frame_graph_resource_usage::unordered_access;
+	}
+
+	// Only meaningful for resolved descriptions
+	bool sp_frame_graph_texture_desc_equal(const sp_frame_graph_texture_desc& lhs, const sp_frame_graph_texture_desc& rhs)
+	{
+		return lhs.width == rhs.width && lhs.height == rhs.height && lhs.format == rhs.format;
+	}
+
+	sp_frame_graph_texture_desc sp_frame_graph_texture_desc_resolve(const sp_frame_graph_texture_desc& desc)
+	{
+		if (desc.size == sp_frame_graph_texture_size::absolute)
+		{
+			return desc;
+		}
+
+		const sp_texture& back_buffer = sp_texture_pool_get(_sp._back_buffer_texture_handles[_sp._back_buffer_index]);
+
+		sp_frame_graph_texture_desc resolved_desc = desc;
+		resolved_desc.width = std::max(1, static_cast<int>(back_buffer._width * desc.scale));
+		resolved_desc.height = std::max(1, static_cast<int>(back_buffer._height * desc.scale));
+		resolved_desc.size = sp_frame_graph_texture_size::absolute;
+		resolved_desc.scale = 1.0f;
+
+		return resolved_desc;
+	}
+
+	bool sp_frame_graph_resource_is_transient(const sp_frame_graph_resource& resource)
+	{
+		return !resource._imported && !resource._history && !resource._history_source;
+	}
+
+	sp_frame_graph_texture_desc sp_frame_graph_resource_get_desc(const sp_frame_graph_resource& resource)
+	{
+		if (!resource._imported)
+		{
+			return sp_frame_graph_texture_desc_resolve(resource._desc);
+		}
+
+		const sp_texture& texture = sp_texture_pool_get(resource._imported_back_buffer ? _sp._back_buffer_texture_handles[_sp._back_buffer_index] : resource._imported_texture_handle);
+
+		return { texture._width, texture._height, texture._format };
+	}
+
+	void sp_frame_graph_task_add_access(sp_frame_graph& frame_graph, sp_frame_graph_task_handle task_handle, sp_frame_graph_resource_handle resource_handle, sp_frame_graph_resource_usage usage, sp_render_pass_load_action first_load_action = sp_render_pass_load_action::clear)
+	{
+		assert(task_handle.index < static_cast<int>(frame_graph._tasks.size()));
+		assert(resource_handle.index < static_cast<int>(frame_graph._resources.size()));
+
+		sp_frame_graph_resource_access access;
+		access.resource = resource_handle;
+		access.usage = usage;
+		access.first_load_action = first_load_action;
+
+		frame_graph._tasks[task_handle.index]._accesses.push_back(access);
+		frame_graph._compiled = false;
+	}
+
+	sp_frame_graph_task_handle sp_frame_graph_add_task(sp_frame_graph& frame_graph, const char* name, sp_frame_graph_queue queue)
+	{
+		sp_frame_graph_task_handle task_handle;
+		task_handle.index = static_cast<short>(frame_graph._tasks.size());
+
+		sp_frame_graph_task task;
+		task._name = name;
+		task._queue = queue;
+
+		frame_graph._tasks.push_back(std::move(task));
+		frame_graph._compiled = false;
+
+		return task_handle;
+	}
+
+	sp_frame_graph_resource_handle sp_frame_graph_add_resource(sp_frame_graph& frame_graph, const sp_frame_graph_resource& resource)
+	{
+		sp_frame_graph_resource_handle resource_handle;
+		resource_handle.index = static_cast<short>(frame_graph._resources.size());
+
+		frame_graph._resources.push_back(resource);
+		frame_graph._compiled = false;
+
+		return resource_handle;
+	}
+
+	sp_texture_handle sp_frame_graph_texture_create(const char* name, const sp_frame_graph_texture_desc& desc)
+	{
+		const sp_texture_flags flags = sp_texture_format_is_depth(desc.format) ? sp_texture_flags::none : sp_texture_flags::render_target;
+
+		return sp_texture_create(name, { desc.width, desc.height, 1, desc.format, flags });
+	}
+}
+
+sp_frame_graph sp_frame_graph_create(const char* name)
+{
+	sp_frame_graph frame_graph;
+
+	frame_graph._name = name;
+	frame_graph._epoch = std::chrono::high_resolution_clock::now();
+
+	return frame_graph;
+}
+
+void sp_frame_graph_destroy(sp_frame_graph& frame_graph)
+{
+	for (auto& physical_texture : frame_graph._physical_textures)
+	{
+		sp_texture_destroy(physical_texture._texture_handle);
+	}
+
+	for (auto& resource : frame_graph._resources)
+	{
+		for (sp_texture_handle texture_handle : resource._history_texture_handles)
+		{
+			if (texture_handle)
+			{
+				sp_texture_destroy(texture_handle);
+			}
+		}
+	}
+
+	frame_graph._physical_textures.clear();
+	frame_graph._resources.clear();
+	frame_graph._tasks.clear();
+	frame_graph._execution_order.clear();
+	frame_graph._final_barriers.clear();
+	frame_graph._compiled = false;
+}
+
+sp_frame_graph_resource_handle sp_frame_graph_create_texture(sp_frame_graph& frame_graph, const char* name, const sp_frame_graph_texture_desc& desc)
+{
+	sp_frame_graph_resource resource;
+	resource._name = name;
+	resource._desc = desc;
+
+	return detail::sp_frame_graph_add_resource(frame_graph, resource);
+}
+
+sp_frame_graph_resource_handle sp_frame_graph_import_texture(sp_frame_graph& frame_graph, sp_texture_handle texture_handle)
+{
+	sp_frame_graph_resource resource;
+	resource._name = detail::sp_texture_pool_get(texture_handle)._name;
+	resource._imported = true;
+	resource._imported_texture_handle = texture_handle;
+
+	return detail::sp_frame_graph_add_resource(frame_graph, resource);
+}
+
+sp_frame_graph_resource_handle sp_frame_graph_import_back_buffer(sp_frame_graph& frame_graph)
+{
+	// The back buffer changes every frame so it's resolved when the graph is executed
+	sp_frame_graph_resource resource;
+	resource._name = "back_buffer";
+	resource._imported = true;
+	resource._imported_back_buffer = true;
+
+	return detail::sp_frame_graph_add_resource(frame_graph, resource);
+}
+
+sp_frame_graph_resource_handle sp_frame_graph_create_history_texture(sp_frame_graph& frame_graph, const char* name, const sp_frame_graph_texture_desc& desc)
+{
+	sp_frame_graph_resource resource;
+	resource._name = name;
+	resource._desc = desc;
+	resource._history = true;
+
+	return detail::sp_frame_graph_add_resource(frame_graph, resource);
+}
+
+sp_frame_graph_resource_handle sp_frame_graph_get_history(sp_frame_graph& frame_graph, sp_frame_graph_resource_handle resource_handle)
+{
+	assert(frame_graph._resources[resource_handle.index]._history && "not a history resource");
+
+	if (!frame_graph._resources[resource_handle.index]._history_previous)
+	{
+		sp_frame_graph_resource resource;
+		resource._name = frame_graph._resources[resource_handle.index]._name;
+		resource._desc = frame_graph._resources[resource_handle.index]._desc;
+		resource._history_source = resource_handle;
+
+		frame_graph._resources[resource_handle.index]._history_previous = detail::sp_frame_graph_add_resource(frame_graph, resource);
+	}
+
+	return frame_graph._resources[resource_handle.index]._history_previous;
+}
+
+bool sp_frame_graph_history_is_valid(const sp_frame_graph& frame_graph, sp_frame_graph_resource_handle resource_handle)
+{
+	const sp_frame_graph_resource* resource = &frame_graph._resources[resource_handle.index];
+	if (resource->_history_source)
+	{
+		resource = &frame_graph._resources[resource->_history_source.index];
+	}
+
+	assert(resource->_history && "not a history resource");
+
+	return frame_graph._compiled && frame_graph._frame_num > resource->_history_frame_num_created;
+}
+
+sp_frame_graph_task_handle sp_frame_graph_add_graphics_task(sp_frame_graph& frame_graph, const char* name, std::function<void(sp_graphics_command_list&)> execute)
+{
+	sp_frame_graph_task_handle task_handle = detail::sp_frame_graph_add_task(frame_graph, name, sp_frame_graph_queue::graphics);
+	frame_graph._tasks[task_handle.index]._execute = std::move(execute);
+
+	return task_handle;
+}
+
+sp_frame_graph_task_handle sp_frame_graph_add_compute_task(sp_frame_graph& frame_graph, const char* name, std::function<void(sp_graphics_command_list&)> execute)
+{
+	sp_frame_graph_task_handle task_handle = detail::sp_frame_graph_add_task(frame_graph, name, sp_frame_graph_queue::compute);
+	frame_graph._tasks[task_handle.index]._execute = std::move(execute);
+
+	return task_handle;
+}
+
+void sp_frame_graph_task_add_render_target(sp_frame_graph& frame_graph, sp_frame_graph_task_handle task_handle, sp_frame_graph_resource_handle resource_handle, sp_render_pass_load_action first_load_action)
+{
+	assert(frame_graph._tasks[task_handle.index]._queue == sp_frame_graph_queue::graphics);
+
+	detail::sp_frame_graph_task_add_access(frame_graph, task_handle, resource_handle, sp_frame_graph_resource_usage::render_target, first_load_action);
+}
+
+void sp_frame_graph_task_set_depth_stencil(sp_frame_graph& frame_graph, sp_frame_graph_task_handle task_handle, sp_frame_graph_resource_handle resource_handle, sp_render_pass_load_action first_load_action)
+{
+	assert(frame_graph._tasks[task_handle.index]._queue == sp_frame_graph_queue::graphics);
+
+	detail::sp_frame_graph_task_add_access(frame_graph, task_handle, resource_handle, sp_frame_graph_resource_usage::depth_stencil, first_load_action);
+}
+
+void sp_frame_graph_task_add_shader_resource(sp_frame_graph& frame_graph, sp_frame_graph_task_handle task_handle, sp_frame_graph_resource_handle resource_handle)
+{
+	detail::sp_frame_graph_task_add_access(frame_graph, task_handle, resource_handle, sp_frame_graph_resource_usage::shader_resource);
+}
+
+void sp_frame_graph_task_add_unordered_access(sp_frame_graph& frame_graph, sp_frame_graph_task_handle task_handle, sp_frame_graph_resource_handle resource_handle)
+{
+	detail::sp_frame_graph_task_add_access(frame_graph, task_handle, resource_handle, sp_frame_graph_resource_usage::unordered_access);
+}
+
+void sp_frame_graph_compile(sp_frame_graph& frame_graph)
+{
+	const int task_count = static_cast<int>(frame_graph._tasks.size());
+	const int resource_count = static_cast<int>(frame_graph._resources.size());
+
+	// Walk backwards from the imported and history resources (the only ones anything outside of this frame can see) and cull
+	// tasks whose writes are never read. Tasks that don't write to anything the graph knows about are assumed to have side effects.
+	std::vector<bool> resource_is_needed(resource_count);
+	for (int resource_index = 0; resource_index < resource_count; ++resource_index)
+	{
+		resource_is_needed[resource_index] = !detail::sp_frame_graph_resource_is_transient(frame_graph._resources[resource_index]);
+	}
+
+	for (int task_index = task_count - 1; task_index >= 0; --task_index)
+	{
+		sp_frame_graph_task& task = frame_graph._tasks[task_index];
+
+		bool has_writes = false;
+		bool has_needed_writes = false;
+		for (const auto& access : task._accesses)
+		{
+			if (detail::sp_frame_graph_resource_usage_is_write(access.usage))
+			{
+				has_writes = true;
+				has_needed_writes = has_needed_writes || resource_is_needed[access.resource.index];
+			}
+		}
+
+		task._culled = has_writes && !has_needed_writes;
+		task._barriers.clear();
+
+		if (!task._culled)
+		{
+			for (const auto& access : task._accesses)
+			{
+				if (detail::sp_frame_graph_resource_usage_is_read(access.usage))
+				{
+					resource_is_needed[access.resource.index] = true;
+				}
+			}
+		}
+	}
+
+	frame_graph._execution_order.clear();
+	for (int task_index = 0; task_index < task_count; ++task_index)
+	{
+		if (!frame_graph._tasks[task_index]._culled)
+		{
+			frame_graph._execution_order.push_back(task_index);
+		}
+	}
+
+	// Lifetimes
+	for (auto& resource : frame_graph._resources)
+	{
+		resource._lifetime_begin = -1;
+		resource._lifetime_end = -1;
+		resource._physical_texture_index = -1;
+	}
+
+	const int execution_count = static_cast<int>(frame_graph._execution_order.size());
+	for (int order_index = 0; order_index < execution_count; ++order_index)
+	{
+		for (const auto& access : frame_graph._tasks[frame_graph._execution_order[order_index]]._accesses)
+		{
+			sp_frame_graph_resource& resource = frame_graph._resources[access.resource.index];
+			if (resource._lifetime_begin < 0)
+			{
+				resource._lifetime_begin = order_index;
+			}
+			resource._lifetime_end = order_index;
+		}
+	}
+
+	// Load and store actions. The first writer of a resource gets to choose whether it's cleared, everyone after it loads. Transient
+	// resources are discarded by the last task that touches them if it has them attached. Tasks that only read them can't, so
+	// every transient resource is cleared or discarded by its first writer instead. That's what makes handing its physical
+	// texture to another resource safe, whatever the previous occupant left behind.
+	for (int order_index = 0; order_index < execution_count; ++order_index)
+	{
+		for (auto& access : frame_graph._tasks[frame_graph._execution_order[order_index]]._accesses)
+		{
+			const sp_frame_graph_resource& resource = frame_graph._resources[access.resource.index];
+
+			access.load_action = sp_render_pass_load_action::load;
+			access.store_action = sp_render_pass_store_action::store;
+
+			if (!detail::sp_frame_graph_resource_usage_is_attachment(access.usage))
+			{
+				assert((resource._lifetime_begin != order_index || !detail::sp_frame_graph_resource_is_transient(resource)) && "transient resources have to be written as an attachment before they're used");
+				continue;
+			}
+
+			if (resource._lifetime_begin == order_index && (!resource._imported || resource._imported_back_buffer))
+			{
+				access.load_action = access.first_load_action;
+
+				// There's nothing to load
+				if (access.load_action == sp_render_pass_load_action::load && detail::sp_frame_graph_resource_is_transient(resource))
+				{
+					access.load_action = sp_render_pass_load_action::dont_care;
+				}
+			}
+
+			if (resource._lifetime_end == order_index && detail::sp_frame_graph_resource_is_transient(resource))
+			{
+				access.store_action = sp_render_pass_store_action::discard;
+			}
+		}
+	}
+
+	// Aliasing. Greedily hand each transient resource (in order of first use) the first physical texture with the same
+	// description whose current occupant is dead by then. Physical textures left over from a previous compile are reused
+	// before creating new ones so recompiling doesn't churn GPU memory.
+	std::vector<int> transient_resource_indices;
+	for (int resource_index = 0; resource_index < resource_count; ++resource_index)
+	{
+		const sp_frame_graph_resource& resource = frame_graph._resources[resource_index];
+		if (detail::sp_frame_graph_resource_is_transient(resource) && resource._lifetime_begin >= 0)
+		{
+			transient_resource_indices.push_back(resource_index);
+		}
+	}
+
+	std::stable_sort(transient_resource_indices.begin(), transient_resource_indices.end(), [&frame_graph](int lhs, int rhs) {
+		return frame_graph._resources[lhs]._lifetime_begin < frame_graph._resources[rhs]._lifetime_begin;
+	});
+
+	const int k_physical_texture_unassigned = -2;
+
+	for (auto& physical_texture : frame_graph._physical_textures)
+	{
+		physical_texture._lifetime_end = k_physical_texture_unassigned;
+	}
+
+	for (int resource_index : transient_resource_indices)
+	{
+		sp_frame_graph_resource& resource = frame_graph._resources[resource_index];
+		const sp_frame_graph_texture_desc desc = detail::sp_frame_graph_texture_desc_resolve(resource._desc);
+
+		int physical_texture_index = -1;
+
+		for (int i = 0; i < static_cast<int>(frame_graph._physical_textures.size()); ++i)
+		{
+			const sp_frame_graph_physical_texture& physical_texture = frame_graph._physical_textures[i];
+			if (physical_texture._lifetime_end != k_physical_texture_unassigned
+				&& physical_texture._lifetime_end < resource._lifetime_begin
+				&& detail::sp_frame_graph_texture_desc_equal(physical_texture._desc, desc))
+			{
+				physical_texture_index = i;
+				break;
+			}
+		}
+
+		if (physical_texture_index < 0)
+		{
+			for (int i = 0; i < static_cast<int>(frame_graph._physical_textures.size()); ++i)
+			{
+				const sp_frame_graph_physical_texture& physical_texture = frame_graph._physical_textures[i];
+				if (physical_texture._lifetime_end == k_physical_texture_unassigned
+					&& detail::sp_frame_graph_texture_desc_equal(physical_texture._desc, desc))
+				{
+					physical_texture_index = i;
+					break;
+				}
+			}
+		}
+
+		if (physical_texture_index < 0)
+		{
+			sp_frame_graph_physical_texture physical_texture;
+			physical_texture._desc = desc;
+			physical_texture._texture_handle = detail::sp_frame_graph_texture_create(resource._name, desc);
+
+			physical_texture_index = static_cast<int>(frame_graph._physical_textures.size());
+			frame_graph._physical_textures.push_back(physical_texture);
+		}
+
+		frame_graph._physical_textures[physical_texture_index]._lifetime_end = resource._lifetime_end;
+		resource._physical_texture_index = physical_texture_index;
+	}
+
+	// Release any physical textures nothing maps to anymore and compact the rest
+	{
+		std::vector<int> physical_texture_remap(frame_graph._physical_textures.size(), -1);
+		std::vector<sp_frame_graph_physical_texture> physical_textures;
+
+		for (int i = 0; i < static_cast<int>(frame_graph._physical_textures.size()); ++i)
+		{
+			const sp_frame_graph_physical_texture& physical_texture = frame_graph._physical_textures[i];
+			if (physical_texture._lifetime_end == k_physical_texture_unassigned)
+			{
+				sp_texture_destroy(physical_texture._texture_handle);
+			}
+			else
+			{
+				physical_texture_remap[i] = static_cast<int>(physical_textures.size());
+				physical_textures.push_back(physical_texture);
+			}
+		}
+
+		for (auto& resource : frame_graph._resources)
+		{
+			if (resource._physical_texture_index >= 0)
+			{
+				resource._physical_texture_index = physical_texture_remap[resource._physical_texture_index];
+			}
+		}
+
+		frame_graph._physical_textures = std::move(physical_textures);
+	}
+
+	// History resources get their own pair of textures. Both are recreated if the size changed.
+	for (auto& resource : frame_graph._resources)
+	{
+		if (!resource._history)
+		{
+			continue;
+		}
+
+		const sp_frame_graph_texture_desc desc = detail::sp_frame_graph_texture_desc_resolve(resource._desc);
+
+		if (!resource._history_texture_handles[0] || !detail::sp_frame_graph_texture_desc_equal(resource._history_texture_desc, desc))
+		{
+			for (sp_texture_handle& texture_handle : resource._history_texture_handles)
+			{
+				if (texture_handle)
+				{
+					sp_texture_destroy(texture_handle);
+				}
+
+				texture_handle = detail::sp_frame_graph_texture_create(resource._name, desc);
+			}
+
+			resource._history_texture_desc = desc;
+			resource._history_frame_num_created = frame_graph._frame_num;
+		}
+	}
+
+	// Barriers. A barrier is needed whenever a resource is used differently from the last task that touched it, and between
+	// back to back unordered accesses. Transient resources are tracked per physical texture since that's what actually changes
+	// state, so the first use of a resource transitions from whatever the previous occupant left behind. Everything, physical
+	// textures included, is back in its default state by the end of the frame. These are the barriers sp_frame_graph_execute
+	// records and the ones that get exported.
+	std::vector<sp_frame_graph_resource_usage> resource_usage(resource_count, sp_frame_graph_resource_usage::none);
+	std::vector<sp_frame_graph_resource_usage> physical_texture_usage(frame_graph._physical_textures.size(), sp_frame_graph_resource_usage::none);
+	std::vector<sp_frame_graph_resource_handle> physical_texture_last_resource(frame_graph._physical_textures.size());
+
+	for (int task_index : frame_graph._execution_order)
+	{
+		sp_frame_graph_task& task = frame_graph._tasks[task_index];
+
+		for (const auto& access : task._accesses)
+		{
+			const int physical_texture_index = frame_graph._resources[access.resource.index]._physical_texture_index;
+
+			sp_frame_graph_resource_usage& usage = physical_texture_index >= 0 ? physical_texture_usage[physical_texture_index] : resource_usage[access.resource.index];
+			if (usage != access.usage || access.usage == sp_frame_graph_resource_usage::unordered_access)
+			{
+				task._barriers.push_back({ access.resource, usage, access.usage });
+			}
+			usage = access.usage;
+
+			if (physical_texture_index >= 0)
+			{
+				physical_texture_last_resource[physical_texture_index] = access.resource;
+			}
+		}
+	}
+
+	frame_graph._final_barriers.clear();
+	for (int resource_index = 0; resource_index < resource_count; ++resource_index)
+	{
+		if (resource_usage[resource_index] != sp_frame_graph_resource_usage::none)
+		{
+			sp_frame_graph_resource_handle resource_handle;
+			resource_handle.index = static_cast<short>(resource_index);
+
+			frame_graph._final_barriers.push_back({ resource_handle, resource_usage[resource_index], sp_frame_graph_resource_usage::none });
+		}
+	}
+
+	for (int physical_texture_index = 0; physical_texture_index < static_cast<int>(frame_graph._physical_textures.size()); ++physical_texture_index)
+	{
+		if (physical_texture_usage[physical_texture_index] != sp_frame_graph_resource_usage::none)
+		{
+			frame_graph._final_barriers.push_back({ physical_texture_last_resource[physical_texture_index], physical_texture_usage[physical_texture_index], sp_frame_graph_resource_usage::none });
+		}
+	}
+
+	const sp_texture& back_buffer = detail::sp_texture_pool_get(detail::_sp._back_buffer_texture_handles[detail::_sp._back_buffer_index]);
+	frame_graph._back_buffer_width = back_buffer._width;
+	frame_graph._back_buffer_height = back_buffer._height;
+
+	frame_graph._compiled = true;
+}
+
+sp_texture_handle sp_frame_graph_get_texture(const sp_frame_graph& frame_graph, sp_frame_graph_resource_handle resource_handle)
+{
+	const sp_frame_graph_resource& resource = frame_graph._resources[resource_handle.index];
+
+	if (resource._imported_back_buffer)
+	{
+		return detail::_sp._back_buffer_texture_handles[detail::_sp._back_buffer_index];
+	}
+
+	if (resource._imported)
+	{
+		return resource._imported_texture_handle;
+	}
+
+	// The two history textures swap roles every frame
+	if (resource._history)
+	{
+		return resource._history_texture_handles[frame_graph._frame_num % 2];
+	}
+
+	if (resource._history_source)
+	{
+		return frame_graph._resources[resource._history_source.index]._history_texture_handles[(frame_graph._frame_num + 1) % 2];
+	}
+
+	assert(resource._physical_texture_index >= 0 && "resource was culled or the frame graph hasn't been compiled");
+
+	return frame_graph._physical_textures[resource._physical_texture_index]._texture_handle;
+}
+
+sp_frame_graph_texture_desc sp_frame_graph_get_texture_desc(const sp_frame_graph& frame_graph, sp_frame_graph_resource_handle resource_handle)
+{
+	return detail::sp_frame_graph_resource_get_desc(frame_graph._resources[resource_handle.index]);
+}
+
+namespace detail
+{
+	D3D12_RESOURCE_STATES sp_frame_graph_resource_usage_get_d3d12(sp_frame_graph_resource_usage usage, D3D12_RESOURCE_STATES default_state)
+	{
+		switch (usage)
+		{
+		case sp_frame_graph_resource_usage::none:             return default_state;
+		case sp_frame_graph_resource_usage::render_target:    return D3D12_RESOURCE_STATE_RENDER_TARGET;
+		case sp_frame_graph_resource_usage::depth_stencil:    return D3D12_RESOURCE_STATE_DEPTH_WRITE;
+		case sp_frame_graph_resource_usage::shader_resource:  return D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+		case sp_frame_graph_resource_usage::unordered_access: return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		};
+
+		assert(false);
+
+		return default_state;
+	}
+
+	// Barriers that end up in the same D3D12 state (e.g. to none when that's the default) are dropped, back to back unordered
+	// accesses become UAV barriers
+	int sp_frame_graph_barriers_get_d3d12(const sp_frame_graph& frame_graph, const std::vector<sp_frame_graph_barrier>& barriers, D3D12_RESOURCE_BARRIER* barriers_d3d12, int barrier_count_max)
+	{
+		int barrier_count = 0;
+
+		for (const auto& barrier : barriers)
+		{
+			const sp_texture& texture = sp_texture_pool_get(sp_frame_graph_get_texture(frame_graph, barrier.resource));
+
+			const D3D12_RESOURCE_STATES state_before = sp_frame_graph_resource_usage_get_d3d12(barrier.usage_before, texture._default_state);
+			const D3D12_RESOURCE_STATES state_after = sp_frame_graph_resource_usage_get_d3d12(barrier.usage_after, texture._default_state);
+
+			if (state_before == state_after && barrier.usage_after != sp_frame_graph_resource_usage::unordered_access)
+			{
+				continue;
+			}
+
+			assert(barrier_count < barrier_count_max);
+
+			barriers_d3d12[barrier_count++] = state_before == state_after
+				? CD3DX12_RESOURCE_BARRIER::UAV(texture._resource.Get())
+				: CD3DX12_RESOURCE_BARRIER::Transition(texture._resource.Get(), state_before, state_after);
+		}
+
+		return barrier_count;
+	}
+}
+
+void sp_frame_graph_execute(sp_frame_graph& frame_graph, sp_graphics_command_list& graphics_command_list)
+{
+	const sp_texture& back_buffer = detail::sp_texture_pool_get(detail::_sp._back_buffer_texture_handles[detail::_sp._back_buffer_index]);
+	if (back_buffer._width != frame_graph._back_buffer_width || back_buffer._height != frame_graph._back_buffer_height)
+	{
+		frame_graph._compiled = false;
+	}
+
+	if (!frame_graph._compiled)
+	{
+		sp_frame_graph_compile(frame_graph);
+	}
+
+	frame_graph._cpu_frame_begin_us = detail::sp_frame_graph_get_time_us(frame_graph);
+
+	// Whatever was drawn before the graph has to be back in its default state, which is where the graph starts from
+	detail::sp_graphics_command_list_restore_default_resource_states(graphics_command_list);
+
+	D3D12_RESOURCE_BARRIER barriers_d3d12[64];
+
+	for (int task_index : frame_graph._execution_order)
+	{
+		sp_frame_graph_task& task = frame_graph._tasks[task_index];
+
+		task._cpu_record_begin_us = detail::sp_frame_graph_get_time_us(frame_graph);
+
+		sp_graphics_command_list_debug_group_push(graphics_command_list, task._name);
+
+		const int barrier_count = detail::sp_frame_graph_barriers_get_d3d12(frame_graph, task._barriers, barriers_d3d12, static_cast<int>(std::size(barriers_d3d12)));
+		if (barrier_count > 0)
+		{
+			graphics_command_list._command_list_d3d12->ResourceBarrier(barrier_count, barriers_d3d12);
+		}
+
+		sp_render_pass_desc render_pass;
+
+		for (const auto& access : task._accesses)
+		{
+			if (access.usage == sp_frame_graph_resource_usage::render_target)
+			{
+				assert(render_pass.render_target_count < static_cast<int>(std::size(render_pass.render_targets)));
+				render_pass.render_targets[render_pass.render_target_count++] = { sp_frame_graph_get_texture(frame_graph, access.resource), access.load_action, access.store_action };
+			}
+			else if (access.usage == sp_frame_graph_resource_usage::depth_stencil)
+			{
+				render_pass.depth_stencil = { sp_frame_graph_get_texture(frame_graph, access.resource), access.load_action, access.store_action };
+			}
+		}
+
+		// Only graphics tasks can have attachments
+		const bool has_attachments = render_pass.render_target_count > 0 || render_pass.depth_stencil.texture_handle;
+
+		if (has_attachments)
+		{
+			detail::sp_graphics_command_list_begin_render_pass(graphics_command_list, render_pass, false);
+
+			const sp_texture& texture = detail::sp_texture_pool_get(render_pass.render_target_count > 0 ? render_pass.render_targets[0].texture_handle : render_pass.depth_stencil.texture_handle);
+			sp_graphics_command_list_set_viewport(graphics_command_list, { 0.0f, 0.0f, static_cast<float>(texture._width), static_cast<float>(texture._height) });
+			sp_graphics_command_list_set_scissor_rect(graphics_command_list, { 0, 0, texture._width, texture._height });
+		}
+
+		if (task._execute)
+		{
+			task._execute(graphics_command_list);
+		}
+
+		if (has_attachments)
+		{
+			sp_graphics_command_list_end_render_pass(graphics_command_list);
+		}
+
+		sp_graphics_command_list_debug_group_pop(graphics_command_list);
+
+		task._cpu_record_duration_us = detail::sp_frame_graph_get_time_us(frame_graph) - task._cpu_record_begin_us;
+	}
+
+	// The end of frame barriers are handed to the command list the same way sp_graphics_command_list_set_render_targets leaves
+	// its transitions, as the transition away from the default state that it reverses later
+	const int final_barrier_count = detail::sp_frame_graph_barriers_get_d3d12(frame_graph, frame_graph._final_barriers, barriers_d3d12, static_cast<int>(std::size(barriers_d3d12)));
+	assert(final_barrier_count <= static_cast<int>(std::size(graphics_command_list._resource_transition_records)));
+
+	for (int i = 0; i < final_barrier_count; ++i)
+	{
+		std::swap(barriers_d3d12[i].Transition.StateBefore, barriers_d3d12[i].Transition.StateAfter);
+		graphics_command_list._resource_transition_records[i] = barriers_d3d12[i];
+	}
+	graphics_command_list._resource_transition_records_count = final_barrier_count;
+
+	frame_graph._cpu_frame_duration_us = detail::sp_frame_graph_get_time_us(frame_graph) - frame_graph._cpu_frame_begin_us;
+
+	++frame_graph._frame_num;
+}
+
+namespace detail
+{
+	void sp_frame_graph_export_graphviz_barriers(FILE* file, const sp_frame_graph& frame_graph, const std::vector<sp_frame_graph_barrier>& barriers)
+	{
+		for (const auto& barrier : barriers)
+		{
+			fprintf(file, "\\n%s: %s -> %s",
+				frame_graph._resources[barrier.resource.index]._name,
+				sp_frame_graph_resource_usage_get_name(barrier.usage_before),
+				sp_frame_graph_resource_usage_get_name(barrier.usage_after));
+		}
+	}
+
+	void sp_frame_graph_export_graphviz_resource(FILE* file, const sp_frame_graph& frame_graph, int resource_index, const char* indent)
+	{
+		const sp_frame_graph_resource& resource = frame_graph._resources[resource_index];
+		const sp_frame_graph_texture_desc desc = sp_frame_graph_resource_get_desc(resource);
+
+		fprintf(file, "%sresource_%d [shape=%s, label=\"%s\\n%dx%d %s",
+			indent,
+			resource_index,
+			detail::sp_frame_graph_resource_is_transient(resource) ? "ellipse" : "doubleoctagon",
+			resource._name,
+			desc.width,
+			desc.height,
+			sp_texture_format_get_name(desc.format));
+
+		if (resource._imported)
+		{
+			fprintf(file, "\\nimported");
+		}
+		else if (resource._history)
+		{
+			fprintf(file, "\\nhistory");
+		}
+		else if (resource._history_source)
+		{
+			fprintf(file, "\\nhistory (previous frame)");
+		}
+
+		if (resource._desc.size == sp_frame_graph_texture_size::relative_to_back_buffer)
+		{
+			fprintf(file, "\\n%.2fx back buffer", resource._desc.scale);
+		}
+
+		if (resource._lifetime_begin >= 0)
+		{
+			fprintf(file, "\\nlifetime [%d, %d]", resource._lifetime_begin, resource._lifetime_end);
+		}
+		else
+		{
+			fprintf(file, "\\nunused");
+		}
+
+		fprintf(file, "\"];\n");
+	}
+}
+
+bool sp_frame_graph_export_graphviz(const sp_frame_graph& frame_graph, const char* path)
+{
+	assert(frame_graph._compiled);
+
+	FILE* file = nullptr;
+	if (fopen_s(&file, path, "w") != 0)
+	{
+		sp_log("sp_frame_graph_export_graphviz: failed to open '%s'", path);
+		return false;
+	}
+
+	fprintf(file, "digraph \"%s\"\n{\n", frame_graph._name);
+	fprintf(file, "\trankdir=LR;\n");
+	fprintf(file, "\tnode [fontname=\"Consolas\", fontsize=10];\n");
+	fprintf(file, "\tedge [fontname=\"Consolas\", fontsize=9];\n");
+	fprintf(file, "\n");
+
+	// Tasks. Barriers are listed on the task that has to wait for them.
+	for (int task_index = 0; task_index < static_cast<int>(frame_graph._tasks.size()); ++task_index)
+	{
+		const sp_frame_graph_task& task = frame_graph._tasks[task_index];
+
+		fprintf(file, "\ttask_%d [shape=box, style=\"%s\", fillcolor=\"%s\", label=\"%s\\n%s",
+			task_index,
+			task._culled ? "filled,dashed" : "filled",
+			task._culled ? "#dddddd" : (task._queue == sp_frame_graph_queue::graphics ? "#f4a460" : "#87ceeb"),
+			task._name,
+			detail::sp_frame_graph_queue_get_name(task._queue));
+
+		if (task._culled)
+		{
+			fprintf(file, " (culled)");
+		}
+		else
+		{
+			const auto order = std::find(frame_graph._execution_order.begin(), frame_graph._execution_order.end(), task_index);
+			fprintf(file, " #%d", static_cast<int>(order - frame_graph._execution_order.begin()));
+		}
+
+		detail::sp_frame_graph_export_graphviz_barriers(file, frame_graph, task._barriers);
+
+		fprintf(file, "\"];\n");
+	}
+
+	fprintf(file, "\tend_of_frame [shape=box, style=rounded, label=\"end of frame");
+	detail::sp_frame_graph_export_graphviz_barriers(file, frame_graph, frame_graph._final_barriers);
+	fprintf(file, "\"];\n");
+	fprintf(file, "\n");
+
+	// Resources. Transient resources sharing a physical texture are clustered by alias group.
+	for (int physical_texture_index = 0; physical_texture_index < static_cast<int>(frame_graph._physical_textures.size()); ++physical_texture_index)
+	{
+		fprintf(file, "\tsubgraph cluster_alias_group_%d\n\t{\n", physical_texture_index);
+		fprintf(file, "\t\tlabel=\"alias group %d\";\n", physical_texture_index);
+		fprintf(file, "\t\tstyle=dashed;\n");
+
+		for (int resource_index = 0; resource_index < static_cast<int>(frame_graph._resources.size()); ++resource_index)
+		{
+			if (frame_graph._resources[resource_index]._physical_texture_index == physical_texture_index)
+			{
+				detail::sp_frame_graph_export_graphviz_resource(file, frame_graph, resource_index, "\t\t");
+			}
+		}
+
+		fprintf(file, "\t}\n");
+	}
+
+	for (int resource_index = 0; resource_index < static_cast<int>(frame_graph._resources.size()); ++resource_index)
+	{
+		if (frame_graph._resources[resource_index]._physical_texture_index < 0)
+		{
+			detail::sp_frame_graph_export_graphviz_resource(file, frame_graph, resource_index, "\t");
+		}
+	}
+
+	fprintf(file, "\n");
+
+	// Edges
+	for (int task_index = 0; task_index < static_cast<int>(frame_graph._tasks.size()); ++task_index)
+	{
+		for (const auto& access : frame_graph._tasks[task_index]._accesses)
+		{
+			const char* usage_name = detail::sp_frame_graph_resource_usage_get_name(access.usage);
+
+			if (access.usage == sp_frame_graph_resource_usage::unordered_access)
+			{
+				fprintf(file, "\ttask_%d -> resource_%d [dir=both, label=\"%s\"];\n", task_index, access.resource.index, usage_name);
+			}
+			else if (detail::sp_frame_graph_resource_usage_is_attachment(access.usage))
+			{
+				fprintf(file, "\ttask_%d -> resource_%d [label=\"%s\\n%s / %s\"];\n",
+					task_index,
+					access.resource.index,
+					usage_name,
+					detail::sp_render_pass_load_action_get_name(access.load_action),
+					detail::sp_render_pass_store_action_get_name(access.store_action));
+			}
+			else
+			{
+				fprintf(file, "\tresource_%d -> task_%d [label=\"%s\"];\n", access.resource.index, task_index, usage_name);
+			}
+		}
+	}
+
+	for (const auto& barrier : frame_graph._final_barriers)
+	{
+		fprintf(file, "\tresource_%d -> end_of_frame [style=dotted];\n", barrier.resource.index);
+	}
+
+	fprintf(file, "}\n");
+
+	fclose(file);
+
+	return true;
+}
+
+namespace detail
+{
+	// Names come from user code so quotes, backslashes and control characters have to be escaped to keep the JSON valid
+	void sp_frame_graph_export_json_string(FILE* file, const char* string)
+	{
+		fputc('"', file);
+
+		for (const char* c = string; *c; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				fputc('\\', file);
+				fputc(*c, file);
+			}
+			else if (static_cast<unsigned char>(*c) < 0x20)
+			{
+				fprintf(file, "\\u%04x", static_cast<unsigned char>(*c));
+			}
+			else
+			{
+				fputc(*c, file);
+			}
+		}
+
+		fputc('"', file);
+	}
+}
+
+bool sp_frame_graph_export_chrome_trace(const sp_frame_graph& frame_graph, const char* path)
+{
+	FILE* file = nullptr;
+	if (fopen_s(&file, path, "w") != 0)
+	{
+		sp_log("sp_frame_graph_export_chrome_trace: failed to open '%s'", path);
+		return false;
+	}
+
+	// One thread per queue the task was assigned to. Tasks nest under a frame event on the graphics queue.
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"displayTimeUnit\": \"ms\",\n");
+	fprintf(file, "\t\"traceEvents\": [\n");
+	fprintf(file, "\t\t{ \"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, \"args\": { \"name\": ");
+	detail::sp_frame_graph_export_json_string(file, frame_graph._name);
+	fprintf(file, " } },\n");
+	fprintf(file, "\t\t{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": { \"name\": \"graphics\" } },\n", static_cast<int>(sp_frame_graph_queue::graphics));
+	fprintf(file, "\t\t{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": { \"name\": \"compute\" } },\n", static_cast<int>(sp_frame_graph_queue::compute));
+	fprintf(file, "\t\t{ \"name\": \"frame %d\", \"cat\": \"frame\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f }",
+		frame_graph._frame_num - 1,
+		static_cast<int>(sp_frame_graph_queue::graphics),
+		frame_graph._cpu_frame_begin_us,
+		frame_graph._cpu_frame_duration_us);
+
+	for (int order_index = 0; order_index < static_cast<int>(frame_graph._execution_order.size()); ++order_index)
+	{
+		const sp_frame_graph_task& task = frame_graph._tasks[frame_graph._execution_order[order_index]];
+
+		fprintf(file, ",\n\t\t{ \"name\": ");
+		detail::sp_frame_graph_export_json_string(file, task._name);
+		fprintf(file, ", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": { \"order\": %d, \"barriers\": %d } }",
+			detail::sp_frame_graph_queue_get_name(task._queue),
+			static_cast<int>(task._queue),
+			task._cpu_record_begin_us,
+			task._cpu_record_duration_us,
+			order_index,
+			static_cast<int>(task._barriers.size()));
+	}
+
+	fprintf(file, "\n\t]\n");
+	fprintf(file, "}\n");
+
+	fclose(file);
+
+	return true;
+}
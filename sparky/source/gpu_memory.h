@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#define NOMINMAX
+#include <d3d12.h>
+
+#include <wrl.h>
+
+// Sub-allocates GPU memory out of a few large heaps instead of giving every resource its own committed allocation. Each pool
+// hands out blocks from pages with a buddy allocator. Buffer pools place one buffer over the whole page so a block is just an
+// offset into it, texture pools and the placed buffer pool place a resource per block.
+//
+// A buddy allocator only deals in power of two blocks, which on its own wastes up to half of every block. Blocks here give
+// the part of their power of two past their size straight back, so a block only takes its size rounded up to the pool's
+// smallest block (256 bytes for shared buffers, 64KB for anything placed) and the rest goes to other blocks.
+
+// Pages are at least this big. Anything bigger gets a page of its own rounded up to a power of two, the rest of which is left
+// for smaller blocks.
+const UINT64 k_gpu_memory_page_size_bytes = 64 * 1024 * 1024;
+
+// Per pool. Pages live in a fixed array and are never moved or freed before shutdown, so blocks can be looked up without
+// taking the lock.
+const int k_gpu_memory_page_count_max = 64;
+
+enum class sp_gpu_memory_pool_type
+{
+	default_buffers,		// Vertex and other static buffers, written through the copy queue
+	upload_buffers,			// CPU writable, persistently mapped. Constant buffers and staging.
+	default_textures,		// Textures that aren't render or depth targets
+	placed_buffers,			// Buffers that need their own resource state or unordered access. Blocks are at least 64KB.
+	count,
+};
+
+struct sp_gpu_memory_block
+{
+	sp_gpu_memory_pool_type _pool_type = sp_gpu_memory_pool_type::count;
+	int _page_index = -1;
+	UINT64 _offset_bytes = 0;
+	UINT64 _size_bytes = 0;
+};
+
+namespace detail
+{
+	// Hands out blocks of [0, size) aligned to their size rounded up to a power of two. Splits bigger blocks on alloc, gives the
+	// end of the power of two the block doesn't use straight back and merges buddies back together on free.
+	struct sp_buddy_allocator
+	{
+		UINT64 _min_block_size_bytes = 0;
+		int _order_count = 0;
+
+		// Free block offsets for each order, where order n holds blocks of _min_block_size_bytes << n
+		std::vector<std::set<UINT64>> _free_blocks;
+	};
+
+	const UINT64 k_buddy_allocator_invalid_offset = ~0ull;
+
+	void sp_buddy_allocator_init(sp_buddy_allocator& allocator, UINT64 size_bytes, UINT64 min_block_size_bytes);
+	UINT64 sp_buddy_allocator_alloc(sp_buddy_allocator& allocator, UINT64 size_bytes);
+	void sp_buddy_allocator_free(sp_buddy_allocator& allocator, UINT64 offset_bytes, UINT64 size_bytes);
+
+	struct sp_gpu_memory_page
+	{
+		Microsoft::WRL::ComPtr<ID3D12Heap> _heap;
+		Microsoft::WRL::ComPtr<ID3D12Resource> _buffer;		// Shared buffer pools only
+		uint8_t* _buffer_cpu = nullptr;						// Upload pools only
+		UINT64 _size_bytes = 0;
+		sp_buddy_allocator _allocator;
+	};
+
+	struct sp_gpu_memory_pool
+	{
+		std::mutex _mutex;
+		sp_gpu_memory_pool_type _type = sp_gpu_memory_pool_type::count;
+
+		// Only added to under the lock. Slots below _page_count are never written again until shutdown.
+		std::unique_ptr<sp_gpu_memory_page> _pages[k_gpu_memory_page_count_max];
+		int _page_count = 0;
+	};
+
+	void sp_gpu_memory_init();
+	void sp_gpu_memory_destroy();
+
+	// Alignment has to be a power of two. Blocks are aligned to their size rounded up to a power of two so anything up to that
+	// is free.
+	sp_gpu_memory_block sp_gpu_memory_alloc(sp_gpu_memory_pool_type pool_type, UINT64 size_bytes, UINT64 alignment_bytes);
+	void sp_gpu_memory_free(sp_gpu_memory_block& block);
+
+	ID3D12Heap* sp_gpu_memory_get_heap(const sp_gpu_memory_block& block);
+
+	// Shared buffer pools only. The buffer is shared by every block in the page so use the offset.
+	ID3D12Resource* sp_gpu_memory_get_buffer(const sp_gpu_memory_block& block);
+	D3D12_GPU_VIRTUAL_ADDRESS sp_gpu_memory_get_gpu_address(const sp_gpu_memory_block& block);
+
+	// Upload pool only
+	uint8_t* sp_gpu_memory_get_cpu_address(const sp_gpu_memory_block& block);
+}
\ No newline at end of file
@@ -0,0 +1,317 @@
+#pragma once
+
+#include "gpu_memory.h"
+#include "sparky.h"
+#include "d3dx12.h"
+
+#include <cassert>
+#include <algorithm>
+
+#define NOMINMAX
+#include <d3d12.h>
+
+namespace detail
+{
+	int sp_buddy_allocator_get_order(const sp_buddy_allocator& allocator, UINT64 size_bytes)
+	{
+		int order = 0;
+		while ((allocator._min_block_size_bytes << order) < size_bytes)
+		{
+			++order;
+		}
+		return order;
+	}
+
+	void sp_buddy_allocator_init(sp_buddy_allocator& allocator, UINT64 size_bytes, UINT64 min_block_size_bytes)
+	{
+		assert((size_bytes & (size_bytes - 1)) == 0 && "size must be a power of two");
+		assert((min_block_size_bytes & (min_block_size_bytes - 1)) == 0 && "min block size must be a power of two");
+		assert(size_bytes >= min_block_size_bytes);
+
+		allocator._min_block_size_bytes = min_block_size_bytes;
+		allocator._order_count = sp_buddy_allocator_get_order(allocator, size_bytes) + 1;
+		allocator._free_blocks.clear();
+		allocator._free_blocks.resize(allocator._order_count);
+		allocator._free_blocks[allocator._order_count - 1].insert(0);
+	}
+
+	// Calls visit(offset, order) for each of the pieces a block of size_bytes at offset_bytes is made of, and free(offset, order)
+	// for each of the pieces of its power of two it doesn't use. Each piece is aligned to its own size since everything before
+	// it in the block is made of bigger ones.
+	template <typename visit_function, typename free_function>
+	void sp_buddy_allocator_split(const sp_buddy_allocator& allocator, UINT64 offset_bytes, UINT64 size_bytes, visit_function&& visit, free_function&& free)
+	{
+		int order = sp_buddy_allocator_get_order(allocator, size_bytes);
+		UINT64 remaining_bytes = std::max((size_bytes + allocator._min_block_size_bytes - 1) / allocator._min_block_size_bytes, 1ull) * allocator._min_block_size_bytes;
+
+		while ((allocator._min_block_size_bytes << order) != remaining_bytes)
+		{
+			--order;
+			const UINT64 half_bytes = allocator._min_block_size_bytes << order;
+
+			if (remaining_bytes > half_bytes)
+			{
+				visit(offset_bytes, order);
+				offset_bytes += half_bytes;
+				remaining_bytes -= half_bytes;
+			}
+			else
+			{
+				free(offset_bytes + half_bytes, order);
+			}
+		}
+
+		visit(offset_bytes, order);
+	}
+
+	// Puts a free block back, merging with its buddy for as long as that's free too
+	void sp_buddy_allocator_free_order(sp_buddy_allocator& allocator, UINT64 offset_bytes, int order)
+	{
+		while (order < allocator._order_count - 1)
+		{
+			const UINT64 buddy_offset_bytes = offset_bytes ^ (allocator._min_block_size_bytes << order);
+			if (allocator._free_blocks[order].erase(buddy_offset_bytes) == 0)
+			{
+				break;
+			}
+
+			offset_bytes = std::min(offset_bytes, buddy_offset_bytes);
+			++order;
+		}
+
+		allocator._free_blocks[order].insert(offset_bytes);
+	}
+
+	UINT64 sp_buddy_allocator_alloc(sp_buddy_allocator& allocator, UINT64 size_bytes)
+	{
+		const int order = sp_buddy_allocator_get_order(allocator, size_bytes);
+		if (order >= allocator._order_count)
+		{
+			return k_buddy_allocator_invalid_offset;
+		}
+
+		int free_order = order;
+		while (free_order < allocator._order_count && allocator._free_blocks[free_order].empty())
+		{
+			++free_order;
+		}
+
+		if (free_order == allocator._order_count)
+		{
+			return k_buddy_allocator_invalid_offset;
+		}
+
+		// Lowest offset first keeps allocations packed towards the start of the page
+		const UINT64 offset_bytes = *allocator._free_blocks[free_order].begin();
+		allocator._free_blocks[free_order].erase(allocator._free_blocks[free_order].begin());
+
+		// Split until it's the right size, freeing the upper half each time
+		while (free_order > order)
+		{
+			--free_order;
+			allocator._free_blocks[free_order].insert(offset_bytes + (allocator._min_block_size_bytes << free_order));
+		}
+
+		// Then give back whatever the block doesn't use of it. Nothing around those pieces is free so there's nothing to merge.
+		sp_buddy_allocator_split(allocator, offset_bytes, size_bytes, [](UINT64, int) {}, [&](UINT64 free_offset_bytes, int free_order) {
+			allocator._free_blocks[free_order].insert(free_offset_bytes);
+		});
+
+		return offset_bytes;
+	}
+
+	void sp_buddy_allocator_free(sp_buddy_allocator& allocator, UINT64 offset_bytes, UINT64 size_bytes)
+	{
+		sp_buddy_allocator_split(allocator, offset_bytes, size_bytes, [&](UINT64 piece_offset_bytes, int piece_order) {
+			sp_buddy_allocator_free_order(allocator, piece_offset_bytes, piece_order);
+		}, [](UINT64, int) {});
+	}
+
+	sp_gpu_memory_pool& sp_gpu_memory_get_pool(sp_gpu_memory_pool_type pool_type)
+	{
+		return _sp._gpu_memory_pools[static_cast<int>(pool_type)];
+	}
+
+	std::unique_ptr<sp_gpu_memory_page> sp_gpu_memory_page_create(sp_gpu_memory_pool_type pool_type, UINT64 size_bytes)
+	{
+		auto page = std::make_unique<sp_gpu_memory_page>();
+
+		D3D12_HEAP_TYPE heap_type = D3D12_HEAP_TYPE_DEFAULT;
+		D3D12_HEAP_FLAGS heap_flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+		UINT64 min_block_size_bytes = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+
+		switch (pool_type)
+		{
+		case sp_gpu_memory_pool_type::default_buffers:
+			break;
+		case sp_gpu_memory_pool_type::upload_buffers:
+			heap_type = D3D12_HEAP_TYPE_UPLOAD;
+			break;
+		case sp_gpu_memory_pool_type::default_textures:
+			heap_flags = D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+			min_block_size_bytes = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+			break;
+		case sp_gpu_memory_pool_type::placed_buffers:
+			min_block_size_bytes = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+			break;
+		default:
+			assert(false);
+		}
+
+		const CD3DX12_HEAP_DESC heap_desc_d3dx12(size_bytes, heap_type, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, heap_flags);
+		HRESULT hr = _sp._device->CreateHeap(&heap_desc_d3dx12, IID_PPV_ARGS(&page->_heap));
+		assert(SUCCEEDED(hr));
+
+		if (pool_type == sp_gpu_memory_pool_type::default_buffers || pool_type == sp_gpu_memory_pool_type::upload_buffers)
+		{
+			// Buffers in the common state are promoted to whatever the queue needs and, since buffers allow simultaneous access,
+			// the copy queue can write one block while another queue reads a different one
+			const D3D12_RESOURCE_STATES state = heap_type == D3D12_HEAP_TYPE_UPLOAD ? D3D12_RESOURCE_STATE_GENERIC_READ : D3D12_RESOURCE_STATE_COMMON;
+
+			const auto buffer_desc_d3dx12 = CD3DX12_RESOURCE_DESC::Buffer(size_bytes);
+			hr = _sp._device->CreatePlacedResource(page->_heap.Get(), 0, &buffer_desc_d3dx12, state, nullptr, IID_PPV_ARGS(&page->_buffer));
+			assert(SUCCEEDED(hr));
+
+			if (heap_type == D3D12_HEAP_TYPE_UPLOAD)
+			{
+				const CD3DX12_RANGE read_range(0, 0);
+				hr = page->_buffer->Map(0, &read_range, reinterpret_cast<void**>(&page->_buffer_cpu));
+				assert(SUCCEEDED(hr));
+			}
+		}
+
+#if SP_DEBUG_RESOURCE_NAMING_ENABLED
+		const wchar_t* names[] = { L"gpu_memory_default_buffers", L"gpu_memory_upload_buffers", L"gpu_memory_default_textures", L"gpu_memory_placed_buffers" };
+		page->_heap->SetName(names[static_cast<int>(pool_type)]);
+		if (page->_buffer)
+		{
+			page->_buffer->SetName(names[static_cast<int>(pool_type)]);
+		}
+#endif
+
+		page->_size_bytes = size_bytes;
+		sp_buddy_allocator_init(page->_allocator, size_bytes, min_block_size_bytes);
+
+		return page;
+	}
+
+	void sp_gpu_memory_init()
+	{
+		for (int i = 0; i < static_cast<int>(sp_gpu_memory_pool_type::count); ++i)
+		{
+			_sp._gpu_memory_pools[i]._type = static_cast<sp_gpu_memory_pool_type>(i);
+		}
+	}
+
+	void sp_gpu_memory_destroy()
+	{
+		for (auto& pool : _sp._gpu_memory_pools)
+		{
+			for (int i = 0; i < pool._page_count; ++i)
+			{
+				if (pool._pages[i]->_buffer_cpu)
+				{
+					pool._pages[i]->_buffer->Unmap(0, nullptr);
+				}
+
+				pool._pages[i].reset();
+			}
+
+			pool._page_count = 0;
+		}
+	}
+
+	sp_gpu_memory_block sp_gpu_memory_alloc(sp_gpu_memory_pool_type pool_type, UINT64 size_bytes, UINT64 alignment_bytes)
+	{
+		assert((alignment_bytes & (alignment_bytes - 1)) == 0 && "alignment must be a power of two");
+
+		sp_gpu_memory_pool& pool = sp_gpu_memory_get_pool(pool_type);
+
+		sp_gpu_memory_block block;
+		block._pool_type = pool_type;
+		block._size_bytes = std::max(size_bytes, alignment_bytes);
+
+		std::lock_guard<std::mutex> lock(pool._mutex);
+
+		for (int page_index = 0; page_index < pool._page_count; ++page_index)
+		{
+			const UINT64 offset_bytes = sp_buddy_allocator_alloc(pool._pages[page_index]->_allocator, block._size_bytes);
+			if (offset_bytes != k_buddy_allocator_invalid_offset)
+			{
+				block._page_index = page_index;
+				block._offset_bytes = offset_bytes;
+
+				return block;
+			}
+		}
+
+		UINT64 page_size_bytes = k_gpu_memory_page_size_bytes;
+		while (page_size_bytes < block._size_bytes)
+		{
+			page_size_bytes *= 2;
+		}
+
+		assert(pool._page_count < k_gpu_memory_page_count_max && "out of gpu memory pages");
+
+		block._page_index = pool._page_count;
+		pool._pages[pool._page_count++] = sp_gpu_memory_page_create(pool_type, page_size_bytes);
+
+		block._offset_bytes = sp_buddy_allocator_alloc(pool._pages[block._page_index]->_allocator, block._size_bytes);
+		assert(block._offset_bytes != k_buddy_allocator_invalid_offset);
+
+		return block;
+	}
+
+	void sp_gpu_memory_free(sp_gpu_memory_block& block)
+	{
+		if (block._page_index < 0)
+		{
+			return;
+		}
+
+		sp_gpu_memory_pool& pool = sp_gpu_memory_get_pool(block._pool_type);
+
+		{
+			std::lock_guard<std::mutex> lock(pool._mutex);
+
+			sp_buddy_allocator_free(pool._pages[block._page_index]->_allocator, block._offset_bytes, block._size_bytes);
+		}
+
+		block = sp_gpu_memory_block();
+	}
+
+	// Without the lock, see k_gpu_memory_page_count_max. The block's page was added before the block was handed out.
+	const sp_gpu_memory_page& sp_gpu_memory_get_page(const sp_gpu_memory_block& block)
+	{
+		assert(block._page_index >= 0 && block._page_index < k_gpu_memory_page_count_max);
+
+		const sp_gpu_memory_page* page = sp_gpu_memory_get_pool(block._pool_type)._pages[block._page_index].get();
+		assert(page);
+
+		return *page;
+	}
+
+	ID3D12Heap* sp_gpu_memory_get_heap(const sp_gpu_memory_block& block)
+	{
+		return sp_gpu_memory_get_page(block)._heap.Get();
+	}
+
+	ID3D12Resource* sp_gpu_memory_get_buffer(const sp_gpu_memory_block& block)
+	{
+		assert(block._pool_type == sp_gpu_memory_pool_type::default_buffers || block._pool_type == sp_gpu_memory_pool_type::upload_buffers);
+
+		return sp_gpu_memory_get_page(block)._buffer.Get();
+	}
+
+	D3D12_GPU_VIRTUAL_ADDRESS sp_gpu_memory_get_gpu_address(const sp_gpu_memory_block& block)
+	{
+		return sp_gpu_memory_get_buffer(block)->GetGPUVirtualAddress() + block._offset_bytes;
+	}
+
+	uint8_t* sp_gpu_memory_get_cpu_address(const sp_gpu_memory_block& block)
+	{
+		assert(block._pool_type == sp_gpu_memory_pool_type::upload_buffers);
+
+		return sp_gpu_memory_get_page(block)._buffer_cpu + block._offset_bytes;
+	}
+}
\ No newline at end of file
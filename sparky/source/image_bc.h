@@ -0,0 +1,15 @@
+#pragma once
+
+#include "image_mips.h"
+
+// CPU encoders for the BCn block compressed formats, meant for cooking textures offline. Each 4x4 block gets endpoints from the
+// principal axis of its colors which are then refined with a least squares fit against the chosen indices before being quantized.
+// Palette searches are done four entries at a time with SSE and rows of blocks are encoded in parallel on the job system.
+//
+// Only the common single partition modes are used. BC7 always encodes mode 6 (RGBA, 7 bit endpoints plus a p-bit, 16 levels)
+// and BC6H always encodes mode 11 (RGB, 10 bit endpoints, 16 levels). Both are good for smooth and natural images, which is
+// most of what we have, but hard edges between more than two colors won't come out as well as with a full mode search.
+
+// Compresses every level of an uncompressed mip chain. BC1, BC3, BC5 and BC7 take r8g8b8a8 and BC6H takes r32g32b32a32, where
+// negative values are clamped to zero. BC1 ignores alpha and BC5 keeps red and green. Has to be called after sp_job_system_init.
+sp_image_mip_chain sp_image_mip_chain_compress(const sp_image_mip_chain& mip_chain, sp_image_format format);
\ No newline at end of file
@@ -0,0 +1,697 @@
+#pragma once
+
+#include "image_bc.h"
+#include "image_convert.h"
+#include "job.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include <immintrin.h>
+
+namespace detail
+{
+	// Number of least squares passes over the endpoints. Most of the improvement comes from the first.
+	const int k_image_bc_refine_iteration_count = 2;
+
+	// Interpolation weights for 4 bit BC6H and BC7 indices
+	const int k_image_bc_weights_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Four channels even when fewer are used so a pixel fills an SSE register. Unused channels are left at zero.
+	struct sp_image_bc_block
+	{
+		alignas(16) float _pixels[16][4];
+	};
+
+	// Palette entries stored a channel at a time so the search can test four entries at once. Entries past the end are pushed
+	// far enough away that they're never picked.
+	struct sp_image_bc_palette
+	{
+		alignas(16) float _channels[4][16];
+		int _entry_count = 0;
+	};
+
+	struct sp_image_bc_bits
+	{
+		uint64_t _words[2] = {};
+		int _position = 0;
+	};
+
+	void sp_image_bc_bits_write(sp_image_bc_bits& bits, uint32_t value, int bit_count)
+	{
+		for (int i = 0; i < bit_count; ++i, ++bits._position)
+		{
+			if ((value >> i) & 1)
+			{
+				bits._words[bits._position >> 6] |= 1ull << (bits._position & 63);
+			}
+		}
+	}
+
+	void sp_image_bc_palette_begin(sp_image_bc_palette& palette, int entry_count)
+	{
+		palette._entry_count = entry_count;
+
+		for (int c = 0; c < 4; ++c)
+		{
+			for (int i = 0; i < 16; ++i)
+			{
+				palette._channels[c][i] = i < entry_count ? 0.0f : 1e18f;
+			}
+		}
+	}
+
+	void sp_image_bc_palette_set(sp_image_bc_palette& palette, int entry, const float* value, int channel_count)
+	{
+		for (int c = 0; c < channel_count; ++c)
+		{
+			palette._channels[c][entry] = value[c];
+		}
+	}
+
+	// Nearest palette entry for every pixel. Returns the total squared error.
+	float sp_image_bc_find_indices(const sp_image_bc_block& block, const sp_image_bc_palette& palette, int* indices)
+	{
+		const int group_count = (palette._entry_count + 3) / 4;
+
+		float error = 0.0f;
+
+		for (int i = 0; i < 16; ++i)
+		{
+			const __m128 r = _mm_set1_ps(block._pixels[i][0]);
+			const __m128 g = _mm_set1_ps(block._pixels[i][1]);
+			const __m128 b = _mm_set1_ps(block._pixels[i][2]);
+			const __m128 a = _mm_set1_ps(block._pixels[i][3]);
+
+			float best_distance = 3.4e38f;
+			int best_index = 0;
+
+			for (int group = 0; group < group_count; ++group)
+			{
+				const __m128 dr = _mm_sub_ps(r, _mm_load_ps(&palette._channels[0][group * 4]));
+				const __m128 dg = _mm_sub_ps(g, _mm_load_ps(&palette._channels[1][group * 4]));
+				const __m128 db = _mm_sub_ps(b, _mm_load_ps(&palette._channels[2][group * 4]));
+				const __m128 da = _mm_sub_ps(a, _mm_load_ps(&palette._channels[3][group * 4]));
+
+				const __m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)),
+					_mm_add_ps(_mm_mul_ps(db, db), _mm_mul_ps(da, da)));
+
+				alignas(16) float distances[4];
+				_mm_store_ps(distances, distance);
+
+				for (int k = 0; k < 4; ++k)
+				{
+					if (distances[k] < best_distance)
+					{
+						best_distance = distances[k];
+						best_index = group * 4 + k;
+					}
+				}
+			}
+
+			indices[i] = best_index;
+			error += best_distance;
+		}
+
+		return error;
+	}
+
+	// Endpoints along the principal axis of the block's colors, from a few rounds of power iteration on the covariance
+	void sp_image_bc_fit_principal_axis(const sp_image_bc_block& block, int channel_count, float* endpoint_0, float* endpoint_1)
+	{
+		float mean[4] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < channel_count; ++c)
+			{
+				mean[c] += block._pixels[i][c] * (1.0f / 16.0f);
+			}
+		}
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c0 = 0; c0 < channel_count; ++c0)
+			{
+				for (int c1 = 0; c1 < channel_count; ++c1)
+				{
+					covariance[c0][c1] += (block._pixels[i][c0] - mean[c0]) * (block._pixels[i][c1] - mean[c1]);
+				}
+			}
+		}
+
+		float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4] = {};
+			float length_squared = 0.0f;
+			for (int c0 = 0; c0 < channel_count; ++c0)
+			{
+				for (int c1 = 0; c1 < channel_count; ++c1)
+				{
+					next[c0] += covariance[c0][c1] * axis[c1];
+				}
+				length_squared += next[c0] * next[c0];
+			}
+
+			// Every pixel is the same (or nearly), any axis will do
+			if (length_squared < 1e-12f)
+			{
+				break;
+			}
+
+			const float inverse_length = 1.0f / std::sqrt(length_squared);
+			for (int c = 0; c < channel_count; ++c)
+			{
+				axis[c] = next[c] * inverse_length;
+			}
+		}
+
+		float t_min = 0.0f;
+		float t_max = 0.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < channel_count; ++c)
+			{
+				t += (block._pixels[i][c] - mean[c]) * axis[c];
+			}
+
+			t_min = std::min(t_min, t);
+			t_max = std::max(t_max, t);
+		}
+
+		for (int c = 0; c < channel_count; ++c)
+		{
+			endpoint_0[c] = mean[c] + axis[c] * t_min;
+			endpoint_1[c] = mean[c] + axis[c] * t_max;
+		}
+	}
+
+	// Alternates between picking indices for the current endpoints and solving for the endpoints that best fit those indices.
+	// weights are the interpolation factors for each index.
+	void sp_image_bc_refine_endpoints(const sp_image_bc_block& block, int channel_count, const float* weights, int weight_count, float value_max, float* endpoint_0, float* endpoint_1)
+	{
+		for (int iteration = 0; iteration < k_image_bc_refine_iteration_count; ++iteration)
+		{
+			sp_image_bc_palette palette;
+			sp_image_bc_palette_begin(palette, weight_count);
+			for (int i = 0; i < weight_count; ++i)
+			{
+				float value[4];
+				for (int c = 0; c < channel_count; ++c)
+				{
+					value[c] = endpoint_0[c] + (endpoint_1[c] - endpoint_0[c]) * weights[i];
+				}
+				sp_image_bc_palette_set(palette, i, value, channel_count);
+			}
+
+			int indices[16];
+			sp_image_bc_find_indices(block, palette, indices);
+
+			float alpha_alpha = 0.0f;
+			float beta_beta = 0.0f;
+			float alpha_beta = 0.0f;
+			float alpha_x[4] = {};
+			float beta_x[4] = {};
+
+			for (int i = 0; i < 16; ++i)
+			{
+				const float beta = weights[indices[i]];
+				const float alpha = 1.0f - beta;
+
+				alpha_alpha += alpha * alpha;
+				beta_beta += beta * beta;
+				alpha_beta += alpha * beta;
+
+				for (int c = 0; c < channel_count; ++c)
+				{
+					alpha_x[c] += alpha * block._pixels[i][c];
+					beta_x[c] += beta * block._pixels[i][c];
+				}
+			}
+
+			// Everything picked the same index
+			const float determinant = alpha_alpha * beta_beta - alpha_beta * alpha_beta;
+			if (std::fabs(determinant) < 1e-6f)
+			{
+				break;
+			}
+
+			const float inverse_determinant = 1.0f / determinant;
+			for (int c = 0; c < channel_count; ++c)
+			{
+				endpoint_0[c] = std::min(std::max((alpha_x[c] * beta_beta - beta_x[c] * alpha_beta) * inverse_determinant, 0.0f), value_max);
+				endpoint_1[c] = std::min(std::max((beta_x[c] * alpha_alpha - alpha_x[c] * alpha_beta) * inverse_determinant, 0.0f), value_max);
+			}
+		}
+	}
+
+	void sp_image_bc_load_block_r8g8b8a8(const sp_image_mip_chain& mip_chain, int mip, int block_x, int block_y, sp_image_bc_block& block)
+	{
+		const sp_image_mip& src_mip = mip_chain._mips[mip];
+		const uint8_t* src = static_cast<const uint8_t*>(sp_image_mip_chain_get_data(mip_chain, mip));
+
+		// Blocks hanging off the edge of small levels repeat the edge pixels
+		for (int y = 0; y < 4; ++y)
+		{
+			const int src_y = std::min(block_y * 4 + y, src_mip._height - 1);
+			for (int x = 0; x < 4; ++x)
+			{
+				const int src_x = std::min(block_x * 4 + x, src_mip._width - 1);
+				const uint8_t* pixel = src + static_cast<size_t>(src_y) * src_mip._row_pitch_bytes + src_x * 4;
+
+				for (int c = 0; c < 4; ++c)
+				{
+					block._pixels[y * 4 + x][c] = pixel[c];
+				}
+			}
+		}
+	}
+
+	// BC6H works on the bit patterns of half floats, which are roughly logarithmic, so errors are measured relative to brightness
+	void sp_image_bc_load_block_bc6h(const sp_image_mip_chain& mip_chain, int mip, int block_x, int block_y, sp_image_bc_block& block)
+	{
+		const sp_image_mip& src_mip = mip_chain._mips[mip];
+		const uint8_t* src = static_cast<const uint8_t*>(sp_image_mip_chain_get_data(mip_chain, mip));
+
+		for (int y = 0; y < 4; ++y)
+		{
+			const int src_y = std::min(block_y * 4 + y, src_mip._height - 1);
+			for (int x = 0; x < 4; ++x)
+			{
+				const int src_x = std::min(block_x * 4 + x, src_mip._width - 1);
+				const float* pixel = reinterpret_cast<const float*>(src + static_cast<size_t>(src_y) * src_mip._row_pitch_bytes + src_x * 16);
+
+				for (int c = 0; c < 3; ++c)
+				{
+					// Largest finite half is 0x7BFF
+					block._pixels[y * 4 + x][c] = std::min(static_cast<float>(sp_image_float_to_half(std::max(pixel[c], 0.0f))), 31743.0f);
+				}
+				block._pixels[y * 4 + x][3] = 0.0f;
+			}
+		}
+	}
+
+	// 5:6:5 with the bits replicated down like the hardware does
+	uint16_t sp_image_bc1_quantize(const float* color, float* expanded)
+	{
+		const int r = std::min(31, std::max(0, static_cast<int>(std::lround(color[0] * (31.0f / 255.0f)))));
+		const int g = std::min(63, std::max(0, static_cast<int>(std::lround(color[1] * (63.0f / 255.0f)))));
+		const int b = std::min(31, std::max(0, static_cast<int>(std::lround(color[2] * (31.0f / 255.0f)))));
+
+		expanded[0] = static_cast<float>((r << 3) | (r >> 2));
+		expanded[1] = static_cast<float>((g << 2) | (g >> 4));
+		expanded[2] = static_cast<float>((b << 3) | (b >> 2));
+
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	// Always uses the four color mode so it also works as the color half of BC3
+	void sp_image_bc1_encode_block(const sp_image_bc_block& block, uint8_t* dst)
+	{
+		// Ignore alpha
+		sp_image_bc_block color_block = block;
+		for (int i = 0; i < 16; ++i)
+		{
+			color_block._pixels[i][3] = 0.0f;
+		}
+
+		// Index order is endpoint 0, endpoint 1, then the two in between
+		const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+		float endpoint_0[4] = {};
+		float endpoint_1[4] = {};
+		sp_image_bc_fit_principal_axis(color_block, 3, endpoint_0, endpoint_1);
+		sp_image_bc_refine_endpoints(color_block, 3, weights, 4, 255.0f, endpoint_0, endpoint_1);
+
+		float expanded_0[4] = {};
+		float expanded_1[4] = {};
+		uint16_t color_0 = sp_image_bc1_quantize(endpoint_0, expanded_0);
+		uint16_t color_1 = sp_image_bc1_quantize(endpoint_1, expanded_1);
+
+		// Endpoint 0 has to be the larger one for four colors. Equal endpoints fall back to three color mode but then every pixel
+		// is endpoint 0 anyway.
+		if (color_0 < color_1)
+		{
+			std::swap(color_0, color_1);
+			std::swap(expanded_0, expanded_1);
+		}
+
+		uint32_t index_bits = 0;
+		if (color_0 != color_1)
+		{
+			sp_image_bc_palette palette;
+			sp_image_bc_palette_begin(palette, 4);
+			for (int i = 0; i < 4; ++i)
+			{
+				float value[3];
+				for (int c = 0; c < 3; ++c)
+				{
+					value[c] = expanded_0[c] + (expanded_1[c] - expanded_0[c]) * weights[i];
+				}
+				sp_image_bc_palette_set(palette, i, value, 3);
+			}
+
+			int indices[16];
+			sp_image_bc_find_indices(color_block, palette, indices);
+
+			for (int i = 0; i < 16; ++i)
+			{
+				index_bits |= static_cast<uint32_t>(indices[i]) << (i * 2);
+			}
+		}
+
+		memcpy(dst + 0, &color_0, sizeof(color_0));
+		memcpy(dst + 2, &color_1, sizeof(color_1));
+		memcpy(dst + 4, &index_bits, sizeof(index_bits));
+	}
+
+	// One channel of the block with the eight value mode
+	void sp_image_bc4_encode_block(const sp_image_bc_block& block, int channel, uint8_t* dst)
+	{
+		float value_min = 255.0f;
+		float value_max = 0.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			value_min = std::min(value_min, block._pixels[i][channel]);
+			value_max = std::max(value_max, block._pixels[i][channel]);
+		}
+
+		const int value_0 = static_cast<int>(std::lround(value_max));
+		const int value_1 = static_cast<int>(std::lround(value_min));
+
+		uint64_t bits = static_cast<uint64_t>(value_0) | (static_cast<uint64_t>(value_1) << 8);
+
+		if (value_0 != value_1)
+		{
+			sp_image_bc_block channel_block = {};
+			for (int i = 0; i < 16; ++i)
+			{
+				channel_block._pixels[i][0] = block._pixels[i][channel];
+			}
+
+			// Index order is endpoint 0, endpoint 1, then the six in between
+			sp_image_bc_palette palette;
+			sp_image_bc_palette_begin(palette, 8);
+			palette._channels[0][0] = static_cast<float>(value_0);
+			palette._channels[0][1] = static_cast<float>(value_1);
+			for (int i = 1; i < 7; ++i)
+			{
+				palette._channels[0][i + 1] = static_cast<float>(((7 - i) * value_0 + i * value_1) / 7);
+			}
+
+			int indices[16];
+			sp_image_bc_find_indices(channel_block, palette, indices);
+
+			for (int i = 0; i < 16; ++i)
+			{
+				bits |= static_cast<uint64_t>(indices[i]) << (16 + i * 3);
+			}
+		}
+
+		memcpy(dst, &bits, 8);
+	}
+
+	void sp_image_bc7_encode_block(const sp_image_bc_block& block, uint8_t* dst)
+	{
+		float weights[16];
+		for (int i = 0; i < 16; ++i)
+		{
+			weights[i] = k_image_bc_weights_4[i] / 64.0f;
+		}
+
+		float endpoints[2][4] = {};
+		sp_image_bc_fit_principal_axis(block, 4, endpoints[0], endpoints[1]);
+		sp_image_bc_refine_endpoints(block, 4, weights, 16, 255.0f, endpoints[0], endpoints[1]);
+
+		// 7 bits per channel plus a p-bit per endpoint that's shared by its channels and becomes the lowest bit of each
+		int quantized[2][4];
+		int p_bits[2];
+		for (int e = 0; e < 2; ++e)
+		{
+			float best_error = 3.4e38f;
+			for (int p = 0; p < 2; ++p)
+			{
+				int candidate[4];
+				float error = 0.0f;
+				for (int c = 0; c < 4; ++c)
+				{
+					candidate[c] = std::min(127, std::max(0, static_cast<int>(std::lround((endpoints[e][c] - p) * 0.5f))));
+					const float difference = static_cast<float>((candidate[c] << 1) | p) - endpoints[e][c];
+					error += difference * difference;
+				}
+
+				if (error < best_error)
+				{
+					best_error = error;
+					p_bits[e] = p;
+					memcpy(quantized[e], candidate, sizeof(candidate));
+				}
+			}
+		}
+
+		int expanded[2][4];
+		for (int e = 0; e < 2; ++e)
+		{
+			for (int c = 0; c < 4; ++c)
+			{
+				expanded[e][c] = (quantized[e][c] << 1) | p_bits[e];
+			}
+		}
+
+		sp_image_bc_palette palette;
+		sp_image_bc_palette_begin(palette, 16);
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < 4; ++c)
+			{
+				palette._channels[c][i] = static_cast<float>(((64 - k_image_bc_weights_4[i]) * expanded[0][c] + k_image_bc_weights_4[i] * expanded[1][c] + 32) >> 6);
+			}
+		}
+
+		int indices[16];
+		sp_image_bc_find_indices(block, palette, indices);
+
+		// The first index is stored without its top bit so it has to be in the lower half
+		if (indices[0] & 8)
+		{
+			std::swap(quantized[0], quantized[1]);
+			std::swap(p_bits[0], p_bits[1]);
+			for (int i = 0; i < 16; ++i)
+			{
+				indices[i] = 15 - indices[i];
+			}
+		}
+
+		sp_image_bc_bits bits;
+		sp_image_bc_bits_write(bits, 1 << 6, 7);
+		for (int c = 0; c < 4; ++c)
+		{
+			sp_image_bc_bits_write(bits, quantized[0][c], 7);
+			sp_image_bc_bits_write(bits, quantized[1][c], 7);
+		}
+		sp_image_bc_bits_write(bits, p_bits[0], 1);
+		sp_image_bc_bits_write(bits, p_bits[1], 1);
+		for (int i = 0; i < 16; ++i)
+		{
+			sp_image_bc_bits_write(bits, indices[i], i == 0 ? 3 : 4);
+		}
+		assert(bits._position == 128);
+
+		memcpy(dst, bits._words, 16);
+	}
+
+	// What the decoder turns a 10 bit endpoint into before interpolating
+	int sp_image_bc6h_unquantize(int value)
+	{
+		if (value == 0)
+		{
+			return 0;
+		}
+		if (value == 1023)
+		{
+			return 0xFFFF;
+		}
+		return ((value << 16) + 0x8000) >> 10;
+	}
+
+	void sp_image_bc6h_encode_block(const sp_image_bc_block& block, uint8_t* dst)
+	{
+		// The decoder scales interpolated values by 31/64 to get the half bits so fit in that space
+		sp_image_bc_block scaled_block = block;
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				scaled_block._pixels[i][c] *= 64.0f / 31.0f;
+			}
+		}
+
+		float weights[16];
+		for (int i = 0; i < 16; ++i)
+		{
+			weights[i] = k_image_bc_weights_4[i] / 64.0f;
+		}
+
+		float endpoints[2][4] = {};
+		sp_image_bc_fit_principal_axis(scaled_block, 3, endpoints[0], endpoints[1]);
+		sp_image_bc_refine_endpoints(scaled_block, 3, weights, 16, 65535.0f, endpoints[0], endpoints[1]);
+
+		int quantized[2][3];
+		int unquantized[2][3];
+		for (int e = 0; e < 2; ++e)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				// Unquantizing is close to value * 64 + 32 so start there and check the neighbours
+				const int guess = std::min(1023, std::max(0, static_cast<int>(std::lround((endpoints[e][c] - 32.0f) / 64.0f))));
+
+				int best = guess;
+				float best_error = 3.4e38f;
+				for (int candidate = std::max(0, guess - 1); candidate <= std::min(1023, guess + 1); ++candidate)
+				{
+					const float error = std::fabs(sp_image_bc6h_unquantize(candidate) - endpoints[e][c]);
+					if (error < best_error)
+					{
+						best_error = error;
+						best = candidate;
+					}
+				}
+
+				quantized[e][c] = best;
+				unquantized[e][c] = sp_image_bc6h_unquantize(best);
+			}
+		}
+
+		// Compared against the original half bits, exactly as they'll be decoded
+		sp_image_bc_palette palette;
+		sp_image_bc_palette_begin(palette, 16);
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				const int interpolated = ((64 - k_image_bc_weights_4[i]) * unquantized[0][c] + k_image_bc_weights_4[i] * unquantized[1][c] + 32) >> 6;
+				palette._channels[c][i] = static_cast<float>((interpolated * 31) >> 6);
+			}
+			palette._channels[3][i] = 0.0f;
+		}
+
+		int indices[16];
+		sp_image_bc_find_indices(block, palette, indices);
+
+		if (indices[0] & 8)
+		{
+			std::swap(quantized[0], quantized[1]);
+			for (int i = 0; i < 16; ++i)
+			{
+				indices[i] = 15 - indices[i];
+			}
+		}
+
+		// Mode 11, one region with 10 bit endpoints
+		sp_image_bc_bits bits;
+		sp_image_bc_bits_write(bits, 0x03, 5);
+		for (int e = 0; e < 2; ++e)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				sp_image_bc_bits_write(bits, quantized[e][c], 10);
+			}
+		}
+		for (int i = 0; i < 16; ++i)
+		{
+			sp_image_bc_bits_write(bits, indices[i], i == 0 ? 3 : 4);
+		}
+		assert(bits._position == 128);
+
+		memcpy(dst, bits._words, 16);
+	}
+
+	void sp_image_bc_encode_block(const sp_image_mip_chain& mip_chain, int mip, int block_x, int block_y, sp_image_format format, uint8_t* dst)
+	{
+		sp_image_bc_block block;
+
+		if (format == sp_image_format::bc6h)
+		{
+			sp_image_bc_load_block_bc6h(mip_chain, mip, block_x, block_y, block);
+			sp_image_bc6h_encode_block(block, dst);
+			return;
+		}
+
+		sp_image_bc_load_block_r8g8b8a8(mip_chain, mip, block_x, block_y, block);
+
+		switch (format)
+		{
+		case sp_image_format::bc1:
+			sp_image_bc1_encode_block(block, dst);
+			break;
+		case sp_image_format::bc3:
+			sp_image_bc4_encode_block(block, 3, dst);
+			sp_image_bc1_encode_block(block, dst + 8);
+			break;
+		case sp_image_format::bc5:
+			sp_image_bc4_encode_block(block, 0, dst);
+			sp_image_bc4_encode_block(block, 1, dst + 8);
+			break;
+		case sp_image_format::bc7:
+			sp_image_bc7_encode_block(block, dst);
+			break;
+		default:
+			assert(false);
+		}
+	}
+}
+
+sp_image_mip_chain sp_image_mip_chain_compress(const sp_image_mip_chain& mip_chain, sp_image_format format)
+{
+	assert(sp_image_format_is_block_compressed(format));
+	assert(!sp_image_format_is_block_compressed(mip_chain._format));
+	assert((format == sp_image_format::bc6h) == (mip_chain._format == sp_image_format::r32g32b32a32));
+
+	sp_image_mip_chain compressed_mip_chain;
+	compressed_mip_chain._format = format;
+	compressed_mip_chain._mip_count = mip_chain._mip_count;
+
+	size_t size_bytes = 0;
+	for (int i = 0; i < mip_chain._mip_count; ++i)
+	{
+		sp_image_mip& mip = compressed_mip_chain._mips[i];
+		mip._width = mip_chain._mips[i]._width;
+		mip._height = mip_chain._mips[i]._height;
+		mip._row_pitch_bytes = sp_image_format_get_row_pitch_bytes(format, mip._width);
+		mip._offset_bytes = size_bytes;
+
+		size_bytes += static_cast<size_t>(mip._row_pitch_bytes) * sp_image_format_get_row_count(format, mip._height);
+	}
+
+	compressed_mip_chain._data.resize(size_bytes);
+
+	const int block_size_bytes = sp_image_format_get_block_size_bytes(format);
+
+	for (int i = 0; i < mip_chain._mip_count; ++i)
+	{
+		const sp_image_mip& mip = compressed_mip_chain._mips[i];
+
+		const int block_count_x = (mip._width + 3) / 4;
+		const int block_count_y = (mip._height + 3) / 4;
+
+		uint8_t* dst = &compressed_mip_chain._data[mip._offset_bytes];
+
+		// Blocks are expensive enough that even a single row is worth a job
+		sp_job_parallel_for(block_count_y, 1, [&](int begin, int end) {
+			for (int block_y = begin; block_y < end; ++block_y)
+			{
+				for (int block_x = 0; block_x < block_count_x; ++block_x)
+				{
+					detail::sp_image_bc_encode_block(mip_chain, i, block_x, block_y, format, dst + static_cast<size_t>(block_y) * mip._row_pitch_bytes + block_x * block_size_bytes);
+				}
+			}
+		});
+	}
+
+	return compressed_mip_chain;
+}
\ No newline at end of file
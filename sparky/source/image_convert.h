@@ -0,0 +1,20 @@
+#pragma once
+
+#include "image_mips.h"
+
+#include <cstdint>
+
+// Packs float images into the smaller float formats the GPU can filter directly. r16g16b16a16 is half the size of
+// r32g32b32a32 and uses F16C when the compiler targets it, with the same round to nearest even done in SSE2 otherwise.
+// r9g9b9e5 is a quarter of the size, drops alpha and follows the D3D rules for picking the shared exponent. Both clamp to
+// the largest value they can hold so bright HDR texels (and infinities) don't turn into infinities. NaNs stay NaN in
+// r16g16b16a16 and become zero in r9g9b9e5, which has no NaN, along with negative values.
+
+// Converts every level of an r32g32b32a32 mip chain to r16g16b16a16 or r9g9b9e5. Has to be called after sp_job_system_init.
+sp_image_mip_chain sp_image_mip_chain_convert(const sp_image_mip_chain& mip_chain, sp_image_format format);
+
+namespace detail
+{
+	// One value at a time with the same rounding, for anything that isn't a whole image
+	uint16_t sp_image_float_to_half(float value);
+}
\ No newline at end of file
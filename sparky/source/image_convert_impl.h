@@ -0,0 +1,220 @@
+#pragma once
+
+#include "image_convert.h"
+#include "job.h"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+#include <immintrin.h>
+
+namespace detail
+{
+	// Largest finite half and the largest value r9g9b9e5 can hold, (511 / 512) * 2^16
+	const float k_image_half_max = 65504.0f;
+	const float k_image_r9g9b9e5_max = 65408.0f;
+
+	// Smallest value that still gets an exponent of its own, anything less comes out as zero
+	const float k_image_r9g9b9e5_min = 1.0f / (1 << 16);
+
+	uint16_t sp_image_float_to_half(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		const uint32_t sign = (bits >> 16) & 0x8000;
+		const int exponent = static_cast<int>((bits >> 23) & 0xFF) - 127 + 15;
+		uint32_t mantissa = bits & 0x7FFFFF;
+
+		// NaNs stay NaN, infinities clamp like everything else that's too big
+		if (((bits >> 23) & 0xFF) == 0xFF && mantissa)
+		{
+			return static_cast<uint16_t>(sign | 0x7E00);
+		}
+
+		if (exponent >= 31)
+		{
+			return static_cast<uint16_t>(sign | 0x7BFF);
+		}
+
+		if (exponent <= 0)
+		{
+			if (exponent < -10)
+			{
+				return static_cast<uint16_t>(sign);
+			}
+
+			// Denormal, round to nearest even
+			mantissa |= 0x800000;
+			const int shift = 14 - exponent;
+			const uint32_t half_mantissa = mantissa >> shift;
+			const uint32_t remainder = mantissa & ((1u << shift) - 1);
+			const uint32_t halfway = 1u << (shift - 1);
+			const uint32_t rounded = half_mantissa + ((remainder > halfway || (remainder == halfway && (half_mantissa & 1))) ? 1 : 0);
+
+			return static_cast<uint16_t>(sign | rounded);
+		}
+
+		// Round to nearest even, which can carry into the exponent. Carrying past the largest half clamps back to it.
+		uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+		const uint32_t remainder = mantissa & 0x1FFF;
+		if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+		{
+			++half;
+		}
+
+		if ((half & 0x7FFF) == 0x7C00)
+		{
+			--half;
+		}
+
+		return static_cast<uint16_t>(half);
+	}
+
+	// Four floats to four halves in the low 64 bits, rounding to nearest even
+	__m128i sp_image_float_to_half_sse(__m128 value)
+	{
+		// min and max return their second operand when either is NaN, so this order lets NaNs through
+		const __m128 max = _mm_set1_ps(k_image_half_max);
+		value = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), max), _mm_min_ps(max, value));
+
+		// MSVC has no F16C macro but every CPU with AVX2 has it
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+		return _mm_cvtps_ph(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+		const __m128i bits = _mm_castps_si128(value);
+		const __m128i sign = _mm_and_si128(bits, _mm_set1_epi32(static_cast<int>(0x80000000u)));
+		const __m128i abs_bits = _mm_xor_si128(bits, sign);
+
+		// Denormals. Adding a magic number lines the mantissa up so the FPU does the rounding.
+		const __m128i denormal_magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+		const __m128 denormal_sum = _mm_add_ps(_mm_castsi128_ps(abs_bits), _mm_castsi128_ps(denormal_magic));
+		const __m128i denormal = _mm_sub_epi32(_mm_castps_si128(denormal_sum), denormal_magic);
+
+		// Normals. Rebias the exponent and round the mantissa by hand, adding the lowest kept bit to break ties to even.
+		const __m128i mantissa_odd = _mm_and_si128(_mm_srli_epi32(abs_bits, 13), _mm_set1_epi32(1));
+		__m128i normal = _mm_add_epi32(abs_bits, _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(15 - 127) << 23) + 0xFFF));
+		normal = _mm_srli_epi32(_mm_add_epi32(normal, mantissa_odd), 13);
+
+		const __m128i is_denormal = _mm_cmplt_epi32(abs_bits, _mm_set1_epi32((127 - 14) << 23));
+		__m128i half = _mm_or_si128(_mm_and_si128(is_denormal, denormal), _mm_andnot_si128(is_denormal, normal));
+
+		const __m128i is_nan = _mm_cmpgt_epi32(abs_bits, _mm_set1_epi32(0x7F800000));
+		half = _mm_or_si128(_mm_and_si128(is_nan, _mm_set1_epi32(0x7E00)), _mm_andnot_si128(is_nan, half));
+		half = _mm_or_si128(half, _mm_srli_epi32(sign, 16));
+
+		// Sign extend so the saturating pack leaves the bits alone
+		half = _mm_srai_epi32(_mm_slli_epi32(half, 16), 16);
+
+		return _mm_packs_epi32(half, half);
+#endif
+	}
+
+	void sp_image_convert_row_r16g16b16a16(const float* src, uint8_t* dst, int width)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 8), sp_image_float_to_half_sse(_mm_loadu_ps(src + x * 4)));
+		}
+	}
+
+	// Four pixels at a time, one channel per register. Same as XMStoreFloat3SE: the largest channel is rounded up to 9 bits
+	// first so its mantissa can never overflow, which gives the shared exponent, and every channel is scaled by it.
+	void sp_image_convert_row_r9g9b9e5(const float* src, uint8_t* dst, int width)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 max = _mm_set1_ps(k_image_r9g9b9e5_max);
+		const __m128 min = _mm_set1_ps(k_image_r9g9b9e5_min);
+
+		for (int x = 0; x < width; x += 4)
+		{
+			const int pixel_count = std::min(4, width - x);
+
+			alignas(16) float pixels[4][4] = {};
+			memcpy(pixels, src + x * 4, sizeof(float) * 4 * pixel_count);
+
+			__m128 r = _mm_load_ps(pixels[0]);
+			__m128 g = _mm_load_ps(pixels[1]);
+			__m128 b = _mm_load_ps(pixels[2]);
+			__m128 a = _mm_load_ps(pixels[3]);
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+
+			r = _mm_min_ps(_mm_max_ps(r, zero), max);
+			g = _mm_min_ps(_mm_max_ps(g, zero), max);
+			b = _mm_min_ps(_mm_max_ps(b, zero), max);
+
+			const __m128 channel_max = _mm_max_ps(_mm_max_ps(_mm_max_ps(r, g), b), min);
+
+			const __m128i exponent = _mm_srli_epi32(_mm_add_epi32(_mm_castps_si128(channel_max), _mm_set1_epi32(0x4000)), 23);
+			const __m128 scale = _mm_castsi128_ps(_mm_sub_epi32(_mm_set1_epi32(static_cast<int>(0x83000000u)), _mm_slli_epi32(exponent, 23)));
+
+			const __m128i r_mantissa = _mm_cvtps_epi32(_mm_mul_ps(r, scale));
+			const __m128i g_mantissa = _mm_cvtps_epi32(_mm_mul_ps(g, scale));
+			const __m128i b_mantissa = _mm_cvtps_epi32(_mm_mul_ps(b, scale));
+			const __m128i shared_exponent = _mm_sub_epi32(exponent, _mm_set1_epi32(0x6F));
+
+			const __m128i packed = _mm_or_si128(
+				_mm_or_si128(r_mantissa, _mm_slli_epi32(g_mantissa, 9)),
+				_mm_or_si128(_mm_slli_epi32(b_mantissa, 18), _mm_slli_epi32(shared_exponent, 27)));
+
+			alignas(16) uint32_t packed_pixels[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(packed_pixels), packed);
+			memcpy(dst + x * 4, packed_pixels, sizeof(uint32_t) * pixel_count);
+		}
+	}
+}
+
+sp_image_mip_chain sp_image_mip_chain_convert(const sp_image_mip_chain& mip_chain, sp_image_format format)
+{
+	assert(mip_chain._format == sp_image_format::r32g32b32a32);
+	assert(format == sp_image_format::r16g16b16a16 || format == sp_image_format::r9g9b9e5);
+
+	sp_image_mip_chain converted;
+	converted._format = format;
+	converted._mip_count = mip_chain._mip_count;
+
+	const int pixel_size_bytes = sp_image_format_get_pixel_size_bytes(format);
+
+	size_t size_bytes = 0;
+	for (int i = 0; i < mip_chain._mip_count; ++i)
+	{
+		sp_image_mip& mip = converted._mips[i];
+		mip._width = mip_chain._mips[i]._width;
+		mip._height = mip_chain._mips[i]._height;
+		mip._row_pitch_bytes = mip._width * pixel_size_bytes;
+		mip._offset_bytes = size_bytes;
+
+		size_bytes += static_cast<size_t>(mip._row_pitch_bytes) * mip._height;
+	}
+
+	converted._data.resize(size_bytes);
+
+	for (int i = 0; i < mip_chain._mip_count; ++i)
+	{
+		const sp_image_mip& src_mip = mip_chain._mips[i];
+		const sp_image_mip& dst_mip = converted._mips[i];
+
+		const uint8_t* src = &mip_chain._data[src_mip._offset_bytes];
+		uint8_t* dst = &converted._data[dst_mip._offset_bytes];
+
+		detail::sp_image_parallel_rows(src_mip._width, src_mip._height, [&](int begin, int end) {
+			for (int y = begin; y < end; ++y)
+			{
+				const float* src_row = reinterpret_cast<const float*>(src + static_cast<size_t>(y) * src_mip._row_pitch_bytes);
+				uint8_t* dst_row = dst + static_cast<size_t>(y) * dst_mip._row_pitch_bytes;
+
+				if (format == sp_image_format::r16g16b16a16)
+				{
+					detail::sp_image_convert_row_r16g16b16a16(src_row, dst_row, src_mip._width);
+				}
+				else
+				{
+					detail::sp_image_convert_row_r9g9b9e5(src_row, dst_row, src_mip._width);
+				}
+			}
+		});
+	}
+
+	return converted;
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "image_file.h"
+#include "image_mips.h"
+
+#include <cstdint>
+
+// DDS files with the DX10 extended header, which is what the offline texture cooker writes. The mips are stored one after the
+// other with tightly packed rows, the same as sp_image_mip_chain, and each array slice has its own run of mips. Reading also
+// takes the older DXT1, DXT5 and ATI2 FourCCs and plain 32 bit RGBA since plenty of tools still write those.
+
+const uint32_t k_image_dds_magic = 0x20534444;		// "DDS "
+const uint32_t k_image_dds_fourcc_dx10 = 0x30315844;	// "DX10"
+
+struct sp_image_dds_pixel_format
+{
+	uint32_t size = 32;
+	uint32_t flags = 0;
+	uint32_t fourcc = 0;
+	uint32_t rgb_bit_count = 0;
+	uint32_t r_bit_mask = 0;
+	uint32_t g_bit_mask = 0;
+	uint32_t b_bit_mask = 0;
+	uint32_t a_bit_mask = 0;
+};
+
+struct sp_image_dds_header
+{
+	uint32_t size = 124;
+	uint32_t flags = 0;
+	uint32_t height = 0;
+	uint32_t width = 0;
+	uint32_t pitch_or_linear_size = 0;
+	uint32_t depth = 0;
+	uint32_t mip_map_count = 0;
+	uint32_t reserved_0[11] = {};
+	sp_image_dds_pixel_format pixel_format;
+	uint32_t caps = 0;
+	uint32_t caps_2 = 0;
+	uint32_t caps_3 = 0;
+	uint32_t caps_4 = 0;
+	uint32_t reserved_1 = 0;
+};
+
+struct sp_image_dds_header_dx10
+{
+	uint32_t dxgi_format = 0;
+	uint32_t resource_dimension = 0;
+	uint32_t misc_flag = 0;
+	uint32_t array_size = 0;
+	uint32_t misc_flags_2 = 0;
+};
+
+static_assert(sizeof(sp_image_dds_header) == 124, "DDS header has to match the file layout");
+static_assert(sizeof(sp_image_dds_header_dx10) == 20, "DDS DX10 header has to match the file layout");
+
+// The DXGI_FORMAT values, without needing dxgi headers
+uint32_t sp_image_dds_get_dxgi_format(sp_image_format format, sp_image_color_space color_space);
+
+// Returns false if the file couldn't be written
+bool sp_image_dds_write(const char* path, const sp_image_mip_chain& mip_chain, sp_image_color_space color_space);
+
+// Returns the format for a DXGI_FORMAT value, or false if there isn't a matching one
+bool sp_image_dds_get_format(uint32_t dxgi_format, sp_image_format& format, sp_image_color_space& color_space);
+
+// Parses the headers of a whole DDS file that's already in memory. Used by sp_image_file_open.
+bool sp_image_dds_read(const uint8_t* data, size_t size_bytes, sp_image_file& image_file);
\ No newline at end of file
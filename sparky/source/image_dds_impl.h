@@ -0,0 +1,239 @@
+#pragma once
+
+#include "image_dds.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+namespace detail
+{
+	// From ddraw.h and dds.h
+	const uint32_t k_image_dds_flags_caps = 0x1;
+	const uint32_t k_image_dds_flags_height = 0x2;
+	const uint32_t k_image_dds_flags_width = 0x4;
+	const uint32_t k_image_dds_flags_pixel_format = 0x1000;
+	const uint32_t k_image_dds_flags_mip_map_count = 0x20000;
+	const uint32_t k_image_dds_flags_linear_size = 0x80000;
+	const uint32_t k_image_dds_pixel_format_flags_fourcc = 0x4;
+	const uint32_t k_image_dds_pixel_format_flags_rgb = 0x40;
+	const uint32_t k_image_dds_caps_complex = 0x8;
+	const uint32_t k_image_dds_caps_texture = 0x1000;
+	const uint32_t k_image_dds_caps_mip_map = 0x400000;
+	const uint32_t k_image_dds_caps_2_cubemap = 0x200;
+	const uint32_t k_image_dds_caps_2_cubemap_all_faces = 0xFC00;
+	const uint32_t k_image_dds_caps_2_volume = 0x200000;
+	const uint32_t k_image_dds_resource_dimension_texture_2d = 3;
+	const uint32_t k_image_dds_misc_flag_texture_cube = 0x4;
+
+	const uint32_t k_image_dds_fourcc_dxt1 = 0x31545844;	// "DXT1"
+	const uint32_t k_image_dds_fourcc_dxt5 = 0x35545844;	// "DXT5"
+	const uint32_t k_image_dds_fourcc_ati2 = 0x32495441;	// "ATI2"
+	const uint32_t k_image_dds_fourcc_bc5u = 0x55354342;	// "BC5U"
+}
+
+uint32_t sp_image_dds_get_dxgi_format(sp_image_format format, sp_image_color_space color_space)
+{
+	const bool srgb = color_space == sp_image_color_space::srgb;
+
+	switch (format)
+	{
+	case sp_image_format::r8g8b8a8:     return srgb ? 29 : 28;		// DXGI_FORMAT_R8G8B8A8_UNORM(_SRGB)
+	case sp_image_format::r32g32b32a32: return 2;					// DXGI_FORMAT_R32G32B32A32_FLOAT
+	case sp_image_format::r16g16b16a16: return 10;					// DXGI_FORMAT_R16G16B16A16_FLOAT
+	case sp_image_format::r9g9b9e5:     return 67;					// DXGI_FORMAT_R9G9B9E5_SHAREDEXP
+	case sp_image_format::bc1:          return srgb ? 72 : 71;		// DXGI_FORMAT_BC1_UNORM(_SRGB)
+	case sp_image_format::bc3:          return srgb ? 78 : 77;		// DXGI_FORMAT_BC3_UNORM(_SRGB)
+	case sp_image_format::bc5:          return 83;					// DXGI_FORMAT_BC5_UNORM
+	case sp_image_format::bc6h:         return 95;					// DXGI_FORMAT_BC6H_UF16
+	case sp_image_format::bc7:          return srgb ? 99 : 98;		// DXGI_FORMAT_BC7_UNORM(_SRGB)
+	};
+
+	assert(false);
+
+	return 0;
+}
+
+bool sp_image_dds_get_format(uint32_t dxgi_format, sp_image_format& format, sp_image_color_space& color_space)
+{
+	switch (dxgi_format)
+	{
+	case 28: format = sp_image_format::r8g8b8a8;     color_space = sp_image_color_space::linear; return true;
+	case 29: format = sp_image_format::r8g8b8a8;     color_space = sp_image_color_space::srgb;   return true;
+	case 2:  format = sp_image_format::r32g32b32a32; color_space = sp_image_color_space::linear; return true;
+	case 10: format = sp_image_format::r16g16b16a16; color_space = sp_image_color_space::linear; return true;
+	case 67: format = sp_image_format::r9g9b9e5;     color_space = sp_image_color_space::linear; return true;
+	case 71: format = sp_image_format::bc1;          color_space = sp_image_color_space::linear; return true;
+	case 72: format = sp_image_format::bc1;          color_space = sp_image_color_space::srgb;   return true;
+	case 77: format = sp_image_format::bc3;          color_space = sp_image_color_space::linear; return true;
+	case 78: format = sp_image_format::bc3;          color_space = sp_image_color_space::srgb;   return true;
+	case 83: format = sp_image_format::bc5;          color_space = sp_image_color_space::linear; return true;
+	case 95: format = sp_image_format::bc6h;         color_space = sp_image_color_space::linear; return true;
+	case 98: format = sp_image_format::bc7;          color_space = sp_image_color_space::linear; return true;
+	case 99: format = sp_image_format::bc7;          color_space = sp_image_color_space::srgb;   return true;
+	};
+
+	return false;
+}
+
+bool sp_image_dds_read(const uint8_t* data, size_t size_bytes, sp_image_file& image_file)
+{
+	uint32_t magic = 0;
+	sp_image_dds_header header;
+
+	if (size_bytes < sizeof(magic) + sizeof(header))
+	{
+		return false;
+	}
+
+	memcpy(&magic, data, sizeof(magic));
+	memcpy(&header, data + sizeof(magic), sizeof(header));
+
+	if (magic != k_image_dds_magic || header.size != sizeof(header) || header.pixel_format.size != sizeof(header.pixel_format))
+	{
+		return false;
+	}
+
+	size_t offset_bytes = sizeof(magic) + sizeof(header);
+
+	image_file._width = static_cast<int>(header.width);
+	image_file._height = static_cast<int>(header.height);
+	image_file._mip_count = header.mip_map_count > 0 ? static_cast<int>(header.mip_map_count) : 1;
+	image_file._array_size = 1;
+	image_file._is_cube = false;
+
+	const sp_image_dds_pixel_format& pixel_format = header.pixel_format;
+
+	if ((pixel_format.flags & detail::k_image_dds_pixel_format_flags_fourcc) && pixel_format.fourcc == k_image_dds_fourcc_dx10)
+	{
+		sp_image_dds_header_dx10 header_dx10;
+
+		if (size_bytes < offset_bytes + sizeof(header_dx10))
+		{
+			return false;
+		}
+
+		memcpy(&header_dx10, data + offset_bytes, sizeof(header_dx10));
+		offset_bytes += sizeof(header_dx10);
+
+		if (header_dx10.resource_dimension != detail::k_image_dds_resource_dimension_texture_2d ||
+			!sp_image_dds_get_format(header_dx10.dxgi_format, image_file._format, image_file._color_space))
+		{
+			return false;
+		}
+
+		// The array size counts whole cubes
+		image_file._is_cube = (header_dx10.misc_flag & detail::k_image_dds_misc_flag_texture_cube) != 0;
+		image_file._array_size = static_cast<int>(header_dx10.array_size) * (image_file._is_cube ? 6 : 1);
+	}
+	else
+	{
+		// Older files don't say anything about color space
+		image_file._color_space = sp_image_color_space::linear;
+
+		if (pixel_format.flags & detail::k_image_dds_pixel_format_flags_fourcc)
+		{
+			switch (pixel_format.fourcc)
+			{
+			case detail::k_image_dds_fourcc_dxt1: image_file._format = sp_image_format::bc1; break;
+			case detail::k_image_dds_fourcc_dxt5: image_file._format = sp_image_format::bc3; break;
+			case detail::k_image_dds_fourcc_ati2: image_file._format = sp_image_format::bc5; break;
+			case detail::k_image_dds_fourcc_bc5u: image_file._format = sp_image_format::bc5; break;
+			default: return false;
+			}
+		}
+		else if ((pixel_format.flags & detail::k_image_dds_pixel_format_flags_rgb) &&
+			pixel_format.rgb_bit_count == 32 &&
+			pixel_format.r_bit_mask == 0x000000FF &&
+			pixel_format.g_bit_mask == 0x0000FF00 &&
+			pixel_format.b_bit_mask == 0x00FF0000 &&
+			pixel_format.a_bit_mask == 0xFF000000)
+		{
+			image_file._format = sp_image_format::r8g8b8a8;
+		}
+		else
+		{
+			return false;
+		}
+
+		if (header.caps_2 & detail::k_image_dds_caps_2_volume)
+		{
+			return false;
+		}
+
+		if (header.caps_2 & detail::k_image_dds_caps_2_cubemap)
+		{
+			// Cubemaps with some of the faces missing aren't a thing in D3D10 and up
+			if ((header.caps_2 & detail::k_image_dds_caps_2_cubemap_all_faces) != detail::k_image_dds_caps_2_cubemap_all_faces)
+			{
+				return false;
+			}
+
+			image_file._is_cube = true;
+			image_file._array_size = 6;
+		}
+	}
+
+	if (!detail::sp_image_file_init_subresources(image_file))
+	{
+		return false;
+	}
+
+	// Every mip of the first slice, then every mip of the next
+	for (int array_slice = 0; array_slice < image_file._array_size; ++array_slice)
+	{
+		for (int mip = 0; mip < image_file._mip_count; ++mip)
+		{
+			image_file._subresources[array_slice * image_file._mip_count + mip]._offset_bytes = offset_bytes;
+			offset_bytes += detail::sp_image_file_get_subresource_size_bytes(image_file, mip);
+		}
+	}
+
+	return true;
+}
+
+bool sp_image_dds_write(const char* path, const sp_image_mip_chain& mip_chain, sp_image_color_space color_space)
+{
+	assert(mip_chain._mip_count > 0);
+
+	sp_image_dds_header header;
+	header.flags =
+		detail::k_image_dds_flags_caps |
+		detail::k_image_dds_flags_height |
+		detail::k_image_dds_flags_width |
+		detail::k_image_dds_flags_pixel_format |
+		detail::k_image_dds_flags_mip_map_count |
+		detail::k_image_dds_flags_linear_size;
+	header.height = mip_chain._mips[0]._height;
+	header.width = mip_chain._mips[0]._width;
+	header.pitch_or_linear_size = static_cast<uint32_t>(mip_chain._mips[0]._row_pitch_bytes * sp_image_format_get_row_count(mip_chain._format, mip_chain._mips[0]._height));
+	header.mip_map_count = mip_chain._mip_count;
+	header.pixel_format.flags = detail::k_image_dds_pixel_format_flags_fourcc;
+	header.pixel_format.fourcc = k_image_dds_fourcc_dx10;
+	header.caps = detail::k_image_dds_caps_texture | (mip_chain._mip_count > 1 ? detail::k_image_dds_caps_complex | detail::k_image_dds_caps_mip_map : 0);
+
+	sp_image_dds_header_dx10 header_dx10;
+	header_dx10.dxgi_format = sp_image_dds_get_dxgi_format(mip_chain._format, color_space);
+	header_dx10.resource_dimension = detail::k_image_dds_resource_dimension_texture_2d;
+	header_dx10.array_size = 1;
+
+	FILE* file = nullptr;
+#if defined(_WIN32)
+	if (fopen_s(&file, path, "wb") != 0)
+#else
+	if (!(file = fopen(path, "wb")))
+#endif
+	{
+		return false;
+	}
+
+	bool written =
+		fwrite(&k_image_dds_magic, sizeof(k_image_dds_magic), 1, file) == 1 &&
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(&header_dx10, sizeof(header_dx10), 1, file) == 1 &&
+		fwrite(mip_chain._data.data(), 1, mip_chain._data.size(), file) == mip_chain._data.size();
+
+	written = fclose(file) == 0 && written;
+
+	return written;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "image_mips.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Cooked textures in DDS or KTX2 containers. The file is memory mapped and only the header is parsed, so every subresource is a
+// pointer straight into the mapping and can be copied into upload staging as it is, block compressed or not, without decoding
+// or building mips at load time.
+
+struct sp_image_file_subresource
+{
+	int _width = 0;
+	int _height = 0;
+	int _row_pitch_bytes = 0;		// Between rows of blocks for block compressed formats
+	size_t _offset_bytes = 0;		// From the start of the file
+};
+
+struct sp_image_file
+{
+	sp_image_format _format = sp_image_format::r8g8b8a8;
+	sp_image_color_space _color_space = sp_image_color_space::linear;
+	int _width = 0;
+	int _height = 0;
+	int _mip_count = 0;
+	int _array_size = 0;			// Six per cube for cubemaps
+	bool _is_cube = false;
+
+	// Mips of the first slice, then mips of the second and so on. Same order as D3D12CalcSubresource.
+	std::vector<sp_image_file_subresource> _subresources;
+
+	const uint8_t* _data = nullptr;
+	size_t _size_bytes = 0;
+};
+
+// Maps the file and parses the header, picking the container from the magic at the start. Returns false if the file doesn't
+// exist, isn't a 2D texture (array) in a format we know or is shorter than the header says it should be.
+bool sp_image_file_open(const char* path, sp_image_file& image_file);
+void sp_image_file_close(sp_image_file& image_file);
+
+const void* sp_image_file_get_data(const sp_image_file& image_file, int mip, int array_slice);
+
+namespace detail
+{
+	// For the container parsers. Sizes _subresources for the mip count and array size and fills in everything but the offsets.
+	// Returns false if the size, mip count or array size the header gave don't make sense.
+	bool sp_image_file_init_subresources(sp_image_file& image_file);
+	size_t sp_image_file_get_subresource_size_bytes(const sp_image_file& image_file, int mip);
+}
\ No newline at end of file
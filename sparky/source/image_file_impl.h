@@ -0,0 +1,105 @@
+#pragma once
+
+#include "image_file.h"
+#include "image_dds.h"
+#include "image_ktx2.h"
+#include "file_map.h"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+namespace detail
+{
+	bool sp_image_file_init_subresources(sp_image_file& image_file)
+	{
+		if (image_file._width <= 0 || image_file._height <= 0 || image_file._array_size <= 0 || image_file._mip_count <= 0 || image_file._mip_count > k_image_mip_count_max)
+		{
+			return false;
+		}
+
+		// Can't have more levels than it takes to get down to 1x1
+		if (std::max(image_file._width, image_file._height) >> (image_file._mip_count - 1) == 0)
+		{
+			return false;
+		}
+
+		image_file._subresources.resize(static_cast<size_t>(image_file._mip_count) * image_file._array_size);
+
+		for (int array_slice = 0; array_slice < image_file._array_size; ++array_slice)
+		{
+			for (int mip = 0; mip < image_file._mip_count; ++mip)
+			{
+				sp_image_file_subresource& subresource = image_file._subresources[array_slice * image_file._mip_count + mip];
+				subresource._width = std::max(1, image_file._width >> mip);
+				subresource._height = std::max(1, image_file._height >> mip);
+				subresource._row_pitch_bytes = sp_image_format_get_row_pitch_bytes(image_file._format, subresource._width);
+				subresource._offset_bytes = 0;
+			}
+		}
+
+		return true;
+	}
+
+	size_t sp_image_file_get_subresource_size_bytes(const sp_image_file& image_file, int mip)
+	{
+		const sp_image_file_subresource& subresource = image_file._subresources[mip];
+
+		return static_cast<size_t>(subresource._row_pitch_bytes) * sp_image_format_get_row_count(image_file._format, subresource._height);
+	}
+}
+
+bool sp_image_file_open(const char* path, sp_image_file& image_file)
+{
+	image_file = sp_image_file();
+
+	if (!sp_file_map(path, image_file._data, image_file._size_bytes))
+	{
+		return false;
+	}
+
+	bool read = false;
+
+	if (image_file._size_bytes >= sizeof(k_image_ktx2_identifier) && memcmp(image_file._data, k_image_ktx2_identifier, sizeof(k_image_ktx2_identifier)) == 0)
+	{
+		read = sp_image_ktx2_read(image_file._data, image_file._size_bytes, image_file);
+	}
+	else
+	{
+		read = sp_image_dds_read(image_file._data, image_file._size_bytes, image_file);
+	}
+
+	// Make sure the header didn't promise more than is there before anything reads past the end of the mapping
+	for (size_t i = 0; read && i < image_file._subresources.size(); ++i)
+	{
+		const size_t mip = i % image_file._mip_count;
+		const size_t subresource_size_bytes = detail::sp_image_file_get_subresource_size_bytes(image_file, static_cast<int>(mip));
+
+		read = image_file._subresources[i]._offset_bytes <= image_file._size_bytes && subresource_size_bytes <= image_file._size_bytes - image_file._subresources[i]._offset_bytes;
+	}
+
+	if (!read)
+	{
+		sp_image_file_close(image_file);
+	}
+
+	return read;
+}
+
+void sp_image_file_close(sp_image_file& image_file)
+{
+	if (image_file._data)
+	{
+		sp_file_unmap(image_file._data, image_file._size_bytes);
+	}
+
+	image_file = sp_image_file();
+}
+
+const void* sp_image_file_get_data(const sp_image_file& image_file, int mip, int array_slice)
+{
+	assert(mip >= 0 && mip < image_file._mip_count);
+	assert(array_slice >= 0 && array_slice < image_file._array_size);
+
+	return image_file._data + image_file._subresources[array_slice * image_file._mip_count + mip]._offset_bytes;
+}
\ No newline at end of file
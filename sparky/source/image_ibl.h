@@ -0,0 +1,55 @@
+#pragma once
+
+#include "image_mips.h"
+
+#include <string>
+
+// Bakes image based lighting from an equirectangular HDR environment so shading only needs a handful of lookups:
+//
+// - Diffuse irradiance as 9 spherical harmonic coefficients, projected from a small resample of the environment and convolved
+//   with the cosine lobe.
+// - Specular radiance prefiltered with GGX for the split sum approximation. Level i of the chain is filtered for a perceptual
+//   roughness of i / (mip count - 1) so level 0 is the environment itself. Importance sampled with the sample's mip picked from
+//   its pdf so a few dozen samples per texel are enough.
+// - The split sum BRDF lookup table, indexed by n_dot_v along x and perceptual roughness along y, with the scale applied to F0
+//   in red and the bias in green.
+//
+// Rows are split across the job system and the inner loops work on four samples or one RGBA pixel per SSE register. Bakes can be
+// cached to disk so they only have to happen once per environment.
+
+const int k_image_ibl_specular_mip_count = 7;
+const int k_image_ibl_brdf_lut_size = 128;
+
+struct sp_image_ibl_desc
+{
+	float scale = 1.0f;				// Applied to the environment before anything else, e.g. REFmulti from an sIBL descriptor
+	sp_image_format specular_format = sp_image_format::r9g9b9e5;
+	sp_image_format brdf_lut_format = sp_image_format::r16g16b16a16;
+};
+
+struct sp_image_ibl
+{
+	// Irradiance rather than radiance, so a Lambert surface reflects albedo / pi times the evaluated result. RGB.
+	float _irradiance_sh9[9][3] = {};
+
+	sp_image_mip_chain _specular;
+	sp_image_mip_chain _brdf_lut;
+};
+
+// Only the parts of an sIBL .ibl descriptor we use. Paths include the descriptor's directory.
+struct sp_image_ibl_descriptor
+{
+	std::string _environment_path;	// Blurred, meant for diffuse
+	float _environment_multiplier = 1.0f;
+	std::string _reflection_path;		// Full resolution, meant for reflections
+	float _reflection_multiplier = 1.0f;
+};
+
+// data is r32g32b32a32, width has to be twice height. Has to be called after sp_job_system_init.
+sp_image_ibl sp_image_ibl_bake(const void* data, int width, int height, const sp_image_ibl_desc& desc);
+
+// Returns false if the file couldn't be read or was written by an older version of the baker
+bool sp_image_ibl_read(const char* path, sp_image_ibl& ibl);
+bool sp_image_ibl_write(const char* path, const sp_image_ibl& ibl);
+
+bool sp_image_ibl_descriptor_read(const char* path, sp_image_ibl_descriptor& descriptor);
\ No newline at end of file
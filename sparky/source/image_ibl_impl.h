@@ -0,0 +1,679 @@
+#pragma once
+
+#include "image_ibl.h"
+#include "image_convert.h"
+#include "job.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+
+#include <immintrin.h>
+
+namespace detail
+{
+	const float k_image_ibl_pi = 3.14159265f;
+
+	// The irradiance is projected from the first level of the box filtered chain at most this wide. Nine coefficients can't
+	// hold any more detail than that.
+	const int k_image_ibl_sh_width_max = 256;
+
+	// Samples per texel for the first prefiltered specular level, doubling each level after that up to the max. Rougher levels
+	// are smaller so they can afford more.
+	const int k_image_ibl_specular_sample_count_min = 32;
+	const int k_image_ibl_specular_sample_count_max = 256;
+
+	const int k_image_ibl_brdf_lut_sample_count = 512;
+
+	const uint32_t k_image_ibl_file_magic = 0x42495053;	// "SPIB"
+
+	// Bump whenever the baker changes so stale caches are baked again
+	const uint32_t k_image_ibl_file_version = 1;
+
+	// Van der Corput sequence for the y coordinate of the Hammersley point set
+	float sp_image_ibl_radical_inverse(uint32_t bits)
+	{
+		bits = (bits << 16) | (bits >> 16);
+		bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+		bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+		bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+		bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+
+		return static_cast<float>(bits) * 2.3283064365386963e-10f;
+	}
+
+	// The same GGX as brdf.hlsli, alpha being perceptual roughness squared
+	float sp_image_ibl_ggx_distribution(float n_dot_h, float alpha)
+	{
+		const float alpha2 = alpha * alpha;
+		const float d = n_dot_h * n_dot_h * (alpha2 - 1.0f) + 1.0f;
+
+		return alpha2 / (k_image_ibl_pi * d * d);
+	}
+
+	// Cosine of the angle between the half vector and the normal for a GGX importance sample
+	float sp_image_ibl_ggx_cos_theta(float xi, float alpha)
+	{
+		return std::sqrt((1.0f - xi) / (1.0f + (alpha * alpha - 1.0f) * xi));
+	}
+
+	__m128 sp_image_ibl_abs_sse(__m128 value)
+	{
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), value);
+	}
+
+	// SSE2 stand in for _mm_blendv_ps
+	__m128 sp_image_ibl_select_sse(__m128 a, __m128 b, __m128 mask)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+	}
+
+	// Polynomial approximation good to about 1e-5 radians, a few thousandths of a texel on a 2k environment
+	__m128 sp_image_ibl_atan2_sse(__m128 y, __m128 x)
+	{
+		const __m128 abs_x = sp_image_ibl_abs_sse(x);
+		const __m128 abs_y = sp_image_ibl_abs_sse(y);
+		const __m128 max = _mm_max_ps(_mm_max_ps(abs_x, abs_y), _mm_set1_ps(1e-30f));
+		const __m128 t = _mm_div_ps(_mm_min_ps(abs_x, abs_y), max);
+		const __m128 t2 = _mm_mul_ps(t, t);
+
+		__m128 result = _mm_set1_ps(0.0208351f);
+		result = _mm_add_ps(_mm_mul_ps(result, t2), _mm_set1_ps(-0.0851330f));
+		result = _mm_add_ps(_mm_mul_ps(result, t2), _mm_set1_ps(0.1801410f));
+		result = _mm_add_ps(_mm_mul_ps(result, t2), _mm_set1_ps(-0.3302995f));
+		result = _mm_add_ps(_mm_mul_ps(result, t2), _mm_set1_ps(0.9998660f));
+		result = _mm_mul_ps(result, t);
+
+		result = sp_image_ibl_select_sse(result, _mm_sub_ps(_mm_set1_ps(0.5f * k_image_ibl_pi), result), _mm_cmpgt_ps(abs_y, abs_x));
+		result = sp_image_ibl_select_sse(result, _mm_sub_ps(_mm_set1_ps(k_image_ibl_pi), result), _mm_cmplt_ps(x, _mm_setzero_ps()));
+
+		return _mm_or_ps(result, _mm_and_ps(y, _mm_set1_ps(-0.0f)));
+	}
+
+	// Abramowitz and Stegun 4.4.46, good to about 2e-8 radians. x has to be in [-1, 1].
+	__m128 sp_image_ibl_acos_sse(__m128 x)
+	{
+		const __m128 abs_x = sp_image_ibl_abs_sse(x);
+
+		__m128 result = _mm_set1_ps(-0.0012624911f);
+		result = _mm_add_ps(_mm_mul_ps(result, abs_x), _mm_set1_ps(0.0066700901f));
+		result = _mm_add_ps(_mm_mul_ps(result, abs_x), _mm_set1_ps(-0.0170881256f));
+		result = _mm_add_ps(_mm_mul_ps(result, abs_x), _mm_set1_ps(0.0308918810f));
+		result = _mm_add_ps(_mm_mul_ps(result, abs_x), _mm_set1_ps(-0.0501743046f));
+		result = _mm_add_ps(_mm_mul_ps(result, abs_x), _mm_set1_ps(0.0889789874f));
+		result = _mm_add_ps(_mm_mul_ps(result, abs_x), _mm_set1_ps(-0.2145988016f));
+		result = _mm_add_ps(_mm_mul_ps(result, abs_x), _mm_set1_ps(1.5707963050f));
+		result = _mm_mul_ps(result, _mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), abs_x)));
+
+		return sp_image_ibl_select_sse(result, _mm_sub_ps(_mm_set1_ps(k_image_ibl_pi), result), _mm_cmplt_ps(x, _mm_setzero_ps()));
+	}
+
+	float sp_image_ibl_hsum_sse(__m128 value)
+	{
+		value = _mm_add_ps(value, _mm_movehl_ps(value, value));
+		value = _mm_add_ss(value, _mm_shuffle_ps(value, value, 1));
+
+		return _mm_cvtss_f32(value);
+	}
+
+	// Wraps horizontally and clamps vertically, the same as the sampler the environment is drawn with
+	__m128 sp_image_ibl_sample_bilinear(const sp_image_mip_chain& mip_chain, int mip, float u, float v)
+	{
+		const sp_image_mip& level = mip_chain._mips[mip];
+		const float* texels = reinterpret_cast<const float*>(&mip_chain._data[level._offset_bytes]);
+
+		const float x = u * level._width - 0.5f;
+		const float y = v * level._height - 0.5f;
+		const float x_floor = std::floor(x);
+		const float y_floor = std::floor(y);
+
+		int x0 = static_cast<int>(x_floor) % level._width;
+		x0 = x0 < 0 ? x0 + level._width : x0;
+		const int x1 = x0 + 1 == level._width ? 0 : x0 + 1;
+		const int y0 = std::min(std::max(static_cast<int>(y_floor), 0), level._height - 1);
+		const int y1 = std::min(std::max(static_cast<int>(y_floor) + 1, 0), level._height - 1);
+
+		const __m128 fx = _mm_set1_ps(x - x_floor);
+		const __m128 fy = _mm_set1_ps(y - y_floor);
+
+		const __m128 p00 = _mm_loadu_ps(texels + (y0 * level._width + x0) * 4);
+		const __m128 p10 = _mm_loadu_ps(texels + (y0 * level._width + x1) * 4);
+		const __m128 p01 = _mm_loadu_ps(texels + (y1 * level._width + x0) * 4);
+		const __m128 p11 = _mm_loadu_ps(texels + (y1 * level._width + x1) * 4);
+
+		const __m128 top = _mm_add_ps(p00, _mm_mul_ps(_mm_sub_ps(p10, p00), fx));
+		const __m128 bottom = _mm_add_ps(p01, _mm_mul_ps(_mm_sub_ps(p11, p01), fx));
+
+		return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+	}
+
+	// Direction through the center of a texel, matching spherical_map in lighting.hlsl
+	void sp_image_ibl_texel_direction(int x, int y, int width, int height, float direction[3])
+	{
+		const float phi = 2.0f * k_image_ibl_pi * (x + 0.5f) / width;
+		const float theta = k_image_ibl_pi * (y + 0.5f) / height;
+
+		direction[0] = std::sin(theta) * std::cos(phi);
+		direction[1] = std::cos(theta);
+		direction[2] = std::sin(theta) * std::sin(phi);
+	}
+
+	void sp_image_ibl_project_sh9(const sp_image_mip_chain& source, sp_image_ibl& ibl)
+	{
+		int mip = 0;
+		while (mip + 1 < source._mip_count && source._mips[mip]._width > k_image_ibl_sh_width_max)
+		{
+			++mip;
+		}
+
+		const sp_image_mip& level = source._mips[mip];
+		const float* texels = reinterpret_cast<const float*>(&source._data[level._offset_bytes]);
+
+		// Each row sums into its own slot and they're added up in double afterwards so the result doesn't depend on scheduling
+		std::vector<float> row_sums(level._height * 9 * 4);
+
+		detail::sp_image_parallel_rows(level._width, level._height, [&](int begin, int end) {
+			for (int y = begin; y < end; ++y)
+			{
+				const float theta = k_image_ibl_pi * (y + 0.5f) / level._height;
+				const float solid_angle = (2.0f * k_image_ibl_pi / level._width) * (k_image_ibl_pi / level._height) * std::sin(theta);
+
+				__m128 sums[9];
+				for (__m128& sum : sums)
+				{
+					sum = _mm_setzero_ps();
+				}
+
+				for (int x = 0; x < level._width; ++x)
+				{
+					float d[3];
+					sp_image_ibl_texel_direction(x, y, level._width, level._height, d);
+
+					const float basis[9] =
+					{
+						0.282095f,
+						0.488603f * d[1],
+						0.488603f * d[2],
+						0.488603f * d[0],
+						1.092548f * d[0] * d[1],
+						1.092548f * d[1] * d[2],
+						0.315392f * (3.0f * d[2] * d[2] - 1.0f),
+						1.092548f * d[0] * d[2],
+						0.546274f * (d[0] * d[0] - d[1] * d[1]),
+					};
+
+					const __m128 radiance = _mm_loadu_ps(texels + (y * level._width + x) * 4);
+
+					for (int i = 0; i < 9; ++i)
+					{
+						sums[i] = _mm_add_ps(sums[i], _mm_mul_ps(radiance, _mm_set1_ps(basis[i] * solid_angle)));
+					}
+				}
+
+				for (int i = 0; i < 9; ++i)
+				{
+					_mm_storeu_ps(&row_sums[(y * 9 + i) * 4], sums[i]);
+				}
+			}
+		});
+
+		// Convolving with the clamped cosine only scales each band. Ramamoorthi and Hanrahan 2001.
+		const float band_scales[9] =
+		{
+			k_image_ibl_pi,
+			2.0f * k_image_ibl_pi / 3.0f, 2.0f * k_image_ibl_pi / 3.0f, 2.0f * k_image_ibl_pi / 3.0f,
+			k_image_ibl_pi / 4.0f, k_image_ibl_pi / 4.0f, k_image_ibl_pi / 4.0f, k_image_ibl_pi / 4.0f, k_image_ibl_pi / 4.0f,
+		};
+
+		for (int i = 0; i < 9; ++i)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				double sum = 0.0;
+				for (int y = 0; y < level._height; ++y)
+				{
+					sum += row_sums[(y * 9 + i) * 4 + c];
+				}
+
+				ibl._irradiance_sh9[i][c] = static_cast<float>(sum) * band_scales[i];
+			}
+		}
+	}
+
+	// Light directions in tangent space with the normal along z, stored as structure of arrays and padded to a multiple of four
+	// with zero weight samples
+	struct sp_image_ibl_specular_samples
+	{
+		std::vector<float> _x;
+		std::vector<float> _y;
+		std::vector<float> _z;
+		std::vector<float> _weights;
+		std::vector<int> _mips;
+		float _weight_sum = 0.0f;
+	};
+
+	// Takes n = v, which is what makes the prefiltered result depend on the reflection vector alone
+	sp_image_ibl_specular_samples sp_image_ibl_specular_samples_build(int sample_count, float alpha, const sp_image_mip_chain& source)
+	{
+		sp_image_ibl_specular_samples samples;
+
+		const float texel_solid_angle = 4.0f * k_image_ibl_pi / (source._mips[0]._width * source._mips[0]._height);
+
+		for (int i = 0; i < sample_count; ++i)
+		{
+			const float phi = 2.0f * k_image_ibl_pi * i / sample_count;
+			const float cos_theta = sp_image_ibl_ggx_cos_theta(sp_image_ibl_radical_inverse(i), alpha);
+			const float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+			const float h[3] = { sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta };
+
+			// Reflect v = n = (0, 0, 1) about h
+			const float n_dot_l = 2.0f * h[2] * h[2] - 1.0f;
+			if (n_dot_l <= 0.0f)
+			{
+				continue;
+			}
+
+			// Fetching from the level whose texels cover about the same solid angle as the sample stands in for the samples we
+			// didn't take. GPU Gems 3 chapter 20, with its bias of one level.
+			const float pdf = sp_image_ibl_ggx_distribution(h[2], alpha) / 4.0f;
+			const float sample_solid_angle = 1.0f / (sample_count * pdf);
+			const float mip = 0.5f * std::log2(sample_solid_angle / texel_solid_angle) + 1.0f;
+
+			samples._x.push_back(2.0f * h[2] * h[0]);
+			samples._y.push_back(2.0f * h[2] * h[1]);
+			samples._z.push_back(n_dot_l);
+			samples._weights.push_back(n_dot_l);
+			samples._mips.push_back(std::min(std::max(static_cast<int>(mip + 0.5f), 0), source._mip_count - 1));
+			samples._weight_sum += n_dot_l;
+		}
+
+		while (samples._weights.size() % 4 != 0)
+		{
+			samples._x.push_back(0.0f);
+			samples._y.push_back(0.0f);
+			samples._z.push_back(1.0f);
+			samples._weights.push_back(0.0f);
+			samples._mips.push_back(0);
+		}
+
+		return samples;
+	}
+
+	void sp_image_ibl_prefilter_specular(const sp_image_mip_chain& source, sp_image_mip_chain& specular, int mip)
+	{
+		const sp_image_mip& level = specular._mips[mip];
+		float* texels = reinterpret_cast<float*>(&specular._data[level._offset_bytes]);
+
+		const float perceptual_roughness = static_cast<float>(mip) / (k_image_ibl_specular_mip_count - 1);
+		const int sample_count = std::min(k_image_ibl_specular_sample_count_min << (mip - 1), k_image_ibl_specular_sample_count_max);
+
+		const sp_image_ibl_specular_samples samples = sp_image_ibl_specular_samples_build(sample_count, perceptual_roughness * perceptual_roughness, source);
+		const int padded_sample_count = static_cast<int>(samples._weights.size());
+
+		detail::sp_image_parallel_rows(level._width, level._height, [&](int begin, int end) {
+			for (int y = begin; y < end; ++y)
+			{
+				for (int x = 0; x < level._width; ++x)
+				{
+					float n[3];
+					sp_image_ibl_texel_direction(x, y, level._width, level._height, n);
+
+					// Any tangent will do since the sample pattern is only rotated about the normal
+					const float up[3] = { 0.0f, std::abs(n[1]) < 0.999f ? 1.0f : 0.0f, std::abs(n[1]) < 0.999f ? 0.0f : 1.0f };
+					float t[3] = { up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2], up[0] * n[1] - up[1] * n[0] };
+					const float t_length = std::sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+					t[0] /= t_length;
+					t[1] /= t_length;
+					t[2] /= t_length;
+					const float b[3] = { n[1] * t[2] - n[2] * t[1], n[2] * t[0] - n[0] * t[2], n[0] * t[1] - n[1] * t[0] };
+
+					__m128 sum = _mm_setzero_ps();
+
+					for (int i = 0; i < padded_sample_count; i += 4)
+					{
+						const __m128 lx = _mm_loadu_ps(&samples._x[i]);
+						const __m128 ly = _mm_loadu_ps(&samples._y[i]);
+						const __m128 lz = _mm_loadu_ps(&samples._z[i]);
+
+						const __m128 wx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[0]), lx), _mm_mul_ps(_mm_set1_ps(b[0]), ly)), _mm_mul_ps(_mm_set1_ps(n[0]), lz));
+						const __m128 wy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[1]), lx), _mm_mul_ps(_mm_set1_ps(b[1]), ly)), _mm_mul_ps(_mm_set1_ps(n[1]), lz));
+						const __m128 wz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[2]), lx), _mm_mul_ps(_mm_set1_ps(b[2]), ly)), _mm_mul_ps(_mm_set1_ps(n[2]), lz));
+
+						const __m128 wy_clamped = _mm_min_ps(_mm_max_ps(wy, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+
+						alignas(16) float u[4];
+						alignas(16) float v[4];
+						_mm_store_ps(u, _mm_mul_ps(sp_image_ibl_atan2_sse(wz, wx), _mm_set1_ps(0.5f / k_image_ibl_pi)));
+						_mm_store_ps(v, _mm_mul_ps(sp_image_ibl_acos_sse(wy_clamped), _mm_set1_ps(1.0f / k_image_ibl_pi)));
+
+						for (int j = 0; j < 4; ++j)
+						{
+							const float weight = samples._weights[i + j];
+							if (weight > 0.0f)
+							{
+								const __m128 radiance = sp_image_ibl_sample_bilinear(source, samples._mips[i + j], u[j], v[j]);
+								sum = _mm_add_ps(sum, _mm_mul_ps(radiance, _mm_set1_ps(weight)));
+							}
+						}
+					}
+
+					sum = _mm_mul_ps(sum, _mm_set1_ps(1.0f / samples._weight_sum));
+
+					_mm_storeu_ps(texels + (y * level._width + x) * 4, sum);
+				}
+			}
+		});
+	}
+
+	// Integrates the GGX BRDF from brdf.hlsli over the hemisphere for F0 = 0 and F0 = 1. Karis 2013.
+	sp_image_mip_chain sp_image_ibl_integrate_brdf()
+	{
+		const int size = k_image_ibl_brdf_lut_size;
+		const int sample_count = k_image_ibl_brdf_lut_sample_count;
+		static_assert(k_image_ibl_brdf_lut_sample_count % 4 == 0, "BRDF samples are taken four at a time");
+
+		std::vector<float> cos_phis(sample_count);
+		std::vector<float> xis(sample_count);
+
+		for (int i = 0; i < sample_count; ++i)
+		{
+			cos_phis[i] = std::cos(2.0f * k_image_ibl_pi * i / sample_count);
+			xis[i] = sp_image_ibl_radical_inverse(i);
+		}
+
+		sp_image_mip_chain brdf_lut;
+		brdf_lut._format = sp_image_format::r32g32b32a32;
+		brdf_lut._mip_count = 1;
+		brdf_lut._mips[0]._width = size;
+		brdf_lut._mips[0]._height = size;
+		brdf_lut._mips[0]._row_pitch_bytes = sp_image_format_get_row_pitch_bytes(brdf_lut._format, size);
+		brdf_lut._data.resize(brdf_lut._mips[0]._row_pitch_bytes * size);
+
+		float* texels = reinterpret_cast<float*>(brdf_lut._data.data());
+
+		detail::sp_image_parallel_rows(size, size, [&](int begin, int end) {
+			for (int y = begin; y < end; ++y)
+			{
+				const float perceptual_roughness = (y + 0.5f) / size;
+				const float alpha = perceptual_roughness * perceptual_roughness;
+				const __m128 alpha2 = _mm_set1_ps(alpha * alpha);
+				const __m128 one = _mm_set1_ps(1.0f);
+				const __m128 zero = _mm_setzero_ps();
+
+				for (int x = 0; x < size; ++x)
+				{
+					// v is in the xz plane so only the x of the half vector matters
+					const float n_dot_v = (x + 0.5f) / size;
+					const __m128 v_x = _mm_set1_ps(std::sqrt(1.0f - n_dot_v * n_dot_v));
+					const __m128 v_z = _mm_set1_ps(n_dot_v);
+					const __m128 lambda_v = _mm_sqrt_ps(_mm_add_ps(alpha2, _mm_mul_ps(_mm_sub_ps(one, alpha2), _mm_mul_ps(v_z, v_z))));
+
+					__m128 scale = zero;
+					__m128 bias = zero;
+
+					for (int i = 0; i < sample_count; i += 4)
+					{
+						const __m128 xi = _mm_loadu_ps(&xis[i]);
+						const __m128 n_dot_h = _mm_sqrt_ps(_mm_div_ps(_mm_sub_ps(one, xi), _mm_add_ps(one, _mm_mul_ps(_mm_sub_ps(alpha2, one), xi))));
+						const __m128 sin_theta = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(n_dot_h, n_dot_h)), zero));
+						const __m128 h_x = _mm_mul_ps(sin_theta, _mm_loadu_ps(&cos_phis[i]));
+
+						const __m128 v_dot_h = _mm_add_ps(_mm_mul_ps(v_x, h_x), _mm_mul_ps(v_z, n_dot_h));
+						const __m128 l_z = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.0f), v_dot_h), n_dot_h), v_z);
+						const __m128 mask = _mm_and_ps(_mm_cmpgt_ps(l_z, zero), _mm_cmpgt_ps(v_dot_h, zero));
+						const __m128 n_dot_l = _mm_max_ps(l_z, zero);
+
+						const __m128 lambda_l = _mm_sqrt_ps(_mm_add_ps(alpha2, _mm_mul_ps(_mm_sub_ps(one, alpha2), _mm_mul_ps(n_dot_l, n_dot_l))));
+						const __m128 visibility = _mm_div_ps(_mm_set1_ps(2.0f), _mm_add_ps(_mm_mul_ps(v_z, lambda_l), _mm_mul_ps(n_dot_l, lambda_v)));
+
+						// The BRDF times n_dot_l over the pdf of l, with D cancelling out and the 4 from the BRDF cancelling the 4
+						// from going between half vector and light pdfs
+						const __m128 weight = _mm_and_ps(mask, _mm_div_ps(_mm_mul_ps(_mm_mul_ps(visibility, n_dot_l), v_dot_h), n_dot_h));
+
+						const __m128 one_minus_v_dot_h = _mm_max_ps(_mm_sub_ps(one, v_dot_h), zero);
+						const __m128 one_minus_v_dot_h_2 = _mm_mul_ps(one_minus_v_dot_h, one_minus_v_dot_h);
+						const __m128 fresnel = _mm_mul_ps(_mm_mul_ps(one_minus_v_dot_h_2, one_minus_v_dot_h_2), one_minus_v_dot_h);
+
+						scale = _mm_add_ps(scale, _mm_mul_ps(_mm_sub_ps(one, fresnel), weight));
+						bias = _mm_add_ps(bias, _mm_mul_ps(fresnel, weight));
+					}
+
+					float* texel = texels + (y * size + x) * 4;
+					texel[0] = sp_image_ibl_hsum_sse(scale) / sample_count;
+					texel[1] = sp_image_ibl_hsum_sse(bias) / sample_count;
+					texel[2] = 0.0f;
+					texel[3] = 1.0f;
+				}
+			}
+		});
+
+		return brdf_lut;
+	}
+
+	bool sp_image_ibl_mip_chain_write(FILE* file, const sp_image_mip_chain& mip_chain)
+	{
+		const uint32_t header[2] = { static_cast<uint32_t>(mip_chain._format), static_cast<uint32_t>(mip_chain._mip_count) };
+
+		bool written = fwrite(header, sizeof(header), 1, file) == 1;
+
+		for (int i = 0; i < mip_chain._mip_count && written; ++i)
+		{
+			const uint32_t size[2] = { static_cast<uint32_t>(mip_chain._mips[i]._width), static_cast<uint32_t>(mip_chain._mips[i]._height) };
+			written = fwrite(size, sizeof(size), 1, file) == 1;
+		}
+
+		return written && fwrite(mip_chain._data.data(), 1, mip_chain._data.size(), file) == mip_chain._data.size();
+	}
+
+	// The offsets and pitches aren't stored, they follow from the sizes the same way they do for the chains the baker makes
+	bool sp_image_ibl_mip_chain_read(FILE* file, sp_image_mip_chain& mip_chain)
+	{
+		uint32_t header[2];
+		if (fread(header, sizeof(header), 1, file) != 1 ||
+			header[0] > static_cast<uint32_t>(sp_image_format::r9g9b9e5) ||
+			header[1] == 0 ||
+			header[1] > k_image_mip_count_max)
+		{
+			return false;
+		}
+
+		mip_chain._format = static_cast<sp_image_format>(header[0]);
+		mip_chain._mip_count = static_cast<int>(header[1]);
+
+		size_t offset_bytes = 0;
+
+		for (int i = 0; i < mip_chain._mip_count; ++i)
+		{
+			uint32_t size[2];
+			if (fread(size, sizeof(size), 1, file) != 1 || size[0] == 0 || size[1] == 0 || size[0] > 16384 || size[1] > 16384)
+			{
+				return false;
+			}
+
+			sp_image_mip& mip = mip_chain._mips[i];
+			mip._width = static_cast<int>(size[0]);
+			mip._height = static_cast<int>(size[1]);
+			mip._row_pitch_bytes = sp_image_format_get_row_pitch_bytes(mip_chain._format, mip._width);
+			mip._offset_bytes = offset_bytes;
+
+			offset_bytes += static_cast<size_t>(mip._row_pitch_bytes) * mip._height;
+		}
+
+		mip_chain._data.resize(offset_bytes);
+
+		return fread(mip_chain._data.data(), 1, offset_bytes, file) == offset_bytes;
+	}
+
+	std::string sp_image_ibl_descriptor_trim(const std::string& value)
+	{
+		const size_t begin = value.find_first_not_of(" \t\r\"");
+		const size_t end = value.find_last_not_of(" \t\r\"");
+
+		return begin == std::string::npos ? std::string() : value.substr(begin, end - begin + 1);
+	}
+}
+
+sp_image_ibl sp_image_ibl_bake(const void* data, int width, int height, const sp_image_ibl_desc& desc)
+{
+	assert(width == height * 2);
+	assert(height >> (k_image_ibl_specular_mip_count - 1) > 0);
+
+	const float* src = static_cast<const float*>(data);
+
+	std::vector<float> scaled;
+	if (desc.scale != 1.0f)
+	{
+		scaled.assign(src, src + static_cast<size_t>(width) * height * 4);
+		for (float& value : scaled)
+		{
+			value *= desc.scale;
+		}
+
+		src = scaled.data();
+	}
+
+	sp_image_mip_chain_desc source_desc;
+	source_desc.format = sp_image_format::r32g32b32a32;
+	source_desc.wrap_x = true;
+
+	// Box filtered all the way down. The irradiance is projected from one of the smaller levels and the specular samples fetch
+	// from whichever level matches their footprint.
+	const sp_image_mip_chain source = sp_image_mip_chain_create(src, width, height, source_desc);
+
+	sp_image_ibl ibl;
+
+	detail::sp_image_ibl_project_sh9(source, ibl);
+
+	// Same layout as the source, just fewer levels, and level 0 is already right
+	sp_image_mip_chain specular;
+	specular._format = source._format;
+	specular._mip_count = k_image_ibl_specular_mip_count;
+	std::copy(source._mips, source._mips + k_image_ibl_specular_mip_count, specular._mips);
+	const sp_image_mip& last_mip = source._mips[k_image_ibl_specular_mip_count - 1];
+	specular._data.resize(last_mip._offset_bytes + static_cast<size_t>(last_mip._row_pitch_bytes) * last_mip._height);
+	memcpy(specular._data.data(), source._data.data(), source._mips[1]._offset_bytes);
+
+	for (int i = 1; i < k_image_ibl_specular_mip_count; ++i)
+	{
+		detail::sp_image_ibl_prefilter_specular(source, specular, i);
+	}
+
+	ibl._specular = desc.specular_format == sp_image_format::r32g32b32a32 ? std::move(specular) : sp_image_mip_chain_convert(specular, desc.specular_format);
+
+	sp_image_mip_chain brdf_lut = detail::sp_image_ibl_integrate_brdf();
+
+	ibl._brdf_lut = desc.brdf_lut_format == sp_image_format::r32g32b32a32 ? std::move(brdf_lut) : sp_image_mip_chain_convert(brdf_lut, desc.brdf_lut_format);
+
+	return ibl;
+}
+
+bool sp_image_ibl_read(const char* path, sp_image_ibl& ibl)
+{
+	FILE* file = nullptr;
+#if defined(_WIN32)
+	if (fopen_s(&file, path, "rb") != 0)
+#else
+	if (!(file = fopen(path, "rb")))
+#endif
+	{
+		return false;
+	}
+
+	uint32_t header[2] = {};
+
+	const bool read =
+		fread(header, sizeof(header), 1, file) == 1 &&
+		header[0] == detail::k_image_ibl_file_magic &&
+		header[1] == detail::k_image_ibl_file_version &&
+		fread(ibl._irradiance_sh9, sizeof(ibl._irradiance_sh9), 1, file) == 1 &&
+		detail::sp_image_ibl_mip_chain_read(file, ibl._specular) &&
+		detail::sp_image_ibl_mip_chain_read(file, ibl._brdf_lut);
+
+	fclose(file);
+
+	return read;
+}
+
+bool sp_image_ibl_write(const char* path, const sp_image_ibl& ibl)
+{
+	FILE* file = nullptr;
+#if defined(_WIN32)
+	if (fopen_s(&file, path, "wb") != 0)
+#else
+	if (!(file = fopen(path, "wb")))
+#endif
+	{
+		return false;
+	}
+
+	const uint32_t header[2] = { detail::k_image_ibl_file_magic, detail::k_image_ibl_file_version };
+
+	bool written =
+		fwrite(header, sizeof(header), 1, file) == 1 &&
+		fwrite(ibl._irradiance_sh9, sizeof(ibl._irradiance_sh9), 1, file) == 1 &&
+		detail::sp_image_ibl_mip_chain_write(file, ibl._specular) &&
+		detail::sp_image_ibl_mip_chain_write(file, ibl._brdf_lut);
+
+	written = fclose(file) == 0 && written;
+
+	return written;
+}
+
+bool sp_image_ibl_descriptor_read(const char* path, sp_image_ibl_descriptor& descriptor)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		return false;
+	}
+
+	const std::string path_string = path;
+	const size_t separator = path_string.find_last_of("/\\");
+	const std::string directory = separator == std::string::npos ? std::string() : path_string.substr(0, separator + 1);
+
+	// The sIBL spec really does spell it "Enviroment"
+	std::string section;
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		line = detail::sp_image_ibl_descriptor_trim(line);
+
+		if (!line.empty() && line.front() == '[')
+		{
+			section = line;
+			continue;
+		}
+
+		const size_t equals = line.find('=');
+		if (equals == std::string::npos)
+		{
+			continue;
+		}
+
+		const std::string key = detail::sp_image_ibl_descriptor_trim(line.substr(0, equals));
+		const std::string value = detail::sp_image_ibl_descriptor_trim(line.substr(equals + 1));
+
+		if (section == "[Enviroment]" && key == "EVfile")
+		{
+			descriptor._environment_path = directory + value;
+		}
+		else if (section == "[Enviroment]" && key == "EVmulti")
+		{
+			descriptor._environment_multiplier = std::strtof(value.c_str(), nullptr);
+		}
+		else if (section == "[Reflection]" && key == "REFfile")
+		{
+			descriptor._reflection_path = directory + value;
+		}
+		else if (section == "[Reflection]" && key == "REFmulti")
+		{
+			descriptor._reflection_multiplier = std::strtof(value.c_str(), nullptr);
+		}
+	}
+
+	return !descriptor._reflection_path.empty() || !descriptor._environment_path.empty();
+}
\ No newline at end of file
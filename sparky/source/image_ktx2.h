@@ -0,0 +1,49 @@
+#pragma once
+
+#include "image_file.h"
+#include "image_mips.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// KTX2 files without supercompression. Unlike DDS the levels come with an index of where each one is, smallest first in the file,
+// and every array slice (and cube face) of a level is stored together.
+
+const uint8_t k_image_ktx2_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct sp_image_ktx2_header
+{
+	uint8_t identifier[12] = {};
+	uint32_t vk_format = 0;
+	uint32_t type_size = 0;
+	uint32_t pixel_width = 0;
+	uint32_t pixel_height = 0;
+	uint32_t pixel_depth = 0;
+	uint32_t layer_count = 0;
+	uint32_t face_count = 0;
+	uint32_t level_count = 0;
+	uint32_t supercompression_scheme = 0;
+	uint32_t dfd_byte_offset = 0;
+	uint32_t dfd_byte_length = 0;
+	uint32_t kvd_byte_offset = 0;
+	uint32_t kvd_byte_length = 0;
+	uint64_t sgd_byte_offset = 0;
+	uint64_t sgd_byte_length = 0;
+};
+
+// One per level straight after the header
+struct sp_image_ktx2_level_index
+{
+	uint64_t byte_offset = 0;
+	uint64_t byte_length = 0;
+	uint64_t uncompressed_byte_length = 0;
+};
+
+static_assert(sizeof(sp_image_ktx2_header) == 80, "KTX2 header has to match the file layout");
+static_assert(sizeof(sp_image_ktx2_level_index) == 24, "KTX2 level index has to match the file layout");
+
+// Returns the format for a VkFormat value, or false if there isn't a matching one
+bool sp_image_ktx2_get_format(uint32_t vk_format, sp_image_format& format, sp_image_color_space& color_space);
+
+// Parses the headers of a whole KTX2 file that's already in memory. Used by sp_image_file_open.
+bool sp_image_ktx2_read(const uint8_t* data, size_t size_bytes, sp_image_file& image_file);
\ No newline at end of file
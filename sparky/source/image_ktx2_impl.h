@@ -0,0 +1,90 @@
+#pragma once
+
+#include "image_ktx2.h"
+
+#include <algorithm>
+#include <cstring>
+
+bool sp_image_ktx2_get_format(uint32_t vk_format, sp_image_format& format, sp_image_color_space& color_space)
+{
+	switch (vk_format)
+	{
+	case 37:  format = sp_image_format::r8g8b8a8;     color_space = sp_image_color_space::linear; return true;	// VK_FORMAT_R8G8B8A8_UNORM
+	case 43:  format = sp_image_format::r8g8b8a8;     color_space = sp_image_color_space::srgb;   return true;	// VK_FORMAT_R8G8B8A8_SRGB
+	case 97:  format = sp_image_format::r16g16b16a16; color_space = sp_image_color_space::linear; return true;	// VK_FORMAT_R16G16B16A16_SFLOAT
+	case 109: format = sp_image_format::r32g32b32a32; color_space = sp_image_color_space::linear; return true;	// VK_FORMAT_R32G32B32A32_SFLOAT
+	case 123: format = sp_image_format::r9g9b9e5;     color_space = sp_image_color_space::linear; return true;	// VK_FORMAT_E5B9G9R9_UFLOAT_PACK32
+	case 131: format = sp_image_format::bc1;          color_space = sp_image_color_space::linear; return true;	// VK_FORMAT_BC1_RGB_UNORM_BLOCK
+	case 132: format = sp_image_format::bc1;          color_space = sp_image_color_space::srgb;   return true;	// VK_FORMAT_BC1_RGB_SRGB_BLOCK
+	case 133: format = sp_image_format::bc1;          color_space = sp_image_color_space::linear; return true;	// VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+	case 134: format = sp_image_format::bc1;          color_space = sp_image_color_space::srgb;   return true;	// VK_FORMAT_BC1_RGBA_SRGB_BLOCK
+	case 137: format = sp_image_format::bc3;          color_space = sp_image_color_space::linear; return true;	// VK_FORMAT_BC3_UNORM_BLOCK
+	case 138: format = sp_image_format::bc3;          color_space = sp_image_color_space::srgb;   return true;	// VK_FORMAT_BC3_SRGB_BLOCK
+	case 141: format = sp_image_format::bc5;          color_space = sp_image_color_space::linear; return true;	// VK_FORMAT_BC5_UNORM_BLOCK
+	case 143: format = sp_image_format::bc6h;         color_space = sp_image_color_space::linear; return true;	// VK_FORMAT_BC6H_UFLOAT_BLOCK
+	case 145: format = sp_image_format::bc7;          color_space = sp_image_color_space::linear; return true;	// VK_FORMAT_BC7_UNORM_BLOCK
+	case 146: format = sp_image_format::bc7;          color_space = sp_image_color_space::srgb;   return true;	// VK_FORMAT_BC7_SRGB_BLOCK
+	};
+
+	return false;
+}
+
+bool sp_image_ktx2_read(const uint8_t* data, size_t size_bytes, sp_image_file& image_file)
+{
+	sp_image_ktx2_header header;
+
+	if (size_bytes < sizeof(header))
+	{
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.identifier, k_image_ktx2_identifier, sizeof(k_image_ktx2_identifier)) != 0)
+	{
+		return false;
+	}
+
+	// Basis and zstd payloads would need decoding, which is what we're trying to avoid. 1D and 3D textures aren't supported.
+	if (header.supercompression_scheme != 0 || header.pixel_height == 0 || header.pixel_depth > 1 || (header.face_count != 1 && header.face_count != 6) ||
+		!sp_image_ktx2_get_format(header.vk_format, image_file._format, image_file._color_space))
+	{
+		return false;
+	}
+
+	image_file._width = static_cast<int>(header.pixel_width);
+	image_file._height = static_cast<int>(header.pixel_height);
+	image_file._mip_count = header.level_count > 0 ? static_cast<int>(header.level_count) : 1;
+	image_file._is_cube = header.face_count == 6;
+	image_file._array_size = static_cast<int>(std::max(header.layer_count, 1u) * header.face_count);
+
+	if (!detail::sp_image_file_init_subresources(image_file))
+	{
+		return false;
+	}
+
+	if (size_bytes < sizeof(header) + sizeof(sp_image_ktx2_level_index) * image_file._mip_count)
+	{
+		return false;
+	}
+
+	for (int mip = 0; mip < image_file._mip_count; ++mip)
+	{
+		sp_image_ktx2_level_index level_index;
+		memcpy(&level_index, data + sizeof(header) + sizeof(level_index) * mip, sizeof(level_index));
+
+		const size_t subresource_size_bytes = detail::sp_image_file_get_subresource_size_bytes(image_file, mip);
+		if (level_index.byte_length < static_cast<uint64_t>(subresource_size_bytes) * image_file._array_size)
+		{
+			return false;
+		}
+
+		// Layers, then faces within each layer. The same order as D3D12 array slices.
+		for (int array_slice = 0; array_slice < image_file._array_size; ++array_slice)
+		{
+			image_file._subresources[array_slice * image_file._mip_count + mip]._offset_bytes = static_cast<size_t>(level_index.byte_offset) + subresource_size_bytes * array_slice;
+		}
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Builds mip chains on the CPU when images are loaded. Every level is filtered from the one above it in linear space, so 8 bit
+// sRGB images are decoded first and encoded again on the way out, and the filter footprints are worked out from the real
+// sizes so odd and non power of two levels come out right. The rows of each level are filtered in parallel on the job system.
+
+// Matches sp_texture_mip_level_max
+const int k_image_mip_count_max = 16;
+
+enum class sp_image_format
+{
+	r8g8b8a8,
+	r32g32b32a32,
+
+	// Smaller float formats. See image_convert.h.
+	r16g16b16a16,	// Half float RGBA
+	r9g9b9e5,		// Unsigned RGB with 9 bit mantissas and a shared 5 bit exponent, no alpha
+
+	// 4x4 blocks. See image_bc.h.
+	bc1,			// RGB, 8 bytes per block
+	bc3,			// RGBA, 16 bytes per block
+	bc5,			// RG, 16 bytes per block
+	bc6h,			// Unsigned half float RGB, 16 bytes per block
+	bc7,			// RGBA, 16 bytes per block
+};
+
+// Alpha is always linear
+enum class sp_image_color_space
+{
+	linear,
+	srgb,
+};
+
+enum class sp_image_mip_filter
+{
+	box,			// Exact area average. Cheap and never rings.
+	kaiser,			// Kaiser windowed sinc. Sharper but rings a little so 8 bit results are clamped.
+};
+
+struct sp_image_mip_chain_desc
+{
+	sp_image_format format = sp_image_format::r8g8b8a8;
+	sp_image_color_space color_space = sp_image_color_space::linear;
+	sp_image_mip_filter filter = sp_image_mip_filter::box;
+
+	// Size of level 0 if the image should be resampled with the filter first. 0 keeps the source size.
+	int width = 0;
+	int height = 0;
+
+	// For images that wrap around horizontally, like equirectangular environments. Vertical edges are always clamped.
+	bool wrap_x = false;
+
+	bool parallel = true;		// Rows go to the job system, which has to be running, or run one after the other on this thread
+};
+
+struct sp_image_mip
+{
+	int _width = 0;
+	int _height = 0;
+	int _row_pitch_bytes = 0;		// Between rows of blocks for block compressed formats
+	size_t _offset_bytes = 0;
+};
+
+struct sp_image_mip_chain
+{
+	sp_image_format _format = sp_image_format::r8g8b8a8;
+	int _mip_count = 0;
+	sp_image_mip _mips[k_image_mip_count_max];
+
+	// Every level back to back with tightly packed rows
+	std::vector<uint8_t> _data;
+};
+
+bool sp_image_format_is_block_compressed(sp_image_format format);
+
+// Uncompressed formats only
+int sp_image_format_get_pixel_size_bytes(sp_image_format format);
+
+// Block compressed formats only
+int sp_image_format_get_block_size_bytes(sp_image_format format);
+
+// Rows of blocks for block compressed formats
+int sp_image_format_get_row_pitch_bytes(sp_image_format format, int width);
+int sp_image_format_get_row_count(sp_image_format format, int height);
+
+// Level 0 is a copy of data, or data resampled to the size in desc, and each level after that is half the size of the last,
+// rounding down, until 1x1. r8g8b8a8 and r32g32b32a32 only. Has to be called after sp_job_system_init.
+sp_image_mip_chain sp_image_mip_chain_create(const void* data, int width, int height, const sp_image_mip_chain_desc& desc);
+
+const void* sp_image_mip_chain_get_data(const sp_image_mip_chain& mip_chain, int mip);
\ No newline at end of file
@@ -0,0 +1,518 @@
+#pragma once
+
+#include "image_mips.h"
+#include "job.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+
+#include <immintrin.h>
+
+namespace detail
+{
+	// Kaiser filter as used by NVTT. Width is in destination texels either side of the center.
+	const double k_image_kaiser_width = 3.0;
+	const double k_image_kaiser_alpha = 4.0;
+
+	// Levels smaller than this aren't worth splitting into jobs
+	const int k_image_mip_parallel_pixel_count_min = 64 * 64;
+
+	// For every destination texel, the run of source texels it's made from and their weights. Taps that would fall off the edge
+	// are folded onto the edge texel (i.e. clamp addressing) so a run never has to be bounds checked. When wrapping, runs can
+	// start before the first texel or end after the last and the row is padded with wrapped texels instead.
+	struct sp_image_filter_taps
+	{
+		int _tap_count_max = 0;
+		int _pad = 0;						// Texels either side of the row that runs can reach
+		std::vector<int> _first;
+		std::vector<int> _count;
+		std::vector<float> _weights;		// _tap_count_max per destination texel
+	};
+
+	struct sp_image_srgb_tables
+	{
+		float _decode[256];
+
+		// Indexed by linear * 65535, which is fine enough that every 8 bit value is reachable
+		uint8_t _encode[65536];
+	};
+
+	const sp_image_srgb_tables& sp_image_srgb_tables_get()
+	{
+		static const sp_image_srgb_tables* tables = []() {
+			sp_image_srgb_tables* tables = new sp_image_srgb_tables;
+
+			for (int i = 0; i < 256; ++i)
+			{
+				const double s = i / 255.0;
+				tables->_decode[i] = static_cast<float>(s <= 0.04045 ? s / 12.92 : std::pow((s + 0.055) / 1.055, 2.4));
+			}
+
+			for (int i = 0; i < 65536; ++i)
+			{
+				const double l = i / 65535.0;
+				const double s = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+				tables->_encode[i] = static_cast<uint8_t>(std::lround(std::min(std::max(s, 0.0), 1.0) * 255.0));
+			}
+
+			return tables;
+		}();
+
+		return *tables;
+	}
+
+	double sp_image_bessel_i0(double x)
+	{
+		// Power series, converges quickly for the small arguments used here
+		const double half_x_squared = (x * 0.5) * (x * 0.5);
+
+		double sum = 1.0;
+		double term = 1.0;
+		for (int k = 1; k < 64 && term > sum * 1e-12; ++k)
+		{
+			term *= half_x_squared / (static_cast<double>(k) * k);
+			sum += term;
+		}
+
+		return sum;
+	}
+
+	double sp_image_kaiser(double x)
+	{
+		const double t = x / k_image_kaiser_width;
+		if (t <= -1.0 || t >= 1.0)
+		{
+			return 0.0;
+		}
+
+		const double pi_x = 3.14159265358979323846 * x;
+		const double sinc = x == 0.0 ? 1.0 : std::sin(pi_x) / pi_x;
+
+		return sinc * sp_image_bessel_i0(k_image_kaiser_alpha * std::sqrt(1.0 - t * t)) / sp_image_bessel_i0(k_image_kaiser_alpha);
+	}
+
+	void sp_image_filter_taps_build(sp_image_filter_taps& taps, int src_size, int dst_size, sp_image_mip_filter filter, bool wrap)
+	{
+		const double scale = static_cast<double>(src_size) / dst_size;
+		const double radius = filter == sp_image_mip_filter::box ? 0.5 * scale : k_image_kaiser_width * scale;
+
+		// Wrapped runs aren't folded so can be longer than the row
+		const int tap_count = static_cast<int>(std::ceil(radius * 2.0)) + 2;
+
+		taps._tap_count_max = wrap ? tap_count : std::min(src_size, tap_count);
+		taps._pad = wrap ? tap_count : 0;
+		taps._first.resize(dst_size);
+		taps._count.resize(dst_size);
+		taps._weights.assign(static_cast<size_t>(dst_size) * taps._tap_count_max, 0.0f);
+
+		std::vector<double> weights(taps._tap_count_max);
+
+		for (int i = 0; i < dst_size; ++i)
+		{
+			// In source texels where texel j covers [j, j + 1)
+			const double center = (i + 0.5) * scale;
+
+			const int begin = static_cast<int>(std::floor(center - radius));
+			const int end = static_cast<int>(std::ceil(center + radius));
+
+			const int first = wrap ? begin : std::max(0, std::min(src_size - 1, begin));
+			const int last = wrap ? end - 1 : std::max(0, std::min(src_size - 1, end - 1));
+
+			std::fill(weights.begin(), weights.end(), 0.0);
+
+			double weight_sum = 0.0;
+			for (int j = begin; j < end; ++j)
+			{
+				double weight;
+				if (filter == sp_image_mip_filter::box)
+				{
+					weight = std::max(0.0, std::min(center + radius, j + 1.0) - std::max(center - radius, static_cast<double>(j)));
+				}
+				else
+				{
+					weight = sp_image_kaiser((j + 0.5 - center) / scale);
+				}
+
+				weights[(wrap ? j : std::max(0, std::min(src_size - 1, j))) - first] += weight;
+				weight_sum += weight;
+			}
+
+			assert(weight_sum > 0.0);
+			assert(last - first + 1 <= taps._tap_count_max);
+
+			taps._first[i] = first;
+			taps._count[i] = last - first + 1;
+
+			for (int k = 0; k < taps._count[i]; ++k)
+			{
+				taps._weights[static_cast<size_t>(i) * taps._tap_count_max + k] = static_cast<float>(weights[k] / weight_sum);
+			}
+		}
+	}
+
+	// Turns rows of 8 bit pixels into linear float RGBA
+	void sp_image_decode_rows_r8g8b8a8(const uint8_t* src, float* dst, int width, int row_begin, int row_end, sp_image_color_space color_space)
+	{
+		const size_t begin = static_cast<size_t>(row_begin) * width;
+		const size_t end = static_cast<size_t>(row_end) * width;
+
+		if (color_space == sp_image_color_space::srgb)
+		{
+			const float* decode = sp_image_srgb_tables_get()._decode;
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				const uint8_t* pixel = src + i * 4;
+				_mm_storeu_ps(dst + i * 4, _mm_setr_ps(decode[pixel[0]], decode[pixel[1]], decode[pixel[2]], pixel[3] * (1.0f / 255.0f)));
+			}
+		}
+		else
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				int32_t packed;
+				memcpy(&packed, src + i * 4, sizeof(packed));
+
+				const __m128i pixel = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+				_mm_storeu_ps(dst + i * 4, _mm_mul_ps(_mm_cvtepi32_ps(pixel), scale));
+			}
+		}
+	}
+
+	// And back again
+	void sp_image_encode_row_r8g8b8a8(const float* src, uint8_t* dst, int width, sp_image_color_space color_space)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		if (color_space == sp_image_color_space::srgb)
+		{
+			const uint8_t* encode = sp_image_srgb_tables_get()._encode;
+			const __m128 scale = _mm_setr_ps(65535.0f, 65535.0f, 65535.0f, 255.0f);
+
+			for (int x = 0; x < width; ++x)
+			{
+				const __m128 pixel = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + x * 4), zero), one);
+
+				alignas(16) int32_t indices[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(indices), _mm_cvtps_epi32(_mm_mul_ps(pixel, scale)));
+
+				dst[x * 4 + 0] = encode[indices[0]];
+				dst[x * 4 + 1] = encode[indices[1]];
+				dst[x * 4 + 2] = encode[indices[2]];
+				dst[x * 4 + 3] = static_cast<uint8_t>(indices[3]);
+			}
+		}
+		else
+		{
+			const __m128 scale = _mm_set1_ps(255.0f);
+
+			for (int x = 0; x < width; ++x)
+			{
+				const __m128 pixel = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + x * 4), zero), one);
+
+				const __m128i pixel_i32 = _mm_cvtps_epi32(_mm_mul_ps(pixel, scale));
+				const __m128i pixel_u8 = _mm_packus_epi16(_mm_packs_epi32(pixel_i32, pixel_i32), pixel_i32);
+
+				const int32_t packed = _mm_cvtsi128_si32(pixel_u8);
+				memcpy(dst + x * 4, &packed, sizeof(packed));
+			}
+		}
+	}
+
+	// Filters one row of the destination level. Columns first so the vertical pass runs over whole contiguous source rows.
+	// column_scratch needs room for the source row plus taps_x._pad texels either side.
+	void sp_image_filter_row(
+		const float* src, int src_width,
+		const sp_image_filter_taps& taps_x, const sp_image_filter_taps& taps_y, int y,
+		float* column_scratch, float* dst, int dst_width)
+	{
+		const int row_float_count = src_width * 4;
+
+		float* column_scratch_padded = column_scratch;
+		column_scratch += taps_x._pad * 4;
+
+		const int first_y = taps_y._first[y];
+		const float* weights_y = &taps_y._weights[static_cast<size_t>(y) * taps_y._tap_count_max];
+
+		for (int k = 0; k < taps_y._count[y]; ++k)
+		{
+			const float* src_row = src + static_cast<size_t>(first_y + k) * row_float_count;
+			const bool first_tap = k == 0;
+
+			int i = 0;
+#if defined(__AVX__)
+			const __m256 weight_avx = _mm256_set1_ps(weights_y[k]);
+			for (; i + 8 <= row_float_count; i += 8)
+			{
+				const __m256 weighted = _mm256_mul_ps(_mm256_loadu_ps(src_row + i), weight_avx);
+				_mm256_storeu_ps(column_scratch + i, first_tap ? weighted : _mm256_add_ps(_mm256_loadu_ps(column_scratch + i), weighted));
+			}
+#endif
+			const __m128 weight = _mm_set1_ps(weights_y[k]);
+			for (; i < row_float_count; i += 4)
+			{
+				const __m128 weighted = _mm_mul_ps(_mm_loadu_ps(src_row + i), weight);
+				_mm_storeu_ps(column_scratch + i, first_tap ? weighted : _mm_add_ps(_mm_loadu_ps(column_scratch + i), weighted));
+			}
+		}
+
+		for (int i = 0; i < taps_x._pad; ++i)
+		{
+			const int left = ((i - taps_x._pad) % src_width + src_width) % src_width;
+			const int right = i % src_width;
+
+			memcpy(column_scratch_padded + i * 4, column_scratch + left * 4, sizeof(float) * 4);
+			memcpy(column_scratch + (src_width + i) * 4, column_scratch + right * 4, sizeof(float) * 4);
+		}
+
+		// One pixel per register so the taps are just a weighted sum of registers
+		for (int x = 0; x < dst_width; ++x)
+		{
+			const float* src_pixel = column_scratch + taps_x._first[x] * 4;
+			const float* weights_x = &taps_x._weights[static_cast<size_t>(x) * taps_x._tap_count_max];
+
+			__m128 sum = _mm_setzero_ps();
+			for (int k = 0; k < taps_x._count[x]; ++k)
+			{
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src_pixel + k * 4), _mm_set1_ps(weights_x[k])));
+			}
+
+			_mm_storeu_ps(dst + x * 4, sum);
+		}
+	}
+
+	void sp_image_parallel_rows(int width, int height, const std::function<void(int begin, int end)>& function)
+	{
+		if (width * height < k_image_mip_parallel_pixel_count_min)
+		{
+			function(0, height);
+		}
+		else
+		{
+			sp_job_parallel_for(height, 0, function);
+		}
+	}
+}
+
+bool sp_image_format_is_block_compressed(sp_image_format format)
+{
+	switch (format)
+	{
+	case sp_image_format::r8g8b8a8:     return false;
+	case sp_image_format::r32g32b32a32: return false;
+	case sp_image_format::r16g16b16a16: return false;
+	case sp_image_format::r9g9b9e5:     return false;
+	case sp_image_format::bc1:          return true;
+	case sp_image_format::bc3:          return true;
+	case sp_image_format::bc5:          return true;
+	case sp_image_format::bc6h:         return true;
+	case sp_image_format::bc7:          return true;
+	};
+
+	assert(false);
+
+	return false;
+}
+
+int sp_image_format_get_pixel_size_bytes(sp_image_format format)
+{
+	switch (format)
+	{
+	case sp_image_format::r8g8b8a8:     return 4;
+	case sp_image_format::r32g32b32a32: return 16;
+	case sp_image_format::r16g16b16a16: return 8;
+	case sp_image_format::r9g9b9e5:     return 4;
+	case sp_image_format::bc1:
+	case sp_image_format::bc3:
+	case sp_image_format::bc5:
+	case sp_image_format::bc6h:
+	case sp_image_format::bc7:
+		break;		// Sized by the block, see sp_image_format_get_block_size_bytes
+	};
+
+	assert(false);
+
+	return 0;
+}
+
+int sp_image_format_get_block_size_bytes(sp_image_format format)
+{
+	switch (format)
+	{
+	case sp_image_format::r8g8b8a8:
+	case sp_image_format::r32g32b32a32:
+	case sp_image_format::r16g16b16a16:
+	case sp_image_format::r9g9b9e5:
+		break;		// Sized by the pixel, see sp_image_format_get_pixel_size_bytes
+	case sp_image_format::bc1:          return 8;
+	case sp_image_format::bc3:          return 16;
+	case sp_image_format::bc5:          return 16;
+	case sp_image_format::bc6h:         return 16;
+	case sp_image_format::bc7:          return 16;
+	};
+
+	assert(false);
+
+	return 0;
+}
+
+int sp_image_format_get_row_pitch_bytes(sp_image_format format, int width)
+{
+	if (sp_image_format_is_block_compressed(format))
+	{
+		return ((width + 3) / 4) * sp_image_format_get_block_size_bytes(format);
+	}
+
+	return width * sp_image_format_get_pixel_size_bytes(format);
+}
+
+int sp_image_format_get_row_count(sp_image_format format, int height)
+{
+	return sp_image_format_is_block_compressed(format) ? (height + 3) / 4 : height;
+}
+
+sp_image_mip_chain sp_image_mip_chain_create(const void* data, int width, int height, const sp_image_mip_chain_desc& desc)
+{
+	assert(data);
+	assert(width > 0 && height > 0);
+	assert(desc.format == sp_image_format::r8g8b8a8 || desc.format == sp_image_format::r32g32b32a32);
+
+	const int top_width = desc.width > 0 ? desc.width : width;
+	const int top_height = desc.height > 0 ? desc.height : height;
+	const bool resample = top_width != width || top_height != height;
+
+	// The filters are only set up for making images smaller
+	assert(top_width <= width && top_height <= height);
+
+	sp_image_mip_chain mip_chain;
+	mip_chain._format = desc.format;
+
+	const int pixel_size_bytes = sp_image_format_get_pixel_size_bytes(desc.format);
+	const int size_max = std::max(top_width, top_height);
+
+	mip_chain._mip_count = 1;
+	while (mip_chain._mip_count < k_image_mip_count_max && (size_max >> mip_chain._mip_count) > 0)
+	{
+		++mip_chain._mip_count;
+	}
+
+	size_t size_bytes = 0;
+	for (int i = 0; i < mip_chain._mip_count; ++i)
+	{
+		sp_image_mip& mip = mip_chain._mips[i];
+		mip._width = std::max(1, top_width >> i);
+		mip._height = std::max(1, top_height >> i);
+		mip._row_pitch_bytes = mip._width * pixel_size_bytes;
+		mip._offset_bytes = size_bytes;
+
+		size_bytes += static_cast<size_t>(mip._row_pitch_bytes) * mip._height;
+	}
+
+	mip_chain._data.resize(size_bytes);
+
+	const auto rows = [&desc](int rows_width, int rows_height, const std::function<void(int begin, int end)>& function) {
+		if (desc.parallel)
+		{
+			detail::sp_image_parallel_rows(rows_width, rows_height, function);
+		}
+		else
+		{
+			function(0, rows_height);
+		}
+	};
+
+	if (!resample)
+	{
+		memcpy(mip_chain._data.data(), data, static_cast<size_t>(mip_chain._mips[0]._row_pitch_bytes) * height);
+
+		if (mip_chain._mip_count == 1)
+		{
+			return mip_chain;
+		}
+	}
+
+	const bool is_float = desc.format == sp_image_format::r32g32b32a32;
+
+	// Float levels are filtered straight into the chain. 8 bit levels are kept in linear float, between a pair of scratch levels,
+	// so nothing is quantized until it's written out. The source only gets a level of its own when it's being resampled.
+	std::unique_ptr<float[]> linear_levels[2];
+	std::unique_ptr<float[]> source_linear_level;
+
+	const float* src_linear = nullptr;
+	if (is_float)
+	{
+		src_linear = resample ? static_cast<const float*>(data) : reinterpret_cast<const float*>(mip_chain._data.data());
+	}
+	else
+	{
+		linear_levels[0].reset(new float[static_cast<size_t>(top_width) * top_height * 4]);
+		if (mip_chain._mip_count > 1)
+		{
+			linear_levels[1].reset(new float[static_cast<size_t>(mip_chain._mips[1]._width) * mip_chain._mips[1]._height * 4]);
+		}
+
+		if (resample)
+		{
+			source_linear_level.reset(new float[static_cast<size_t>(width) * height * 4]);
+		}
+
+		const uint8_t* src = static_cast<const uint8_t*>(data);
+		float* dst = resample ? source_linear_level.get() : linear_levels[0].get();
+
+		rows(width, height, [src, dst, width, &desc](int begin, int end) {
+			detail::sp_image_decode_rows_r8g8b8a8(src, dst, width, begin, end, desc.color_space);
+		});
+
+		src_linear = dst;
+	}
+
+	detail::sp_image_filter_taps taps_x;
+	detail::sp_image_filter_taps taps_y;
+
+	for (int i = resample ? 0 : 1; i < mip_chain._mip_count; ++i)
+	{
+		const int src_width = i == 0 ? width : mip_chain._mips[i - 1]._width;
+		const int src_height = i == 0 ? height : mip_chain._mips[i - 1]._height;
+		const sp_image_mip& dst_mip = mip_chain._mips[i];
+
+		detail::sp_image_filter_taps_build(taps_x, src_width, dst_mip._width, desc.filter, desc.wrap_x);
+		detail::sp_image_filter_taps_build(taps_y, src_height, dst_mip._height, desc.filter, false);
+
+		float* dst_linear = is_float ? reinterpret_cast<float*>(&mip_chain._data[dst_mip._offset_bytes]) : linear_levels[i & 1].get();
+		uint8_t* dst = &mip_chain._data[dst_mip._offset_bytes];
+
+		rows(dst_mip._width, dst_mip._height, [&](int begin, int end) {
+			std::vector<float> column_scratch(static_cast<size_t>(src_width + taps_x._pad * 2) * 4);
+
+			for (int y = begin; y < end; ++y)
+			{
+				float* dst_linear_row = dst_linear + static_cast<size_t>(y) * dst_mip._width * 4;
+
+				detail::sp_image_filter_row(src_linear, src_width, taps_x, taps_y, y, column_scratch.data(), dst_linear_row, dst_mip._width);
+
+				if (!is_float)
+				{
+					detail::sp_image_encode_row_r8g8b8a8(dst_linear_row, dst + static_cast<size_t>(y) * dst_mip._row_pitch_bytes, dst_mip._width, desc.color_space);
+				}
+			}
+		});
+
+		src_linear = dst_linear;
+	}
+
+	return mip_chain;
+}
+
+const void* sp_image_mip_chain_get_data(const sp_image_mip_chain& mip_chain, int mip)
+{
+	assert(mip >= 0 && mip < mip_chain._mip_count);
+
+	return &mip_chain._data[mip_chain._mips[mip]._offset_bytes];
+}
\ No newline at end of file
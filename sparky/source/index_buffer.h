@@ -0,0 +1,37 @@
+#pragma once
+
+#include "handle.h"
+#include "gpu_memory.h"
+
+#define NOMINMAX
+#include <d3d12.h>
+
+#include <wrl.h>
+
+struct sp_index_buffer_desc
+{
+	int _size_in_bytes = -1;
+	int _index_size_in_bytes = 4;		// 2 or 4
+};
+
+struct sp_index_buffer
+{
+	const char* _name = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> _resource;		// Shared with every other buffer in the same gpu memory page
+	sp_gpu_memory_block _memory_block;
+	D3D12_INDEX_BUFFER_VIEW _index_buffer_view;
+};
+
+using sp_index_buffer_handle = sp_handle;
+
+namespace detail
+{
+	void sp_index_buffer_pool_create();
+	void sp_index_buffer_pool_destroy();
+	sp_index_buffer& sp_index_buffer_pool_get(sp_index_buffer_handle index_buffer_handle);
+}
+
+sp_index_buffer_handle sp_index_buffer_create(const char* name, const sp_index_buffer_desc& desc);
+// Goes through the copy queue like sp_texture_update
+void sp_index_buffer_update(const sp_index_buffer_handle& buffer_handle, const void* data_cpu, int size_bytes);
+void sp_index_buffer_destroy(const sp_index_buffer_handle& buffer_handle);
\ No newline at end of file
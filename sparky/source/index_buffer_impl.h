@@ -0,0 +1,71 @@
+#pragma once
+
+#include "index_buffer.h"
+
+#include "d3dx12.h"
+
+#include <array>
+
+namespace detail
+{
+	namespace resource_pools
+	{
+		std::array<sp_index_buffer, 1024> index_buffers;
+		sp_handle_pool index_buffer_handles;
+	}
+
+	void sp_index_buffer_pool_create()
+	{
+		sp_handle_pool_create(&resource_pools::index_buffer_handles, static_cast<int>(resource_pools::index_buffers.size()));
+	}
+
+	void sp_index_buffer_pool_destroy()
+	{
+		sp_handle_pool_destroy(&resource_pools::index_buffer_handles);
+	}
+
+	sp_index_buffer& sp_index_buffer_pool_get(sp_index_buffer_handle index_buffer_handle)
+	{
+		return resource_pools::index_buffers[index_buffer_handle.index];
+	}
+}
+
+sp_index_buffer_handle sp_index_buffer_create(const char* name, const sp_index_buffer_desc& desc)
+{
+	assert(desc._index_size_in_bytes == 2 || desc._index_size_in_bytes == 4);
+
+	sp_index_buffer_handle buffer_handle = sp_handle_alloc(&detail::resource_pools::index_buffer_handles);
+	sp_index_buffer& buffer = detail::resource_pools::index_buffers[buffer_handle.index];
+
+	// Same default heap pages as the vertex buffers
+	buffer._memory_block = detail::sp_gpu_memory_alloc(sp_gpu_memory_pool_type::default_buffers, desc._size_in_bytes, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+	buffer._resource = detail::sp_gpu_memory_get_buffer(buffer._memory_block);
+
+	buffer._name = name;
+
+	buffer._index_buffer_view.BufferLocation = detail::sp_gpu_memory_get_gpu_address(buffer._memory_block);
+	buffer._index_buffer_view.SizeInBytes = desc._size_in_bytes;
+	buffer._index_buffer_view.Format = desc._index_size_in_bytes == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+
+	return buffer_handle;
+}
+
+void sp_index_buffer_update(const sp_index_buffer_handle& buffer_handle, const void* data_cpu, int size_bytes)
+{
+	sp_index_buffer& buffer = detail::resource_pools::index_buffers[buffer_handle.index];
+
+	assert(size_bytes <= static_cast<int>(buffer._memory_block._size_bytes));
+
+	detail::sp_upload_buffer_region(detail::_sp._upload_context, buffer._resource.Get(), buffer._memory_block._offset_bytes, data_cpu, size_bytes);
+}
+
+void sp_index_buffer_destroy(const sp_index_buffer_handle& buffer_handle)
+{
+	sp_index_buffer& buffer = detail::resource_pools::index_buffers[buffer_handle.index];
+
+	// The page's buffer stays alive regardless, it's only the block that has to wait for the GPU
+	buffer._resource = nullptr;
+	detail::sp_deferred_release(buffer._memory_block);
+
+	sp_handle_free(&detail::resource_pools::index_buffer_handles, buffer_handle);
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// The CPU half of GPU driven drawing. Every instance's bounds live in a GPU buffer, a compute shader tests them against the
+// frustum and the depth pyramid of the previous frame and counts the survivors into indirect draw arguments, and the draws are
+// issued with ExecuteIndirect so the CPU never touches an instance. This has the layouts those buffers share with the shaders
+// and reference implementations of building the pyramid and culling that do the same arithmetic in the same order, so what the
+// shaders write can be checked against them. tools/sparky_test checks the references on hand built depth and instances on any
+// platform and the pbr demo's GPU driven mode can compare what its shaders wrote with them.
+//
+// Occlusion is tested against last frame's depth, reprojected with last frame's matrix, so whatever was hidden behind something
+// that moved out of the way shows up a frame late. The pyramid keeps the farthest depth of each texel's footprint and an
+// instance is hidden when the nearest point of its bounds is behind the farthest depth of the at most 2x2 texels its screen
+// rectangle covers in the first mip small enough (Greene, "Hierarchical Z-Buffer Visibility"). Bounds that reach behind the
+// camera are always visible.
+//
+// The shaders write the same argument buffers as long as the GPU rounds like the CPU. Additions and multiplications are marked
+// precise so they aren't fused, but D3D allows division to be off by 2.5 ULP so an instance whose screen rectangle lands within
+// a few ULP of a pyramid texel's edge could be tested against a different texel. Visible instances are appended to their draw's
+// range with atomics on the GPU so the order within a draw can differ from the reference, only the counts have to match.
+
+const int k_depth_pyramid_mip_count_max = 16;
+
+// Same layout as D3D12_DRAW_INDEXED_ARGUMENTS
+struct sp_indirect_draw_args
+{
+	uint32_t _index_count = 0;
+	uint32_t _instance_count = 0;
+	uint32_t _first_index = 0;
+	int32_t _base_vertex = 0;
+	uint32_t _first_instance = 0;		// Where the draw's visible instances start, room for all of them has to follow
+};
+
+// 32 bytes so it's one structured buffer element
+struct sp_indirect_cull_instance
+{
+	float _center[3];		// Axis aligned world space bounds
+	uint32_t _draw = 0;		// Which draw arguments it's counted into
+	float _extent[3];
+	uint32_t _data = 0;		// Written to the draw's visible instances, e.g. an index into per instance data
+};
+
+// Mip 0 is half the size of the depth buffer, rounded down, and every mip after it half the one before down to 1x1. A texel
+// keeps the farthest depth of the 2x2 texels under it, 3 wide or high along the last column or row of an odd sized mip so
+// nothing is left out. Every mip is in one array, rows top to bottom, so it uploads as one buffer.
+struct sp_depth_pyramid
+{
+	int _depth_width = 0;
+	int _depth_height = 0;
+	int _mip_count = 0;
+	int _mip_widths[k_depth_pyramid_mip_count_max] = {};
+	int _mip_heights[k_depth_pyramid_mip_count_max] = {};
+	int _mip_offsets[k_depth_pyramid_mip_count_max] = {};		// Into _depths
+	int _depth_count = 0;		// Over every mip
+	std::vector<float> _depths;		// Only filled in by sp_depth_pyramid_build, the layout is enough for the GPU
+};
+
+struct sp_indirect_cull_desc
+{
+	float planes[6][4] = {};		// Like math::get_frustum_planes
+	float view_projection[4][4] = {};		// Last frame's, that the pyramid was rendered with, for row vectors
+	const sp_depth_pyramid* depth_pyramid = nullptr;		// Skips occlusion culling if null
+};
+
+// Works out the mip sizes and where each one starts for a depth buffer of the given size
+void sp_depth_pyramid_init(sp_depth_pyramid& pyramid, int depth_width, int depth_height);
+
+// Initializes the pyramid for depth, width by height floats in rows top to bottom, and fills in every mip
+void sp_depth_pyramid_build(sp_depth_pyramid& pyramid, const float* depth, int depth_width, int depth_height);
+
+// Whether the bounds are behind the pyramid everywhere they cover. The matrix is the one the pyramid's depth was rendered with.
+bool sp_depth_pyramid_occludes(const sp_depth_pyramid& pyramid, const float (&view_projection)[4][4], const float (&center)[3], const float (&extent)[3]);
+
+// Sets every draw's instance count to zero and, in instance order, counts each instance that survives into its draw and writes
+// its data to visible at the draw's first instance plus its count so far. Returns the number of visible instances.
+int sp_indirect_cull_reference(const sp_indirect_cull_desc& desc, const sp_indirect_cull_instance* instances, int instance_count, sp_indirect_draw_args* draw_args, int draw_count, uint32_t* visible);
\ No newline at end of file
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "indirect_cull.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Everything here is written the way indirect_cull.hlsl and depth_pyramid.hlsl in the pbr demo are, down to the order of the
+// additions, so change them together
+
+namespace detail
+{
+	// Reduces source into the mip of the given size, each texel the farthest depth of the ones under it
+	void sp_depth_pyramid_reduce(const float* source, int source_width, int source_height, float* mip, int mip_width, int mip_height)
+	{
+		for (int y = 0; y < mip_height; ++y)
+		{
+			// The last row of an odd sized source has no row of its own to go to so the last row takes it too
+			const int source_y_begin = std::min(y * 2, source_height - 1);
+			const int source_y_end = y == mip_height - 1 ? source_height - 1 : std::min(y * 2 + 1, source_height - 1);
+
+			for (int x = 0; x < mip_width; ++x)
+			{
+				const int source_x_begin = std::min(x * 2, source_width - 1);
+				const int source_x_end = x == mip_width - 1 ? source_width - 1 : std::min(x * 2 + 1, source_width - 1);
+
+				float depth_max = source[source_y_begin * source_width + source_x_begin];
+				for (int source_y = source_y_begin; source_y <= source_y_end; ++source_y)
+				{
+					for (int source_x = source_x_begin; source_x <= source_x_end; ++source_x)
+					{
+						depth_max = std::max(depth_max, source[source_y * source_width + source_x]);
+					}
+				}
+
+				mip[y * mip_width + x] = depth_max;
+			}
+		}
+	}
+
+	bool sp_indirect_cull_outside_frustum(const float (&planes)[6][4], const sp_indirect_cull_instance& instance)
+	{
+		// Same test as math::frustum_outside_aabb
+		for (int i = 0; i < 6; ++i)
+		{
+			const float distance = planes[i][0] * instance._center[0] + planes[i][1] * instance._center[1] + planes[i][2] * instance._center[2] + planes[i][3];
+			const float reach = std::abs(planes[i][0]) * instance._extent[0] + std::abs(planes[i][1]) * instance._extent[1] + std::abs(planes[i][2]) * instance._extent[2];
+			if (distance + reach < 0.0f)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
+void sp_depth_pyramid_init(sp_depth_pyramid& pyramid, int depth_width, int depth_height)
+{
+	assert(depth_width > 0 && depth_height > 0);
+
+	pyramid._depth_width = depth_width;
+	pyramid._depth_height = depth_height;
+	pyramid._mip_count = 0;
+	pyramid._depth_count = 0;
+
+	int width = std::max(depth_width / 2, 1);
+	int height = std::max(depth_height / 2, 1);
+
+	while (pyramid._mip_count < k_depth_pyramid_mip_count_max)
+	{
+		pyramid._mip_widths[pyramid._mip_count] = width;
+		pyramid._mip_heights[pyramid._mip_count] = height;
+		pyramid._mip_offsets[pyramid._mip_count] = pyramid._depth_count;
+		pyramid._depth_count += width * height;
+		++pyramid._mip_count;
+
+		if (width == 1 && height == 1)
+		{
+			break;
+		}
+
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+}
+
+void sp_depth_pyramid_build(sp_depth_pyramid& pyramid, const float* depth, int depth_width, int depth_height)
+{
+	sp_depth_pyramid_init(pyramid, depth_width, depth_height);
+
+	pyramid._depths.resize(pyramid._depth_count);
+
+	const float* source = depth;
+	int source_width = depth_width;
+	int source_height = depth_height;
+
+	for (int mip = 0; mip < pyramid._mip_count; ++mip)
+	{
+		float* destination = pyramid._depths.data() + pyramid._mip_offsets[mip];
+
+		detail::sp_depth_pyramid_reduce(source, source_width, source_height, destination, pyramid._mip_widths[mip], pyramid._mip_heights[mip]);
+
+		source = destination;
+		source_width = pyramid._mip_widths[mip];
+		source_height = pyramid._mip_heights[mip];
+	}
+}
+
+bool sp_depth_pyramid_occludes(const sp_depth_pyramid& pyramid, const float (&view_projection)[4][4], const float (&center)[3], const float (&extent)[3])
+{
+	assert(pyramid._depths.size() == static_cast<size_t>(pyramid._depth_count));
+
+	float ndc_min[3] = { 1.0f, 1.0f, 1.0f };
+	float ndc_max[3] = { -1.0f, -1.0f, -1.0f };
+
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		const float position[3] = {
+			center[0] + ((corner & 1) ? extent[0] : -extent[0]),
+			center[1] + ((corner & 2) ? extent[1] : -extent[1]),
+			center[2] + ((corner & 4) ? extent[2] : -extent[2]),
+		};
+
+		float clip[4];
+		for (int k = 0; k < 4; ++k)
+		{
+			clip[k] = position[0] * view_projection[0][k] + position[1] * view_projection[1][k] + position[2] * view_projection[2][k] + view_projection[3][k];
+		}
+
+		// Projecting a corner behind the camera would flip it to the other side of the screen
+		if (clip[3] <= 0.0f)
+		{
+			return false;
+		}
+
+		for (int k = 0; k < 3; ++k)
+		{
+			const float ndc = clip[k] / clip[3];
+			ndc_min[k] = std::min(ndc_min[k], ndc);
+			ndc_max[k] = std::max(ndc_max[k], ndc);
+		}
+	}
+
+	// Texture coordinates have y going down
+	const float u_min = std::min(std::max(ndc_min[0] * 0.5f + 0.5f, 0.0f), 1.0f);
+	const float u_max = std::min(std::max(ndc_max[0] * 0.5f + 0.5f, 0.0f), 1.0f);
+	const float v_min = std::min(std::max(0.5f - ndc_max[1] * 0.5f, 0.0f), 1.0f);
+	const float v_max = std::min(std::max(0.5f - ndc_min[1] * 0.5f, 0.0f), 1.0f);
+
+	// Depth buffer pixels first so the halving below lands on the same texels the reduction folded them into
+	int x_min = std::min(static_cast<int>(u_min * pyramid._depth_width), pyramid._depth_width - 1);
+	int x_max = std::min(static_cast<int>(u_max * pyramid._depth_width), pyramid._depth_width - 1);
+	int y_min = std::min(static_cast<int>(v_min * pyramid._depth_height), pyramid._depth_height - 1);
+	int y_max = std::min(static_cast<int>(v_max * pyramid._depth_height), pyramid._depth_height - 1);
+
+	int mip = -1;
+	do
+	{
+		++mip;
+		x_min = std::min(x_min / 2, pyramid._mip_widths[mip] - 1);
+		x_max = std::min(x_max / 2, pyramid._mip_widths[mip] - 1);
+		y_min = std::min(y_min / 2, pyramid._mip_heights[mip] - 1);
+		y_max = std::min(y_max / 2, pyramid._mip_heights[mip] - 1);
+	} while ((x_max - x_min > 1 || y_max - y_min > 1) && mip + 1 < pyramid._mip_count);
+
+	const float* depths = pyramid._depths.data() + pyramid._mip_offsets[mip];
+	const int width = pyramid._mip_widths[mip];
+
+	const float depth_max = std::max(
+		std::max(depths[y_min * width + x_min], depths[y_min * width + x_max]),
+		std::max(depths[y_max * width + x_min], depths[y_max * width + x_max]));
+
+	return ndc_min[2] > depth_max;
+}
+
+int sp_indirect_cull_reference(const sp_indirect_cull_desc& desc, const sp_indirect_cull_instance* instances, int instance_count, sp_indirect_draw_args* draw_args, int draw_count, uint32_t* visible)
+{
+	for (int i = 0; i < draw_count; ++i)
+	{
+		draw_args[i]._instance_count = 0;
+	}
+
+	int visible_count = 0;
+
+	for (int i = 0; i < instance_count; ++i)
+	{
+		const sp_indirect_cull_instance& instance = instances[i];
+
+		assert(instance._draw < static_cast<uint32_t>(draw_count));
+
+		if (detail::sp_indirect_cull_outside_frustum(desc.planes, instance))
+		{
+			continue;
+		}
+
+		if (desc.depth_pyramid && sp_depth_pyramid_occludes(*desc.depth_pyramid, desc.view_projection, instance._center, instance._extent))
+		{
+			continue;
+		}
+
+		sp_indirect_draw_args& args = draw_args[instance._draw];
+		visible[args._first_instance + args._instance_count++] = instance._data;
+		++visible_count;
+	}
+
+	return visible_count;
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+// Work stealing job system. Every worker owns a deque of jobs that it pushes to and pops from at one end while idle workers
+// steal from the other. The main thread is worker 0 and only runs jobs while it's waiting on a counter.
+//
+// Worker threads run on fibers. A job that waits (on a counter, a GPU fence, IO, ...) parks its fiber and the worker carries on
+// with other jobs on a fresh one. Parked fibers are resumed by whichever worker notices they're ready. Jobs running on the main
+// thread can't be moved to another thread so they run other jobs while they wait instead.
+//
+// Has no dependencies outside the standard library and Win32 fibers or ucontext. tools/sparky_test checks it and
+// tools/sparky_benchmark times it on any platform.
+
+// Per worker. A worker that has this many jobs in flight runs jobs until one of its slots frees up.
+const int k_job_count_per_worker_max = 4096;
+
+// Shared by all workers. Bounds the number of jobs that can be waiting at once, after that waits run other jobs instead.
+const int k_job_fiber_count = 128;
+const int k_job_fiber_stack_size_bytes = 256 * 1024;
+
+// Tracks the number of unfinished jobs it was passed to. Must outlive those jobs.
+struct sp_job_counter
+{
+	std::atomic<int> _value{ 0 };
+};
+
+using sp_job_function = std::function<void()>;
+
+// worker_thread_count doesn't include the main thread. -1 creates one worker per hardware thread after the main thread.
+void sp_job_system_init(int worker_thread_count = -1);
+void sp_job_system_shutdown();
+
+// Including the main thread
+int sp_job_system_get_worker_count();
+
+// 0 for the main thread, -1 for threads the job system doesn't know about
+int sp_job_get_worker_index();
+bool sp_job_is_main_thread();
+
+// True on worker threads, where waiting parks the fiber. Anywhere else a wait keeps the thread busy running jobs or polling, so
+// waits that can block on an OS primitive instead should when this is false.
+bool sp_job_can_park();
+
+void sp_job_run(sp_job_function function, sp_job_counter* counter);
+
+// For work that has to happen on the main thread (e.g. anything touching the window). Runs the next time the main thread
+// calls sp_job_pump_main_thread or waits on a counter.
+void sp_job_run_on_main_thread(sp_job_function function, sp_job_counter* counter);
+void sp_job_pump_main_thread();
+
+// Returns once the counter reaches zero. See above for what happens in the meantime.
+void sp_job_wait(sp_job_counter& counter);
+
+// Same as sp_job_wait for anything else a job might wait on, e.g. a fence value or HasOverlappedIoCompleted. The predicate is
+// polled from any thread until it returns true so it has to be thread safe and cheap.
+void sp_job_wait_until(std::function<bool()> predicate);
+bool sp_job_counter_is_done(const sp_job_counter& counter);
+
+// Splits [0, count) into batches of batch_size and runs them as jobs, returning once all of them are finished. The calling
+// thread takes part. A batch_size of 0 picks one that gives every worker a few batches.
+void sp_job_parallel_for(int count, int batch_size, const std::function<void(int begin, int end)>& function);
\ No newline at end of file
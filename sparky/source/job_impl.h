@@ -0,0 +1,714 @@
+#pragma once
+
+#include "job.h"
+
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#define SP_JOB_NOINLINE __declspec(noinline)
+#else
+#include <ucontext.h>
+#define SP_JOB_NOINLINE __attribute__((noinline))
+#endif
+
+namespace detail
+{
+	struct sp_job
+	{
+		sp_job_function _function;
+		sp_job_counter* _counter = nullptr;
+		std::atomic<bool> _in_use{ false };
+	};
+
+	// Chase-Lev deque. Only the owning worker pushes and pops (at the bottom), anyone can steal (from the top).
+	// https://www.di.ens.fr/~zappa/readings/ppopp13.pdf
+	struct sp_job_deque
+	{
+		alignas(64) std::atomic<int64_t> _top{ 0 };
+		alignas(64) std::atomic<int64_t> _bottom{ 0 };
+		std::atomic<sp_job*> _jobs[k_job_count_per_worker_max];
+	};
+
+	struct sp_job_worker
+	{
+		sp_job_deque _deque;
+
+		// Ring of job slots. Jobs are allocated by the worker that submits them.
+		sp_job _jobs[k_job_count_per_worker_max];
+		int _next_job_index = 0;
+
+		uint32_t _random_state = 0;
+
+		std::thread _thread;
+	};
+
+	struct sp_job_fiber
+	{
+#if defined(_WIN32)
+		void* _fiber = nullptr;
+#else
+		ucontext_t _context;
+		std::unique_ptr<char[]> _stack;
+#endif
+	};
+
+	struct sp_job_waiting_fiber
+	{
+		sp_job_fiber* _fiber = nullptr;
+		std::function<bool()> _predicate;
+	};
+
+	enum class sp_job_fiber_switch_action
+	{
+		none,
+		release,		// Return the fiber we came from to the pool
+		park,			// Add the fiber we came from to the waiting list
+	};
+
+	struct sp_job_thread_state
+	{
+		int _worker_index = -1;
+
+		// Workers run on pool fibers and only go back to the thread's own stack to exit. Null on the main thread.
+		sp_job_fiber _thread_fiber;
+		sp_job_fiber* _current_fiber = nullptr;
+
+		// What to do with the fiber we just switched away from. Has to wait until we're off its stack otherwise another worker
+		// could pick it up while it's still running.
+		sp_job_fiber_switch_action _switch_action = sp_job_fiber_switch_action::none;
+		sp_job_fiber* _switch_fiber = nullptr;
+		std::function<bool()> _switch_predicate;
+	};
+
+	struct sp_job_system
+	{
+		std::vector<std::unique_ptr<sp_job_worker>> _workers;
+
+		std::vector<std::unique_ptr<sp_job_fiber>> _fibers;
+		std::mutex _fiber_mutex;
+		std::vector<sp_job_fiber*> _free_fibers;
+		std::vector<sp_job_waiting_fiber> _waiting_fibers;
+		std::atomic<int> _waiting_fiber_count{ 0 };
+
+		std::atomic<bool> _quit{ false };
+
+		// Workers sleep when there's nothing to do. Queued jobs are counted so they know when to wake up.
+		std::atomic<int> _queued_job_count{ 0 };
+		std::atomic<int> _sleeping_worker_count{ 0 };
+		std::mutex _sleep_mutex;
+		std::condition_variable _sleep_condition;
+
+		std::mutex _main_thread_jobs_mutex;
+		std::vector<sp_job*> _main_thread_jobs;
+	};
+
+	sp_job_system g_job_system;
+
+	thread_local sp_job_thread_state g_job_thread_state;
+
+	// Fibers can resume on a different thread than the one they were suspended on so the address of a thread local can't be
+	// cached across a switch. Everything goes through here and it's kept out of line so the compiler can't do that.
+	SP_JOB_NOINLINE sp_job_thread_state& sp_job_get_thread_state()
+	{
+		return g_job_thread_state;
+	}
+
+	static_assert((k_job_count_per_worker_max & (k_job_count_per_worker_max - 1)) == 0, "k_job_count_per_worker_max must be a power of two");
+
+	void sp_job_deque_push(sp_job_deque& deque, sp_job* job)
+	{
+		const int64_t bottom = deque._bottom.load(std::memory_order_relaxed);
+		const int64_t top = deque._top.load(std::memory_order_acquire);
+
+		assert(bottom - top < k_job_count_per_worker_max && "job deque overflow");
+
+		deque._jobs[bottom & (k_job_count_per_worker_max - 1)].store(job, std::memory_order_relaxed);
+		deque._bottom.store(bottom + 1, std::memory_order_release);
+	}
+
+	sp_job* sp_job_deque_pop(sp_job_deque& deque)
+	{
+		const int64_t bottom = deque._bottom.load(std::memory_order_relaxed) - 1;
+		deque._bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top = deque._top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{
+			deque._bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		sp_job* job = deque._jobs[bottom & (k_job_count_per_worker_max - 1)].load(std::memory_order_relaxed);
+
+		if (top == bottom)
+		{
+			// Last job. Race any thieves for it.
+			if (!deque._top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				job = nullptr;
+			}
+			deque._bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+
+		return job;
+	}
+
+	sp_job* sp_job_deque_steal(sp_job_deque& deque)
+	{
+		int64_t top = deque._top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t bottom = deque._bottom.load(std::memory_order_acquire);
+
+		if (top >= bottom)
+		{
+			return nullptr;
+		}
+
+		sp_job* job = deque._jobs[top & (k_job_count_per_worker_max - 1)].load(std::memory_order_relaxed);
+
+		if (!deque._top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			return nullptr;
+		}
+
+		return job;
+	}
+
+	sp_job_worker& sp_job_get_worker()
+	{
+		const int worker_index = sp_job_get_thread_state()._worker_index;
+
+		assert(worker_index >= 0 && "jobs can only be run from the main thread or a worker");
+
+		return *g_job_system._workers[worker_index];
+	}
+
+	void sp_job_execute(sp_job* job)
+	{
+		job->_function();
+		job->_function = nullptr;
+
+		// Anyone waiting on the counter is free to destroy it once it hits zero so the job is released first
+		sp_job_counter* counter = job->_counter;
+		job->_counter = nullptr;
+		job->_in_use.store(false, std::memory_order_release);
+
+		if (counter)
+		{
+			counter->_value.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	}
+
+	// Pops from our own deque first and then tries to steal from everyone else, starting from a random worker so thieves
+	// don't all pile onto the same victim.
+	bool sp_job_run_one()
+	{
+		const int worker_index = sp_job_get_thread_state()._worker_index;
+		sp_job_worker& worker = sp_job_get_worker();
+
+		sp_job* job = sp_job_deque_pop(worker._deque);
+
+		if (!job)
+		{
+			const int worker_count = static_cast<int>(g_job_system._workers.size());
+
+			// xorshift
+			worker._random_state ^= worker._random_state << 13;
+			worker._random_state ^= worker._random_state >> 17;
+			worker._random_state ^= worker._random_state << 5;
+
+			const int first_victim_index = static_cast<int>(worker._random_state % worker_count);
+			for (int i = 0; i < worker_count && !job; ++i)
+			{
+				const int victim_index = (first_victim_index + i) % worker_count;
+				if (victim_index != worker_index)
+				{
+					job = sp_job_deque_steal(g_job_system._workers[victim_index]->_deque);
+				}
+			}
+		}
+
+		if (!job)
+		{
+			return false;
+		}
+
+		g_job_system._queued_job_count.fetch_sub(1, std::memory_order_relaxed);
+
+		sp_job_execute(job);
+
+		return true;
+	}
+
+	sp_job* sp_job_alloc(sp_job_function&& function, sp_job_counter* counter)
+	{
+		// Skip over slots whose jobs haven't finished yet. Long running jobs (e.g. one that's waiting on its children) would
+		// otherwise stall the ring when it wraps around to them. If every slot is taken help out until one frees up.
+		sp_job* job = nullptr;
+		while (!job)
+		{
+			// Running a job can move us to another thread so the worker has to be looked up again every time around
+			sp_job_worker& worker = sp_job_get_worker();
+
+			for (int i = 0; i < k_job_count_per_worker_max && !job; ++i)
+			{
+				sp_job* candidate = &worker._jobs[worker._next_job_index & (k_job_count_per_worker_max - 1)];
+				++worker._next_job_index;
+
+				if (!candidate->_in_use.load(std::memory_order_acquire))
+				{
+					job = candidate;
+				}
+			}
+
+			if (!job && !sp_job_run_one())
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		job->_function = std::move(function);
+		job->_counter = counter;
+		job->_in_use.store(true, std::memory_order_relaxed);
+
+		if (counter)
+		{
+			counter->_value.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		return job;
+	}
+
+	void sp_job_fiber_switch(sp_job_fiber* from, sp_job_fiber* to)
+	{
+#if defined(_WIN32)
+		(void)from;
+		SwitchToFiber(to->_fiber);
+#else
+		swapcontext(&from->_context, &to->_context);
+#endif
+	}
+
+	sp_job_fiber* sp_job_fiber_alloc()
+	{
+		std::lock_guard<std::mutex> lock(g_job_system._fiber_mutex);
+
+		if (g_job_system._free_fibers.empty())
+		{
+			return nullptr;
+		}
+
+		sp_job_fiber* fiber = g_job_system._free_fibers.back();
+		g_job_system._free_fibers.pop_back();
+
+		return fiber;
+	}
+
+	// Must be called straight after every switch, by the fiber we switched to
+	void sp_job_fiber_after_switch()
+	{
+		sp_job_thread_state& thread_state = sp_job_get_thread_state();
+
+		if (thread_state._switch_action == sp_job_fiber_switch_action::none)
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(g_job_system._fiber_mutex);
+
+			if (thread_state._switch_action == sp_job_fiber_switch_action::release)
+			{
+				g_job_system._free_fibers.push_back(thread_state._switch_fiber);
+			}
+			else
+			{
+				g_job_system._waiting_fibers.push_back({ thread_state._switch_fiber, std::move(thread_state._switch_predicate) });
+				g_job_system._waiting_fiber_count.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		thread_state._switch_action = sp_job_fiber_switch_action::none;
+		thread_state._switch_fiber = nullptr;
+		thread_state._switch_predicate = nullptr;
+	}
+
+	void sp_job_fiber_switch_from_current(sp_job_fiber* to, sp_job_fiber_switch_action action, std::function<bool()> predicate)
+	{
+		sp_job_thread_state& thread_state = sp_job_get_thread_state();
+
+		sp_job_fiber* from = thread_state._current_fiber;
+
+		thread_state._switch_action = action;
+		thread_state._switch_fiber = from;
+		thread_state._switch_predicate = std::move(predicate);
+		thread_state._current_fiber = to;
+
+		sp_job_fiber_switch(from, to);
+
+		// Possibly on a different thread now
+		sp_job_fiber_after_switch();
+	}
+
+	// Switches to the first parked fiber whose wait is over. Only safe from the worker loop since the fiber we're on goes back to
+	// the pool and may be reused from the top of the loop.
+	bool sp_job_resume_waiting_fiber()
+	{
+		if (g_job_system._waiting_fiber_count.load(std::memory_order_relaxed) == 0)
+		{
+			return false;
+		}
+
+		sp_job_fiber* fiber = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(g_job_system._fiber_mutex);
+
+			for (auto it = g_job_system._waiting_fibers.begin(); it != g_job_system._waiting_fibers.end(); ++it)
+			{
+				if (it->_predicate())
+				{
+					fiber = it->_fiber;
+					g_job_system._waiting_fibers.erase(it);
+					g_job_system._waiting_fiber_count.fetch_sub(1, std::memory_order_relaxed);
+					break;
+				}
+			}
+		}
+
+		if (!fiber)
+		{
+			return false;
+		}
+
+		sp_job_fiber_switch_from_current(fiber, sp_job_fiber_switch_action::release, nullptr);
+
+		return true;
+	}
+
+	void sp_job_worker_loop()
+	{
+		while (!g_job_system._quit.load(std::memory_order_acquire))
+		{
+			if (sp_job_resume_waiting_fiber() || sp_job_run_one())
+			{
+				continue;
+			}
+
+			// Spin for a little while before going to sleep since more work tends to show up right after we run out
+			bool found_job = false;
+			for (int i = 0; i < 64 && !found_job; ++i)
+			{
+				std::this_thread::yield();
+				found_job = g_job_system._queued_job_count.load(std::memory_order_relaxed) > 0;
+			}
+
+			if (found_job)
+			{
+				continue;
+			}
+
+			const auto wake_predicate = []() {
+				return g_job_system._queued_job_count.load(std::memory_order_seq_cst) > 0 || g_job_system._quit.load(std::memory_order_acquire);
+			};
+
+			std::unique_lock<std::mutex> lock(g_job_system._sleep_mutex);
+			g_job_system._sleeping_worker_count.fetch_add(1, std::memory_order_seq_cst);
+
+			// Nothing signals when a parked fiber's wait is over so keep polling while there are any
+			if (g_job_system._waiting_fiber_count.load(std::memory_order_relaxed) > 0)
+			{
+				g_job_system._sleep_condition.wait_for(lock, std::chrono::milliseconds(1), wake_predicate);
+			}
+			else
+			{
+				g_job_system._sleep_condition.wait(lock, wake_predicate);
+			}
+
+			g_job_system._sleeping_worker_count.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+
+#if defined(_WIN32)
+	void WINAPI sp_job_fiber_main(void*)
+#else
+	void sp_job_fiber_main()
+#endif
+	{
+		sp_job_fiber_after_switch();
+
+		sp_job_worker_loop();
+
+		// Back to the thread's own stack so it can exit. The fiber isn't returned to the pool since nothing should be using it
+		// from here on.
+		sp_job_thread_state& thread_state = sp_job_get_thread_state();
+		sp_job_fiber* from = thread_state._current_fiber;
+		thread_state._current_fiber = nullptr;
+
+		sp_job_fiber_switch(from, &thread_state._thread_fiber);
+
+		assert(false && "exited fiber was resumed");
+	}
+
+	sp_job_fiber* sp_job_fiber_create()
+	{
+		sp_job_fiber* fiber = new sp_job_fiber;
+
+#if defined(_WIN32)
+		fiber->_fiber = CreateFiber(k_job_fiber_stack_size_bytes, sp_job_fiber_main, nullptr);
+		assert(fiber->_fiber);
+#else
+		fiber->_stack = std::make_unique<char[]>(k_job_fiber_stack_size_bytes);
+
+		getcontext(&fiber->_context);
+		fiber->_context.uc_stack.ss_sp = fiber->_stack.get();
+		fiber->_context.uc_stack.ss_size = k_job_fiber_stack_size_bytes;
+		fiber->_context.uc_link = nullptr;
+		makecontext(&fiber->_context, sp_job_fiber_main, 0);
+#endif
+
+		return fiber;
+	}
+
+	void sp_job_fiber_destroy(sp_job_fiber* fiber)
+	{
+#if defined(_WIN32)
+		DeleteFiber(fiber->_fiber);
+#endif
+		delete fiber;
+	}
+
+	void sp_job_worker_thread(int worker_index)
+	{
+		sp_job_thread_state& thread_state = sp_job_get_thread_state();
+		thread_state._worker_index = worker_index;
+
+#if defined(_WIN32)
+		thread_state._thread_fiber._fiber = ConvertThreadToFiber(nullptr);
+		assert(thread_state._thread_fiber._fiber);
+#endif
+
+		sp_job_fiber* fiber = sp_job_fiber_alloc();
+		assert(fiber && "need at least one fiber per worker");
+
+		thread_state._current_fiber = fiber;
+		sp_job_fiber_switch(&thread_state._thread_fiber, fiber);
+
+		// The worker loop has exited
+#if defined(_WIN32)
+		ConvertFiberToThread();
+#endif
+
+		thread_state._worker_index = -1;
+	}
+}
+
+void sp_job_system_init(int worker_thread_count)
+{
+	assert(detail::g_job_system._workers.empty());
+
+	if (worker_thread_count < 0)
+	{
+		worker_thread_count = std::max(0, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+	}
+
+	detail::g_job_system._quit = false;
+	detail::g_job_system._queued_job_count = 0;
+	detail::g_job_system._sleeping_worker_count = 0;
+
+	for (int worker_index = 0; worker_index < worker_thread_count + 1; ++worker_index)
+	{
+		detail::g_job_system._workers.push_back(std::make_unique<detail::sp_job_worker>());
+		detail::g_job_system._workers.back()->_random_state = 0x9e3779b9u * (worker_index + 1);
+	}
+
+	detail::sp_job_get_thread_state()._worker_index = 0;
+
+	// The main thread can't park since it has to stay on its own thread so fibers are only useful with worker threads
+	if (worker_thread_count > 0)
+	{
+		for (int i = 0; i < std::max(k_job_fiber_count, worker_thread_count + 1); ++i)
+		{
+			detail::g_job_system._fibers.emplace_back(detail::sp_job_fiber_create());
+			detail::g_job_system._free_fibers.push_back(detail::g_job_system._fibers.back().get());
+		}
+	}
+
+	// Workers only start once every deque exists since they steal from all of them
+	for (int worker_index = 1; worker_index < worker_thread_count + 1; ++worker_index)
+	{
+		detail::g_job_system._workers[worker_index]->_thread = std::thread(detail::sp_job_worker_thread, worker_index);
+	}
+}
+
+void sp_job_system_shutdown()
+{
+	assert(sp_job_is_main_thread());
+
+	// Anything still queued is dropped. Callers are expected to have waited on their counters.
+	{
+		std::lock_guard<std::mutex> lock(detail::g_job_system._sleep_mutex);
+		detail::g_job_system._quit = true;
+	}
+	detail::g_job_system._sleep_condition.notify_all();
+
+	for (auto& worker : detail::g_job_system._workers)
+	{
+		if (worker->_thread.joinable())
+		{
+			worker->_thread.join();
+		}
+	}
+
+	assert(detail::g_job_system._waiting_fibers.empty() && "jobs still waiting at shutdown");
+
+	for (auto& fiber : detail::g_job_system._fibers)
+	{
+		detail::sp_job_fiber_destroy(fiber.release());
+	}
+
+	detail::g_job_system._fibers.clear();
+	detail::g_job_system._free_fibers.clear();
+	detail::g_job_system._workers.clear();
+	detail::g_job_system._main_thread_jobs.clear();
+
+	detail::sp_job_get_thread_state()._worker_index = -1;
+}
+
+int sp_job_system_get_worker_count()
+{
+	return static_cast<int>(detail::g_job_system._workers.size());
+}
+
+int sp_job_get_worker_index()
+{
+	return detail::sp_job_get_thread_state()._worker_index;
+}
+
+bool sp_job_is_main_thread()
+{
+	return detail::sp_job_get_thread_state()._worker_index == 0;
+}
+
+bool sp_job_can_park()
+{
+	return detail::sp_job_get_thread_state()._current_fiber != nullptr;
+}
+
+void sp_job_run(sp_job_function function, sp_job_counter* counter)
+{
+	detail::sp_job* job = detail::sp_job_alloc(std::move(function), counter);
+
+	detail::sp_job_deque_push(detail::sp_job_get_worker()._deque, job);
+
+	// Pairs with the sleeping worker count increment in sp_job_worker_loop. Either we see the sleeper or it sees the job.
+	detail::g_job_system._queued_job_count.fetch_add(1, std::memory_order_seq_cst);
+	if (detail::g_job_system._sleeping_worker_count.load(std::memory_order_seq_cst) > 0)
+	{
+		std::lock_guard<std::mutex> lock(detail::g_job_system._sleep_mutex);
+		detail::g_job_system._sleep_condition.notify_one();
+	}
+}
+
+void sp_job_run_on_main_thread(sp_job_function function, sp_job_counter* counter)
+{
+	detail::sp_job* job = detail::sp_job_alloc(std::move(function), counter);
+
+	std::lock_guard<std::mutex> lock(detail::g_job_system._main_thread_jobs_mutex);
+	detail::g_job_system._main_thread_jobs.push_back(job);
+}
+
+void sp_job_pump_main_thread()
+{
+	assert(sp_job_is_main_thread());
+
+	std::vector<detail::sp_job*> jobs;
+	{
+		std::lock_guard<std::mutex> lock(detail::g_job_system._main_thread_jobs_mutex);
+		jobs.swap(detail::g_job_system._main_thread_jobs);
+	}
+
+	for (detail::sp_job* job : jobs)
+	{
+		detail::sp_job_execute(job);
+	}
+}
+
+void sp_job_wait(sp_job_counter& counter)
+{
+	sp_job_wait_until([&counter]() { return sp_job_counter_is_done(counter); });
+}
+
+void sp_job_wait_until(std::function<bool()> predicate)
+{
+	if (predicate())
+	{
+		return;
+	}
+
+	// Park this fiber and carry on with a fresh one. The worker loop on that fiber resumes this one once the predicate passes.
+	if (detail::sp_job_get_thread_state()._current_fiber)
+	{
+		if (detail::sp_job_fiber* fiber = detail::sp_job_fiber_alloc())
+		{
+			detail::sp_job_fiber_switch_from_current(fiber, detail::sp_job_fiber_switch_action::park, std::move(predicate));
+
+			return;
+		}
+	}
+
+	// On the main thread or out of fibers so help out until it's done
+	while (!predicate())
+	{
+		if (sp_job_is_main_thread())
+		{
+			sp_job_pump_main_thread();
+		}
+
+		if (!detail::sp_job_run_one())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+bool sp_job_counter_is_done(const sp_job_counter& counter)
+{
+	return counter._value.load(std::memory_order_acquire) == 0;
+}
+
+void sp_job_parallel_for(int count, int batch_size, const std::function<void(int begin, int end)>& function)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	if (batch_size <= 0)
+	{
+		batch_size = std::max(1, count / (sp_job_system_get_worker_count() * 4));
+	}
+
+	sp_job_counter counter;
+
+	// The last batch runs on this thread instead of sitting idle in sp_job_wait
+	int begin = 0;
+	for (; begin + batch_size < count; begin += batch_size)
+	{
+		sp_job_run([&function, begin, batch_size]() { function(begin, begin + batch_size); }, &counter);
+	}
+
+	function(begin, count);
+
+	sp_job_wait(counter);
+}
\ No newline at end of file
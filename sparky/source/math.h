@@ -5,6 +5,8 @@
 #include <cstdint>
 #include <initializer_list>
 
+#include <immintrin.h>
+
 namespace math
 {
 	constexpr float pi = 3.1415927f;
@@ -838,6 +840,262 @@ namespace math
 		return ret.xyz;
 	}
 
+	// Left, right, bottom, top, near and far, each a normal and a distance with the inside where dot(normal, position) + distance
+	// >= 0, in whatever space the matrix transforms from. Assumes Direct3D style clip space where Z ranges from 0 to 1.
+	inline void get_frustum_planes(const mat<4>& view_projection, float (&planes)[6][4])
+	{
+		// The W column plus or minus the X, Y or Z column, except near which is just the Z column since Z starts at 0
+		const int columns[6] = { 0, 0, 1, 1, 2, 2 };
+		const float signs[6] = { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f };
+
+		for (int i = 0; i < 6; ++i)
+		{
+			const float w = i == 4 ? 0.0f : 1.0f;
+			for (int row = 0; row < 4; ++row)
+			{
+				planes[i][row] = view_projection[row][3] * w + view_projection[row][columns[i]] * signs[i];
+			}
+
+			const float length = std::sqrt(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+			for (int k = 0; k < 4; ++k)
+			{
+				planes[i][k] /= length;
+			}
+		}
+	}
+
+	// Boxes as centers and half extents and spheres as centers and radii, a component to an array so four or eight objects load
+	// into a register at once
+	struct aabb_soa
+	{
+		const float* center[3];
+		const float* extent[3];
+	};
+
+	struct sphere_soa
+	{
+		const float* center[3];
+		const float* radius;
+	};
+
+	// Frustum culling without a hierarchy, for flat lists of objects. Each writes the indices of the objects at least partly
+	// inside the planes to visible, which needs room for every object, and returns how many there are. The planes are in the
+	// layout get_frustum_planes returns. The _reference versions test one object at a time and the others test eight at a time
+	// with AVX when the compiler targets it and four at a time with SSE otherwise, with the same arithmetic in the same order so
+	// they find exactly the same objects.
+
+	inline bool frustum_outside_aabb(const float (&planes)[6][4], float center_x, float center_y, float center_z, float extent_x, float extent_y, float extent_z)
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			const float distance = planes[i][0] * center_x + planes[i][1] * center_y + planes[i][2] * center_z + planes[i][3];
+			const float reach = std::abs(planes[i][0]) * extent_x + std::abs(planes[i][1]) * extent_y + std::abs(planes[i][2]) * extent_z;
+			if (distance + reach < 0.0f)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	inline bool frustum_outside_sphere(const float (&planes)[6][4], float center_x, float center_y, float center_z, float radius)
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			const float distance = planes[i][0] * center_x + planes[i][1] * center_y + planes[i][2] * center_z + planes[i][3];
+			if (distance + radius < 0.0f)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	inline int frustum_cull_aabbs_reference(const float (&planes)[6][4], const aabb_soa& aabbs, int count, uint32_t* visible)
+	{
+		int visible_count = 0;
+
+		for (int i = 0; i < count; ++i)
+		{
+			if (!frustum_outside_aabb(planes, aabbs.center[0][i], aabbs.center[1][i], aabbs.center[2][i], aabbs.extent[0][i], aabbs.extent[1][i], aabbs.extent[2][i]))
+			{
+				visible[visible_count++] = i;
+			}
+		}
+
+		return visible_count;
+	}
+
+	inline int frustum_cull_spheres_reference(const float (&planes)[6][4], const sphere_soa& spheres, int count, uint32_t* visible)
+	{
+		int visible_count = 0;
+
+		for (int i = 0; i < count; ++i)
+		{
+			if (!frustum_outside_sphere(planes, spheres.center[0][i], spheres.center[1][i], spheres.center[2][i], spheres.radius[i]))
+			{
+				visible[visible_count++] = i;
+			}
+		}
+
+		return visible_count;
+	}
+
+	// Every lane's index is written and only the visible ones are kept, so there's no branch per object
+	inline int frustum_compact(int first, int lane_count, int outside_mask, uint32_t* visible, int visible_count)
+	{
+		for (int lane = 0; lane < lane_count; ++lane)
+		{
+			visible[visible_count] = first + lane;
+			visible_count += ~outside_mask >> lane & 1;
+		}
+
+		return visible_count;
+	}
+
+	inline int frustum_cull_aabbs(const float (&planes)[6][4], const aabb_soa& aabbs, int count, uint32_t* visible)
+	{
+		int visible_count = 0;
+		int i = 0;
+
+		float abs_planes[6][3];
+		for (int j = 0; j < 6; ++j)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				abs_planes[j][k] = std::abs(planes[j][k]);
+			}
+		}
+
+#if defined(__AVX__)
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256 center_x = _mm256_loadu_ps(aabbs.center[0] + i);
+			const __m256 center_y = _mm256_loadu_ps(aabbs.center[1] + i);
+			const __m256 center_z = _mm256_loadu_ps(aabbs.center[2] + i);
+			const __m256 extent_x = _mm256_loadu_ps(aabbs.extent[0] + i);
+			const __m256 extent_y = _mm256_loadu_ps(aabbs.extent[1] + i);
+			const __m256 extent_z = _mm256_loadu_ps(aabbs.extent[2] + i);
+
+			__m256 outside = _mm256_setzero_ps();
+			for (int j = 0; j < 6; ++j)
+			{
+				const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(_mm256_set1_ps(planes[j][0]), center_x),
+					_mm256_mul_ps(_mm256_set1_ps(planes[j][1]), center_y)),
+					_mm256_mul_ps(_mm256_set1_ps(planes[j][2]), center_z)),
+					_mm256_set1_ps(planes[j][3]));
+				const __m256 reach = _mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(_mm256_set1_ps(abs_planes[j][0]), extent_x),
+					_mm256_mul_ps(_mm256_set1_ps(abs_planes[j][1]), extent_y)),
+					_mm256_mul_ps(_mm256_set1_ps(abs_planes[j][2]), extent_z));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_LT_OQ));
+			}
+
+			visible_count = frustum_compact(i, 8, _mm256_movemask_ps(outside), visible, visible_count);
+		}
+#endif
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 center_x = _mm_loadu_ps(aabbs.center[0] + i);
+			const __m128 center_y = _mm_loadu_ps(aabbs.center[1] + i);
+			const __m128 center_z = _mm_loadu_ps(aabbs.center[2] + i);
+			const __m128 extent_x = _mm_loadu_ps(aabbs.extent[0] + i);
+			const __m128 extent_y = _mm_loadu_ps(aabbs.extent[1] + i);
+			const __m128 extent_z = _mm_loadu_ps(aabbs.extent[2] + i);
+
+			__m128 outside = _mm_setzero_ps();
+			for (int j = 0; j < 6; ++j)
+			{
+				const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_set1_ps(planes[j][0]), center_x),
+					_mm_mul_ps(_mm_set1_ps(planes[j][1]), center_y)),
+					_mm_mul_ps(_mm_set1_ps(planes[j][2]), center_z)),
+					_mm_set1_ps(planes[j][3]));
+				const __m128 reach = _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_set1_ps(abs_planes[j][0]), extent_x),
+					_mm_mul_ps(_mm_set1_ps(abs_planes[j][1]), extent_y)),
+					_mm_mul_ps(_mm_set1_ps(abs_planes[j][2]), extent_z));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+			}
+
+			visible_count = frustum_compact(i, 4, _mm_movemask_ps(outside), visible, visible_count);
+		}
+
+		for (; i < count; ++i)
+		{
+			if (!frustum_outside_aabb(planes, aabbs.center[0][i], aabbs.center[1][i], aabbs.center[2][i], aabbs.extent[0][i], aabbs.extent[1][i], aabbs.extent[2][i]))
+			{
+				visible[visible_count++] = i;
+			}
+		}
+
+		return visible_count;
+	}
+
+	inline int frustum_cull_spheres(const float (&planes)[6][4], const sphere_soa& spheres, int count, uint32_t* visible)
+	{
+		int visible_count = 0;
+		int i = 0;
+
+#if defined(__AVX__)
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256 center_x = _mm256_loadu_ps(spheres.center[0] + i);
+			const __m256 center_y = _mm256_loadu_ps(spheres.center[1] + i);
+			const __m256 center_z = _mm256_loadu_ps(spheres.center[2] + i);
+			const __m256 radius = _mm256_loadu_ps(spheres.radius + i);
+
+			__m256 outside = _mm256_setzero_ps();
+			for (int j = 0; j < 6; ++j)
+			{
+				const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(_mm256_set1_ps(planes[j][0]), center_x),
+					_mm256_mul_ps(_mm256_set1_ps(planes[j][1]), center_y)),
+					_mm256_mul_ps(_mm256_set1_ps(planes[j][2]), center_z)),
+					_mm256_set1_ps(planes[j][3]));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+			}
+
+			visible_count = frustum_compact(i, 8, _mm256_movemask_ps(outside), visible, visible_count);
+		}
+#endif
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 center_x = _mm_loadu_ps(spheres.center[0] + i);
+			const __m128 center_y = _mm_loadu_ps(spheres.center[1] + i);
+			const __m128 center_z = _mm_loadu_ps(spheres.center[2] + i);
+			const __m128 radius = _mm_loadu_ps(spheres.radius + i);
+
+			__m128 outside = _mm_setzero_ps();
+			for (int j = 0; j < 6; ++j)
+			{
+				const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_set1_ps(planes[j][0]), center_x),
+					_mm_mul_ps(_mm_set1_ps(planes[j][1]), center_y)),
+					_mm_mul_ps(_mm_set1_ps(planes[j][2]), center_z)),
+					_mm_set1_ps(planes[j][3]));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+			}
+
+			visible_count = frustum_compact(i, 4, _mm_movemask_ps(outside), visible, visible_count);
+		}
+
+		for (; i < count; ++i)
+		{
+			if (!frustum_outside_sphere(planes, spheres.center[0][i], spheres.center[1][i], spheres.center[2][i], spheres.radius[i]))
+			{
+				visible[visible_count++] = i;
+			}
+		}
+
+		return visible_count;
+	}
+
 	template <typename T>
 	T square(const T& a)
 	{
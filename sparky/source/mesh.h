@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Models on the CPU, between importing them from a source format and uploading them. There's one vertex stream and one index
+// stream for the whole model and each submesh is a range of both, so a model goes up in one vertex and one index buffer and
+// every submesh is drawn with its own first index and base vertex. Apart from the vertices, which are quantized on the way,
+// the records here are also the records of the cooked file format, see mesh_file.h, so they're plain data with fixed sizes.
+
+// Full precision for importing and optimizing, see mesh_quantize.h for what's uploaded
+struct sp_mesh_vertex
+{
+	float _position[3];
+	float _normal[3];
+	float _texcoord[2];
+	float _color[4];
+};
+
+struct sp_mesh_submesh
+{
+	uint32_t _first_index = 0;
+	uint32_t _index_count = 0;
+	uint32_t _base_vertex = 0;		// Added to every index of the submesh
+	uint32_t _vertex_count = 0;
+	int32_t _material_index = -1;
+	uint32_t _first_meshlet = 0;		// Both 0 until meshlets are built, see mesh_meshlet.h
+	uint32_t _meshlet_count = 0;
+	uint32_t _first_lod = 0;			// Simplified versions of the submesh, coarsest last, see mesh_lod.h
+	uint32_t _lod_count = 0;
+	float _bounds_min[3] = {};		// Around every vertex of the submesh, in object space
+	float _bounds_max[3] = {};
+};
+
+// Another range of the index stream over the same vertices as its submesh, see mesh_lod.h
+struct sp_mesh_lod
+{
+	uint32_t _first_index = 0;
+	uint32_t _index_count = 0;
+	uint32_t _first_meshlet = 0;
+	uint32_t _meshlet_count = 0;
+	float _error = 0.0f;		// How far it's off the full detail surface, in object space
+};
+
+// A cluster of up to 64 vertices and 126 triangles of one submesh or LOD, see mesh_meshlet.h
+struct sp_mesh_meshlet
+{
+	uint32_t _first_index = 0;			// Its triangles are contiguous in the index stream, and in the meshlet triangle table from _first_index / 3
+	uint32_t _triangle_count = 0;
+	uint32_t _first_vertex = 0;			// Into the meshlet vertex table
+	uint32_t _vertex_count = 0;
+	float _center[3] = {};				// Bounding sphere, in object space
+	float _radius = 0.0f;
+	float _cone_axis[3] = {};			// Normal cone around every triangle's normal
+	float _cone_cutoff = 1.0f;			// Sine of its half angle, 1 if it's too wide to ever cull
+};
+
+struct sp_mesh_material
+{
+	char _name[128] = {};
+	int32_t _base_color_texture_index = -1;				// Into the texture table, -1 if there isn't one
+	int32_t _metalness_roughness_texture_index = -1;
+	float _base_color_factor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	float _metalness_factor = 1.0f;
+	float _roughness_factor = 1.0f;
+	uint32_t _double_sided = 0;
+};
+
+struct sp_mesh_texture
+{
+	char _path[256] = {};		// Relative to the model
+	uint32_t _srgb = 0;			// Base color textures are sRGB, everything else is filtered as it is
+};
+
+struct sp_mesh
+{
+	std::vector<sp_mesh_vertex> _vertices;
+	std::vector<uint32_t> _indices;		// Relative to the base vertex of their submesh
+	std::vector<sp_mesh_submesh> _submeshes;
+	std::vector<sp_mesh_lod> _lods;
+	std::vector<sp_mesh_meshlet> _meshlets;
+	std::vector<uint32_t> _meshlet_vertices;		// Relative to the base vertex of their submesh
+	std::vector<uint32_t> _meshlet_triangles;		// One per triangle of the index stream, three 8 bit indices into its meshlet's vertices
+	std::vector<sp_mesh_material> _materials;
+	std::vector<sp_mesh_texture> _textures;
+};
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "mesh.h"
+#include "mesh_quantize.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Cooked models. The file is the header followed by the vertex, index, submesh, LOD, meshlet, meshlet vertex, meshlet
+// triangle, material and texture tables, each one an array of the records from mesh.h starting on a cache line, except the
+// vertices which are the quantized stream from mesh_quantize.h described by the vertex format in the header. Opening one is a
+// memory map and a few bounds checks, and the tables are used straight out of the mapping, so the vertex and index streams
+// can be copied into upload staging as they are.
+
+const uint32_t k_mesh_file_magic = 0x534D5053;		// "SPMS"
+
+// Bump whenever a record or the cooking changes so stale files get cooked again
+const uint32_t k_mesh_file_version = 6;
+
+// Every table starts on a multiple of this
+const size_t k_mesh_file_alignment_bytes = 64;
+
+struct sp_mesh_file_header
+{
+	uint32_t magic = k_mesh_file_magic;
+	uint32_t version = k_mesh_file_version;
+	uint32_t vertex_size_bytes = 0;
+	uint32_t index_size_bytes = sizeof(uint32_t);
+	uint32_t vertex_count = 0;
+	uint32_t index_count = 0;
+	uint32_t submesh_count = 0;
+	uint32_t material_count = 0;
+	uint32_t texture_count = 0;
+	uint32_t reserved = 0;
+	uint64_t vertices_offset_bytes = 0;
+	uint64_t indices_offset_bytes = 0;
+	uint64_t submeshes_offset_bytes = 0;
+	uint64_t materials_offset_bytes = 0;
+	uint64_t textures_offset_bytes = 0;
+	sp_mesh_vertex_format vertex_format;
+	uint32_t meshlet_count = 0;
+	uint32_t meshlet_vertex_count = 0;
+	uint32_t meshlet_triangle_count = 0;		// Either 0 or one per triangle
+	uint64_t meshlets_offset_bytes = 0;
+	uint64_t meshlet_vertices_offset_bytes = 0;
+	uint64_t meshlet_triangles_offset_bytes = 0;
+	uint32_t lod_count = 0;
+	uint32_t reserved_2 = 0;
+	uint64_t lods_offset_bytes = 0;
+};
+
+static_assert(sizeof(sp_mesh_vertex_format) == 60, "Mesh vertex format has to match the file layout");
+static_assert(sizeof(sp_mesh_file_header) == 192, "Mesh file header has to match the file layout");
+
+struct sp_mesh_file
+{
+	int _vertex_count = 0;
+	int _index_count = 0;
+	int _submesh_count = 0;
+	int _material_count = 0;
+	int _texture_count = 0;
+	int _lod_count = 0;
+	int _meshlet_count = 0;
+	int _meshlet_vertex_count = 0;
+	int _meshlet_triangle_count = 0;
+
+	sp_mesh_vertex_format _vertex_format;
+
+	// Straight into the mapping
+	const uint8_t* _vertices = nullptr;		// _vertex_format._stride_bytes apart
+	const uint32_t* _indices = nullptr;
+	const sp_mesh_submesh* _submeshes = nullptr;
+	const sp_mesh_lod* _lods = nullptr;
+	const sp_mesh_meshlet* _meshlets = nullptr;
+	const uint32_t* _meshlet_vertices = nullptr;
+	const uint32_t* _meshlet_triangles = nullptr;
+	const sp_mesh_material* _materials = nullptr;
+	const sp_mesh_texture* _textures = nullptr;
+
+	const uint8_t* _data = nullptr;
+	size_t _size_bytes = 0;
+};
+
+// Everything but the vertices comes from mesh, which has to be what vertices were quantized from. Returns false if the file
+// couldn't be written.
+bool sp_mesh_file_write(const char* path, const sp_mesh& mesh, const sp_mesh_quantized_vertices& vertices);
+
+// Maps the file and checks the header against it. Returns false if the file doesn't exist, was cooked by another version, has
+// a vertex format we can't decode or has a table, submesh, LOD or meshlet that reaches past where it should.
+bool sp_mesh_file_open(const char* path, sp_mesh_file& mesh_file);
+void sp_mesh_file_close(sp_mesh_file& mesh_file);
\ No newline at end of file
@@ -0,0 +1,272 @@
+#pragma once
+
+#include "mesh_file.h"
+#include "mesh_meshlet.h"
+#include "file_map.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+namespace detail
+{
+	uint64_t sp_mesh_file_align(uint64_t offset_bytes)
+	{
+		return (offset_bytes + k_mesh_file_alignment_bytes - 1) & ~static_cast<uint64_t>(k_mesh_file_alignment_bytes - 1);
+	}
+
+	// Checks a table lies inside the file before anything points into it
+	bool sp_mesh_file_table_fits(const sp_mesh_file& mesh_file, uint64_t offset_bytes, uint64_t count, size_t record_size_bytes)
+	{
+		return
+			offset_bytes % k_mesh_file_alignment_bytes == 0 &&
+			offset_bytes <= mesh_file._size_bytes &&
+			count <= (mesh_file._size_bytes - offset_bytes) / record_size_bytes;
+	}
+
+	bool sp_mesh_file_write_table(FILE* file, uint64_t& offset_bytes, uint64_t table_offset_bytes, const void* data, size_t size_bytes)
+	{
+		static const uint8_t padding[k_mesh_file_alignment_bytes] = {};
+
+		const size_t padding_bytes = static_cast<size_t>(table_offset_bytes - offset_bytes);
+		offset_bytes = table_offset_bytes + size_bytes;
+
+		return
+			fwrite(padding, 1, padding_bytes, file) == padding_bytes &&
+			fwrite(data, 1, size_bytes, file) == size_bytes;
+	}
+
+	// There are far fewer meshlets than indices so every one of them is checked, against the index range they belong to
+	bool sp_mesh_file_meshlets_valid(const sp_mesh_file& mesh_file, uint32_t first_meshlet, uint32_t meshlet_count, uint32_t first_index, uint32_t index_count)
+	{
+		if (first_meshlet > static_cast<uint32_t>(mesh_file._meshlet_count) || meshlet_count > mesh_file._meshlet_count - first_meshlet)
+		{
+			return false;
+		}
+
+		for (uint32_t i = 0; i < meshlet_count; ++i)
+		{
+			const sp_mesh_meshlet& meshlet = mesh_file._meshlets[first_meshlet + i];
+
+			const bool valid =
+				mesh_file._meshlet_triangle_count > 0 &&
+				meshlet._first_index % 3 == 0 &&
+				meshlet._first_index >= first_index &&
+				meshlet._first_index <= first_index + index_count &&
+				meshlet._triangle_count <= k_mesh_meshlet_triangle_count_max &&
+				meshlet._triangle_count * 3 <= first_index + index_count - meshlet._first_index &&
+				meshlet._vertex_count <= k_mesh_meshlet_vertex_count_max &&
+				meshlet._first_vertex <= static_cast<uint32_t>(mesh_file._meshlet_vertex_count) &&
+				meshlet._vertex_count <= mesh_file._meshlet_vertex_count - meshlet._first_vertex;
+
+			if (!valid)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool sp_mesh_file_vertex_format_valid(const sp_mesh_vertex_format& format)
+	{
+		const bool formats_valid =
+			format._position == sp_mesh_attribute_format::unorm16x4 &&
+			(format._texcoord == sp_mesh_attribute_format::float16x2 || format._texcoord == sp_mesh_attribute_format::float32x2) &&
+			(format._color == sp_mesh_attribute_format::none || format._color == sp_mesh_attribute_format::unorm8x4) &&
+			(format._normal == sp_mesh_attribute_format::snorm16x2 || format._normal == sp_mesh_attribute_format::snorm8x2);
+
+		return
+			formats_valid &&
+			format._stride_bytes % 4 == 0 &&
+			format._stride_bytes >=
+				sp_mesh_attribute_format_get_size_bytes(format._position) +
+				sp_mesh_attribute_format_get_size_bytes(format._texcoord) +
+				sp_mesh_attribute_format_get_size_bytes(format._color) +
+				sp_mesh_attribute_format_get_size_bytes(format._normal);
+	}
+}
+
+bool sp_mesh_file_write(const char* path, const sp_mesh& mesh, const sp_mesh_quantized_vertices& vertices)
+{
+	assert(vertices._data.size() == mesh._vertices.size() * vertices._format._stride_bytes);
+
+	sp_mesh_file_header header;
+	header.vertex_size_bytes = vertices._format._stride_bytes;
+	header.vertex_format = vertices._format;
+	header.vertex_count = static_cast<uint32_t>(mesh._vertices.size());
+	header.index_count = static_cast<uint32_t>(mesh._indices.size());
+	header.submesh_count = static_cast<uint32_t>(mesh._submeshes.size());
+	header.material_count = static_cast<uint32_t>(mesh._materials.size());
+	header.texture_count = static_cast<uint32_t>(mesh._textures.size());
+	header.lod_count = static_cast<uint32_t>(mesh._lods.size());
+	header.meshlet_count = static_cast<uint32_t>(mesh._meshlets.size());
+	header.meshlet_vertex_count = static_cast<uint32_t>(mesh._meshlet_vertices.size());
+	header.meshlet_triangle_count = static_cast<uint32_t>(mesh._meshlet_triangles.size());
+	header.vertices_offset_bytes = detail::sp_mesh_file_align(sizeof(header));
+	header.indices_offset_bytes = detail::sp_mesh_file_align(header.vertices_offset_bytes + vertices._data.size());
+	header.submeshes_offset_bytes = detail::sp_mesh_file_align(header.indices_offset_bytes + mesh._indices.size() * sizeof(uint32_t));
+	header.lods_offset_bytes = detail::sp_mesh_file_align(header.submeshes_offset_bytes + mesh._submeshes.size() * sizeof(sp_mesh_submesh));
+	header.meshlets_offset_bytes = detail::sp_mesh_file_align(header.lods_offset_bytes + mesh._lods.size() * sizeof(sp_mesh_lod));
+	header.meshlet_vertices_offset_bytes = detail::sp_mesh_file_align(header.meshlets_offset_bytes + mesh._meshlets.size() * sizeof(sp_mesh_meshlet));
+	header.meshlet_triangles_offset_bytes = detail::sp_mesh_file_align(header.meshlet_vertices_offset_bytes + mesh._meshlet_vertices.size() * sizeof(uint32_t));
+	header.materials_offset_bytes = detail::sp_mesh_file_align(header.meshlet_triangles_offset_bytes + mesh._meshlet_triangles.size() * sizeof(uint32_t));
+	header.textures_offset_bytes = detail::sp_mesh_file_align(header.materials_offset_bytes + mesh._materials.size() * sizeof(sp_mesh_material));
+
+	FILE* file = nullptr;
+#if defined(_WIN32)
+	if (fopen_s(&file, path, "wb") != 0)
+#else
+	if (!(file = fopen(path, "wb")))
+#endif
+	{
+		return false;
+	}
+
+	uint64_t offset_bytes = sizeof(header);
+
+	bool written =
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		detail::sp_mesh_file_write_table(file, offset_bytes, header.vertices_offset_bytes, vertices._data.data(), vertices._data.size()) &&
+		detail::sp_mesh_file_write_table(file, offset_bytes, header.indices_offset_bytes, mesh._indices.data(), mesh._indices.size() * sizeof(uint32_t)) &&
+		detail::sp_mesh_file_write_table(file, offset_bytes, header.submeshes_offset_bytes, mesh._submeshes.data(), mesh._submeshes.size() * sizeof(sp_mesh_submesh)) &&
+		detail::sp_mesh_file_write_table(file, offset_bytes, header.lods_offset_bytes, mesh._lods.data(), mesh._lods.size() * sizeof(sp_mesh_lod)) &&
+		detail::sp_mesh_file_write_table(file, offset_bytes, header.meshlets_offset_bytes, mesh._meshlets.data(), mesh._meshlets.size() * sizeof(sp_mesh_meshlet)) &&
+		detail::sp_mesh_file_write_table(file, offset_bytes, header.meshlet_vertices_offset_bytes, mesh._meshlet_vertices.data(), mesh._meshlet_vertices.size() * sizeof(uint32_t)) &&
+		detail::sp_mesh_file_write_table(file, offset_bytes, header.meshlet_triangles_offset_bytes, mesh._meshlet_triangles.data(), mesh._meshlet_triangles.size() * sizeof(uint32_t)) &&
+		detail::sp_mesh_file_write_table(file, offset_bytes, header.materials_offset_bytes, mesh._materials.data(), mesh._materials.size() * sizeof(sp_mesh_material)) &&
+		detail::sp_mesh_file_write_table(file, offset_bytes, header.textures_offset_bytes, mesh._textures.data(), mesh._textures.size() * sizeof(sp_mesh_texture));
+
+	written = fclose(file) == 0 && written;
+
+	return written;
+}
+
+bool sp_mesh_file_open(const char* path, sp_mesh_file& mesh_file)
+{
+	mesh_file = sp_mesh_file();
+
+	if (!sp_file_map(path, mesh_file._data, mesh_file._size_bytes))
+	{
+		return false;
+	}
+
+	sp_mesh_file_header header;
+	if (mesh_file._size_bytes >= sizeof(header))
+	{
+		memcpy(&header, mesh_file._data, sizeof(header));
+	}
+
+	bool read =
+		mesh_file._size_bytes >= sizeof(header) &&
+		header.magic == k_mesh_file_magic &&
+		header.version == k_mesh_file_version &&
+		detail::sp_mesh_file_vertex_format_valid(header.vertex_format) &&
+		header.vertex_size_bytes == header.vertex_format._stride_bytes &&
+		header.index_size_bytes == sizeof(uint32_t) &&
+		header.vertex_count <= INT32_MAX &&
+		header.index_count <= INT32_MAX &&
+		header.lod_count <= INT32_MAX &&
+		header.meshlet_count <= INT32_MAX &&
+		header.meshlet_vertex_count <= INT32_MAX &&
+		(header.meshlet_triangle_count == 0 || header.meshlet_triangle_count == header.index_count / 3) &&
+		detail::sp_mesh_file_table_fits(mesh_file, header.vertices_offset_bytes, header.vertex_count, header.vertex_size_bytes) &&
+		detail::sp_mesh_file_table_fits(mesh_file, header.indices_offset_bytes, header.index_count, sizeof(uint32_t)) &&
+		detail::sp_mesh_file_table_fits(mesh_file, header.submeshes_offset_bytes, header.submesh_count, sizeof(sp_mesh_submesh)) &&
+		detail::sp_mesh_file_table_fits(mesh_file, header.lods_offset_bytes, header.lod_count, sizeof(sp_mesh_lod)) &&
+		detail::sp_mesh_file_table_fits(mesh_file, header.meshlets_offset_bytes, header.meshlet_count, sizeof(sp_mesh_meshlet)) &&
+		detail::sp_mesh_file_table_fits(mesh_file, header.meshlet_vertices_offset_bytes, header.meshlet_vertex_count, sizeof(uint32_t)) &&
+		detail::sp_mesh_file_table_fits(mesh_file, header.meshlet_triangles_offset_bytes, header.meshlet_triangle_count, sizeof(uint32_t)) &&
+		detail::sp_mesh_file_table_fits(mesh_file, header.materials_offset_bytes, header.material_count, sizeof(sp_mesh_material)) &&
+		detail::sp_mesh_file_table_fits(mesh_file, header.textures_offset_bytes, header.texture_count, sizeof(sp_mesh_texture));
+
+	if (read)
+	{
+		mesh_file._vertex_count = static_cast<int>(header.vertex_count);
+		mesh_file._index_count = static_cast<int>(header.index_count);
+		mesh_file._submesh_count = static_cast<int>(header.submesh_count);
+		mesh_file._material_count = static_cast<int>(header.material_count);
+		mesh_file._texture_count = static_cast<int>(header.texture_count);
+		mesh_file._lod_count = static_cast<int>(header.lod_count);
+		mesh_file._meshlet_count = static_cast<int>(header.meshlet_count);
+		mesh_file._meshlet_vertex_count = static_cast<int>(header.meshlet_vertex_count);
+		mesh_file._meshlet_triangle_count = static_cast<int>(header.meshlet_triangle_count);
+		mesh_file._vertex_format = header.vertex_format;
+
+		mesh_file._vertices = mesh_file._data + header.vertices_offset_bytes;
+		mesh_file._indices = reinterpret_cast<const uint32_t*>(mesh_file._data + header.indices_offset_bytes);
+		mesh_file._submeshes = reinterpret_cast<const sp_mesh_submesh*>(mesh_file._data + header.submeshes_offset_bytes);
+		mesh_file._lods = reinterpret_cast<const sp_mesh_lod*>(mesh_file._data + header.lods_offset_bytes);
+		mesh_file._meshlets = reinterpret_cast<const sp_mesh_meshlet*>(mesh_file._data + header.meshlets_offset_bytes);
+		mesh_file._meshlet_vertices = reinterpret_cast<const uint32_t*>(mesh_file._data + header.meshlet_vertices_offset_bytes);
+		mesh_file._meshlet_triangles = reinterpret_cast<const uint32_t*>(mesh_file._data + header.meshlet_triangles_offset_bytes);
+		mesh_file._materials = reinterpret_cast<const sp_mesh_material*>(mesh_file._data + header.materials_offset_bytes);
+		mesh_file._textures = reinterpret_cast<const sp_mesh_texture*>(mesh_file._data + header.textures_offset_bytes);
+	}
+
+	// Only the ranges are checked, not the indices themselves, which would mean touching every page of the index stream
+	for (int i = 0; read && i < mesh_file._submesh_count; ++i)
+	{
+		const sp_mesh_submesh& submesh = mesh_file._submeshes[i];
+
+		read =
+			submesh._first_index <= header.index_count &&
+			submesh._index_count <= header.index_count - submesh._first_index &&
+			submesh._base_vertex <= header.vertex_count &&
+			submesh._vertex_count <= header.vertex_count - submesh._base_vertex &&
+			submesh._material_index >= -1 &&
+			submesh._material_index < mesh_file._material_count &&
+			detail::sp_mesh_file_meshlets_valid(mesh_file, submesh._first_meshlet, submesh._meshlet_count, submesh._first_index, submesh._index_count) &&
+			submesh._first_lod <= header.lod_count &&
+			submesh._lod_count <= header.lod_count - submesh._first_lod &&
+			submesh._bounds_min[0] <= submesh._bounds_max[0] &&
+			submesh._bounds_min[1] <= submesh._bounds_max[1] &&
+			submesh._bounds_min[2] <= submesh._bounds_max[2];
+
+		for (uint32_t j = 0; read && j < submesh._lod_count; ++j)
+		{
+			const sp_mesh_lod& lod = mesh_file._lods[submesh._first_lod + j];
+
+			read =
+				lod._first_index % 3 == 0 &&
+				lod._first_index <= header.index_count &&
+				lod._index_count <= header.index_count - lod._first_index &&
+				lod._error >= 0.0f &&
+				detail::sp_mesh_file_meshlets_valid(mesh_file, lod._first_meshlet, lod._meshlet_count, lod._first_index, lod._index_count);
+		}
+	}
+
+	for (int i = 0; read && i < mesh_file._material_count; ++i)
+	{
+		const sp_mesh_material& material = mesh_file._materials[i];
+
+		read =
+			material._base_color_texture_index >= -1 &&
+			material._base_color_texture_index < mesh_file._texture_count &&
+			material._metalness_roughness_texture_index >= -1 &&
+			material._metalness_roughness_texture_index < mesh_file._texture_count &&
+			memchr(material._name, '\0', sizeof(material._name)) != nullptr;
+	}
+
+	for (int i = 0; read && i < mesh_file._texture_count; ++i)
+	{
+		read = memchr(mesh_file._textures[i]._path, '\0', sizeof(mesh_file._textures[i]._path)) != nullptr;
+	}
+
+	if (!read)
+	{
+		sp_mesh_file_close(mesh_file);
+	}
+
+	return read;
+}
+
+void sp_mesh_file_close(sp_mesh_file& mesh_file)
+{
+	if (mesh_file._data)
+	{
+		sp_file_unmap(mesh_file._data, mesh_file._size_bytes);
+	}
+
+	mesh_file = sp_mesh_file();
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "mesh.h"
+
+// Imports glTF 2.0 models. Every triangle primitive of every mesh becomes a submesh with its vertices and indices as they are
+// in the file, and node transforms are ignored. Primitives without positions, normals or texcoords are skipped.
+
+sp_mesh sp_mesh_create_from_gltf(const char* path);
\ No newline at end of file
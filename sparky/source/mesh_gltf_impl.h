@@ -0,0 +1,195 @@
+#pragma once
+
+#include "mesh_gltf.h"
+
+#include <fx/gltf.h>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+
+namespace detail
+{
+	// Float attributes only, which is all glTF allows for the ones we read
+	template <size_t N>
+	void sp_mesh_gltf_read_attribute(const fx::gltf::Document& document, uint32_t accessor_index, std::vector<std::array<float, N>>& elements)
+	{
+		const fx::gltf::Accessor& accessor = document.accessors[accessor_index];
+		const fx::gltf::BufferView& buffer_view = document.bufferViews[accessor.bufferView];
+		const fx::gltf::Buffer& buffer = document.buffers[buffer_view.buffer];
+
+		assert(accessor.componentType == fx::gltf::Accessor::ComponentType::Float);
+
+		const size_t element_size_bytes = sizeof(float) * N;
+		const size_t stride_bytes = buffer_view.byteStride != 0 ? buffer_view.byteStride : element_size_bytes;
+		const uint8_t* data = &buffer.data[buffer_view.byteOffset + accessor.byteOffset];
+
+		elements.resize(accessor.count);
+
+		for (size_t i = 0; i < elements.size(); ++i)
+		{
+			memcpy(elements[i].data(), data + i * stride_bytes, element_size_bytes);
+		}
+	}
+
+	void sp_mesh_gltf_read_indices(const fx::gltf::Document& document, uint32_t accessor_index, std::vector<uint32_t>& indices)
+	{
+		const fx::gltf::Accessor& accessor = document.accessors[accessor_index];
+		const fx::gltf::BufferView& buffer_view = document.bufferViews[accessor.bufferView];
+		const fx::gltf::Buffer& buffer = document.buffers[buffer_view.buffer];
+
+		const uint8_t* data = &buffer.data[buffer_view.byteOffset + accessor.byteOffset];
+
+		const size_t first_index = indices.size();
+		indices.resize(first_index + accessor.count);
+
+		for (size_t i = 0; i < accessor.count; ++i)
+		{
+			switch (accessor.componentType)
+			{
+			case fx::gltf::Accessor::ComponentType::UnsignedByte:
+				indices[first_index + i] = data[i];
+				break;
+			case fx::gltf::Accessor::ComponentType::UnsignedShort:
+			{
+				uint16_t index;
+				memcpy(&index, data + i * sizeof(index), sizeof(index));
+				indices[first_index + i] = index;
+				break;
+			}
+			case fx::gltf::Accessor::ComponentType::UnsignedInt:
+				memcpy(&indices[first_index + i], data + i * sizeof(uint32_t), sizeof(uint32_t));
+				break;
+			default:
+				assert(false);
+			}
+		}
+	}
+}
+
+sp_mesh sp_mesh_create_from_gltf(const char* path)
+{
+	const fx::gltf::ReadQuotas read_quotas_fx = {
+		fx::gltf::detail::DefaultMaxBufferCount,
+		fx::gltf::detail::DefaultMaxMemoryAllocation * 2,
+		fx::gltf::detail::DefaultMaxMemoryAllocation * 2,
+	};
+	const fx::gltf::Document doc_fx = fx::gltf::LoadFromText(path, read_quotas_fx);
+
+	sp_mesh mesh;
+
+	mesh._textures.resize(doc_fx.textures.size());
+	for (size_t i = 0; i < doc_fx.textures.size(); ++i)
+	{
+		const fx::gltf::Image& image_fx = doc_fx.images[doc_fx.textures[i].source];
+
+		// Embedded images would need decoding from the buffers
+		assert(!image_fx.uri.empty() && !image_fx.IsEmbeddedResource());
+		assert(image_fx.uri.size() < sizeof(mesh._textures[i]._path));
+
+		strncpy(mesh._textures[i]._path, image_fx.uri.c_str(), sizeof(mesh._textures[i]._path) - 1);
+	}
+
+	mesh._materials.resize(doc_fx.materials.size());
+	for (size_t i = 0; i < doc_fx.materials.size(); ++i)
+	{
+		const fx::gltf::Material& material_fx = doc_fx.materials[i];
+		sp_mesh_material& material = mesh._materials[i];
+
+		strncpy(material._name, material_fx.name.c_str(), sizeof(material._name) - 1);
+		material._base_color_texture_index = material_fx.pbrMetallicRoughness.baseColorTexture.index;
+		material._metalness_roughness_texture_index = material_fx.pbrMetallicRoughness.metallicRoughnessTexture.index;
+		memcpy(material._base_color_factor, material_fx.pbrMetallicRoughness.baseColorFactor.data(), sizeof(material._base_color_factor));
+		material._metalness_factor = material_fx.pbrMetallicRoughness.metallicFactor;
+		material._roughness_factor = material_fx.pbrMetallicRoughness.roughnessFactor;
+		material._double_sided = material_fx.doubleSided ? 1 : 0;
+
+		if (material._base_color_texture_index >= 0)
+		{
+			mesh._textures[material._base_color_texture_index]._srgb = 1;
+		}
+	}
+
+	std::vector<std::array<float, 3>> positions;
+	std::vector<std::array<float, 3>> normals;
+	std::vector<std::array<float, 2>> texcoords;
+
+	for (const fx::gltf::Mesh& mesh_fx : doc_fx.meshes)
+	{
+		for (const fx::gltf::Primitive& primitive_fx : mesh_fx.primitives)
+		{
+			if (primitive_fx.mode != fx::gltf::Primitive::Mode::Triangles)
+			{
+				continue;
+			}
+
+			positions.clear();
+			normals.clear();
+			texcoords.clear();
+
+			for (const auto& attribute_fx : primitive_fx.attributes)
+			{
+				if (attribute_fx.first == "POSITION")
+				{
+					detail::sp_mesh_gltf_read_attribute(doc_fx, attribute_fx.second, positions);
+				}
+				else if (attribute_fx.first == "NORMAL")
+				{
+					detail::sp_mesh_gltf_read_attribute(doc_fx, attribute_fx.second, normals);
+				}
+				else if (attribute_fx.first == "TEXCOORD_0")
+				{
+					detail::sp_mesh_gltf_read_attribute(doc_fx, attribute_fx.second, texcoords);
+				}
+			}
+
+			if (positions.empty() || normals.size() != positions.size() || texcoords.size() != positions.size())
+			{
+				continue;
+			}
+
+			sp_mesh_submesh submesh;
+			submesh._first_index = static_cast<uint32_t>(mesh._indices.size());
+			submesh._base_vertex = static_cast<uint32_t>(mesh._vertices.size());
+			submesh._vertex_count = static_cast<uint32_t>(positions.size());
+			submesh._material_index = primitive_fx.material;
+
+			if (primitive_fx.indices >= 0)
+			{
+				detail::sp_mesh_gltf_read_indices(doc_fx, primitive_fx.indices, mesh._indices);
+			}
+			else
+			{
+				for (uint32_t i = 0; i < submesh._vertex_count; ++i)
+				{
+					mesh._indices.push_back(i);
+				}
+			}
+
+			submesh._index_count = static_cast<uint32_t>(mesh._indices.size()) - submesh._first_index;
+
+			for (size_t i = 0; i < positions.size(); ++i)
+			{
+				sp_mesh_vertex vertex = {
+					{ positions[i][0], positions[i][1], positions[i][2] },
+					{ normals[i][0], normals[i][1], normals[i][2] },
+					{ texcoords[i][0], texcoords[i][1] },
+					{ 1.0f, 1.0f, 1.0f, 1.0f },
+				};
+
+				mesh._vertices.push_back(vertex);
+
+				for (int k = 0; k < 3; ++k)
+				{
+					submesh._bounds_min[k] = i > 0 ? std::min(submesh._bounds_min[k], positions[i][k]) : positions[i][k];
+					submesh._bounds_max[k] = i > 0 ? std::max(submesh._bounds_max[k], positions[i][k]) : positions[i][k];
+				}
+			}
+
+			mesh._submeshes.push_back(submesh);
+		}
+	}
+
+	return mesh;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "mesh.h"
+
+// Generates a chain of simplified LODs for every submesh with quadric error metrics (Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics"). Edges are collapsed onto one of their existing vertices, cheapest first, so
+// every LOD is just another index range over the submesh's vertices and the vertex stream doesn't grow.
+//
+// Vertices are sorted by how free they are to move, which is what keeps seams intact:
+//
+// - Interior vertices can collapse onto any neighbour.
+// - Border vertices, on the open edge of a mesh, only slide along that edge so the outline stays where it is.
+// - Seam vertices, where two vertices share a position but not their normals or texcoords, only slide along the seam and
+//   take their twin on the other side with them so the two sides can't come apart.
+// - Anything else, corners where seams meet borders or non-manifold geometry, stays where it is.
+//
+// Each LOD aims for a fixed fraction of the one before and records the worst error of the collapses that made it, the area
+// weighted RMS distance to the planes the collapsed vertices came from. That's in object space, so the renderer scales it by
+// the entity transform, projects it to pixels from the entity's distance and draws the coarsest LOD under its threshold.
+//
+// Generate LODs after optimizing, which drops them, and before building meshlets, which builds them for every LOD too.
+
+const int k_mesh_lod_count_max = 4;		// Not counting the submesh itself
+
+struct sp_mesh_lod_desc
+{
+	int lod_count_max = k_mesh_lod_count_max;		// No more than k_mesh_lod_count_max
+	float triangle_ratio = 0.5f;					// Of the LOD before
+	int triangle_count_min = 64;					// LODs stop before they'd get smaller than this
+
+	// Relative to the largest side of the submesh's bounds. Collapses that cost more than this aren't made, so a submesh with
+	// nothing left to give can end up with fewer LODs, and LODs that couldn't get below 90% of the one before are dropped.
+	float error_max_relative = 0.1f;
+
+	bool parallel = true;		// Submeshes go to the job system, which has to be running, or run one after the other on this thread
+};
+
+// Replaces the LODs of every submesh. The LOD indices go after the ones already in the index stream.
+void sp_mesh_generate_lods(sp_mesh& mesh, const sp_mesh_lod_desc& desc);
+
+// The coarsest LOD whose error projects to no more than pixel_error_max pixels, as an index into lods plus one so 0 is the
+// full detail submesh. error_scale takes the errors to the same space as distance, which should be to the nearest point of
+// the submesh's bounds, and projection_scale is the viewport height over 2 * tan(vertical fov / 2).
+int sp_mesh_lod_select(const sp_mesh_lod* lods, int lod_count, float error_scale, float distance, float projection_scale, float pixel_error_max);
\ No newline at end of file
@@ -0,0 +1,682 @@
+#pragma once
+
+#include "mesh_lod.h"
+#include "mesh_optimize_impl.h"
+#include "job.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+namespace detail
+{
+	const uint32_t k_mesh_lod_invalid_index = ~0u;
+
+	// Open edges weigh this much more than the triangles either side of them so outlines are expensive to move
+	const double k_mesh_lod_edge_weight = 10.0;
+
+	// Each pass makes the cheapest collapses up to this much more than the one that would meet the pass's goal, so a pass
+	// doesn't take expensive collapses just because it has triangles left to remove
+	const double k_mesh_lod_pass_error_slack = 1.5;
+
+	enum class sp_mesh_lod_vertex_kind : uint8_t
+	{
+		manifold,
+		border,
+		seam,
+		locked,
+	};
+
+	// Whether a vertex of the row's kind can collapse onto a vertex of the column's. Borders and seams also have to collapse
+	// along their open edge, which is checked separately.
+	const bool k_mesh_lod_can_collapse[4][4] =
+	{
+		{ true, true, true, true },
+		{ false, true, false, true },
+		{ false, false, true, true },
+		{ false, false, false, false },
+	};
+
+	// Sum of squared distances to planes, as the symmetric matrix A, vector b and constant c of p'Ap + 2b'p + c
+	struct sp_mesh_lod_quadric
+	{
+		double _a00 = 0.0;
+		double _a11 = 0.0;
+		double _a22 = 0.0;
+		double _a01 = 0.0;
+		double _a02 = 0.0;
+		double _a12 = 0.0;
+		double _b0 = 0.0;
+		double _b1 = 0.0;
+		double _b2 = 0.0;
+		double _c = 0.0;
+		double _weight = 0.0;
+	};
+
+	struct sp_mesh_lod_collapse
+	{
+		uint32_t _from = 0;
+		uint32_t _to = 0;
+		double _error = 0.0;
+	};
+
+	struct sp_mesh_lod_chain
+	{
+		std::vector<std::vector<uint32_t>> _indices;		// One per LOD, relative to the base vertex like the submesh's
+		std::vector<float> _errors;
+	};
+
+	void sp_mesh_lod_quadric_add_plane(sp_mesh_lod_quadric& quadric, const double (&normal)[3], double distance, double weight)
+	{
+		quadric._a00 += weight * normal[0] * normal[0];
+		quadric._a11 += weight * normal[1] * normal[1];
+		quadric._a22 += weight * normal[2] * normal[2];
+		quadric._a01 += weight * normal[0] * normal[1];
+		quadric._a02 += weight * normal[0] * normal[2];
+		quadric._a12 += weight * normal[1] * normal[2];
+		quadric._b0 += weight * normal[0] * distance;
+		quadric._b1 += weight * normal[1] * distance;
+		quadric._b2 += weight * normal[2] * distance;
+		quadric._c += weight * distance * distance;
+		quadric._weight += weight;
+	}
+
+	void sp_mesh_lod_quadric_add(sp_mesh_lod_quadric& a, const sp_mesh_lod_quadric& b)
+	{
+		a._a00 += b._a00;
+		a._a11 += b._a11;
+		a._a22 += b._a22;
+		a._a01 += b._a01;
+		a._a02 += b._a02;
+		a._a12 += b._a12;
+		a._b0 += b._b0;
+		a._b1 += b._b1;
+		a._b2 += b._b2;
+		a._c += b._c;
+		a._weight += b._weight;
+	}
+
+	// The weighted mean squared distance to the quadric's planes
+	double sp_mesh_lod_quadric_error(const sp_mesh_lod_quadric& quadric, const float (&position)[3])
+	{
+		const double x = position[0];
+		const double y = position[1];
+		const double z = position[2];
+
+		const double error =
+			quadric._a00 * x * x + quadric._a11 * y * y + quadric._a22 * z * z +
+			2.0 * (quadric._a01 * x * y + quadric._a02 * x * z + quadric._a12 * y * z) +
+			2.0 * (quadric._b0 * x + quadric._b1 * y + quadric._b2 * z) +
+			quadric._c;
+
+		return quadric._weight > 0.0 ? std::fabs(error) / quadric._weight : 0.0;
+	}
+
+	void sp_mesh_lod_cross(const double (&a)[3], const double (&b)[3], double (&result)[3])
+	{
+		result[0] = a[1] * b[2] - a[2] * b[1];
+		result[1] = a[2] * b[0] - a[0] * b[2];
+		result[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	double sp_mesh_lod_dot(const double (&a)[3], const double (&b)[3])
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	void sp_mesh_lod_triangle_normal(const float (&p0)[3], const float (&p1)[3], const float (&p2)[3], double (&normal)[3])
+	{
+		const double e0[3] = { static_cast<double>(p1[0]) - p0[0], static_cast<double>(p1[1]) - p0[1], static_cast<double>(p1[2]) - p0[2] };
+		const double e1[3] = { static_cast<double>(p2[0]) - p0[0], static_cast<double>(p2[1]) - p0[1], static_cast<double>(p2[2]) - p0[2] };
+
+		sp_mesh_lod_cross(e0, e1, normal);
+	}
+
+	void sp_mesh_lod_generate_chain(const sp_mesh_vertex* vertices, uint32_t vertex_count, const uint32_t* source_indices, uint32_t index_count, const sp_mesh_lod_desc& desc, sp_mesh_lod_chain& chain)
+	{
+		std::vector<uint32_t> indices(source_indices, source_indices + index_count);
+
+		// Vertices that share a position, ignoring the ones nothing uses. remap points at the first of them and wedges link
+		// them in a ring.
+		std::vector<uint8_t> used(vertex_count, 0);
+		for (uint32_t index : indices)
+		{
+			used[index] = 1;
+		}
+
+		std::vector<uint32_t> order;
+		order.reserve(vertex_count);
+		for (uint32_t i = 0; i < vertex_count; ++i)
+		{
+			if (used[i])
+			{
+				order.push_back(i);
+			}
+		}
+
+		auto position_less = [vertices](uint32_t a, uint32_t b) {
+			return std::lexicographical_compare(vertices[a]._position, vertices[a]._position + 3, vertices[b]._position, vertices[b]._position + 3);
+		};
+
+		std::stable_sort(order.begin(), order.end(), position_less);
+
+		std::vector<uint32_t> remap(vertex_count);
+		std::vector<uint32_t> wedges(vertex_count);
+		std::iota(remap.begin(), remap.end(), 0);
+		std::iota(wedges.begin(), wedges.end(), 0);
+
+		for (size_t begin = 0, end = 0; begin < order.size(); begin = end)
+		{
+			end = begin + 1;
+			while (end < order.size() && !position_less(order[begin], order[end]))
+			{
+				++end;
+			}
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				remap[order[i]] = order[begin];
+				wedges[order[i]] = order[i + 1 < end ? i + 1 : begin];
+			}
+		}
+
+		// Half edges going out of every vertex. An edge is open when the one going back the other way doesn't exist, which is
+		// the case along borders and, since the vertices either side differ, along seams.
+		std::vector<uint32_t> edge_offsets(vertex_count + 1, 0);
+		for (uint32_t index : indices)
+		{
+			++edge_offsets[index + 1];
+		}
+
+		for (uint32_t i = 0; i < vertex_count; ++i)
+		{
+			edge_offsets[i + 1] += edge_offsets[i];
+		}
+
+		std::vector<uint32_t> edge_targets(index_count);
+		{
+			std::vector<uint32_t> edge_counts(vertex_count, 0);
+			for (uint32_t i = 0; i < index_count; ++i)
+			{
+				const uint32_t from = indices[i];
+				const uint32_t to = indices[i - i % 3 + (i + 1) % 3];
+
+				edge_targets[edge_offsets[from] + edge_counts[from]++] = to;
+			}
+		}
+
+		auto has_edge = [&](uint32_t from, uint32_t to) {
+			return std::find(edge_targets.begin() + edge_offsets[from], edge_targets.begin() + edge_offsets[from + 1], to) != edge_targets.begin() + edge_offsets[from + 1];
+		};
+
+		// The open edges into and out of every vertex, k_mesh_lod_invalid_index for none or the vertex itself for more than one
+		std::vector<uint32_t> loops(vertex_count, k_mesh_lod_invalid_index);
+		std::vector<uint32_t> loops_back(vertex_count, k_mesh_lod_invalid_index);
+
+		for (uint32_t from = 0; from < vertex_count; ++from)
+		{
+			for (uint32_t i = edge_offsets[from]; i < edge_offsets[from + 1]; ++i)
+			{
+				const uint32_t to = edge_targets[i];
+
+				if (!has_edge(to, from))
+				{
+					loops[from] = loops[from] == k_mesh_lod_invalid_index ? to : from;
+					loops_back[to] = loops_back[to] == k_mesh_lod_invalid_index ? from : to;
+				}
+			}
+		}
+
+		auto has_one_loop = [&](uint32_t vertex) {
+			return
+				loops[vertex] != k_mesh_lod_invalid_index && loops[vertex] != vertex &&
+				loops_back[vertex] != k_mesh_lod_invalid_index && loops_back[vertex] != vertex;
+		};
+
+		std::vector<sp_mesh_lod_vertex_kind> kinds(vertex_count, sp_mesh_lod_vertex_kind::locked);
+
+		for (uint32_t vertex : order)
+		{
+			if (remap[vertex] != vertex)
+			{
+				continue;
+			}
+
+			sp_mesh_lod_vertex_kind kind = sp_mesh_lod_vertex_kind::locked;
+			const uint32_t wedge = wedges[vertex];
+
+			if (wedge == vertex)
+			{
+				if (loops[vertex] == k_mesh_lod_invalid_index && loops_back[vertex] == k_mesh_lod_invalid_index)
+				{
+					kind = sp_mesh_lod_vertex_kind::manifold;
+				}
+				else if (has_one_loop(vertex))
+				{
+					kind = sp_mesh_lod_vertex_kind::border;
+				}
+			}
+			else if (wedges[wedge] == vertex && has_one_loop(vertex) && has_one_loop(wedge))
+			{
+				// Two vertices either side of a seam have open edges running opposite ways between the same positions
+				if (remap[loops[vertex]] == remap[loops_back[wedge]] && remap[loops_back[vertex]] == remap[loops[wedge]])
+				{
+					kind = sp_mesh_lod_vertex_kind::seam;
+				}
+			}
+
+			uint32_t i = vertex;
+			do
+			{
+				kinds[i] = kind;
+				i = wedges[i];
+			} while (i != vertex);
+		}
+
+		// Every position's quadric, from the planes of its triangles weighted by area and the planes standing up on its open edges
+		std::vector<sp_mesh_lod_quadric> quadrics(vertex_count);
+
+		float bounds_min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float bounds_max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		for (uint32_t vertex : order)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				bounds_min[axis] = std::min(bounds_min[axis], vertices[vertex]._position[axis]);
+				bounds_max[axis] = std::max(bounds_max[axis], vertices[vertex]._position[axis]);
+			}
+		}
+
+		for (uint32_t i = 0; i < index_count; i += 3)
+		{
+			double normal[3];
+			sp_mesh_lod_triangle_normal(vertices[indices[i + 0]]._position, vertices[indices[i + 1]]._position, vertices[indices[i + 2]]._position, normal);
+
+			const double length = std::sqrt(sp_mesh_lod_dot(normal, normal));
+			if (length == 0.0)
+			{
+				continue;
+			}
+
+			for (double& component : normal)
+			{
+				component /= length;
+			}
+
+			for (int j = 0; j < 3; ++j)
+			{
+				const float* position = vertices[indices[i + j]]._position;
+				const double distance = -(normal[0] * position[0] + normal[1] * position[1] + normal[2] * position[2]);
+
+				sp_mesh_lod_quadric_add_plane(quadrics[remap[indices[i + j]]], normal, distance, length * 0.5);
+			}
+
+			for (int j = 0; j < 3; ++j)
+			{
+				const uint32_t from = indices[i + j];
+				const uint32_t to = indices[i + (j + 1) % 3];
+
+				if (has_edge(to, from))
+				{
+					continue;
+				}
+
+				const float* p0 = vertices[from]._position;
+				const float* p1 = vertices[to]._position;
+
+				const double edge[3] = { static_cast<double>(p1[0]) - p0[0], static_cast<double>(p1[1]) - p0[1], static_cast<double>(p1[2]) - p0[2] };
+				const double edge_length_squared = sp_mesh_lod_dot(edge, edge);
+
+				double edge_normal[3];
+				sp_mesh_lod_cross(edge, normal, edge_normal);
+
+				const double edge_normal_length = std::sqrt(sp_mesh_lod_dot(edge_normal, edge_normal));
+				if (edge_normal_length == 0.0)
+				{
+					continue;
+				}
+
+				for (double& component : edge_normal)
+				{
+					component /= edge_normal_length;
+				}
+
+				const double distance = -(edge_normal[0] * p0[0] + edge_normal[1] * p0[1] + edge_normal[2] * p0[2]);
+
+				sp_mesh_lod_quadric_add_plane(quadrics[remap[from]], edge_normal, distance, edge_length_squared * k_mesh_lod_edge_weight);
+				sp_mesh_lod_quadric_add_plane(quadrics[remap[to]], edge_normal, distance, edge_length_squared * k_mesh_lod_edge_weight);
+			}
+		}
+
+		const float extent = std::max(std::max(bounds_max[0] - bounds_min[0], bounds_max[1] - bounds_min[1]), bounds_max[2] - bounds_min[2]);
+		const double error_limit = static_cast<double>(desc.error_max_relative) * extent * desc.error_max_relative * extent;
+
+		// The vertex on the far side of a seam from from, for a collapse from -> to along the seam
+		auto get_seam_twin = [&](uint32_t from, uint32_t to, uint32_t& twin_from, uint32_t& twin_to) {
+			twin_from = wedges[from];
+			twin_to = loops[from] == to ? loops_back[twin_from] : loops[twin_from];
+
+			return twin_to < vertex_count && twin_to != twin_from && remap[twin_to] == remap[to];
+		};
+
+		auto get_collapse_error = [&](uint32_t from, uint32_t to) {
+			sp_mesh_lod_quadric quadric = quadrics[remap[from]];
+			sp_mesh_lod_quadric_add(quadric, quadrics[remap[to]]);
+
+			return sp_mesh_lod_quadric_error(quadric, vertices[to]._position);
+		};
+
+		auto can_collapse = [&](uint32_t from, uint32_t to) {
+			const sp_mesh_lod_vertex_kind from_kind = kinds[from];
+
+			if (remap[from] == remap[to] || !k_mesh_lod_can_collapse[static_cast<int>(from_kind)][static_cast<int>(kinds[to])])
+			{
+				return false;
+			}
+
+			if (from_kind == sp_mesh_lod_vertex_kind::border || from_kind == sp_mesh_lod_vertex_kind::seam)
+			{
+				if (loops[from] != to && loops_back[from] != to)
+				{
+					return false;
+				}
+			}
+
+			uint32_t twin_from, twin_to;
+			return from_kind != sp_mesh_lod_vertex_kind::seam || get_seam_twin(from, to, twin_from, twin_to);
+		};
+
+		// Moving the vertex mustn't turn any of the triangles around it over
+		std::vector<uint32_t> triangle_offsets(vertex_count + 1);
+		std::vector<uint32_t> triangles;
+
+		auto has_flip = [&](uint32_t from, uint32_t to) {
+			for (uint32_t i = triangle_offsets[from]; i < triangle_offsets[from + 1]; ++i)
+			{
+				const uint32_t* triangle = &indices[triangles[i] * 3];
+
+				if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+				{
+					continue;
+				}
+
+				const int corner = triangle[0] == from ? 0 : triangle[1] == from ? 1 : 2;
+				const uint32_t next = triangle[(corner + 1) % 3];
+				const uint32_t previous = triangle[(corner + 2) % 3];
+
+				double before[3];
+				double after[3];
+				sp_mesh_lod_triangle_normal(vertices[from]._position, vertices[next]._position, vertices[previous]._position, before);
+				sp_mesh_lod_triangle_normal(vertices[to]._position, vertices[next]._position, vertices[previous]._position, after);
+
+				if (sp_mesh_lod_dot(before, before) > 0.0 && sp_mesh_lod_dot(before, after) <= 0.0)
+				{
+					return true;
+				}
+			}
+
+			return false;
+		};
+
+		// Keeps the open edge loops joined up once from is gone
+		auto collapse_loops = [&](uint32_t from, uint32_t to) {
+			if (loops[from] == to)
+			{
+				const uint32_t previous = loops_back[from];
+				loops[previous] = to;
+				loops_back[to] = previous;
+			}
+			else if (loops_back[from] == to)
+			{
+				const uint32_t next = loops[from];
+				loops_back[next] = to;
+				loops[to] = next;
+			}
+		};
+
+		std::vector<uint32_t> collapse_remap(vertex_count);
+		std::iota(collapse_remap.begin(), collapse_remap.end(), 0);
+
+		std::vector<uint8_t> locked(vertex_count);
+		std::vector<sp_mesh_lod_collapse> collapses;
+
+		double error_max = 0.0;
+		bool stuck = false;
+
+		for (int lod = 0; lod < desc.lod_count_max && !stuck; ++lod)
+		{
+			const size_t previous_triangle_count = indices.size() / 3;
+			const size_t target_triangle_count = static_cast<size_t>(previous_triangle_count * desc.triangle_ratio);
+
+			if (target_triangle_count < static_cast<size_t>(desc.triangle_count_min))
+			{
+				break;
+			}
+
+			while (indices.size() / 3 > target_triangle_count)
+			{
+				const uint32_t triangle_count = static_cast<uint32_t>(indices.size() / 3);
+
+				std::fill(triangle_offsets.begin(), triangle_offsets.end(), 0);
+				for (uint32_t index : indices)
+				{
+					++triangle_offsets[index + 1];
+				}
+
+				for (uint32_t i = 0; i < vertex_count; ++i)
+				{
+					triangle_offsets[i + 1] += triangle_offsets[i];
+				}
+
+				triangles.resize(indices.size());
+				{
+					std::vector<uint32_t> triangle_counts(vertex_count, 0);
+					for (uint32_t i = 0; i < indices.size(); ++i)
+					{
+						triangles[triangle_offsets[indices[i]] + triangle_counts[indices[i]]++] = i / 3;
+					}
+				}
+
+				// Every half edge is a collapse of its start onto its end. Open edges have no opposite half edge so they're
+				// tried the other way round too.
+				collapses.clear();
+
+				for (uint32_t i = 0; i < indices.size(); ++i)
+				{
+					const uint32_t from = indices[i];
+					const uint32_t to = indices[i - i % 3 + (i + 1) % 3];
+
+					if (can_collapse(from, to))
+					{
+						collapses.push_back({ from, to, get_collapse_error(from, to) });
+					}
+
+					if (loops[from] == to && can_collapse(to, from))
+					{
+						collapses.push_back({ to, from, get_collapse_error(to, from) });
+					}
+				}
+
+				std::sort(collapses.begin(), collapses.end(), [](const sp_mesh_lod_collapse& a, const sp_mesh_lod_collapse& b) {
+					return a._error != b._error ? a._error < b._error : a._from != b._from ? a._from < b._from : a._to < b._to;
+				});
+
+				// Most collapses take two triangles with them
+				const size_t triangle_goal = triangle_count - target_triangle_count;
+				const size_t collapse_goal = std::max<size_t>(triangle_goal / 2, 1);
+				const double error_goal = collapse_goal < collapses.size() ? collapses[collapse_goal]._error * k_mesh_lod_pass_error_slack : DBL_MAX;
+
+				std::fill(locked.begin(), locked.end(), 0);
+
+				size_t collapsed_triangle_count = 0;
+				size_t collapse_count = 0;
+
+				for (const sp_mesh_lod_collapse& collapse : collapses)
+				{
+					if (collapse._error > error_goal || collapse._error > error_limit || collapsed_triangle_count >= triangle_goal)
+					{
+						break;
+					}
+
+					const uint32_t from = collapse._from;
+					const uint32_t to = collapse._to;
+
+					if (locked[remap[from]] || locked[remap[to]] || has_flip(from, to))
+					{
+						continue;
+					}
+
+					const sp_mesh_lod_vertex_kind kind = kinds[from];
+
+					if (kind == sp_mesh_lod_vertex_kind::seam)
+					{
+						uint32_t twin_from, twin_to;
+						get_seam_twin(from, to, twin_from, twin_to);
+
+						if (has_flip(twin_from, twin_to))
+						{
+							continue;
+						}
+
+						collapse_loops(twin_from, twin_to);
+						collapse_remap[twin_from] = twin_to;
+					}
+
+					if (kind == sp_mesh_lod_vertex_kind::border || kind == sp_mesh_lod_vertex_kind::seam)
+					{
+						collapse_loops(from, to);
+					}
+
+					collapse_remap[from] = to;
+
+					sp_mesh_lod_quadric_add(quadrics[remap[to]], quadrics[remap[from]]);
+
+					locked[remap[from]] = 1;
+					locked[remap[to]] = 1;
+
+					error_max = std::max(error_max, collapse._error);
+					collapsed_triangle_count += kind == sp_mesh_lod_vertex_kind::border ? 1 : 2;
+					++collapse_count;
+				}
+
+				if (collapse_count == 0)
+				{
+					stuck = true;
+					break;
+				}
+
+				size_t write = 0;
+				for (size_t i = 0; i < indices.size(); i += 3)
+				{
+					const uint32_t a = collapse_remap[indices[i + 0]];
+					const uint32_t b = collapse_remap[indices[i + 1]];
+					const uint32_t c = collapse_remap[indices[i + 2]];
+
+					if (remap[a] != remap[b] && remap[b] != remap[c] && remap[c] != remap[a])
+					{
+						indices[write++] = a;
+						indices[write++] = b;
+						indices[write++] = c;
+					}
+				}
+
+				indices.resize(write);
+			}
+
+			// Not worth a draw of its own
+			if (indices.size() / 3 > previous_triangle_count * 9 / 10)
+			{
+				break;
+			}
+
+			sp_mesh_optimize_vertex_cache(indices, vertex_count);
+
+			chain._indices.push_back(indices);
+			chain._errors.push_back(static_cast<float>(std::sqrt(error_max)));
+		}
+	}
+}
+
+void sp_mesh_generate_lods(sp_mesh& mesh, const sp_mesh_lod_desc& desc)
+{
+	assert(desc.lod_count_max >= 0 && desc.lod_count_max <= k_mesh_lod_count_max);
+	assert(desc.triangle_ratio > 0.0f && desc.triangle_ratio < 1.0f);
+
+	// The LOD indices are always after every submesh's, so dropping the old ones is a resize. Meshlets would point at them.
+	uint32_t submesh_index_count = 0;
+	for (sp_mesh_submesh& submesh : mesh._submeshes)
+	{
+		submesh_index_count = std::max(submesh_index_count, submesh._first_index + submesh._index_count);
+		submesh._first_lod = 0;
+		submesh._lod_count = 0;
+		submesh._first_meshlet = 0;
+		submesh._meshlet_count = 0;
+	}
+
+	mesh._indices.resize(submesh_index_count);
+	mesh._lods.clear();
+	mesh._meshlets.clear();
+	mesh._meshlet_vertices.clear();
+	mesh._meshlet_triangles.clear();
+
+	std::vector<detail::sp_mesh_lod_chain> chains(mesh._submeshes.size());
+
+	auto generate_chains = [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			const sp_mesh_submesh& submesh = mesh._submeshes[i];
+
+			detail::sp_mesh_lod_generate_chain(
+				mesh._vertices.data() + submesh._base_vertex,
+				submesh._vertex_count,
+				mesh._indices.data() + submesh._first_index,
+				submesh._index_count,
+				desc,
+				chains[i]);
+		}
+	};
+
+	if (desc.parallel)
+	{
+		sp_job_parallel_for(static_cast<int>(chains.size()), 1, generate_chains);
+	}
+	else
+	{
+		generate_chains(0, static_cast<int>(chains.size()));
+	}
+
+	for (size_t i = 0; i < chains.size(); ++i)
+	{
+		sp_mesh_submesh& submesh = mesh._submeshes[i];
+
+		submesh._first_lod = static_cast<uint32_t>(mesh._lods.size());
+		submesh._lod_count = static_cast<uint32_t>(chains[i]._indices.size());
+
+		for (size_t j = 0; j < chains[i]._indices.size(); ++j)
+		{
+			sp_mesh_lod lod;
+			lod._first_index = static_cast<uint32_t>(mesh._indices.size());
+			lod._index_count = static_cast<uint32_t>(chains[i]._indices[j].size());
+			lod._error = chains[i]._errors[j];
+
+			mesh._lods.push_back(lod);
+			mesh._indices.insert(mesh._indices.end(), chains[i]._indices[j].begin(), chains[i]._indices[j].end());
+		}
+	}
+}
+
+int sp_mesh_lod_select(const sp_mesh_lod* lods, int lod_count, float error_scale, float distance, float projection_scale, float pixel_error_max)
+{
+	int selected = 0;
+
+	// Errors only grow down the chain
+	while (selected < lod_count && lods[selected]._error * error_scale * projection_scale <= pixel_error_max * distance)
+	{
+		++selected;
+	}
+
+	return selected;
+}
\ No newline at end of file
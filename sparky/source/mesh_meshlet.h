@@ -0,0 +1,58 @@
+#pragma once
+
+#include "mesh.h"
+
+// Splits every submesh and LOD into meshlets, clusters of up to 64 vertices and 126 triangles, which is what mesh shaders
+// want and small enough to cull against the frustum and by facing one cluster at a time. Each meshlet gets:
+//
+// - A range of the index stream. Its triangles are moved next to each other so drawing the visible meshlets of a submesh or
+//   LOD is a handful of indexed draws over the ranges that survived.
+// - A list of the vertices it uses and its triangles as 8 bit indices into that list, for mesh shaders or compute culling.
+// - A bounding sphere and a cone around its triangles' normals. A meshlet whose cone points away from the camera far enough
+//   that no triangle in its sphere can face it is backfacing as a whole (Kubisch, "Introduction to Turing Mesh Shaders", and
+//   Kapoulkine's meshoptimizer).
+//
+// Meshlets are grown greedily from the triangle order the optimizer left, always taking the connected triangle that adds the
+// fewest new vertices. Submeshes and LODs are cut into fixed chunks of triangles that are built as separate jobs and stitched
+// back together in order, so the result is the same whatever the worker count.
+//
+// Build meshlets last, after optimizing and generating LODs, which both drop them. Bounds come from the mesh's float positions
+// so if the vertices are quantized afterwards run sp_mesh_dequantize first to bound what the GPU will draw.
+
+const int k_mesh_meshlet_vertex_count_max = 64;
+const int k_mesh_meshlet_triangle_count_max = 126;
+
+// Triangles per job. Meshlets don't cross chunks so it's also the most a meshlet can be off from the best it could be.
+const int k_mesh_meshlet_chunk_triangle_count = 16 * 1024;
+
+struct sp_mesh_meshlet_desc
+{
+	int vertex_count_max = k_mesh_meshlet_vertex_count_max;			// No more than k_mesh_meshlet_vertex_count_max
+	int triangle_count_max = k_mesh_meshlet_triangle_count_max;		// No more than k_mesh_meshlet_triangle_count_max
+	bool parallel = true;		// Chunks go to the job system, which has to be running, or run one after the other on this thread
+};
+
+struct sp_mesh_meshlet_stats
+{
+	int _meshlet_count = 0;
+	int _triangle_count = 0;
+	float _vertex_fill = 0.0f;					// Average vertices per meshlet over the most allowed
+	float _triangle_fill = 0.0f;				// Average triangles per meshlet over the most allowed
+	float _vertices_per_triangle = 0.0f;		// Meshlet vertices over triangles, 0.5 is a regular grid with no seams
+	float _radius_relative = 0.0f;				// Average bounding sphere radius over the radius of the whole model
+	float _cone_angle_degrees = 0.0f;			// Average normal cone half angle of the meshlets that can be backface culled
+	float _backface_culled = 0.0f;				// Fraction of meshlets backface culled from far away, averaged over 26 directions
+};
+
+// Replaces the meshlets of every submesh and LOD and reorders their triangles to match
+void sp_mesh_build_meshlets(sp_mesh& mesh, const sp_mesh_meshlet_desc& desc);
+
+// Only the full detail submeshes' meshlets, so it's comparable with and without LODs
+sp_mesh_meshlet_stats sp_mesh_analyze_meshlets(const sp_mesh& mesh);
+
+// The planes and the camera have to be in the meshlet's object space. Planes are a normal and a distance, with the inside
+// where dot(normal, position) + distance >= 0.
+bool sp_mesh_meshlet_outside_frustum(const sp_mesh_meshlet& meshlet, const float (&planes)[6][4]);
+
+// Only for meshlets of single sided materials. Counter clockwise triangles are front facing, like glTF.
+bool sp_mesh_meshlet_backfacing(const sp_mesh_meshlet& meshlet, const float (&camera_position)[3]);
\ No newline at end of file
@@ -0,0 +1,589 @@
+#pragma once
+
+#include "mesh_meshlet.h"
+#include "job.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+namespace detail
+{
+	const uint32_t k_mesh_meshlet_invalid_index = ~0u;
+	const uint8_t k_mesh_meshlet_invalid_slot = 0xff;
+
+	// Cones wider than this, about 84 degrees, would only ever cull from right behind so they're not worth testing
+	const float k_mesh_meshlet_cone_dot_min = 0.1f;
+
+	struct sp_mesh_meshlet_chunk
+	{
+		uint32_t _base_vertex = 0;
+		uint32_t _first_index = 0;
+		uint32_t _triangle_count = 0;
+
+		// Of the submesh or LOD the chunk is part of, set by its first chunk and added to by every one
+		uint32_t* _first_meshlet = nullptr;
+		uint32_t* _meshlet_count = nullptr;
+		bool _first = false;
+
+		// Filled in by its job. The ranges in the meshlets are relative to the chunk until it's stitched into the mesh.
+		std::vector<sp_mesh_meshlet> _meshlets;
+		std::vector<uint32_t> _meshlet_vertices;
+		std::vector<uint32_t> _meshlet_triangles;
+		std::vector<uint32_t> _indices;
+	};
+
+	float sp_mesh_meshlet_dot(const float* a, const float* b)
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	float sp_mesh_meshlet_distance_squared(const float* a, const float* b)
+	{
+		const float d[3] = { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+
+		return sp_mesh_meshlet_dot(d, d);
+	}
+
+	// Ritter's sphere, grown from the most distant pair of axis extremes, then widened to whatever the rounding left outside
+	void sp_mesh_meshlet_compute_sphere(sp_mesh_meshlet& meshlet, const sp_mesh_vertex* vertices, const uint32_t* meshlet_vertices)
+	{
+		int extremes[6] = {};
+
+		for (uint32_t i = 1; i < meshlet._vertex_count; ++i)
+		{
+			const float* position = vertices[meshlet_vertices[i]]._position;
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				if (position[axis] < vertices[meshlet_vertices[extremes[axis * 2 + 0]]]._position[axis])
+				{
+					extremes[axis * 2 + 0] = i;
+				}
+
+				if (position[axis] > vertices[meshlet_vertices[extremes[axis * 2 + 1]]]._position[axis])
+				{
+					extremes[axis * 2 + 1] = i;
+				}
+			}
+		}
+
+		int widest_axis = 0;
+		float widest_distance_squared = -1.0f;
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float distance_squared = sp_mesh_meshlet_distance_squared(
+				vertices[meshlet_vertices[extremes[axis * 2 + 0]]]._position,
+				vertices[meshlet_vertices[extremes[axis * 2 + 1]]]._position);
+
+			if (distance_squared > widest_distance_squared)
+			{
+				widest_axis = axis;
+				widest_distance_squared = distance_squared;
+			}
+		}
+
+		const float* a = vertices[meshlet_vertices[extremes[widest_axis * 2 + 0]]]._position;
+		const float* b = vertices[meshlet_vertices[extremes[widest_axis * 2 + 1]]]._position;
+
+		float center[3] = { (a[0] + b[0]) * 0.5f, (a[1] + b[1]) * 0.5f, (a[2] + b[2]) * 0.5f };
+		float radius = std::sqrt(widest_distance_squared) * 0.5f;
+
+		for (uint32_t i = 0; i < meshlet._vertex_count; ++i)
+		{
+			const float* position = vertices[meshlet_vertices[i]]._position;
+			const float distance = std::sqrt(sp_mesh_meshlet_distance_squared(position, center));
+
+			if (distance > radius)
+			{
+				const float grown_radius = (radius + distance) * 0.5f;
+				const float t = (grown_radius - radius) / distance;
+
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					center[axis] += (position[axis] - center[axis]) * t;
+				}
+
+				radius = grown_radius;
+			}
+		}
+
+		for (uint32_t i = 0; i < meshlet._vertex_count; ++i)
+		{
+			radius = std::max(radius, std::sqrt(sp_mesh_meshlet_distance_squared(vertices[meshlet_vertices[i]]._position, center)));
+		}
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			meshlet._center[axis] = center[axis];
+		}
+
+		meshlet._radius = radius;
+	}
+
+	// The axis is the average of the triangles' unit normals and the cone is as wide as the normal furthest from it
+	void sp_mesh_meshlet_compute_cone(sp_mesh_meshlet& meshlet, const sp_mesh_vertex* vertices, const uint32_t* indices)
+	{
+		float normals[k_mesh_meshlet_triangle_count_max][3];
+		int normal_count = 0;
+
+		float axis[3] = {};
+
+		for (uint32_t i = 0; i < meshlet._triangle_count; ++i)
+		{
+			const float* p0 = vertices[indices[i * 3 + 0]]._position;
+			const float* p1 = vertices[indices[i * 3 + 1]]._position;
+			const float* p2 = vertices[indices[i * 3 + 2]]._position;
+
+			const float e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			const float e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			const float normal[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+
+			const float length = std::sqrt(sp_mesh_meshlet_dot(normal, normal));
+			if (length == 0.0f)
+			{
+				continue;
+			}
+
+			for (int j = 0; j < 3; ++j)
+			{
+				normals[normal_count][j] = normal[j] / length;
+				axis[j] += normals[normal_count][j];
+			}
+
+			++normal_count;
+		}
+
+		meshlet._cone_cutoff = 1.0f;
+
+		const float axis_length = std::sqrt(sp_mesh_meshlet_dot(axis, axis));
+		if (axis_length == 0.0f)
+		{
+			return;
+		}
+
+		for (int j = 0; j < 3; ++j)
+		{
+			meshlet._cone_axis[j] = axis[j] / axis_length;
+		}
+
+		float dot_min = 1.0f;
+		for (int i = 0; i < normal_count; ++i)
+		{
+			dot_min = std::min(dot_min, sp_mesh_meshlet_dot(normals[i], meshlet._cone_axis));
+		}
+
+		if (dot_min > k_mesh_meshlet_cone_dot_min)
+		{
+			meshlet._cone_cutoff = std::sqrt(1.0f - dot_min * dot_min);
+		}
+	}
+
+	// Grows meshlets over one chunk. indices are the chunk's, relative to the base vertex, and vertices start at it.
+	void sp_mesh_meshlet_build_chunk(sp_mesh_meshlet_chunk& chunk, const sp_mesh_vertex* vertices, const uint32_t* indices, int vertex_count_max, int triangle_count_max)
+	{
+		const uint32_t triangle_count = chunk._triangle_count;
+
+		// Renumbered to the vertices the chunk uses so everything below is sized by the chunk rather than the whole submesh
+		std::vector<uint32_t> chunk_vertices(indices, indices + triangle_count * 3);
+		std::sort(chunk_vertices.begin(), chunk_vertices.end());
+		chunk_vertices.erase(std::unique(chunk_vertices.begin(), chunk_vertices.end()), chunk_vertices.end());
+
+		const uint32_t vertex_count = static_cast<uint32_t>(chunk_vertices.size());
+
+		std::vector<uint32_t> chunk_indices(triangle_count * 3);
+		for (uint32_t i = 0; i < triangle_count * 3; ++i)
+		{
+			chunk_indices[i] = static_cast<uint32_t>(std::lower_bound(chunk_vertices.begin(), chunk_vertices.end(), indices[i]) - chunk_vertices.begin());
+		}
+
+		// The triangles around every vertex
+		std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+		for (uint32_t index : chunk_indices)
+		{
+			++adjacency_offsets[index + 1];
+		}
+
+		for (uint32_t i = 0; i < vertex_count; ++i)
+		{
+			adjacency_offsets[i + 1] += adjacency_offsets[i];
+		}
+
+		std::vector<uint32_t> adjacency(triangle_count * 3);
+		{
+			std::vector<uint32_t> adjacency_counts(vertex_count, 0);
+			for (uint32_t i = 0; i < triangle_count * 3; ++i)
+			{
+				const uint32_t index = chunk_indices[i];
+				adjacency[adjacency_offsets[index] + adjacency_counts[index]++] = i / 3;
+			}
+		}
+
+		std::vector<uint8_t> emitted(triangle_count, 0);
+		std::vector<uint32_t> candidate_meshlets(triangle_count, k_mesh_meshlet_invalid_index);		// The last meshlet it was a candidate for
+		std::vector<uint8_t> candidate_new_vertex_counts(triangle_count, 0);						// What it would add to that meshlet
+		std::vector<uint8_t> slots(vertex_count, k_mesh_meshlet_invalid_slot);						// Where it is in the current meshlet
+
+		std::vector<uint32_t> candidates;
+		uint32_t meshlet_chunk_vertices[k_mesh_meshlet_vertex_count_max];
+
+		sp_mesh_meshlet meshlet;
+		uint32_t emitted_count = 0;
+		uint32_t next_triangle = 0;
+
+		auto get_new_vertex_count = [&](uint32_t triangle) {
+			return
+				(slots[chunk_indices[triangle * 3 + 0]] == k_mesh_meshlet_invalid_slot ? 1 : 0) +
+				(slots[chunk_indices[triangle * 3 + 1]] == k_mesh_meshlet_invalid_slot ? 1 : 0) +
+				(slots[chunk_indices[triangle * 3 + 2]] == k_mesh_meshlet_invalid_slot ? 1 : 0);
+		};
+
+		auto add_triangle = [&](uint32_t triangle) {
+			uint32_t packed_triangle = 0;
+
+			for (int i = 0; i < 3; ++i)
+			{
+				const uint32_t index = chunk_indices[triangle * 3 + i];
+
+				if (slots[index] == k_mesh_meshlet_invalid_slot)
+				{
+					slots[index] = static_cast<uint8_t>(meshlet._vertex_count);
+					meshlet_chunk_vertices[meshlet._vertex_count++] = index;
+					chunk._meshlet_vertices.push_back(chunk_vertices[index]);
+
+					for (uint32_t j = adjacency_offsets[index]; j < adjacency_offsets[index + 1]; ++j)
+					{
+						const uint32_t adjacent_triangle = adjacency[j];
+						const uint32_t meshlet_index = static_cast<uint32_t>(chunk._meshlets.size());
+
+						if (emitted[adjacent_triangle])
+						{
+							continue;
+						}
+
+						if (candidate_meshlets[adjacent_triangle] == meshlet_index)
+						{
+							--candidate_new_vertex_counts[adjacent_triangle];
+						}
+						else
+						{
+							candidate_meshlets[adjacent_triangle] = meshlet_index;
+							candidate_new_vertex_counts[adjacent_triangle] = static_cast<uint8_t>(get_new_vertex_count(adjacent_triangle));
+							candidates.push_back(adjacent_triangle);
+						}
+					}
+				}
+
+				packed_triangle |= static_cast<uint32_t>(slots[index]) << (i * 8);
+				chunk._indices.push_back(chunk_vertices[index]);
+			}
+
+			chunk._meshlet_triangles.push_back(packed_triangle);
+			emitted[triangle] = 1;
+			++meshlet._triangle_count;
+			++emitted_count;
+		};
+
+		auto finish_meshlet = [&]() {
+			sp_mesh_meshlet_compute_sphere(meshlet, vertices, chunk._meshlet_vertices.data() + meshlet._first_vertex);
+			sp_mesh_meshlet_compute_cone(meshlet, vertices, chunk._indices.data() + meshlet._first_index);
+
+			chunk._meshlets.push_back(meshlet);
+
+			for (uint32_t i = 0; i < meshlet._vertex_count; ++i)
+			{
+				slots[meshlet_chunk_vertices[i]] = k_mesh_meshlet_invalid_slot;
+			}
+
+			candidates.clear();
+
+			meshlet = sp_mesh_meshlet();
+			meshlet._first_index = static_cast<uint32_t>(chunk._indices.size());
+			meshlet._first_vertex = static_cast<uint32_t>(chunk._meshlet_vertices.size());
+		};
+
+		while (emitted_count < triangle_count)
+		{
+			// The connected triangle that adds the fewest vertices, then the earliest one to stay close to the optimizer's order
+			uint32_t best_triangle = k_mesh_meshlet_invalid_index;
+			int best_new_vertex_count = 4;
+
+			size_t candidate_count = 0;
+			for (uint32_t triangle : candidates)
+			{
+				if (emitted[triangle])
+				{
+					continue;
+				}
+
+				candidates[candidate_count++] = triangle;
+
+				const int new_vertex_count = candidate_new_vertex_counts[triangle];
+				if (static_cast<int>(meshlet._vertex_count) + new_vertex_count > vertex_count_max)
+				{
+					continue;
+				}
+
+				if (new_vertex_count < best_new_vertex_count || (new_vertex_count == best_new_vertex_count && triangle < best_triangle))
+				{
+					best_triangle = triangle;
+					best_new_vertex_count = new_vertex_count;
+				}
+			}
+
+			candidates.resize(candidate_count);
+
+			if (best_triangle == k_mesh_meshlet_invalid_index)
+			{
+				while (emitted[next_triangle])
+				{
+					++next_triangle;
+				}
+
+				// Starts the next meshlet where the optimizer's order carries on. A meshlet that runs out of connected triangles
+				// while it's still mostly empty, which happens on models made of lots of small pieces, is topped up the same way
+				// rather than closed with a handful of triangles.
+				const bool top_up =
+					static_cast<int>(meshlet._triangle_count) < triangle_count_max / 4 &&
+					static_cast<int>(meshlet._vertex_count) + get_new_vertex_count(next_triangle) <= vertex_count_max;
+
+				if (meshlet._triangle_count == 0 || top_up)
+				{
+					best_triangle = next_triangle;
+				}
+			}
+
+			if (best_triangle == k_mesh_meshlet_invalid_index)
+			{
+				finish_meshlet();
+				continue;
+			}
+
+			add_triangle(best_triangle);
+
+			if (static_cast<int>(meshlet._triangle_count) == triangle_count_max)
+			{
+				finish_meshlet();
+			}
+		}
+
+		if (meshlet._triangle_count > 0)
+		{
+			finish_meshlet();
+		}
+	}
+}
+
+void sp_mesh_build_meshlets(sp_mesh& mesh, const sp_mesh_meshlet_desc& desc)
+{
+	assert(desc.vertex_count_max >= 3 && desc.vertex_count_max <= k_mesh_meshlet_vertex_count_max);
+	assert(desc.triangle_count_max >= 1 && desc.triangle_count_max <= k_mesh_meshlet_triangle_count_max);
+	assert(mesh._indices.size() % 3 == 0);
+
+	std::vector<detail::sp_mesh_meshlet_chunk> chunks;
+
+	auto add_chunks = [&chunks](uint32_t base_vertex, uint32_t first_index, uint32_t index_count, uint32_t& first_meshlet, uint32_t& meshlet_count) {
+		first_meshlet = 0;
+		meshlet_count = 0;
+
+		for (uint32_t first_triangle = 0; first_triangle < index_count / 3; first_triangle += k_mesh_meshlet_chunk_triangle_count)
+		{
+			detail::sp_mesh_meshlet_chunk chunk;
+			chunk._base_vertex = base_vertex;
+			chunk._first_index = first_index + first_triangle * 3;
+			chunk._triangle_count = std::min(index_count / 3 - first_triangle, static_cast<uint32_t>(k_mesh_meshlet_chunk_triangle_count));
+			chunk._first_meshlet = &first_meshlet;
+			chunk._meshlet_count = &meshlet_count;
+			chunk._first = first_triangle == 0;
+
+			chunks.push_back(std::move(chunk));
+		}
+	};
+
+	for (sp_mesh_submesh& submesh : mesh._submeshes)
+	{
+		add_chunks(submesh._base_vertex, submesh._first_index, submesh._index_count, submesh._first_meshlet, submesh._meshlet_count);
+
+		for (uint32_t i = 0; i < submesh._lod_count; ++i)
+		{
+			sp_mesh_lod& lod = mesh._lods[submesh._first_lod + i];
+			add_chunks(submesh._base_vertex, lod._first_index, lod._index_count, lod._first_meshlet, lod._meshlet_count);
+		}
+	}
+
+	auto build_chunks = [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			detail::sp_mesh_meshlet_chunk& chunk = chunks[i];
+
+			detail::sp_mesh_meshlet_build_chunk(
+				chunk,
+				mesh._vertices.data() + chunk._base_vertex,
+				mesh._indices.data() + chunk._first_index,
+				desc.vertex_count_max,
+				desc.triangle_count_max);
+		}
+	};
+
+	if (desc.parallel)
+	{
+		sp_job_parallel_for(static_cast<int>(chunks.size()), 1, build_chunks);
+	}
+	else
+	{
+		build_chunks(0, static_cast<int>(chunks.size()));
+	}
+
+	mesh._meshlets.clear();
+	mesh._meshlet_vertices.clear();
+	mesh._meshlet_triangles.assign(mesh._indices.size() / 3, 0);
+
+	for (detail::sp_mesh_meshlet_chunk& chunk : chunks)
+	{
+		if (chunk._first)
+		{
+			*chunk._first_meshlet = static_cast<uint32_t>(mesh._meshlets.size());
+		}
+
+		const uint32_t first_index = chunk._first_index;
+		const uint32_t first_vertex = static_cast<uint32_t>(mesh._meshlet_vertices.size());
+
+		for (sp_mesh_meshlet meshlet : chunk._meshlets)
+		{
+			meshlet._first_index += first_index;
+			meshlet._first_vertex += first_vertex;
+
+			mesh._meshlets.push_back(meshlet);
+		}
+
+		*chunk._meshlet_count += static_cast<uint32_t>(chunk._meshlets.size());
+
+		std::copy(chunk._indices.begin(), chunk._indices.end(), mesh._indices.begin() + first_index);
+		std::copy(chunk._meshlet_triangles.begin(), chunk._meshlet_triangles.end(), mesh._meshlet_triangles.begin() + first_index / 3);
+		mesh._meshlet_vertices.insert(mesh._meshlet_vertices.end(), chunk._meshlet_vertices.begin(), chunk._meshlet_vertices.end());
+	}
+}
+
+sp_mesh_meshlet_stats sp_mesh_analyze_meshlets(const sp_mesh& mesh)
+{
+	sp_mesh_meshlet_stats stats;
+
+	std::vector<sp_mesh_meshlet> meshlets;
+	for (const sp_mesh_submesh& submesh : mesh._submeshes)
+	{
+		meshlets.insert(meshlets.end(), mesh._meshlets.begin() + submesh._first_meshlet, mesh._meshlets.begin() + submesh._first_meshlet + submesh._meshlet_count);
+	}
+
+	stats._meshlet_count = static_cast<int>(meshlets.size());
+
+	if (meshlets.empty())
+	{
+		return stats;
+	}
+
+	// Bounds of the whole model to put the cameras around
+	float bounds_min[3] = { INFINITY, INFINITY, INFINITY };
+	float bounds_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+	for (const sp_mesh_vertex& vertex : mesh._vertices)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			bounds_min[axis] = std::min(bounds_min[axis], vertex._position[axis]);
+			bounds_max[axis] = std::max(bounds_max[axis], vertex._position[axis]);
+		}
+	}
+
+	const float center[3] = { (bounds_min[0] + bounds_max[0]) * 0.5f, (bounds_min[1] + bounds_max[1]) * 0.5f, (bounds_min[2] + bounds_max[2]) * 0.5f };
+	const float radius = std::max(std::sqrt(detail::sp_mesh_meshlet_distance_squared(bounds_min, bounds_max)) * 0.5f, FLT_MIN);
+
+	int vertex_count = 0;
+	int cone_count = 0;
+	double radius_sum = 0.0;
+	double cone_angle_sum = 0.0;
+
+	for (const sp_mesh_meshlet& meshlet : meshlets)
+	{
+		vertex_count += meshlet._vertex_count;
+		stats._triangle_count += meshlet._triangle_count;
+		radius_sum += meshlet._radius;
+
+		if (meshlet._cone_cutoff < 1.0f)
+		{
+			cone_angle_sum += std::asin(meshlet._cone_cutoff);
+			++cone_count;
+		}
+	}
+
+	int culled_count = 0;
+	int direction_count = 0;
+
+	for (int x = -1; x <= 1; ++x)
+	{
+		for (int y = -1; y <= 1; ++y)
+		{
+			for (int z = -1; z <= 1; ++z)
+			{
+				if (x == 0 && y == 0 && z == 0)
+				{
+					continue;
+				}
+
+				const float distance = radius * 100.0f / std::sqrt(static_cast<float>(x * x + y * y + z * z));
+				const float camera_position[3] = { center[0] + x * distance, center[1] + y * distance, center[2] + z * distance };
+
+				for (const sp_mesh_meshlet& meshlet : meshlets)
+				{
+					culled_count += sp_mesh_meshlet_backfacing(meshlet, camera_position) ? 1 : 0;
+				}
+
+				++direction_count;
+			}
+		}
+	}
+
+	const float meshlet_count = static_cast<float>(stats._meshlet_count);
+
+	stats._vertex_fill = vertex_count / (meshlet_count * k_mesh_meshlet_vertex_count_max);
+	stats._triangle_fill = stats._triangle_count / (meshlet_count * k_mesh_meshlet_triangle_count_max);
+	stats._vertices_per_triangle = static_cast<float>(vertex_count) / stats._triangle_count;
+	stats._radius_relative = static_cast<float>(radius_sum / meshlet_count / radius);
+	stats._cone_angle_degrees = cone_count > 0 ? static_cast<float>(cone_angle_sum / cone_count * 180.0 / 3.14159265358979323846) : 0.0f;
+	stats._backface_culled = static_cast<float>(culled_count) / (meshlet_count * direction_count);
+
+	return stats;
+}
+
+bool sp_mesh_meshlet_outside_frustum(const sp_mesh_meshlet& meshlet, const float (&planes)[6][4])
+{
+	for (const float (&plane)[4] : planes)
+	{
+		if (detail::sp_mesh_meshlet_dot(plane, meshlet._center) + plane[3] < -meshlet._radius)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool sp_mesh_meshlet_backfacing(const sp_mesh_meshlet& meshlet, const float (&camera_position)[3])
+{
+	if (meshlet._cone_cutoff >= 1.0f)
+	{
+		return false;
+	}
+
+	const float to_center[3] =
+	{
+		meshlet._center[0] - camera_position[0],
+		meshlet._center[1] - camera_position[1],
+		meshlet._center[2] - camera_position[2],
+	};
+
+	const float distance = std::sqrt(detail::sp_mesh_meshlet_dot(to_center, to_center));
+
+	return detail::sp_mesh_meshlet_dot(to_center, meshlet._cone_axis) >= meshlet._cone_cutoff * distance + meshlet._radius;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "mesh.h"
+
+// Reorders models for the GPU after importing them and before cooking, one submesh at a time:
+//
+// - Welds vertices that are bit for bit the same, which glTF exporters leave plenty of, and drops triangles that collapse.
+// - Orders triangles for the post transform vertex cache with Tom Forsyth's linear speed algorithm.
+// - Splits that order into clusters wherever the cache starts cold anyway and sorts the clusters so the ones facing away from
+//   the middle of the submesh draw first, which cuts overdraw from most directions without giving up much of the cache win
+//   (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+// - Renumbers vertices in the order the indices first use them so vertex fetch walks memory forwards.
+//
+// Cache efficiency is reported as ACMR, cache misses per triangle, and ATVR, cache misses per vertex. ATVR is 1 for a perfect
+// order whatever the mesh, ACMR is around 0.5 for a perfect order on a regular grid and 3 for the worst order.
+
+// What the stats simulate. Small enough that it's a fair guess for every GPU we care about.
+const int k_mesh_optimize_fifo_cache_size = 16;
+
+struct sp_mesh_vertex_cache_stats
+{
+	int _triangle_count = 0;
+	int _vertex_count = 0;		// Only the ones the indices use
+	int _miss_count = 0;
+	float _acmr = 0.0f;
+	float _atvr = 0.0f;
+};
+
+struct sp_mesh_optimize_desc
+{
+	bool weld = true;
+	bool vertex_cache = true;
+	bool overdraw = true;
+	bool vertex_fetch = true;
+
+	// How much worse than the cache order a cluster is allowed to be for the overdraw sort. 1 keeps the cache order's ACMR, a
+	// bit more gives the sort smaller clusters to work with.
+	float overdraw_threshold = 1.05f;
+};
+
+// Simulates a FIFO cache of k_mesh_optimize_fifo_cache_size entries over every submesh
+sp_mesh_vertex_cache_stats sp_mesh_analyze_vertex_cache(const sp_mesh& mesh);
+
+// Keeps the submeshes, materials and textures as they are, replaces the vertices and indices and drops any LODs and meshlets
+void sp_mesh_optimize(sp_mesh& mesh, const sp_mesh_optimize_desc& desc);
\ No newline at end of file
@@ -0,0 +1,606 @@
+#pragma once
+
+#include "mesh_optimize.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace detail
+{
+	// Forsyth's tuning, from "Linear-Speed Vertex Cache Optimisation"
+	const int k_mesh_optimize_forsyth_cache_size = 32;
+	const int k_mesh_optimize_forsyth_valence_table_size = 32;
+	const float k_mesh_optimize_forsyth_cache_decay_power = 1.5f;
+	const float k_mesh_optimize_forsyth_last_triangle_score = 0.75f;
+	const float k_mesh_optimize_forsyth_valence_boost_scale = 2.0f;
+	const float k_mesh_optimize_forsyth_valence_boost_power = 0.5f;
+
+	const uint32_t k_mesh_optimize_invalid_index = ~0u;
+
+	struct sp_mesh_optimize_forsyth_tables
+	{
+		float cache_scores[k_mesh_optimize_forsyth_cache_size];
+		float valence_scores[k_mesh_optimize_forsyth_valence_table_size];
+	};
+
+	const sp_mesh_optimize_forsyth_tables& sp_mesh_optimize_get_forsyth_tables()
+	{
+		static const sp_mesh_optimize_forsyth_tables tables = []() {
+			sp_mesh_optimize_forsyth_tables tables;
+
+			for (int i = 0; i < k_mesh_optimize_forsyth_cache_size; ++i)
+			{
+				// The last triangle's vertices score the same whatever order they went in, otherwise the next triangle would
+				// depend on which way round the last one was wound
+				tables.cache_scores[i] = i < 3 ?
+					k_mesh_optimize_forsyth_last_triangle_score :
+					powf(1.0f - static_cast<float>(i - 3) / (k_mesh_optimize_forsyth_cache_size - 3), k_mesh_optimize_forsyth_cache_decay_power);
+			}
+
+			for (int i = 0; i < k_mesh_optimize_forsyth_valence_table_size; ++i)
+			{
+				tables.valence_scores[i] = i == 0 ? 0.0f : k_mesh_optimize_forsyth_valence_boost_scale * powf(static_cast<float>(i), -k_mesh_optimize_forsyth_valence_boost_power);
+			}
+
+			return tables;
+		}();
+
+		return tables;
+	}
+
+	// Vertices with few triangles left get a boost so they're finished off rather than left behind as lone triangles
+	float sp_mesh_optimize_forsyth_score(const sp_mesh_optimize_forsyth_tables& tables, int cache_position, uint32_t remaining_triangle_count)
+	{
+		if (remaining_triangle_count == 0)
+		{
+			return -1.0f;
+		}
+
+		const float cache_score = cache_position >= 0 ? tables.cache_scores[cache_position] : 0.0f;
+		const float valence_score = remaining_triangle_count < k_mesh_optimize_forsyth_valence_table_size ?
+			tables.valence_scores[remaining_triangle_count] :
+			k_mesh_optimize_forsyth_valence_boost_scale * powf(static_cast<float>(remaining_triangle_count), -k_mesh_optimize_forsyth_valence_boost_power);
+
+		return cache_score + valence_score;
+	}
+
+	// Simulates a FIFO cache without storing it. A vertex is still cached if fewer than the cache size misses happened since it
+	// went in, so only the time of the last miss per vertex is needed. Moving timestamp on by more than the cache size flushes.
+	uint32_t sp_mesh_optimize_fifo_misses(const uint32_t* triangle, std::vector<uint32_t>& cache_timestamps, uint32_t& timestamp)
+	{
+		uint32_t miss_count = 0;
+
+		for (int i = 0; i < 3; ++i)
+		{
+			if (timestamp - cache_timestamps[triangle[i]] > k_mesh_optimize_fifo_cache_size)
+			{
+				cache_timestamps[triangle[i]] = timestamp++;
+				++miss_count;
+			}
+		}
+
+		return miss_count;
+	}
+
+	uint32_t sp_mesh_optimize_hash(const sp_mesh_vertex& vertex)
+	{
+		uint32_t words[sizeof(sp_mesh_vertex) / sizeof(uint32_t)];
+		memcpy(words, &vertex, sizeof(words));
+
+		// FNV-1a a word at a time
+		uint32_t hash = 2166136261u;
+		for (uint32_t word : words)
+		{
+			hash = (hash ^ word) * 16777619u;
+		}
+
+		return hash ^ (hash >> 15);
+	}
+
+	void sp_mesh_optimize_weld(std::vector<sp_mesh_vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		// Open addressing, at most half full
+		size_t table_size = 1;
+		while (table_size < vertices.size() * 2)
+		{
+			table_size *= 2;
+		}
+
+		std::vector<uint32_t> table(table_size, k_mesh_optimize_invalid_index);
+		std::vector<uint32_t> remap(vertices.size());
+
+		std::vector<sp_mesh_vertex> welded;
+		welded.reserve(vertices.size());
+
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			size_t slot = sp_mesh_optimize_hash(vertices[i]) & (table_size - 1);
+
+			while (table[slot] != k_mesh_optimize_invalid_index && memcmp(&welded[table[slot]], &vertices[i], sizeof(sp_mesh_vertex)) != 0)
+			{
+				slot = (slot + 1) & (table_size - 1);
+			}
+
+			if (table[slot] == k_mesh_optimize_invalid_index)
+			{
+				table[slot] = static_cast<uint32_t>(welded.size());
+				welded.push_back(vertices[i]);
+			}
+
+			remap[i] = table[slot];
+		}
+
+		// Triangles with two corners welded together don't cover anything
+		size_t index_count = 0;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			assert(indices[i] < vertices.size() && indices[i + 1] < vertices.size() && indices[i + 2] < vertices.size());
+
+			const uint32_t a = remap[indices[i]];
+			const uint32_t b = remap[indices[i + 1]];
+			const uint32_t c = remap[indices[i + 2]];
+
+			if (a != b && b != c && c != a)
+			{
+				indices[index_count++] = a;
+				indices[index_count++] = b;
+				indices[index_count++] = c;
+			}
+		}
+
+		indices.resize(index_count);
+		vertices.swap(welded);
+	}
+
+	void sp_mesh_optimize_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count)
+	{
+		const sp_mesh_optimize_forsyth_tables& tables = sp_mesh_optimize_get_forsyth_tables();
+
+		const size_t triangle_count = indices.size() / 3;
+
+		if (triangle_count == 0)
+		{
+			return;
+		}
+
+		// Every vertex's triangles, with the ones still to be emitted kept at the front of its range
+		std::vector<uint32_t> remaining_triangle_counts(vertex_count, 0);
+		for (uint32_t index : indices)
+		{
+			++remaining_triangle_counts[index];
+		}
+
+		std::vector<uint32_t> triangle_offsets(vertex_count + 1, 0);
+		for (size_t i = 0; i < vertex_count; ++i)
+		{
+			triangle_offsets[i + 1] = triangle_offsets[i] + remaining_triangle_counts[i];
+		}
+
+		std::vector<uint32_t> triangles(indices.size());
+		{
+			std::vector<uint32_t> cursors(triangle_offsets.begin(), triangle_offsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i)
+			{
+				triangles[cursors[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		std::vector<int> cache_positions(vertex_count, -1);
+
+		std::vector<float> vertex_scores(vertex_count);
+		for (size_t i = 0; i < vertex_count; ++i)
+		{
+			vertex_scores[i] = sp_mesh_optimize_forsyth_score(tables, -1, remaining_triangle_counts[i]);
+		}
+
+		std::vector<float> triangle_scores(triangle_count);
+		std::vector<bool> triangles_emitted(triangle_count, false);
+
+		uint32_t best_triangle = 0;
+		for (size_t i = 0; i < triangle_count; ++i)
+		{
+			triangle_scores[i] = vertex_scores[indices[i * 3]] + vertex_scores[indices[i * 3 + 1]] + vertex_scores[indices[i * 3 + 2]];
+
+			if (triangle_scores[i] > triangle_scores[best_triangle])
+			{
+				best_triangle = static_cast<uint32_t>(i);
+			}
+		}
+
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+
+		// Room for the whole cache plus the three vertices pushing the oldest ones out
+		uint32_t cache[k_mesh_optimize_forsyth_cache_size + 3];
+		int cache_count = 0;
+
+		size_t scan_cursor = 0;
+
+		while (result.size() < indices.size())
+		{
+			if (best_triangle == k_mesh_optimize_invalid_index)
+			{
+				// Nothing in the cache has triangles left so carry on from wherever is left in the original order
+				while (triangles_emitted[scan_cursor])
+				{
+					++scan_cursor;
+				}
+
+				best_triangle = static_cast<uint32_t>(scan_cursor);
+			}
+
+			const uint32_t* triangle = &indices[best_triangle * 3];
+
+			result.insert(result.end(), triangle, triangle + 3);
+			triangles_emitted[best_triangle] = true;
+
+			for (int i = 0; i < 3; ++i)
+			{
+				const uint32_t vertex = triangle[i];
+
+				uint32_t* vertex_triangles = &triangles[triangle_offsets[vertex]];
+				const uint32_t remaining_triangle_count = remaining_triangle_counts[vertex];
+
+				for (uint32_t j = 0; j < remaining_triangle_count; ++j)
+				{
+					if (vertex_triangles[j] == best_triangle)
+					{
+						std::swap(vertex_triangles[j], vertex_triangles[remaining_triangle_count - 1]);
+						break;
+					}
+				}
+
+				--remaining_triangle_counts[vertex];
+			}
+
+			// The triangle's vertices go to the front and everything else moves back
+			uint32_t new_cache[k_mesh_optimize_forsyth_cache_size + 3];
+			int new_cache_count = 0;
+
+			new_cache[new_cache_count++] = triangle[0];
+			new_cache[new_cache_count++] = triangle[1];
+			new_cache[new_cache_count++] = triangle[2];
+
+			for (int i = 0; i < cache_count; ++i)
+			{
+				if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+				{
+					new_cache[new_cache_count++] = cache[i];
+				}
+			}
+
+			for (int i = 0; i < new_cache_count; ++i)
+			{
+				const uint32_t vertex = new_cache[i];
+
+				cache_positions[vertex] = i < k_mesh_optimize_forsyth_cache_size ? i : -1;
+				vertex_scores[vertex] = sp_mesh_optimize_forsyth_score(tables, cache_positions[vertex], remaining_triangle_counts[vertex]);
+			}
+
+			cache_count = std::min(new_cache_count, k_mesh_optimize_forsyth_cache_size);
+			for (int i = 0; i < cache_count; ++i)
+			{
+				cache[i] = new_cache[i];
+			}
+
+			// Only triangles touching a vertex whose score changed can have changed, and the next best is usually among them
+			best_triangle = k_mesh_optimize_invalid_index;
+			float best_score = -1.0f;
+
+			for (int i = 0; i < new_cache_count; ++i)
+			{
+				const uint32_t vertex = new_cache[i];
+				const uint32_t* vertex_triangles = &triangles[triangle_offsets[vertex]];
+
+				for (uint32_t j = 0; j < remaining_triangle_counts[vertex]; ++j)
+				{
+					const uint32_t candidate = vertex_triangles[j];
+					const uint32_t* candidate_triangle = &indices[candidate * 3];
+
+					triangle_scores[candidate] =
+						vertex_scores[candidate_triangle[0]] +
+						vertex_scores[candidate_triangle[1]] +
+						vertex_scores[candidate_triangle[2]];
+
+					if (triangle_scores[candidate] > best_score)
+					{
+						best_triangle = candidate;
+						best_score = triangle_scores[candidate];
+					}
+				}
+			}
+		}
+
+		indices.swap(result);
+	}
+
+	void sp_mesh_optimize_overdraw(std::vector<uint32_t>& indices, const std::vector<sp_mesh_vertex>& vertices, float threshold)
+	{
+		const size_t triangle_count = indices.size() / 3;
+
+		if (triangle_count < 2)
+		{
+			return;
+		}
+
+		std::vector<uint32_t> cache_timestamps(vertices.size(), 0);
+		uint32_t timestamp = k_mesh_optimize_fifo_cache_size + 1;
+
+		// Hard boundaries are where the cache order jumped somewhere new and missed on every vertex. Starting a cluster there
+		// costs nothing.
+		std::vector<uint32_t> hard_cluster_starts;
+		for (size_t i = 0; i < triangle_count; ++i)
+		{
+			if (sp_mesh_optimize_fifo_misses(&indices[i * 3], cache_timestamps, timestamp) == 3)
+			{
+				hard_cluster_starts.push_back(static_cast<uint32_t>(i));
+			}
+		}
+
+		hard_cluster_starts.push_back(static_cast<uint32_t>(triangle_count));
+
+		// Soft boundaries split hard clusters wherever the part so far is already as cheap as the whole cluster give or take the
+		// threshold, so starting cold again after it doesn't cost much
+		std::vector<uint32_t> cluster_starts;
+		for (size_t i = 0; i + 1 < hard_cluster_starts.size(); ++i)
+		{
+			const uint32_t start = hard_cluster_starts[i];
+			const uint32_t end = hard_cluster_starts[i + 1];
+
+			timestamp += k_mesh_optimize_fifo_cache_size + 1;
+
+			uint32_t cluster_miss_count = 0;
+			for (uint32_t j = start; j < end; ++j)
+			{
+				cluster_miss_count += sp_mesh_optimize_fifo_misses(&indices[j * 3], cache_timestamps, timestamp);
+			}
+
+			const float cluster_acmr_threshold = threshold * cluster_miss_count / (end - start);
+
+			const size_t first_cluster = cluster_starts.size();
+			cluster_starts.push_back(start);
+
+			timestamp += k_mesh_optimize_fifo_cache_size + 1;
+
+			uint32_t running_miss_count = 0;
+			uint32_t running_triangle_count = 0;
+
+			for (uint32_t j = start; j < end; ++j)
+			{
+				running_miss_count += sp_mesh_optimize_fifo_misses(&indices[j * 3], cache_timestamps, timestamp);
+				++running_triangle_count;
+
+				if (static_cast<float>(running_miss_count) / running_triangle_count <= cluster_acmr_threshold)
+				{
+					cluster_starts.push_back(j + 1);
+
+					timestamp += k_mesh_optimize_fifo_cache_size + 1;
+
+					running_miss_count = 0;
+					running_triangle_count = 0;
+				}
+			}
+
+			// Whatever is left at the end never got cheap enough on its own so it goes back into the cluster before it
+			if (cluster_starts.back() == end || (running_triangle_count > 0 && cluster_starts.size() - first_cluster > 1))
+			{
+				cluster_starts.pop_back();
+			}
+		}
+
+		cluster_starts.push_back(static_cast<uint32_t>(triangle_count));
+
+		// Clusters are sorted by how far out from the middle of the submesh they face, so outward facing ones draw first and
+		// occlude whatever is behind them. Centroids and normals are area weighted.
+		struct cluster
+		{
+			uint32_t start;
+			uint32_t end;
+			float sort_key;
+		};
+
+		const size_t cluster_count = cluster_starts.size() - 1;
+
+		std::vector<cluster> clusters(cluster_count);
+		std::vector<float> cluster_data(cluster_count * 7, 0.0f);		// Centroid times area, normal, area
+
+		float mesh_centroid[3] = {};
+		float mesh_area = 0.0f;
+
+		for (size_t i = 0; i < cluster_count; ++i)
+		{
+			clusters[i].start = cluster_starts[i];
+			clusters[i].end = cluster_starts[i + 1];
+
+			float* data = &cluster_data[i * 7];
+
+			for (uint32_t j = clusters[i].start; j < clusters[i].end; ++j)
+			{
+				const float* p0 = vertices[indices[j * 3]]._position;
+				const float* p1 = vertices[indices[j * 3 + 1]]._position;
+				const float* p2 = vertices[indices[j * 3 + 2]]._position;
+
+				const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+				const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+				const float normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+				const float area = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+				for (int k = 0; k < 3; ++k)
+				{
+					data[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * area;
+					data[3 + k] += normal[k];
+				}
+
+				data[6] += area;
+			}
+
+			for (int k = 0; k < 3; ++k)
+			{
+				mesh_centroid[k] += data[k];
+			}
+
+			mesh_area += data[6];
+		}
+
+		if (mesh_area > 0.0f)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				mesh_centroid[k] /= mesh_area;
+			}
+		}
+
+		for (size_t i = 0; i < cluster_count; ++i)
+		{
+			const float* data = &cluster_data[i * 7];
+
+			const float normal_length = sqrtf(data[3] * data[3] + data[4] * data[4] + data[5] * data[5]);
+
+			clusters[i].sort_key = 0.0f;
+
+			if (data[6] > 0.0f && normal_length > 0.0f)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					clusters[i].sort_key += (data[k] / data[6] - mesh_centroid[k]) * data[3 + k] / normal_length;
+				}
+			}
+		}
+
+		std::stable_sort(clusters.begin(), clusters.end(), [](const cluster& a, const cluster& b) {
+			return a.sort_key > b.sort_key;
+		});
+
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+
+		for (const cluster& cluster : clusters)
+		{
+			result.insert(result.end(), indices.begin() + cluster.start * 3, indices.begin() + cluster.end * 3);
+		}
+
+		indices.swap(result);
+	}
+
+	// Also drops any vertex nothing uses
+	void sp_mesh_optimize_vertex_fetch(std::vector<sp_mesh_vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		std::vector<uint32_t> remap(vertices.size(), k_mesh_optimize_invalid_index);
+
+		std::vector<sp_mesh_vertex> fetched;
+		fetched.reserve(vertices.size());
+
+		for (uint32_t& index : indices)
+		{
+			if (remap[index] == k_mesh_optimize_invalid_index)
+			{
+				remap[index] = static_cast<uint32_t>(fetched.size());
+				fetched.push_back(vertices[index]);
+			}
+
+			index = remap[index];
+		}
+
+		vertices.swap(fetched);
+	}
+}
+
+sp_mesh_vertex_cache_stats sp_mesh_analyze_vertex_cache(const sp_mesh& mesh)
+{
+	sp_mesh_vertex_cache_stats stats;
+
+	std::vector<uint32_t> cache_timestamps;
+
+	// Every submesh is its own draw so each one starts with a cold cache
+	for (const sp_mesh_submesh& submesh : mesh._submeshes)
+	{
+		cache_timestamps.assign(submesh._vertex_count, 0);
+		uint32_t timestamp = k_mesh_optimize_fifo_cache_size + 1;
+
+		const uint32_t* indices = mesh._indices.data() + submesh._first_index;
+
+		for (uint32_t i = 0; i + 2 < submesh._index_count; i += 3)
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				if (cache_timestamps[indices[i + j]] == 0)
+				{
+					++stats._vertex_count;
+				}
+			}
+
+			stats._miss_count += detail::sp_mesh_optimize_fifo_misses(&indices[i], cache_timestamps, timestamp);
+			++stats._triangle_count;
+		}
+	}
+
+	stats._acmr = stats._triangle_count > 0 ? static_cast<float>(stats._miss_count) / stats._triangle_count : 0.0f;
+	stats._atvr = stats._vertex_count > 0 ? static_cast<float>(stats._miss_count) / stats._vertex_count : 0.0f;
+
+	return stats;
+}
+
+void sp_mesh_optimize(sp_mesh& mesh, const sp_mesh_optimize_desc& desc)
+{
+	std::vector<sp_mesh_vertex> vertices;
+	vertices.reserve(mesh._vertices.size());
+
+	std::vector<uint32_t> indices;
+	indices.reserve(mesh._indices.size());
+
+	std::vector<sp_mesh_vertex> submesh_vertices;
+	std::vector<uint32_t> submesh_indices;
+
+	for (sp_mesh_submesh& submesh : mesh._submeshes)
+	{
+		submesh_vertices.assign(mesh._vertices.begin() + submesh._base_vertex, mesh._vertices.begin() + submesh._base_vertex + submesh._vertex_count);
+		submesh_indices.assign(mesh._indices.begin() + submesh._first_index, mesh._indices.begin() + submesh._first_index + submesh._index_count);
+
+		if (desc.weld)
+		{
+			detail::sp_mesh_optimize_weld(submesh_vertices, submesh_indices);
+		}
+
+		if (desc.vertex_cache)
+		{
+			detail::sp_mesh_optimize_vertex_cache(submesh_indices, submesh_vertices.size());
+		}
+
+		if (desc.overdraw)
+		{
+			detail::sp_mesh_optimize_overdraw(submesh_indices, submesh_vertices, desc.overdraw_threshold);
+		}
+
+		if (desc.vertex_fetch)
+		{
+			detail::sp_mesh_optimize_vertex_fetch(submesh_vertices, submesh_indices);
+		}
+
+		submesh._first_index = static_cast<uint32_t>(indices.size());
+		submesh._index_count = static_cast<uint32_t>(submesh_indices.size());
+		submesh._base_vertex = static_cast<uint32_t>(vertices.size());
+		submesh._vertex_count = static_cast<uint32_t>(submesh_vertices.size());
+
+		vertices.insert(vertices.end(), submesh_vertices.begin(), submesh_vertices.end());
+		indices.insert(indices.end(), submesh_indices.begin(), submesh_indices.end());
+	}
+
+	mesh._vertices.swap(vertices);
+	mesh._indices.swap(indices);
+
+	// They'd point at vertices and triangles that have moved
+	mesh._lods.clear();
+	mesh._meshlets.clear();
+	mesh._meshlet_vertices.clear();
+	mesh._meshlet_triangles.clear();
+
+	for (sp_mesh_submesh& submesh : mesh._submeshes)
+	{
+		submesh._first_meshlet = 0;
+		submesh._meshlet_count = 0;
+		submesh._first_lod = 0;
+		submesh._lod_count = 0;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <cstdint>
+#include <vector>
+
+// Packs the float vertices of a model into the compact vertex stream that's cooked and uploaded:
+//
+// - Positions as 16 bit unorm inside the bounds of the whole model. The shader gets them back with a scale and offset.
+// - Normals octahedral encoded in two snorm components, 16 bit by default or 8 bit if that's close enough.
+// - Texcoords as halfs unless that loses more than the error allowed, e.g. tiled UVs far from zero, which stay floats.
+// - Colors as 8 bit unorm, or dropped if they're the same everywhere so the constant can go into the material instead.
+//
+// Attributes are laid out in that order with no gaps so a D3D12 input layout using D3D12_APPEND_ALIGNED_ELEMENT matches it.
+// The formats are all ones the input assembler converts to float on its own, so only positions and normals need decoding.
+
+enum class sp_mesh_attribute_format : uint32_t
+{
+	none,
+	float32x2,
+	float32x3,
+	float16x2,
+	unorm16x4,
+	snorm16x2,
+	snorm8x2,
+	unorm8x4,
+};
+
+struct sp_mesh_vertex_format
+{
+	sp_mesh_attribute_format _position = sp_mesh_attribute_format::unorm16x4;
+	sp_mesh_attribute_format _texcoord = sp_mesh_attribute_format::float16x2;
+	sp_mesh_attribute_format _color = sp_mesh_attribute_format::none;
+	sp_mesh_attribute_format _normal = sp_mesh_attribute_format::snorm16x2;
+	uint32_t _stride_bytes = 0;
+
+	// Object space position is offset + scale * the decoded unorm position
+	float _position_scale[3] = { 1.0f, 1.0f, 1.0f };
+	float _position_offset[3] = { 0.0f, 0.0f, 0.0f };
+
+	// Every vertex's color when _color is none
+	float _color_constant[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+};
+
+struct sp_mesh_quantize_desc
+{
+	sp_mesh_attribute_format normal_format = sp_mesh_attribute_format::snorm16x2;		// Or snorm8x2
+	float texcoord_error_max = 1.0f / 4096.0f;		// Halfs are exact to this over [0, 1]
+};
+
+// How far the decoded vertices are from the float ones, worst case over the model
+struct sp_mesh_quantize_report
+{
+	float _position_error_max = 0.0f;				// In object space units
+	float _position_error_max_relative = 0.0f;		// To the largest side of the bounds
+	float _normal_error_max_degrees = 0.0f;
+	float _texcoord_error_max = 0.0f;
+	float _color_error_max = 0.0f;
+};
+
+struct sp_mesh_quantized_vertices
+{
+	sp_mesh_vertex_format _format;
+	std::vector<uint8_t> _data;		// _stride_bytes per vertex, same order as the mesh's vertices
+};
+
+sp_mesh_quantized_vertices sp_mesh_quantize(const sp_mesh& mesh, const sp_mesh_quantize_desc& desc, sp_mesh_quantize_report* report = nullptr);
+
+// 0 for none
+uint32_t sp_mesh_attribute_format_get_size_bytes(sp_mesh_attribute_format format);
+
+// Straight back to floats, for tools and for checking the error
+sp_mesh_vertex sp_mesh_vertex_format_decode(const sp_mesh_vertex_format& format, const uint8_t* vertex);
+
+// Replaces the mesh's vertices with the decoded ones and fits the submesh bounds around them, so anything worked out from them
+// afterwards, like meshlet bounds, fits what the GPU draws rather than what was imported
+void sp_mesh_dequantize(sp_mesh& mesh, const sp_mesh_quantized_vertices& vertices);
\ No newline at end of file
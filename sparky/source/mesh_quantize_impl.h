@@ -0,0 +1,431 @@
+#pragma once
+
+#include "mesh_quantize.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace detail
+{
+	// Round to nearest even, clamped to the largest finite half. Denormals are kept since texcoords near zero land there.
+	uint16_t sp_mesh_quantize_float_to_half(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		const uint32_t sign = (bits >> 16) & 0x8000;
+		const uint32_t abs_bits = bits & 0x7FFFFFFF;
+
+		// 65520 and up rounds to infinity
+		if (abs_bits >= 0x477FF000)
+		{
+			return static_cast<uint16_t>(sign | 0x7BFF);
+		}
+
+		// Below the smallest normal half the float is scaled so its mantissa lines up with the half's and the FPU rounds it
+		if (abs_bits < 0x38800000)
+		{
+			float abs_value;
+			memcpy(&abs_value, &abs_bits, sizeof(abs_value));
+
+			return static_cast<uint16_t>(sign | static_cast<uint32_t>(nearbyintf(abs_value * 16777216.0f)));
+		}
+
+		const uint32_t rebiased = abs_bits - ((127 - 15) << 23);
+		const uint32_t rounded = rebiased + 0xFFF + ((rebiased >> 13) & 1);
+
+		return static_cast<uint16_t>(sign | (rounded >> 13));
+	}
+
+	float sp_mesh_quantize_half_to_float(uint16_t value)
+	{
+		const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+		const uint32_t exponent = (value >> 10) & 0x1F;
+		const uint32_t mantissa = value & 0x3FF;
+
+		float result;
+
+		if (exponent == 0)
+		{
+			result = mantissa / 16777216.0f;
+			return sign ? -result : result;
+		}
+
+		const uint32_t bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+		memcpy(&result, &bits, sizeof(result));
+
+		return result;
+	}
+
+	float sp_mesh_quantize_snorm_to_float(int value, int bits)
+	{
+		return std::max(static_cast<float>(value) / ((1 << (bits - 1)) - 1), -1.0f);
+	}
+
+	void sp_mesh_quantize_oct_decode(float x, float y, float normal[3])
+	{
+		normal[0] = x;
+		normal[1] = y;
+		normal[2] = 1.0f - fabsf(x) - fabsf(y);
+
+		if (normal[2] < 0.0f)
+		{
+			normal[0] = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			normal[1] = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		}
+
+		const float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+		normal[0] /= length;
+		normal[1] /= length;
+		normal[2] /= length;
+	}
+
+	// Projects onto the octahedron and unfolds the lower half, then tries the four codes around the projection and keeps whichever
+	// decodes closest, which halves the worst case error of plain rounding
+	void sp_mesh_quantize_oct_encode(const float normal[3], int bits, int encoded[2])
+	{
+		const float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+
+		if (length == 0.0f)
+		{
+			encoded[0] = 0;
+			encoded[1] = 0;
+			return;
+		}
+
+		float x = normal[0] / length;
+		float y = normal[1] / length;
+
+		if (normal[2] < 0.0f)
+		{
+			const float folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			const float folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = folded_x;
+			y = folded_y;
+		}
+
+		const int max = (1 << (bits - 1)) - 1;
+
+		const float unit_length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		float best_dot = -2.0f;
+
+		for (int i = 0; i < 4; ++i)
+		{
+			const int candidate_x = std::min(std::max(static_cast<int>(i & 1 ? ceilf(x * max) : floorf(x * max)), -max), max);
+			const int candidate_y = std::min(std::max(static_cast<int>(i & 2 ? ceilf(y * max) : floorf(y * max)), -max), max);
+
+			float decoded[3];
+			sp_mesh_quantize_oct_decode(sp_mesh_quantize_snorm_to_float(candidate_x, bits), sp_mesh_quantize_snorm_to_float(candidate_y, bits), decoded);
+
+			const float dot = (decoded[0] * normal[0] + decoded[1] * normal[1] + decoded[2] * normal[2]) / unit_length;
+
+			if (dot > best_dot)
+			{
+				best_dot = dot;
+				encoded[0] = candidate_x;
+				encoded[1] = candidate_y;
+			}
+		}
+	}
+
+	uint32_t sp_mesh_quantize_unorm(float value, int bits)
+	{
+		const float max = static_cast<float>((1u << bits) - 1);
+
+		return static_cast<uint32_t>(std::min(std::max(value, 0.0f), 1.0f) * max + 0.5f);
+	}
+
+	void sp_mesh_quantize_init_offsets(const sp_mesh_vertex_format& format, uint32_t offsets_bytes[4])
+	{
+		const sp_mesh_attribute_format formats[4] = { format._position, format._texcoord, format._color, format._normal };
+
+		uint32_t offset_bytes = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			offsets_bytes[i] = offset_bytes;
+			offset_bytes += sp_mesh_attribute_format_get_size_bytes(formats[i]);
+		}
+	}
+}
+
+uint32_t sp_mesh_attribute_format_get_size_bytes(sp_mesh_attribute_format format)
+{
+	switch (format)
+	{
+	case sp_mesh_attribute_format::none:      return 0;
+	case sp_mesh_attribute_format::float32x2: return 8;
+	case sp_mesh_attribute_format::float32x3: return 12;
+	case sp_mesh_attribute_format::float16x2: return 4;
+	case sp_mesh_attribute_format::unorm16x4: return 8;
+	case sp_mesh_attribute_format::snorm16x2: return 4;
+	case sp_mesh_attribute_format::snorm8x2:  return 2;
+	case sp_mesh_attribute_format::unorm8x4:  return 4;
+	};
+
+	assert(false);
+
+	return 0;
+}
+
+sp_mesh_vertex sp_mesh_vertex_format_decode(const sp_mesh_vertex_format& format, const uint8_t* vertex)
+{
+	uint32_t offsets_bytes[4];
+	detail::sp_mesh_quantize_init_offsets(format, offsets_bytes);
+
+	sp_mesh_vertex decoded = {};
+
+	{
+		assert(format._position == sp_mesh_attribute_format::unorm16x4);
+
+		uint16_t position[4];
+		memcpy(position, vertex + offsets_bytes[0], sizeof(position));
+
+		for (int i = 0; i < 3; ++i)
+		{
+			decoded._position[i] = format._position_offset[i] + format._position_scale[i] * (position[i] / 65535.0f);
+		}
+	}
+
+	if (format._texcoord == sp_mesh_attribute_format::float16x2)
+	{
+		uint16_t texcoord[2];
+		memcpy(texcoord, vertex + offsets_bytes[1], sizeof(texcoord));
+
+		decoded._texcoord[0] = detail::sp_mesh_quantize_half_to_float(texcoord[0]);
+		decoded._texcoord[1] = detail::sp_mesh_quantize_half_to_float(texcoord[1]);
+	}
+	else
+	{
+		assert(format._texcoord == sp_mesh_attribute_format::float32x2);
+
+		memcpy(decoded._texcoord, vertex + offsets_bytes[1], sizeof(decoded._texcoord));
+	}
+
+	if (format._color == sp_mesh_attribute_format::unorm8x4)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			decoded._color[i] = vertex[offsets_bytes[2] + i] / 255.0f;
+		}
+	}
+	else
+	{
+		assert(format._color == sp_mesh_attribute_format::none);
+
+		memcpy(decoded._color, format._color_constant, sizeof(decoded._color));
+	}
+
+	if (format._normal == sp_mesh_attribute_format::snorm16x2)
+	{
+		int16_t normal[2];
+		memcpy(normal, vertex + offsets_bytes[3], sizeof(normal));
+
+		detail::sp_mesh_quantize_oct_decode(detail::sp_mesh_quantize_snorm_to_float(normal[0], 16), detail::sp_mesh_quantize_snorm_to_float(normal[1], 16), decoded._normal);
+	}
+	else
+	{
+		assert(format._normal == sp_mesh_attribute_format::snorm8x2);
+
+		int8_t normal[2];
+		memcpy(normal, vertex + offsets_bytes[3], sizeof(normal));
+
+		detail::sp_mesh_quantize_oct_decode(detail::sp_mesh_quantize_snorm_to_float(normal[0], 8), detail::sp_mesh_quantize_snorm_to_float(normal[1], 8), decoded._normal);
+	}
+
+	return decoded;
+}
+
+sp_mesh_quantized_vertices sp_mesh_quantize(const sp_mesh& mesh, const sp_mesh_quantize_desc& desc, sp_mesh_quantize_report* report)
+{
+	assert(desc.normal_format == sp_mesh_attribute_format::snorm16x2 || desc.normal_format == sp_mesh_attribute_format::snorm8x2);
+
+	sp_mesh_quantized_vertices quantized;
+	sp_mesh_vertex_format& format = quantized._format;
+
+	format._normal = desc.normal_format;
+
+	// Bounds of the whole model so every submesh shares the one scale and offset
+	float bounds_min[3] = { INFINITY, INFINITY, INFINITY };
+	float bounds_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+	for (const sp_mesh_vertex& vertex : mesh._vertices)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			bounds_min[i] = std::min(bounds_min[i], vertex._position[i]);
+			bounds_max[i] = std::max(bounds_max[i], vertex._position[i]);
+		}
+	}
+
+	if (!mesh._vertices.empty())
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			format._position_offset[i] = bounds_min[i];
+			format._position_scale[i] = bounds_max[i] - bounds_min[i];
+		}
+	}
+
+	// Halfs unless any texcoord would move further than allowed
+	for (const sp_mesh_vertex& vertex : mesh._vertices)
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			const float decoded = detail::sp_mesh_quantize_half_to_float(detail::sp_mesh_quantize_float_to_half(vertex._texcoord[i]));
+
+			if (!(fabsf(decoded - vertex._texcoord[i]) <= desc.texcoord_error_max))
+			{
+				format._texcoord = sp_mesh_attribute_format::float32x2;
+			}
+		}
+	}
+
+	if (!mesh._vertices.empty())
+	{
+		format._color = sp_mesh_attribute_format::none;
+		memcpy(format._color_constant, mesh._vertices[0]._color, sizeof(format._color_constant));
+
+		for (const sp_mesh_vertex& vertex : mesh._vertices)
+		{
+			if (memcmp(vertex._color, format._color_constant, sizeof(format._color_constant)) != 0)
+			{
+				format._color = sp_mesh_attribute_format::unorm8x4;
+				break;
+			}
+		}
+	}
+
+	uint32_t offsets_bytes[4];
+	detail::sp_mesh_quantize_init_offsets(format, offsets_bytes);
+
+	// Every format is at least two bytes and the two byte one is always last, but D3D12 wants strides in whole dwords
+	format._stride_bytes = (offsets_bytes[3] + sp_mesh_attribute_format_get_size_bytes(format._normal) + 3) & ~3u;
+
+	quantized._data.resize(mesh._vertices.size() * format._stride_bytes, 0);
+
+	const int normal_bits = format._normal == sp_mesh_attribute_format::snorm16x2 ? 16 : 8;
+
+	for (size_t i = 0; i < mesh._vertices.size(); ++i)
+	{
+		const sp_mesh_vertex& vertex = mesh._vertices[i];
+		uint8_t* data = &quantized._data[i * format._stride_bytes];
+
+		{
+			uint16_t position[4] = {};
+			for (int j = 0; j < 3; ++j)
+			{
+				const float normalized = format._position_scale[j] > 0.0f ? (vertex._position[j] - format._position_offset[j]) / format._position_scale[j] : 0.0f;
+				position[j] = static_cast<uint16_t>(detail::sp_mesh_quantize_unorm(normalized, 16));
+			}
+
+			memcpy(data + offsets_bytes[0], position, sizeof(position));
+		}
+
+		if (format._texcoord == sp_mesh_attribute_format::float16x2)
+		{
+			const uint16_t texcoord[2] = {
+				detail::sp_mesh_quantize_float_to_half(vertex._texcoord[0]),
+				detail::sp_mesh_quantize_float_to_half(vertex._texcoord[1]),
+			};
+
+			memcpy(data + offsets_bytes[1], texcoord, sizeof(texcoord));
+		}
+		else
+		{
+			memcpy(data + offsets_bytes[1], vertex._texcoord, sizeof(vertex._texcoord));
+		}
+
+		if (format._color == sp_mesh_attribute_format::unorm8x4)
+		{
+			for (int j = 0; j < 4; ++j)
+			{
+				data[offsets_bytes[2] + j] = static_cast<uint8_t>(detail::sp_mesh_quantize_unorm(vertex._color[j], 8));
+			}
+		}
+
+		{
+			int normal[2];
+			detail::sp_mesh_quantize_oct_encode(vertex._normal, normal_bits, normal);
+
+			if (normal_bits == 16)
+			{
+				const int16_t normal_snorm[2] = { static_cast<int16_t>(normal[0]), static_cast<int16_t>(normal[1]) };
+				memcpy(data + offsets_bytes[3], normal_snorm, sizeof(normal_snorm));
+			}
+			else
+			{
+				const int8_t normal_snorm[2] = { static_cast<int8_t>(normal[0]), static_cast<int8_t>(normal[1]) };
+				memcpy(data + offsets_bytes[3], normal_snorm, sizeof(normal_snorm));
+			}
+		}
+	}
+
+	if (report)
+	{
+		*report = sp_mesh_quantize_report();
+
+		for (size_t i = 0; i < mesh._vertices.size(); ++i)
+		{
+			const sp_mesh_vertex& vertex = mesh._vertices[i];
+			const sp_mesh_vertex decoded = sp_mesh_vertex_format_decode(format, &quantized._data[i * format._stride_bytes]);
+
+			float normal_length = 0.0f;
+			float normal_dot = 0.0f;
+
+			for (int j = 0; j < 3; ++j)
+			{
+				report->_position_error_max = std::max(report->_position_error_max, fabsf(decoded._position[j] - vertex._position[j]));
+				normal_length += vertex._normal[j] * vertex._normal[j];
+				normal_dot += vertex._normal[j] * decoded._normal[j];
+			}
+
+			if (normal_length > 0.0f)
+			{
+				const float angle = acosf(std::min(std::max(normal_dot / sqrtf(normal_length), -1.0f), 1.0f));
+				report->_normal_error_max_degrees = std::max(report->_normal_error_max_degrees, angle * (180.0f / 3.14159265f));
+			}
+
+			for (int j = 0; j < 2; ++j)
+			{
+				report->_texcoord_error_max = std::max(report->_texcoord_error_max, fabsf(decoded._texcoord[j] - vertex._texcoord[j]));
+			}
+
+			for (int j = 0; j < 4; ++j)
+			{
+				report->_color_error_max = std::max(report->_color_error_max, fabsf(decoded._color[j] - vertex._color[j]));
+			}
+		}
+
+		const float extent = std::max(std::max(format._position_scale[0], format._position_scale[1]), format._position_scale[2]);
+		report->_position_error_max_relative = extent > 0.0f ? report->_position_error_max / extent : 0.0f;
+	}
+
+	return quantized;
+}
+
+void sp_mesh_dequantize(sp_mesh& mesh, const sp_mesh_quantized_vertices& vertices)
+{
+	assert(vertices._data.size() == mesh._vertices.size() * vertices._format._stride_bytes);
+
+	for (size_t i = 0; i < mesh._vertices.size(); ++i)
+	{
+		mesh._vertices[i] = sp_mesh_vertex_format_decode(vertices._format, &vertices._data[i * vertices._format._stride_bytes]);
+	}
+
+	// Rounding can move a vertex a little past the bounds it was imported with
+	for (sp_mesh_submesh& submesh : mesh._submeshes)
+	{
+		for (uint32_t i = 0; i < submesh._vertex_count; ++i)
+		{
+			const sp_mesh_vertex& vertex = mesh._vertices[submesh._base_vertex + i];
+			for (int k = 0; k < 3; ++k)
+			{
+				submesh._bounds_min[k] = i > 0 ? std::min(submesh._bounds_min[k], vertex._position[k]) : vertex._position[k];
+				submesh._bounds_max[k] = i > 0 ? std::max(submesh._bounds_max[k], vertex._position[k]) : vertex._position[k];
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "handle.h"
 #include "texture.h"
 #include "shader.h"
+#include "mesh_quantize.h"
 
 #define NOMINMAX
 #include <d3d12.h>
@@ -14,6 +15,8 @@ struct sp_input_element_desc
 	const char* _semantic_name = nullptr;
 	unsigned _semantic_index = 0;
 	DXGI_FORMAT _format = DXGI_FORMAT_UNKNOWN;
+	unsigned _input_slot = 0;				// Which of the vertex buffers set on the command list it's read from
+	unsigned _instance_step_rate = 0;		// 0 for per vertex data, otherwise how many instances each element is drawn for
 };
 
 enum class sp_rasterizer_cull_face
@@ -89,5 +92,12 @@ namespace detail
 sp_graphics_pipeline_state_handle sp_graphics_pipeline_state_create(const char* name, const sp_graphics_pipeline_state_desc& desc);
 void sp_graphics_pipeline_state_destroy(const sp_graphics_pipeline_state_handle& pipeline_state_handle);
 
+// Fills in the input layout for vertices quantized by mesh_quantize.h. Attributes are POSITION, TEXCOORD, COLOR if the format
+// kept it and NORMAL, each in whatever format the vertices were packed with.
+void sp_graphics_pipeline_state_desc_set_input_layout(sp_graphics_pipeline_state_desc& desc, const sp_mesh_vertex_format& vertex_format);
+
+// Adds elements after the ones already in the layout, like a per instance stream in another slot after the vertices
+void sp_graphics_pipeline_state_desc_append_input_layout(sp_graphics_pipeline_state_desc& desc, const sp_input_element_desc* input_elements, int input_element_count);
+
 sp_compute_pipeline_state_handle sp_compute_pipeline_state_create(const char* name, const sp_compute_pipeline_state_desc& desc);
 void sp_compute_pipeline_state_destroy(const sp_graphics_pipeline_state_handle& pipeline_state_handle);
\ No newline at end of file
@@ -9,6 +9,8 @@
 #include "d3dx12.h"
 
 #include <array>
+#include <cassert>
+#include <utility>
 
 #define NOMINMAX
 #include <d3d12.h>
@@ -75,7 +77,14 @@ namespace detail
 			input_element_desc[input_element_count].SemanticName = desc.input_layout[input_element_count]._semantic_name;
 			input_element_desc[input_element_count].SemanticIndex = desc.input_layout[input_element_count]._semantic_index;
 			input_element_desc[input_element_count].Format = desc.input_layout[input_element_count]._format;
+			input_element_desc[input_element_count].InputSlot = desc.input_layout[input_element_count]._input_slot;
+			// Appended after the previous element in the same slot
 			input_element_desc[input_element_count].AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
+			if (desc.input_layout[input_element_count]._instance_step_rate > 0)
+			{
+				input_element_desc[input_element_count].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA;
+				input_element_desc[input_element_count].InstanceDataStepRate = desc.input_layout[input_element_count]._instance_step_rate;
+			}
 		}
 
 		const sp_vertex_shader& vertex_shader = detail::sp_vertex_shader_pool_get(desc.vertex_shader_handle);
@@ -138,6 +147,9 @@ namespace detail
 		pipeline_state_desc_d3d12.NumRenderTargets = render_target_count;
 		pipeline_state_desc_d3d12.SampleDesc.Count = 1;
 
+		// When reloading, the GPU could still be using the old one
+		detail::sp_deferred_release(std::move(pipeline_state->_pipeline_d3d12));
+
 		HRESULT hr = _sp._device->CreateGraphicsPipelineState(&pipeline_state_desc_d3d12, IID_PPV_ARGS(&pipeline_state->_pipeline_d3d12));
 		assert(SUCCEEDED(hr));
 
@@ -200,11 +212,75 @@ void sp_graphics_pipeline_state_destroy(const sp_graphics_pipeline_state_handle&
 	sp_graphics_pipeline_state& pipeline_state = detail::resource_pools::graphics_pipelines[pipeline_state_handle.index];
 
 	pipeline_state._name = nullptr;
-	pipeline_state._pipeline_d3d12.Reset();
+	detail::sp_deferred_release(std::move(pipeline_state._pipeline_d3d12));
 
 	sp_handle_free(&detail::resource_pools::graphics_pipeline_handles, pipeline_state_handle);
 }
 
+namespace detail
+{
+	DXGI_FORMAT sp_mesh_attribute_format_get_dxgi_format(sp_mesh_attribute_format format)
+	{
+		switch (format)
+		{
+		case sp_mesh_attribute_format::none:      return DXGI_FORMAT_UNKNOWN;
+		case sp_mesh_attribute_format::float32x2: return DXGI_FORMAT_R32G32_FLOAT;
+		case sp_mesh_attribute_format::float32x3: return DXGI_FORMAT_R32G32B32_FLOAT;
+		case sp_mesh_attribute_format::float16x2: return DXGI_FORMAT_R16G16_FLOAT;
+		case sp_mesh_attribute_format::unorm16x4: return DXGI_FORMAT_R16G16B16A16_UNORM;
+		case sp_mesh_attribute_format::snorm16x2: return DXGI_FORMAT_R16G16_SNORM;
+		case sp_mesh_attribute_format::snorm8x2:  return DXGI_FORMAT_R8G8_SNORM;
+		case sp_mesh_attribute_format::unorm8x4:  return DXGI_FORMAT_R8G8B8A8_UNORM;
+		};
+
+		assert(false);
+
+		return DXGI_FORMAT_UNKNOWN;
+	}
+}
+
+void sp_graphics_pipeline_state_desc_set_input_layout(sp_graphics_pipeline_state_desc& desc, const sp_mesh_vertex_format& vertex_format)
+{
+	// Same order as mesh_quantize.h packs them since the offsets are appended
+	const std::pair<const char*, sp_mesh_attribute_format> attributes[] = {
+		{ "POSITION", vertex_format._position },
+		{ "TEXCOORD", vertex_format._texcoord },
+		{ "COLOR", vertex_format._color },
+		{ "NORMAL", vertex_format._normal },
+	};
+
+	int input_element_count = 0;
+
+	for (const auto& attribute : attributes)
+	{
+		if (attribute.second != sp_mesh_attribute_format::none)
+		{
+			desc.input_layout[input_element_count++] = { attribute.first, 0, detail::sp_mesh_attribute_format_get_dxgi_format(attribute.second) };
+		}
+	}
+
+	for (; input_element_count < D3D12_STANDARD_VERTEX_ELEMENT_COUNT; ++input_element_count)
+	{
+		desc.input_layout[input_element_count] = sp_input_element_desc();
+	}
+}
+
+void sp_graphics_pipeline_state_desc_append_input_layout(sp_graphics_pipeline_state_desc& desc, const sp_input_element_desc* input_elements, int input_element_count)
+{
+	int first_free = 0;
+	while (first_free < D3D12_STANDARD_VERTEX_ELEMENT_COUNT && desc.input_layout[first_free]._semantic_name)
+	{
+		++first_free;
+	}
+
+	assert(first_free + input_element_count <= D3D12_STANDARD_VERTEX_ELEMENT_COUNT);
+
+	for (int i = 0; i < input_element_count; ++i)
+	{
+		desc.input_layout[first_free + i] = input_elements[i];
+	}
+}
+
 namespace detail
 {
 	void sp_compute_pipeline_state_init(const char* name, const sp_compute_pipeline_state_desc& desc, sp_compute_pipeline_state* pipeline_state)
@@ -212,6 +288,9 @@ namespace detail
 		D3D12_COMPUTE_PIPELINE_STATE_DESC pipeline_state_desc_d3d12 = {};
 		pipeline_state_desc_d3d12.pRootSignature = detail::_sp._root_signature.Get();
 		pipeline_state_desc_d3d12.CS = CD3DX12_SHADER_BYTECODE(detail::sp_compute_shader_pool_get(desc.compute_shader_handle)._blob.Get());
+		// When reloading, the GPU could still be using the old one
+		detail::sp_deferred_release(std::move(pipeline_state->_impl));
+
 		HRESULT hr = detail::_sp._device->CreateComputePipelineState(&pipeline_state_desc_d3d12, IID_PPV_ARGS(&pipeline_state->_impl));
 		assert(SUCCEEDED(hr));
 
@@ -252,7 +331,7 @@ void sp_compute_pipeline_state_destroy(const sp_graphics_pipeline_state_handle&
 	sp_compute_pipeline_state& pipeline_state = detail::resource_pools::compute_pipelines[pipeline_state_handle.index];
 
 	pipeline_state._name = nullptr;
-	pipeline_state._impl.Reset();
+	detail::sp_deferred_release(std::move(pipeline_state._impl));
 
 	sp_handle_free(&detail::resource_pools::compute_pipeline_handles, pipeline_state_handle);
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Draws pushed as a 64 bit sort key and a payload, typically the index of whatever the draw was made from, then sorted so they
+// can be recorded in key order instead of the order they were pushed in.
+//
+// Keys are built from the most significant bits down (Ericson, "Order your graphics draw calls around!"):
+//
+// - The pass, so everything in one pass comes before the next.
+// - Opaque draws then sort by pipeline state and material, the things that are expensive to change, and by depth last so draws
+//   sharing state go front to back for early depth rejection.
+// - Transparent draws sort by depth first, back to front so they blend in the right order, with state only breaking ties.
+//
+// Depth is bucketed by keeping the top bits of the float, which sort like the floats themselves as long as they're positive.
+// Buckets are finer close to the camera where it matters more.
+//
+// Sorting is a least significant digit radix sort, 11 bits at a time. Digits every key has the same value for are skipped,
+// which can be the pass and pipeline bits when there are only a few of them. Big queues split each digit's histogram and
+// scatter into blocks that run as jobs, with each block's offsets worked out from the histograms of the blocks before it so
+// the result is stable and the same whatever the worker count.
+
+const int k_render_queue_pass_bits = 4;
+const int k_render_queue_pipeline_bits = 12;
+const int k_render_queue_material_bits = 24;
+const int k_render_queue_depth_bits = 24;
+
+// Queues with fewer items than this are sorted by comparison instead
+const int k_render_queue_radix_item_count_min = 1024;
+
+// Queues with fewer items than this are sorted on the calling thread since the jobs would cost more than they save
+const int k_render_queue_parallel_item_count_min = 64 * 1024;
+
+enum class sp_render_queue_depth_order
+{
+	front_to_back,		// For opaque draws, after state
+	back_to_front,		// For transparent draws, before state
+};
+
+struct sp_render_queue_item
+{
+	uint64_t _key = 0;
+	uint32_t _payload = 0;
+};
+
+struct sp_render_queue_sort_desc
+{
+	bool parallel = true;		// Blocks go to the job system, which has to be running, or run one after the other on this thread
+};
+
+struct sp_render_queue
+{
+	std::vector<sp_render_queue_item> _items;
+	std::vector<sp_render_queue_item> _scratch;		// Every digit scatters from one to the other
+};
+
+// Pass, pipeline and material are truncated to their bits. Depth is the distance from the camera, negative counts as 0.
+uint64_t sp_render_queue_key(uint32_t pass, uint32_t pipeline, uint32_t material, float depth, sp_render_queue_depth_order depth_order);
+
+// A front to back key without its depth, for telling whether two opaque draws share all their state and could be drawn together
+uint64_t sp_render_queue_key_state(uint64_t key);
+
+// Keeps the memory
+void sp_render_queue_clear(sp_render_queue& queue);
+
+void sp_render_queue_push(sp_render_queue& queue, uint64_t key, uint32_t payload);
+
+// Sorts the items by key. Items with the same key stay in the order they were pushed.
+void sp_render_queue_sort(sp_render_queue& queue, const sp_render_queue_sort_desc& desc);
\ No newline at end of file
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "render_queue.h"
+#include "job.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+namespace detail
+{
+	// Six digits for 64 bits, with a histogram that still fits in L1 (Herf, "Radix Tricks")
+	const int k_render_queue_digit_bits = 11;
+	const int k_render_queue_digit_count = (64 + k_render_queue_digit_bits - 1) / k_render_queue_digit_bits;
+	const int k_render_queue_bucket_count = 1 << k_render_queue_digit_bits;
+
+	using sp_render_queue_histogram = std::array<uint32_t, k_render_queue_bucket_count>;
+
+	uint64_t sp_render_queue_bits(uint32_t value, int bit_count)
+	{
+		return value & ((1ull << bit_count) - 1);
+	}
+
+	uint32_t sp_render_queue_depth_bucket(float depth)
+	{
+		// Also catches NaN
+		if (!(depth > 0.0f))
+		{
+			return 0;
+		}
+
+		// The sign bit is always 0 so the bucket is the bits right under it
+		uint32_t bits;
+		memcpy(&bits, &depth, sizeof(bits));
+		return bits >> (31 - k_render_queue_depth_bits);
+	}
+
+	// Runs the function for every block, as jobs if there's more than one
+	void sp_render_queue_for_blocks(int block_count, const std::function<void(int block)>& function)
+	{
+		if (block_count > 1)
+		{
+			sp_job_parallel_for(block_count, 1, [&](int begin, int end) {
+				for (int block = begin; block < end; ++block)
+				{
+					function(block);
+				}
+			});
+		}
+		else
+		{
+			function(0);
+		}
+	}
+}
+
+uint64_t sp_render_queue_key(uint32_t pass, uint32_t pipeline, uint32_t material, float depth, sp_render_queue_depth_order depth_order)
+{
+	static_assert(k_render_queue_pass_bits + k_render_queue_pipeline_bits + k_render_queue_material_bits + k_render_queue_depth_bits == 64, "Keys are 64 bits");
+
+	const uint64_t pass_bits = detail::sp_render_queue_bits(pass, k_render_queue_pass_bits);
+	const uint64_t pipeline_bits = detail::sp_render_queue_bits(pipeline, k_render_queue_pipeline_bits);
+	const uint64_t material_bits = detail::sp_render_queue_bits(material, k_render_queue_material_bits);
+	const uint64_t depth_bits = detail::sp_render_queue_depth_bucket(depth);
+
+	uint64_t key = pass_bits << (64 - k_render_queue_pass_bits);
+
+	if (depth_order == sp_render_queue_depth_order::front_to_back)
+	{
+		key |= pipeline_bits << (k_render_queue_material_bits + k_render_queue_depth_bits);
+		key |= material_bits << k_render_queue_depth_bits;
+		key |= depth_bits;
+	}
+	else
+	{
+		// Flipping the bucket makes the farthest draws sort first
+		const uint64_t depth_flipped_bits = depth_bits ^ ((1ull << k_render_queue_depth_bits) - 1);
+
+		key |= depth_flipped_bits << (k_render_queue_pipeline_bits + k_render_queue_material_bits);
+		key |= pipeline_bits << k_render_queue_material_bits;
+		key |= material_bits;
+	}
+
+	return key;
+}
+
+uint64_t sp_render_queue_key_state(uint64_t key)
+{
+	return key & ~((1ull << k_render_queue_depth_bits) - 1);
+}
+
+void sp_render_queue_clear(sp_render_queue& queue)
+{
+	queue._items.clear();
+}
+
+void sp_render_queue_push(sp_render_queue& queue, uint64_t key, uint32_t payload)
+{
+	queue._items.push_back({ key, payload });
+}
+
+void sp_render_queue_sort(sp_render_queue& queue, const sp_render_queue_sort_desc& desc)
+{
+	const int item_count = static_cast<int>(queue._items.size());
+	if (item_count < 2)
+	{
+		return;
+	}
+
+	// Clearing the histograms alone would cost more than a comparison sort
+	if (item_count < k_render_queue_radix_item_count_min)
+	{
+		std::stable_sort(queue._items.begin(), queue._items.end(), [](const sp_render_queue_item& a, const sp_render_queue_item& b) {
+			return a._key < b._key;
+		});
+		return;
+	}
+
+	queue._scratch.resize(item_count);
+
+	const bool parallel = desc.parallel && item_count >= k_render_queue_parallel_item_count_min;
+	const int block_count = parallel ? std::max(sp_job_system_get_worker_count(), 1) : 1;
+
+	auto block_begin = [&](int block) {
+		return static_cast<int>(static_cast<int64_t>(item_count) * block / block_count);
+	};
+
+	// Bits that differ from the first key in any key. Digits with none of them set would leave the order as it is.
+	std::vector<uint64_t> block_varying_bits(block_count, 0);
+
+	detail::sp_render_queue_for_blocks(block_count, [&](int block) {
+		const uint64_t first_key = queue._items[0]._key;
+		uint64_t varying_bits = 0;
+		for (int i = block_begin(block); i < block_begin(block + 1); ++i)
+		{
+			varying_bits |= queue._items[i]._key ^ first_key;
+		}
+		block_varying_bits[block] = varying_bits;
+	});
+
+	uint64_t varying_bits = 0;
+	for (uint64_t bits : block_varying_bits)
+	{
+		varying_bits |= bits;
+	}
+
+	std::vector<detail::sp_render_queue_histogram> block_histograms(block_count);
+
+	for (int digit = 0; digit < detail::k_render_queue_digit_count; ++digit)
+	{
+		const int shift = digit * detail::k_render_queue_digit_bits;
+		if (((varying_bits >> shift) & (detail::k_render_queue_bucket_count - 1)) == 0)
+		{
+			continue;
+		}
+
+		const sp_render_queue_item* items = queue._items.data();
+		sp_render_queue_item* scratch = queue._scratch.data();
+
+		detail::sp_render_queue_for_blocks(block_count, [&](int block) {
+			detail::sp_render_queue_histogram& histogram = block_histograms[block];
+			histogram.fill(0);
+			for (int i = block_begin(block); i < block_begin(block + 1); ++i)
+			{
+				++histogram[(items[i]._key >> shift) & (detail::k_render_queue_bucket_count - 1)];
+			}
+		});
+
+		// Each block's histogram becomes where its items of every bucket go, after the same bucket's items from the blocks
+		// before it, which keeps the sort stable
+		uint32_t offset = 0;
+		for (int bucket = 0; bucket < detail::k_render_queue_bucket_count; ++bucket)
+		{
+			for (int block = 0; block < block_count; ++block)
+			{
+				const uint32_t count = block_histograms[block][bucket];
+				block_histograms[block][bucket] = offset;
+				offset += count;
+			}
+		}
+
+		assert(offset == static_cast<uint32_t>(item_count));
+
+		detail::sp_render_queue_for_blocks(block_count, [&](int block) {
+			detail::sp_render_queue_histogram& offsets = block_histograms[block];
+			for (int i = block_begin(block); i < block_begin(block + 1); ++i)
+			{
+				scratch[offsets[(items[i]._key >> shift) & (detail::k_render_queue_bucket_count - 1)]++] = items[i];
+			}
+		});
+
+		std::swap(queue._items, queue._scratch);
+	}
+}
\ No newline at end of file
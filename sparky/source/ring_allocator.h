@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+// Hands out aligned ranges of a ring of bytes in order and takes them back in the same order once the fence value each was
+// handed out with has completed, for the upload staging ring. Knows nothing about D3D so sparky_test can check it on its own.
+//
+// Offsets only ever increase and are wrapped when used so head - tail is always the space in use. An allocation that doesn't
+// fit before the end of the ring skips the rest of it and starts again at the beginning.
+
+namespace detail
+{
+	const uint64_t k_ring_allocator_full = ~0ull;
+
+	struct sp_ring_allocation
+	{
+		uint64_t _end_offset = 0;		// Unwrapped
+		uint64_t _fence_value = 0;
+	};
+
+	struct sp_ring_allocator
+	{
+		uint64_t _size_bytes = 0;
+		uint64_t _head = 0;
+		uint64_t _tail = 0;
+		std::deque<sp_ring_allocation> _allocations;		// Oldest first
+	};
+
+	void sp_ring_allocator_init(sp_ring_allocator& ring, uint64_t size_bytes);
+
+	// Returns the offset into the ring, or k_ring_allocator_full if there isn't room until the oldest allocation is retired. The
+	// size can't be bigger than the ring and the alignment has to be a power of two.
+	uint64_t sp_ring_allocator_alloc(sp_ring_allocator& ring, uint64_t size_bytes, uint64_t alignment, uint64_t fence_value);
+
+	// Gives back every allocation, oldest first, up to the first one whose fence value hasn't completed
+	void sp_ring_allocator_retire(sp_ring_allocator& ring, uint64_t completed_fence_value);
+}
\ No newline at end of file
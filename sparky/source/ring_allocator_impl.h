@@ -0,0 +1,61 @@
+#pragma once
+
+#include "ring_allocator.h"
+
+#include <cassert>
+
+namespace detail
+{
+	void sp_ring_allocator_init(sp_ring_allocator& ring, uint64_t size_bytes)
+	{
+		ring._size_bytes = size_bytes;
+		ring._head = 0;
+		ring._tail = 0;
+		ring._allocations.clear();
+	}
+
+	uint64_t sp_ring_allocator_alloc(sp_ring_allocator& ring, uint64_t size_bytes, uint64_t alignment, uint64_t fence_value)
+	{
+		assert(size_bytes <= ring._size_bytes);
+		assert((alignment & (alignment - 1)) == 0 && "alignment must be a power of two");
+
+		if (ring._allocations.empty())
+		{
+			// Nothing's in use so start again at the beginning of the ring rather than waiting for space that's already free. Past
+			// a wrapped head there might not be room for size bytes before or after the end.
+			ring._head = (ring._head + ring._size_bytes - 1) / ring._size_bytes * ring._size_bytes;
+			ring._tail = ring._head;
+		}
+
+		const uint64_t head_wrapped = ring._head % ring._size_bytes;
+
+		uint64_t offset = (head_wrapped + alignment - 1) & ~(alignment - 1);
+		uint64_t padding_bytes = offset - head_wrapped;
+		if (offset + size_bytes > ring._size_bytes)
+		{
+			// Doesn't fit before the end so skip the remainder and start again at the beginning
+			offset = 0;
+			padding_bytes = ring._size_bytes - head_wrapped;
+		}
+
+		const uint64_t end_offset = ring._head + padding_bytes + size_bytes;
+		if (end_offset - ring._tail > ring._size_bytes)
+		{
+			return k_ring_allocator_full;
+		}
+
+		ring._head = end_offset;
+		ring._allocations.push_back({ end_offset, fence_value });
+
+		return offset;
+	}
+
+	void sp_ring_allocator_retire(sp_ring_allocator& ring, uint64_t completed_fence_value)
+	{
+		while (!ring._allocations.empty() && ring._allocations.front()._fence_value <= completed_fence_value)
+		{
+			ring._tail = ring._allocations.front()._end_offset;
+			ring._allocations.pop_front();
+		}
+	}
+}
\ No newline at end of file
@@ -3,6 +3,9 @@
 #include "descriptor.h"
 #include "constant_buffer.h"
 #include "texture.h"
+#include "upload.h"
+#include "gpu_memory.h"
+#include "deferred_release.h"
 
 #define NOMINMAX
 #include <d3d12.h>
@@ -20,6 +23,7 @@ namespace detail
 	{
 		Microsoft::WRL::ComPtr<ID3D12Device> _device;
 		Microsoft::WRL::ComPtr<IDXGISwapChain3> _swap_chain;
+		DXGI_FORMAT _swap_chain_format = DXGI_FORMAT_UNKNOWN;
 		int _back_buffer_index = 0;
 
 		Microsoft::WRL::ComPtr<ID3D12CommandQueue> _graphics_queue;
@@ -32,9 +36,18 @@ namespace detail
 
 		Microsoft::WRL::ComPtr<ID3D12RootSignature> _root_signature;
 
+		// Indirect draws only read draw arguments, nothing that changes root arguments, so one signature does for all of them
+		Microsoft::WRL::ComPtr<ID3D12CommandSignature> _command_signature_draw_indexed;
+
 		sp_texture_handle _back_buffer_texture_handles[k_back_buffer_count];
 
 		sp_constant_buffer_heap _constant_buffer_heap;
 
+		sp_upload_context _upload_context;
+
+		sp_gpu_memory_pool _gpu_memory_pools[static_cast<int>(sp_gpu_memory_pool_type::count)];
+
+		sp_deferred_release_queue _deferred_release_queue;
+
 	} _sp;
 }
\ No newline at end of file
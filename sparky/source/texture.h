@@ -3,6 +3,8 @@
 #include "handle.h"
 #include "d3dx12.h"
 #include "descriptor.h"
+#include "gpu_memory.h"
+#include "image_file.h"
 
 #include <vector>
 
@@ -20,14 +22,21 @@ enum class sp_texture_format
 	r10g10b10a2,
 	r16g16b16a16,
 	r32g32b32a32,
+	r9g9b9e5,
 	d16,
 	d32,
+	bc1,
+	bc3,
+	bc5,
+	bc6h,
+	bc7,
 };
 
 enum class sp_texture_flags
 {
 	none = 0x00,
 	render_target = 0x01,
+	cube = 0x02,			// array_size has to be a multiple of 6, one for each face
 };
 
 inline sp_texture_flags operator | (sp_texture_flags lhs, sp_texture_flags rhs)
@@ -55,6 +64,18 @@ struct sp_texture_desc
 	int depth = 0;
 	sp_texture_format format;
 	sp_texture_flags flags;
+	int array_size = 1;		// 2D textures only
+	int mip_count = 0;		// 0 for a full chain. Only for textures that aren't render or depth targets.
+};
+
+// One subresource's worth of data for sp_texture_update_subresources
+struct sp_texture_subresource_data
+{
+	int mip_level = 0;
+	int array_slice = 0;
+	const void* data_cpu = nullptr;
+	int row_pitch_bytes = 0;		// Between rows of blocks for block compressed formats
+	int slice_pitch_bytes = 0;	// Between the depth slices of a 3D texture. 0 means tightly packed rows.
 };
 
 struct sp_texture
@@ -63,7 +84,10 @@ struct sp_texture
 	int _width = 0;
 	int _height = 0;
 	int _depth = 1;
+	int _array_size = 1;
+	bool _is_cube = false;
 	Microsoft::WRL::ComPtr<ID3D12Resource> _resource;
+	sp_gpu_memory_block _memory_block;		// Unused for committed resources
 	int _num_mip_levels = 1;
 	sp_texture_format _format = sp_texture_format::unknown;
 
@@ -74,6 +98,9 @@ struct sp_texture
 
 	D3D12_RESOURCE_STATES _default_state = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
 
+	// Copy fence value of the last sp_texture_update or sp_texture_update_subresources
+	UINT64 _upload_fence_value = 0;
+
 	D3D12_CLEAR_VALUE _optimized_clear_value;
 };
 
@@ -101,8 +128,14 @@ namespace detail
 		case sp_texture_format::r10g10b10a2:  return false;
 		case sp_texture_format::r16g16b16a16: return false;
 		case sp_texture_format::r32g32b32a32: return false;
+		case sp_texture_format::r9g9b9e5:     return false;
 		case sp_texture_format::d16:          return true;
 		case sp_texture_format::d32:          return true;
+		case sp_texture_format::bc1:          return false;
+		case sp_texture_format::bc3:          return false;
+		case sp_texture_format::bc5:          return false;
+		case sp_texture_format::bc6h:         return false;
+		case sp_texture_format::bc7:          return false;
 		};
 
 		assert(false);
@@ -110,6 +143,49 @@ namespace detail
 		return false;
 	}
 
+	inline bool sp_texture_format_is_block_compressed(sp_texture_format format)
+	{
+		switch (format)
+		{
+		case sp_texture_format::bc1:          return true;
+		case sp_texture_format::bc3:          return true;
+		case sp_texture_format::bc5:          return true;
+		case sp_texture_format::bc6h:         return true;
+		case sp_texture_format::bc7:          return true;
+		default:                              return false;
+		};
+	}
+
+	// Block compressed and shared exponent formats can only be read by shaders
+	inline bool sp_texture_format_supports_uav(sp_texture_format format)
+	{
+		return !sp_texture_format_is_block_compressed(format) && format != sp_texture_format::r9g9b9e5;
+	}
+
+	inline const char* sp_texture_format_get_name(sp_texture_format format)
+	{
+		switch (format)
+		{
+		case sp_texture_format::unknown:      return "unknown";
+		case sp_texture_format::r8g8b8a8:     return "r8g8b8a8";
+		case sp_texture_format::r10g10b10a2:  return "r10g10b10a2";
+		case sp_texture_format::r16g16b16a16: return "r16g16b16a16";
+		case sp_texture_format::r32g32b32a32: return "r32g32b32a32";
+		case sp_texture_format::r9g9b9e5:     return "r9g9b9e5";
+		case sp_texture_format::d16:          return "d16";
+		case sp_texture_format::d32:          return "d32";
+		case sp_texture_format::bc1:          return "bc1";
+		case sp_texture_format::bc3:          return "bc3";
+		case sp_texture_format::bc5:          return "bc5";
+		case sp_texture_format::bc6h:         return "bc6h";
+		case sp_texture_format::bc7:          return "bc7";
+		};
+
+		assert(false);
+
+		return "";
+	}
+
 	inline DXGI_FORMAT sp_texture_format_get_base_format_d3d12(sp_texture_format format)
 	{
 		switch (format)
@@ -118,8 +194,14 @@ namespace detail
 		case sp_texture_format::r10g10b10a2:  return DXGI_FORMAT_R10G10B10A2_TYPELESS;
 		case sp_texture_format::r16g16b16a16: return DXGI_FORMAT_R16G16B16A16_TYPELESS;
 		case sp_texture_format::r32g32b32a32: return DXGI_FORMAT_R32G32B32A32_TYPELESS;
+		case sp_texture_format::r9g9b9e5:     return DXGI_FORMAT_R9G9B9E5_SHAREDEXP;
 		case sp_texture_format::d16:          return DXGI_FORMAT_R16_TYPELESS;
 		case sp_texture_format::d32:          return DXGI_FORMAT_R32_TYPELESS;
+		case sp_texture_format::bc1:          return DXGI_FORMAT_BC1_TYPELESS;
+		case sp_texture_format::bc3:          return DXGI_FORMAT_BC3_TYPELESS;
+		case sp_texture_format::bc5:          return DXGI_FORMAT_BC5_TYPELESS;
+		case sp_texture_format::bc6h:         return DXGI_FORMAT_BC6H_TYPELESS;
+		case sp_texture_format::bc7:          return DXGI_FORMAT_BC7_TYPELESS;
 		};
 
 		assert(false);
@@ -135,8 +217,14 @@ namespace detail
 		case sp_texture_format::r10g10b10a2:  return DXGI_FORMAT_R10G10B10A2_UNORM;
 		case sp_texture_format::r16g16b16a16: return DXGI_FORMAT_R16G16B16A16_FLOAT;
 		case sp_texture_format::r32g32b32a32: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+		case sp_texture_format::r9g9b9e5:     return DXGI_FORMAT_R9G9B9E5_SHAREDEXP;
 		case sp_texture_format::d16:          return DXGI_FORMAT_R16_UNORM;
 		case sp_texture_format::d32:          return DXGI_FORMAT_R32_FLOAT;
+		case sp_texture_format::bc1:          return DXGI_FORMAT_BC1_UNORM;
+		case sp_texture_format::bc3:          return DXGI_FORMAT_BC3_UNORM;
+		case sp_texture_format::bc5:          return DXGI_FORMAT_BC5_UNORM;
+		case sp_texture_format::bc6h:         return DXGI_FORMAT_BC6H_UF16;
+		case sp_texture_format::bc7:          return DXGI_FORMAT_BC7_UNORM;
 		};
 
 		assert(false);
@@ -160,7 +248,17 @@ namespace detail
 
 sp_texture_handle sp_texture_create(const char* name, const sp_texture_desc& desc);
 void sp_texture_destroy(sp_texture_handle texture_handle);
+// Returns as soon as the data has been copied into staging. The copy itself happens on the copy queue and anything executed on the
+// graphics or compute queues afterwards waits for it on the GPU.
 void sp_texture_update(const sp_texture_handle& texture_handle, const void* data_cpu, int size_bytes, int pixel_size_bytes);
+// Same as above for any number of mips and array slices, e.g. a whole precomputed mip chain or every face of a cubemap. The
+// copies are all recorded into one batch.
+void sp_texture_update_subresources(const sp_texture_handle& texture_handle, const sp_texture_subresource_data* subresources, int subresource_count);
+bool sp_texture_update_is_complete(const sp_texture_handle& texture_handle);
+
+// Creates a texture the same size and format as a cooked file with all of its mips and slices, then uploads them straight
+// from the mapped file. The file can be closed as soon as this returns.
+sp_texture_handle sp_texture_create_from_image_file(const char* name, const sp_image_file& image_file);
 
 sp_texture_handle sp_texture_defaults_white();
 sp_texture_handle sp_texture_defaults_black();
@@ -120,11 +120,36 @@ namespace detail
 			sp_texture_mip_level_max, 
 			static_cast<int>(std::floor(std::log2(std::max(height, width)))) + 1);
 	}
+
+	sp_texture_format sp_texture_format_from_image_format(sp_image_format format)
+	{
+		switch (format)
+		{
+		case sp_image_format::r8g8b8a8:     return sp_texture_format::r8g8b8a8;
+		case sp_image_format::r32g32b32a32: return sp_texture_format::r32g32b32a32;
+		case sp_image_format::r16g16b16a16: return sp_texture_format::r16g16b16a16;
+		case sp_image_format::r9g9b9e5:     return sp_texture_format::r9g9b9e5;
+		case sp_image_format::bc1:          return sp_texture_format::bc1;
+		case sp_image_format::bc3:          return sp_texture_format::bc3;
+		case sp_image_format::bc5:          return sp_texture_format::bc5;
+		case sp_image_format::bc6h:         return sp_texture_format::bc6h;
+		case sp_image_format::bc7:          return sp_texture_format::bc7;
+		};
+
+		assert(false);
+
+		return sp_texture_format::unknown;
+	}
 }
 
 sp_texture_handle sp_texture_create(const char* name, const sp_texture_desc& desc)
 {
 	assert(desc.depth > 0);
+	assert(desc.array_size > 0);
+	assert(desc.depth == 1 || desc.array_size == 1);
+
+	const bool is_cube = (desc.flags & sp_texture_flags::cube) != sp_texture_flags::none;
+	assert(!is_cube || (desc.array_size % 6 == 0 && desc.width == desc.height));
 
 	sp_texture_handle texture_handle = sp_handle_alloc(&detail::resource_pools::texture_handles);
 	sp_texture& texture = detail::resource_pools::textures[texture_handle.index];
@@ -133,19 +158,25 @@ sp_texture_handle sp_texture_create(const char* name, const sp_texture_desc& des
 	resource_desc_d3d12.Format = detail::sp_texture_format_get_base_format_d3d12(desc.format);
 	resource_desc_d3d12.Width = desc.width;
 	resource_desc_d3d12.Height = desc.height;
-	resource_desc_d3d12.DepthOrArraySize = desc.depth;
+	resource_desc_d3d12.DepthOrArraySize = desc.depth == 1 ? desc.array_size : desc.depth;
 	resource_desc_d3d12.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
 	resource_desc_d3d12.SampleDesc.Count = 1;
 	resource_desc_d3d12.SampleDesc.Quality = 0;
 
 	D3D12_CLEAR_VALUE* optimized_clear_value = nullptr;
 
+	// Anything that can't be rendered to gets its contents from the copy queue which needs it in the common state. Reads from
+	// the graphics queue implicitly promote it.
+	D3D12_RESOURCE_STATES default_state = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+
 	if (desc.depth == 1)
 	{
 		resource_desc_d3d12.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
 
 		if (detail::sp_texture_format_is_depth(desc.format))
 		{
+			assert(desc.array_size == 1);
+
 			resource_desc_d3d12.MipLevels = 1;
 			resource_desc_d3d12.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
 
@@ -159,6 +190,8 @@ sp_texture_handle sp_texture_create(const char* name, const sp_texture_desc& des
 		{
 			if ((desc.flags & sp_texture_flags::render_target) != sp_texture_flags::none)
 			{
+				assert(desc.array_size == 1);
+
 				resource_desc_d3d12.MipLevels = 1;
 				resource_desc_d3d12.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
 
@@ -173,7 +206,19 @@ sp_texture_handle sp_texture_create(const char* name, const sp_texture_desc& des
 			else
 			{
 				resource_desc_d3d12.MipLevels = detail::sp_texture_calculate_num_mip_levels(desc.width, desc.height);
-				resource_desc_d3d12.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+				if (desc.mip_count > 0)
+				{
+					assert(desc.mip_count <= resource_desc_d3d12.MipLevels);
+
+					resource_desc_d3d12.MipLevels = desc.mip_count;
+				}
+
+				// The top level of block compressed formats has to be whole blocks
+				assert(!detail::sp_texture_format_is_block_compressed(desc.format) || (desc.width % 4 == 0 && desc.height % 4 == 0));
+
+				resource_desc_d3d12.Flags = detail::sp_texture_format_supports_uav(desc.format) ? D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS : D3D12_RESOURCE_FLAG_NONE;
+
+				default_state = D3D12_RESOURCE_STATE_COMMON;
 			}
 		}
 	}
@@ -181,26 +226,56 @@ sp_texture_handle sp_texture_create(const char* name, const sp_texture_desc& des
 	{
 		resource_desc_d3d12.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D;
 		resource_desc_d3d12.MipLevels = 1;
+
+		default_state = D3D12_RESOURCE_STATE_COMMON;
 	}
 
-	const auto heap_properties_d3dx12 = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-	HRESULT hr = detail::_sp._device->CreateCommittedResource(
-		&heap_properties_d3dx12,
-		D3D12_HEAP_FLAG_NONE,
-		&resource_desc_d3d12,
-		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-		optimized_clear_value,
-		IID_PPV_ARGS(&texture._resource));
-	assert(hr == S_OK);
+	HRESULT hr = S_OK;
+
+	// Render and depth targets want their own committed allocations and anything bigger than a page would waste most of the
+	// power of two page it'd get. Everything else is placed in a shared texture heap.
+	const D3D12_RESOURCE_ALLOCATION_INFO allocation_info_d3d12 = detail::_sp._device->GetResourceAllocationInfo(0, 1, &resource_desc_d3d12);
+
+	texture._memory_block = sp_gpu_memory_block();
+
+	if (!optimized_clear_value && allocation_info_d3d12.SizeInBytes <= k_gpu_memory_page_size_bytes)
+	{
+		texture._memory_block = detail::sp_gpu_memory_alloc(sp_gpu_memory_pool_type::default_textures, allocation_info_d3d12.SizeInBytes, allocation_info_d3d12.Alignment);
+
+		hr = detail::_sp._device->CreatePlacedResource(
+			detail::sp_gpu_memory_get_heap(texture._memory_block),
+			texture._memory_block._offset_bytes,
+			&resource_desc_d3d12,
+			default_state,
+			nullptr,
+			IID_PPV_ARGS(&texture._resource));
+		assert(hr == S_OK);
+	}
+	else
+	{
+		const auto heap_properties_d3dx12 = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+		hr = detail::_sp._device->CreateCommittedResource(
+			&heap_properties_d3dx12,
+			D3D12_HEAP_FLAG_NONE,
+			&resource_desc_d3d12,
+			default_state,
+			optimized_clear_value,
+			IID_PPV_ARGS(&texture._resource));
+		assert(hr == S_OK);
+	}
 
 #if SP_DEBUG_RESOURCE_NAMING_ENABLED
 	texture._resource->SetName(std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().from_bytes(name).c_str());
 #endif
 
 	texture._name = name;
+	texture._default_state = default_state;
+	texture._upload_fence_value = 0;
 	texture._width = desc.width;
 	texture._height = desc.height;
 	texture._depth = desc.depth;
+	texture._array_size = desc.array_size;
+	texture._is_cube = is_cube;
 	texture._num_mip_levels = resource_desc_d3d12.MipLevels;
 	texture._format = desc.format;
 
@@ -212,15 +287,33 @@ sp_texture_handle sp_texture_create(const char* name, const sp_texture_desc& des
 	D3D12_SHADER_RESOURCE_VIEW_DESC shader_resource_view_desc_d3d12 = {};
 	shader_resource_view_desc_d3d12.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 	shader_resource_view_desc_d3d12.Format = detail::sp_texture_format_get_srv_format_d3d12(desc.format);
-	shader_resource_view_desc_d3d12.Texture2D.MipLevels = -1;
 
-	if (desc.depth == 1)
+	if (desc.depth > 1)
 	{
-		shader_resource_view_desc_d3d12.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		shader_resource_view_desc_d3d12.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE3D;
+		shader_resource_view_desc_d3d12.Texture3D.MipLevels = -1;
+	}
+	else if (is_cube && desc.array_size == 6)
+	{
+		shader_resource_view_desc_d3d12.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
+		shader_resource_view_desc_d3d12.TextureCube.MipLevels = -1;
+	}
+	else if (is_cube)
+	{
+		shader_resource_view_desc_d3d12.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBEARRAY;
+		shader_resource_view_desc_d3d12.TextureCubeArray.MipLevels = -1;
+		shader_resource_view_desc_d3d12.TextureCubeArray.NumCubes = desc.array_size / 6;
+	}
+	else if (desc.array_size > 1)
+	{
+		shader_resource_view_desc_d3d12.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+		shader_resource_view_desc_d3d12.Texture2DArray.MipLevels = -1;
+		shader_resource_view_desc_d3d12.Texture2DArray.ArraySize = desc.array_size;
 	}
 	else
 	{
-		shader_resource_view_desc_d3d12.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE3D;
+		shader_resource_view_desc_d3d12.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		shader_resource_view_desc_d3d12.Texture2D.MipLevels = -1;
 	}
 
 	detail::_sp._device->CreateShaderResourceView(texture._resource.Get(), &shader_resource_view_desc_d3d12, texture._shader_resource_view._handle_cpu_d3d12);
@@ -250,14 +343,24 @@ sp_texture_handle sp_texture_create(const char* name, const sp_texture_desc& des
 
 				detail::_sp._device->CreateRenderTargetView(texture._resource.Get(), &render_target_view_desc_d3d12, texture._render_target_view._handle_cpu_d3d12);
 			}
-			else
+			else if (detail::sp_texture_format_supports_uav(desc.format))
 			{
 				texture._unordered_access_view = detail::sp_descriptor_alloc(detail::_sp._descriptor_heap_cbv_srv_uav_cpu);
 
 				D3D12_UNORDERED_ACCESS_VIEW_DESC unordered_access_view_desc_d3d12 = {};
 				unordered_access_view_desc_d3d12.Format = detail::sp_texture_format_get_srv_format_d3d12(desc.format);
-				unordered_access_view_desc_d3d12.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
-				unordered_access_view_desc_d3d12.Texture2D.MipSlice = 0;
+
+				if (desc.array_size > 1)
+				{
+					unordered_access_view_desc_d3d12.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2DARRAY;
+					unordered_access_view_desc_d3d12.Texture2DArray.MipSlice = 0;
+					unordered_access_view_desc_d3d12.Texture2DArray.ArraySize = desc.array_size;
+				}
+				else
+				{
+					unordered_access_view_desc_d3d12.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+					unordered_access_view_desc_d3d12.Texture2D.MipSlice = 0;
+				}
 
 				detail::_sp._device->CreateUnorderedAccessView(texture._resource.Get(), nullptr, &unordered_access_view_desc_d3d12, texture._unordered_access_view._handle_cpu_d3d12);
 			}
@@ -271,6 +374,14 @@ void sp_texture_destroy(sp_texture_handle texture_handle)
 {
 	sp_texture& texture = detail::resource_pools::textures[texture_handle.index];
 
+	// The GPU could still be using any of it. The handle can go straight away since everything's been moved out of the slot.
+	detail::sp_deferred_release(std::move(texture._resource));
+	detail::sp_deferred_release(texture._memory_block);
+	detail::sp_deferred_release(detail::_sp._descriptor_heap_cbv_srv_uav_cpu, texture._shader_resource_view);
+	detail::sp_deferred_release(detail::_sp._descriptor_heap_cbv_srv_uav_cpu, texture._unordered_access_view);
+	detail::sp_deferred_release(detail::_sp._descriptor_heap_rtv_cpu, texture._render_target_view);
+	detail::sp_deferred_release(detail::_sp._descriptor_heap_dsv_cpu, texture._depth_stencil_view);
+
 	sp_handle_free(&detail::resource_pools::texture_handles, texture_handle);
 }
 
@@ -278,72 +389,86 @@ void sp_texture_update(const sp_texture_handle& texture_handle, const void* data
 {
 	sp_texture& texture = detail::resource_pools::textures[texture_handle.index];
 
-	// Create the GPU upload buffer.
-	UINT64 upload_buffer_size_bytes = 0;
+	// The copy queue can only touch resources in the common state
+	assert(texture._default_state == D3D12_RESOURCE_STATE_COMMON);
 
-	{
-		ID3D12Device* device = nullptr;
-		texture._resource->GetDevice(__uuidof(*device), reinterpret_cast<void**>(&device));
-		const auto resource_desc_d3d12 = texture._resource->GetDesc();
-		device->GetCopyableFootprints(&resource_desc_d3d12, 0, 1, 0, nullptr, nullptr, nullptr, &upload_buffer_size_bytes);
-		device->Release();
-	}
+	const int row_pitch_bytes = texture._width * pixel_size_bytes;
+	const int slice_pitch_bytes = row_pitch_bytes * texture._height;
 
-	// assert(size_bytes == upload_buffer_size_bytes);
+	assert(size_bytes == slice_pitch_bytes * texture._depth);
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> texture_upload_buffer;
+	texture._upload_fence_value = detail::sp_upload_texture_subresource(detail::_sp._upload_context, texture._resource.Get(), 0, data_cpu, row_pitch_bytes, slice_pitch_bytes);
+}
 
-	const auto heap_properties_d3dx12 = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-	const auto resource_desc_d3dx12 = CD3DX12_RESOURCE_DESC::Buffer(upload_buffer_size_bytes);
-	HRESULT hr = detail::_sp._device->CreateCommittedResource(
-		&heap_properties_d3dx12,
-		D3D12_HEAP_FLAG_NONE,
-		&resource_desc_d3dx12,
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_PPV_ARGS(&texture_upload_buffer));
-	assert(hr == S_OK);
+void sp_texture_update_subresources(const sp_texture_handle& texture_handle, const sp_texture_subresource_data* subresources, int subresource_count)
+{
+	sp_texture& texture = detail::resource_pools::textures[texture_handle.index];
 
-#if SP_DEBUG_RESOURCE_NAMING_ENABLED
-	texture_upload_buffer->SetName(std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().from_bytes(texture._name).c_str());
-#endif
+	assert(texture._default_state == D3D12_RESOURCE_STATE_COMMON);
 
-	// Copy data to the intermediate upload heap and then schedule a copy 
-	// from the upload heap to the Texture2D.
-	D3D12_SUBRESOURCE_DATA subresource_data = {};
-	subresource_data.pData = data_cpu;
-	subresource_data.RowPitch = texture._width * pixel_size_bytes;
-	subresource_data.SlicePitch = subresource_data.RowPitch * texture._height;
+	std::vector<detail::sp_upload_subresource> upload_subresources(subresource_count);
 
-	assert(size_bytes == subresource_data.SlicePitch * texture._depth);
+	for (int i = 0; i < subresource_count; ++i)
+	{
+		const sp_texture_subresource_data& subresource = subresources[i];
+		assert(subresource.mip_level >= 0 && subresource.mip_level < texture._num_mip_levels);
+		assert(subresource.array_slice >= 0 && subresource.array_slice < texture._array_size);
 
-	// TODO: Should this use a copy command list/queue
-	sp_graphics_command_list texture_update_command_list = sp_graphics_command_list_create(texture._name, {});
+		// Rows of blocks for block compressed formats
+		int row_count = std::max(1, texture._height >> subresource.mip_level);
+		if (detail::sp_texture_format_is_block_compressed(texture._format))
+		{
+			row_count = (row_count + 3) / 4;
+		}
 
-	sp_graphics_command_list_begin(texture_update_command_list);
+		detail::sp_upload_subresource& upload_subresource = upload_subresources[i];
+		upload_subresource._subresource = D3D12CalcSubresource(subresource.mip_level, subresource.array_slice, 0, texture._num_mip_levels, texture._array_size);
+		upload_subresource._data_cpu = subresource.data_cpu;
+		upload_subresource._row_pitch_bytes = subresource.row_pitch_bytes;
+		upload_subresource._slice_pitch_bytes = subresource.slice_pitch_bytes > 0 ? subresource.slice_pitch_bytes : subresource.row_pitch_bytes * row_count;
+	}
 
-	auto barrier_d3dx12 = CD3DX12_RESOURCE_BARRIER::Transition(texture._resource.Get(), texture._default_state, D3D12_RESOURCE_STATE_COPY_DEST);
-	texture_update_command_list._command_list_d3d12->ResourceBarrier(1, &barrier_d3dx12);
+	texture._upload_fence_value = detail::sp_upload_texture_subresources(detail::_sp._upload_context, texture._resource.Get(), upload_subresources.data(), subresource_count);
+}
 
-	UpdateSubresources(texture_update_command_list._command_list_d3d12.Get(),
-		texture._resource.Get(),
-		texture_upload_buffer.Get(),
-		0,
-		0,
-		1,
-		&subresource_data);
+bool sp_texture_update_is_complete(const sp_texture_handle& texture_handle)
+{
+	const sp_texture& texture = detail::resource_pools::textures[texture_handle.index];
 
-	barrier_d3dx12 = CD3DX12_RESOURCE_BARRIER::Transition(texture._resource.Get(), D3D12_RESOURCE_STATE_COPY_DEST, texture._default_state);
-	texture_update_command_list._command_list_d3d12->ResourceBarrier(1, &barrier_d3dx12);
+	return detail::sp_upload_is_complete(detail::_sp._upload_context, texture._upload_fence_value);
+}
 
-	sp_graphics_command_list_end(texture_update_command_list);
+sp_texture_handle sp_texture_create_from_image_file(const char* name, const sp_image_file& image_file)
+{
+	sp_texture_desc desc;
+	desc.width = image_file._width;
+	desc.height = image_file._height;
+	desc.depth = 1;
+	desc.format = detail::sp_texture_format_from_image_format(image_file._format);
+	desc.flags = image_file._is_cube ? sp_texture_flags::cube : sp_texture_flags::none;
+	desc.array_size = image_file._array_size;
+	desc.mip_count = image_file._mip_count;
 
-	sp_graphics_queue_execute(texture_update_command_list);
+	sp_texture_handle texture_handle = sp_texture_create(name, desc);
 
-	// Need to wait for texture to be updated before allowing upload buffer to fall out of scope
-	sp_graphics_queue_wait_for_idle();
+	// Pointers into the mapping so the only copy on the CPU is the one into staging
+	std::vector<sp_texture_subresource_data> subresources(image_file._subresources.size());
 
-	sp_graphics_command_list_destroy(texture_update_command_list);
+	for (int array_slice = 0; array_slice < image_file._array_size; ++array_slice)
+	{
+		for (int mip = 0; mip < image_file._mip_count; ++mip)
+		{
+			sp_texture_subresource_data& subresource = subresources[array_slice * image_file._mip_count + mip];
+			subresource.mip_level = mip;
+			subresource.array_slice = array_slice;
+			subresource.data_cpu = sp_image_file_get_data(image_file, mip, array_slice);
+			subresource.row_pitch_bytes = image_file._subresources[array_slice * image_file._mip_count + mip]._row_pitch_bytes;
+		}
+	}
+
+	sp_texture_update_subresources(texture_handle, subresources.data(), static_cast<int>(subresources.size()));
+
+	return texture_handle;
 }
 
 sp_texture_handle sp_texture_defaults_white()
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define NOMINMAX
+#include <d3d12.h>
+
+#include <wrl.h>
+
+#include "gpu_memory.h"
+#include "ring_allocator.h"
+
+// Uploads are copied into a persistently mapped staging ring and recorded on a dedicated copy queue. Copies are batched into
+// one command list until it's full, the ring needs the space back or a queue that might read the results is about to execute.
+// The graphics and compute queues wait for the copy queue on the GPU so nothing stalls on the CPU unless the ring is full.
+
+// Number of copies recorded into a batch before it's submitted
+const int k_upload_batch_copy_count_max = 256;
+
+namespace detail
+{
+	struct sp_upload_batch
+	{
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> _command_allocator_d3d12;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> _command_list_d3d12;
+		UINT64 _fence_value = 0;
+	};
+
+	// Uploads too big for the ring get their own block which lives until the copy has finished
+	struct sp_upload_oversized_block
+	{
+		sp_gpu_memory_block _memory_block;
+		UINT64 _fence_value = 0;
+	};
+
+	// Where a single upload's data was copied to
+	struct sp_upload_staging
+	{
+		ID3D12Resource* _buffer = nullptr;
+		UINT64 _offset_bytes = 0;
+		uint8_t* _data_cpu = nullptr;
+	};
+
+	// One subresource's worth of data for sp_upload_texture_subresources
+	struct sp_upload_subresource
+	{
+		int _subresource = 0;
+		const void* _data_cpu = nullptr;
+		int _row_pitch_bytes = 0;
+		int _slice_pitch_bytes = 0;
+	};
+
+	struct sp_upload_context_desc
+	{
+		int staging_size_bytes = 0;
+	};
+
+	struct sp_upload_context
+	{
+		std::mutex _mutex;
+
+		Microsoft::WRL::ComPtr<ID3D12CommandQueue> _copy_queue;
+		Microsoft::WRL::ComPtr<ID3D12Fence> _fence;
+
+		// The fence value the open batch will signal when it's submitted
+		UINT64 _next_fence_value = 1;
+
+		// The last copy fence value each queue has been told to wait for
+		UINT64 _graphics_queue_wait_fence_value = 0;
+		UINT64 _compute_queue_wait_fence_value = 0;
+
+		std::vector<std::unique_ptr<sp_upload_batch>> _batches;
+		sp_upload_batch* _open_batch = nullptr;
+		int _open_batch_copy_count = 0;
+
+		sp_gpu_memory_block _staging_memory_block;
+		sp_ring_allocator _staging_ring;		// Tagged with the copy fence value
+
+		std::vector<sp_upload_oversized_block> _oversized_blocks;
+	};
+
+	void sp_upload_context_init(sp_upload_context& upload_context, const sp_upload_context_desc& desc);
+	void sp_upload_context_destroy(sp_upload_context& upload_context);
+
+	// Copies the data for one subresource into staging and records the copy. The data can be freed as soon as this returns. Returns
+	// the copy fence value that signals once the copy has finished on the GPU. The resource has to be in the common state.
+	UINT64 sp_upload_texture_subresource(sp_upload_context& upload_context, ID3D12Resource* resource, int subresource, const void* data_cpu, int row_pitch_bytes, int slice_pitch_bytes);
+
+	// Same as above for any number of subresources of one texture. The footprints are worked out in one go, the data goes into a
+	// single staging allocation and every copy is recorded into the same batch.
+	UINT64 sp_upload_texture_subresources(sp_upload_context& upload_context, ID3D12Resource* resource, const sp_upload_subresource* subresources, int subresource_count);
+
+	// Same as above for a range of a buffer. The buffer has to be in the common state.
+	UINT64 sp_upload_buffer_region(sp_upload_context& upload_context, ID3D12Resource* buffer, UINT64 offset_bytes, const void* data_cpu, UINT64 size_bytes);
+
+	// Submits anything recorded so far and makes the queue wait for it on the GPU before any work executed on it afterwards
+	void sp_upload_flush_for_queue(sp_upload_context& upload_context, ID3D12CommandQueue* command_queue, UINT64& queue_wait_fence_value);
+
+	bool sp_upload_is_complete(sp_upload_context& upload_context, UINT64 fence_value);
+}
+
+// Submits anything recorded so far. Happens automatically before the graphics or compute queue executes.
+void sp_upload_flush();
+
+// Returns once every upload so far has finished on the GPU
+void sp_upload_wait_for_idle();
\ No newline at end of file
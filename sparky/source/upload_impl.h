@@ -0,0 +1,369 @@
+#pragma once
+
+#include "upload.h"
+#include "sparky.h"
+#include "d3dx12.h"
+
+#include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#define NOMINMAX
+#include <d3d12.h>
+
+namespace detail
+{
+	void sp_upload_context_init(sp_upload_context& upload_context, const sp_upload_context_desc& desc)
+	{
+		D3D12_COMMAND_QUEUE_DESC copy_queue_desc = {};
+		copy_queue_desc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+		copy_queue_desc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+
+		HRESULT hr = _sp._device->CreateCommandQueue(&copy_queue_desc, IID_PPV_ARGS(&upload_context._copy_queue));
+		assert(SUCCEEDED(hr));
+
+		hr = _sp._device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&upload_context._fence));
+		assert(SUCCEEDED(hr));
+
+		upload_context._next_fence_value = 1;
+		upload_context._graphics_queue_wait_fence_value = 0;
+		upload_context._compute_queue_wait_fence_value = 0;
+
+#if SP_DEBUG_RESOURCE_NAMING_ENABLED
+		upload_context._copy_queue->SetName(L"upload_copy_queue");
+#endif
+
+		upload_context._staging_memory_block = sp_gpu_memory_alloc(sp_gpu_memory_pool_type::upload_buffers, desc.staging_size_bytes, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+		sp_ring_allocator_init(upload_context._staging_ring, desc.staging_size_bytes);
+	}
+
+	// Must hold the lock
+	void sp_upload_retire(sp_upload_context& upload_context)
+	{
+		const UINT64 completed_fence_value = upload_context._fence->GetCompletedValue();
+
+		sp_ring_allocator_retire(upload_context._staging_ring, completed_fence_value);
+
+		auto& oversized_blocks = upload_context._oversized_blocks;
+		oversized_blocks.erase(std::remove_if(oversized_blocks.begin(), oversized_blocks.end(), [completed_fence_value](sp_upload_oversized_block& oversized_block) {
+			if (oversized_block._fence_value > completed_fence_value)
+			{
+				return false;
+			}
+
+			sp_gpu_memory_free(oversized_block._memory_block);
+
+			return true;
+		}), oversized_blocks.end());
+	}
+
+	// Must hold the lock
+	void sp_upload_submit(sp_upload_context& upload_context)
+	{
+		if (!upload_context._open_batch)
+		{
+			return;
+		}
+
+		sp_upload_batch& batch = *upload_context._open_batch;
+
+		HRESULT hr = batch._command_list_d3d12->Close();
+		assert(SUCCEEDED(hr));
+
+		ID3D12CommandList* command_lists_d3d12[] = { batch._command_list_d3d12.Get() };
+		upload_context._copy_queue->ExecuteCommandLists(static_cast<UINT>(std::size(command_lists_d3d12)), command_lists_d3d12);
+
+		batch._fence_value = upload_context._next_fence_value++;
+		hr = upload_context._copy_queue->Signal(upload_context._fence.Get(), batch._fence_value);
+		assert(SUCCEEDED(hr));
+
+		upload_context._open_batch = nullptr;
+		upload_context._open_batch_copy_count = 0;
+	}
+
+	// Must hold the lock
+	sp_upload_batch& sp_upload_get_open_batch(sp_upload_context& upload_context)
+	{
+		if (upload_context._open_batch)
+		{
+			return *upload_context._open_batch;
+		}
+
+		// Reuse the first batch the GPU is done with. There are only ever a handful since they're submitted often.
+		const UINT64 completed_fence_value = upload_context._fence->GetCompletedValue();
+
+		sp_upload_batch* batch = nullptr;
+		for (auto& candidate : upload_context._batches)
+		{
+			if (candidate->_fence_value <= completed_fence_value)
+			{
+				batch = candidate.get();
+				break;
+			}
+		}
+
+		HRESULT hr = S_OK;
+
+		if (batch)
+		{
+			hr = batch->_command_allocator_d3d12->Reset();
+			assert(SUCCEEDED(hr));
+
+			hr = batch->_command_list_d3d12->Reset(batch->_command_allocator_d3d12.Get(), nullptr);
+			assert(SUCCEEDED(hr));
+		}
+		else
+		{
+			upload_context._batches.push_back(std::make_unique<sp_upload_batch>());
+			batch = upload_context._batches.back().get();
+
+			hr = _sp._device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&batch->_command_allocator_d3d12));
+			assert(SUCCEEDED(hr));
+
+			hr = _sp._device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, batch->_command_allocator_d3d12.Get(), nullptr, IID_PPV_ARGS(&batch->_command_list_d3d12));
+			assert(SUCCEEDED(hr));
+
+#if SP_DEBUG_RESOURCE_NAMING_ENABLED
+			batch->_command_list_d3d12->SetName(L"upload_batch");
+#endif
+		}
+
+		// Anything recorded from here on completes with the next signal
+		batch->_fence_value = upload_context._next_fence_value;
+
+		upload_context._open_batch = batch;
+		upload_context._open_batch_copy_count = 0;
+
+		return *batch;
+	}
+
+	// Returns the offset into the staging ring. Waits for earlier copies to finish if the ring is full. Must hold the lock.
+	UINT64 sp_upload_staging_ring_alloc(sp_upload_context& upload_context, std::unique_lock<std::mutex>& lock, UINT64 size_bytes, UINT64 alignment)
+	{
+		for (;;)
+		{
+			sp_upload_retire(upload_context);
+
+			const UINT64 offset = sp_ring_allocator_alloc(upload_context._staging_ring, size_bytes, alignment, upload_context._next_fence_value);
+			if (offset != k_ring_allocator_full)
+			{
+				return offset;
+			}
+
+			// Full, wait for the oldest copy. It might not have been submitted yet.
+			const UINT64 fence_value = upload_context._staging_ring._allocations.front()._fence_value;
+			if (fence_value == upload_context._next_fence_value)
+			{
+				sp_upload_submit(upload_context);
+			}
+
+			// Can't hold a mutex while parked since we might resume on another thread
+			lock.unlock();
+			sp_fence_wait(upload_context._fence.Get(), fence_value);
+			lock.lock();
+		}
+	}
+
+	// Must hold the lock
+	sp_upload_staging sp_upload_staging_alloc(sp_upload_context& upload_context, std::unique_lock<std::mutex>& lock, UINT64 size_bytes, UINT64 alignment)
+	{
+		sp_upload_staging staging;
+
+		if (size_bytes <= upload_context._staging_ring._size_bytes)
+		{
+			const UINT64 ring_offset_bytes = sp_upload_staging_ring_alloc(upload_context, lock, size_bytes, alignment);
+
+			staging._buffer = sp_gpu_memory_get_buffer(upload_context._staging_memory_block);
+			staging._offset_bytes = upload_context._staging_memory_block._offset_bytes + ring_offset_bytes;
+			staging._data_cpu = sp_gpu_memory_get_cpu_address(upload_context._staging_memory_block) + ring_offset_bytes;
+		}
+		else
+		{
+			sp_upload_oversized_block oversized_block;
+			oversized_block._memory_block = sp_gpu_memory_alloc(sp_gpu_memory_pool_type::upload_buffers, size_bytes, alignment);
+			oversized_block._fence_value = upload_context._next_fence_value;
+
+			staging._buffer = sp_gpu_memory_get_buffer(oversized_block._memory_block);
+			staging._offset_bytes = oversized_block._memory_block._offset_bytes;
+			staging._data_cpu = sp_gpu_memory_get_cpu_address(oversized_block._memory_block);
+
+			upload_context._oversized_blocks.push_back(oversized_block);
+		}
+
+		return staging;
+	}
+
+	// Must hold the lock
+	UINT64 sp_upload_end_copy(sp_upload_context& upload_context, const sp_upload_batch& batch, int copy_count = 1)
+	{
+		const UINT64 fence_value = batch._fence_value;
+
+		upload_context._open_batch_copy_count += copy_count;
+		if (upload_context._open_batch_copy_count >= k_upload_batch_copy_count_max)
+		{
+			sp_upload_submit(upload_context);
+		}
+
+		return fence_value;
+	}
+
+	UINT64 sp_upload_texture_subresource(sp_upload_context& upload_context, ID3D12Resource* resource, int subresource, const void* data_cpu, int row_pitch_bytes, int slice_pitch_bytes)
+	{
+		sp_upload_subresource upload_subresource;
+		upload_subresource._subresource = subresource;
+		upload_subresource._data_cpu = data_cpu;
+		upload_subresource._row_pitch_bytes = row_pitch_bytes;
+		upload_subresource._slice_pitch_bytes = slice_pitch_bytes;
+
+		return sp_upload_texture_subresources(upload_context, resource, &upload_subresource, 1);
+	}
+
+	UINT64 sp_upload_texture_subresources(sp_upload_context& upload_context, ID3D12Resource* resource, const sp_upload_subresource* subresources, int subresource_count)
+	{
+		assert(subresource_count > 0);
+
+		const auto resource_desc_d3d12 = resource->GetDesc();
+
+		const UINT array_size = resource_desc_d3d12.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? 1 : resource_desc_d3d12.DepthOrArraySize;
+		const UINT resource_subresource_count = resource_desc_d3d12.MipLevels * array_size;
+
+		// Every subresource of the resource in one call, then packed one after the other in staging since only some of them
+		// might be uploaded
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(resource_subresource_count);
+		std::vector<UINT> row_counts(resource_subresource_count);
+		std::vector<UINT64> row_sizes_bytes(resource_subresource_count);
+		_sp._device->GetCopyableFootprints(&resource_desc_d3d12, 0, resource_subresource_count, 0, footprints.data(), row_counts.data(), row_sizes_bytes.data(), nullptr);
+
+		std::vector<UINT64> staging_offsets_bytes(subresource_count);
+		UINT64 size_bytes = 0;
+
+		for (int i = 0; i < subresource_count; ++i)
+		{
+			const sp_upload_subresource& subresource = subresources[i];
+			assert(subresource._subresource >= 0 && static_cast<UINT>(subresource._subresource) < resource_subresource_count);
+
+			const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint = footprints[subresource._subresource];
+			assert(row_sizes_bytes[subresource._subresource] <= static_cast<UINT64>(subresource._row_pitch_bytes));
+
+			staging_offsets_bytes[i] = (size_bytes + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1) & ~static_cast<UINT64>(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1);
+			size_bytes = staging_offsets_bytes[i] + static_cast<UINT64>(footprint.Footprint.RowPitch) * row_counts[subresource._subresource] * footprint.Footprint.Depth;
+		}
+
+		std::unique_lock<std::mutex> lock(upload_context._mutex);
+
+		// Keep all of the copies in one batch. Has to happen before the staging allocation is tagged with the batch's fence value.
+		if (upload_context._open_batch && upload_context._open_batch_copy_count + subresource_count > k_upload_batch_copy_count_max)
+		{
+			sp_upload_submit(upload_context);
+		}
+
+		const sp_upload_staging staging = sp_upload_staging_alloc(upload_context, lock, size_bytes, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+
+		sp_upload_batch& batch = sp_upload_get_open_batch(upload_context);
+
+		for (int i = 0; i < subresource_count; ++i)
+		{
+			const sp_upload_subresource& subresource = subresources[i];
+
+			D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = footprints[subresource._subresource];
+			footprint.Offset = staging._offset_bytes + staging_offsets_bytes[i];
+
+			const UINT row_count = row_counts[subresource._subresource];
+			const UINT64 row_size_bytes = row_sizes_bytes[subresource._subresource];
+
+			// Staging rows are padded out to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT so copy a row at a time
+			for (UINT z = 0; z < footprint.Footprint.Depth; ++z)
+			{
+				const uint8_t* src_slice = static_cast<const uint8_t*>(subresource._data_cpu) + static_cast<size_t>(z) * subresource._slice_pitch_bytes;
+				uint8_t* dst_slice = staging._data_cpu + staging_offsets_bytes[i] + static_cast<size_t>(z) * footprint.Footprint.RowPitch * row_count;
+
+				for (UINT y = 0; y < row_count; ++y)
+				{
+					memcpy(dst_slice + static_cast<size_t>(y) * footprint.Footprint.RowPitch, src_slice + static_cast<size_t>(y) * subresource._row_pitch_bytes, row_size_bytes);
+				}
+			}
+
+			// Resources are implicitly promoted to copy dest on the copy queue and decay back to common once it's done
+			const CD3DX12_TEXTURE_COPY_LOCATION dst_location(resource, subresource._subresource);
+			const CD3DX12_TEXTURE_COPY_LOCATION src_location(staging._buffer, footprint);
+			batch._command_list_d3d12->CopyTextureRegion(&dst_location, 0, 0, 0, &src_location, nullptr);
+		}
+
+		return sp_upload_end_copy(upload_context, batch, subresource_count);
+	}
+
+	UINT64 sp_upload_buffer_region(sp_upload_context& upload_context, ID3D12Resource* buffer, UINT64 offset_bytes, const void* data_cpu, UINT64 size_bytes)
+	{
+		std::unique_lock<std::mutex> lock(upload_context._mutex);
+
+		const sp_upload_staging staging = sp_upload_staging_alloc(upload_context, lock, size_bytes, 16);
+
+		memcpy(staging._data_cpu, data_cpu, size_bytes);
+
+		sp_upload_batch& batch = sp_upload_get_open_batch(upload_context);
+
+		batch._command_list_d3d12->CopyBufferRegion(buffer, offset_bytes, staging._buffer, staging._offset_bytes, size_bytes);
+
+		return sp_upload_end_copy(upload_context, batch);
+	}
+
+	void sp_upload_flush_for_queue(sp_upload_context& upload_context, ID3D12CommandQueue* command_queue, UINT64& queue_wait_fence_value)
+	{
+		std::lock_guard<std::mutex> lock(upload_context._mutex);
+
+		sp_upload_submit(upload_context);
+
+		const UINT64 last_fence_value = upload_context._next_fence_value - 1;
+		if (queue_wait_fence_value < last_fence_value)
+		{
+			HRESULT hr = command_queue->Wait(upload_context._fence.Get(), last_fence_value);
+			assert(SUCCEEDED(hr));
+
+			queue_wait_fence_value = last_fence_value;
+		}
+	}
+
+	bool sp_upload_is_complete(sp_upload_context& upload_context, UINT64 fence_value)
+	{
+		return upload_context._fence->GetCompletedValue() >= fence_value;
+	}
+
+	void sp_upload_context_destroy(sp_upload_context& upload_context)
+	{
+		// Not worth locking, nothing else should be uploading by now
+		sp_upload_submit(upload_context);
+		sp_fence_wait(upload_context._fence.Get(), upload_context._next_fence_value - 1);
+
+		sp_upload_retire(upload_context);
+		assert(upload_context._oversized_blocks.empty());
+
+		sp_gpu_memory_free(upload_context._staging_memory_block);
+		sp_ring_allocator_init(upload_context._staging_ring, 0);
+		upload_context._batches.clear();
+		upload_context._open_batch = nullptr;
+		upload_context._fence.Reset();
+		upload_context._copy_queue.Reset();
+	}
+}
+
+void sp_upload_flush()
+{
+	std::lock_guard<std::mutex> lock(detail::_sp._upload_context._mutex);
+
+	detail::sp_upload_submit(detail::_sp._upload_context);
+}
+
+void sp_upload_wait_for_idle()
+{
+	UINT64 fence_value = 0;
+	{
+		std::lock_guard<std::mutex> lock(detail::_sp._upload_context._mutex);
+
+		detail::sp_upload_submit(detail::_sp._upload_context);
+
+		fence_value = detail::_sp._upload_context._next_fence_value - 1;
+	}
+
+	detail::sp_fence_wait(detail::_sp._upload_context._fence.Get(), fence_value);
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "handle.h"
+#include "gpu_memory.h"
 
 #define NOMINMAX
 #include <d3d12.h>
@@ -11,13 +12,17 @@ struct sp_vertex_buffer_desc
 {
 	int _size_in_bytes = -1;
 	int _stride_in_bytes = -1;
+	bool _dynamic = false;		// Rewritten every frame, like per instance data
 };
 
 struct sp_vertex_buffer
 {
 	const char* _name = nullptr;
-	Microsoft::WRL::ComPtr<ID3D12Resource> _resource;
+	Microsoft::WRL::ComPtr<ID3D12Resource> _resource;		// Shared with every other buffer in the same gpu memory page
+	sp_gpu_memory_block _memory_block;
 	D3D12_VERTEX_BUFFER_VIEW _vertex_buffer_view;
+	uint8_t* _data_cpu = nullptr;		// Only for dynamic buffers, one copy per back buffer
+	int _size_in_bytes = 0;				// Of each copy
 };
 
 using sp_vertex_buffer_handle = sp_handle;
@@ -30,5 +35,7 @@ namespace detail
 }
 
 sp_vertex_buffer_handle sp_vertex_buffer_create(const char* name, const sp_vertex_buffer_desc& desc);
+// Goes through the copy queue like sp_texture_update. Dynamic buffers are written straight into the copy for this frame's back
+// buffer instead, since the GPU could still be reading the copies of frames in flight, and draw whatever was last written to.
 void sp_vertex_buffer_update(const sp_vertex_buffer_handle& buffer_handle, const void* data_cpu, int size_bytes);
 void sp_vertex_buffer_destroy(const sp_vertex_buffer_handle& buffer_handle);
\ No newline at end of file
@@ -33,34 +33,31 @@ namespace detail
 
 sp_vertex_buffer_handle sp_vertex_buffer_create(const char* name, const sp_vertex_buffer_desc& desc)
 {
-	HRESULT hr = S_OK;
-
 	sp_vertex_buffer_handle buffer_handle = sp_handle_alloc(&detail::resource_pools::vertex_buffer_handles);
 	sp_vertex_buffer& buffer = detail::resource_pools::vertex_buffers[buffer_handle.index];
 
-	// Note: using upload heaps to transfer static data is not 
-	// recommended. Every time the GPU needs it, the upload heap will be marshalled 
-	// over. Please read up on Default Heap usage. An upload heap is used here for 
-	// code simplicity.
-
-	const D3D12_HEAP_PROPERTIES heap_properties_d3d12 = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-	const D3D12_RESOURCE_DESC resource_desc_d3d12 = CD3DX12_RESOURCE_DESC::Buffer(desc._size_in_bytes);
-	hr = detail::_sp._device->CreateCommittedResource(
-		&heap_properties_d3d12,
-		D3D12_HEAP_FLAG_NONE,
-		&resource_desc_d3d12,
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_PPV_ARGS(&buffer._resource));
-	assert(SUCCEEDED(hr));
+	if (desc._dynamic)
+	{
+		// Written every frame so reading it across the bus beats copying it first. Copies are aligned like constant buffers.
+		const int size_in_bytes_aligned = (desc._size_in_bytes + 255) & ~255;
+		buffer._memory_block = detail::sp_gpu_memory_alloc(sp_gpu_memory_pool_type::upload_buffers, size_in_bytes_aligned * k_back_buffer_count, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+		buffer._data_cpu = detail::sp_gpu_memory_get_cpu_address(buffer._memory_block);
+		buffer._size_in_bytes = size_in_bytes_aligned;
+	}
+	else
+	{
+		// Lives in a default heap so the GPU isn't reading it across the bus every frame
+		buffer._memory_block = detail::sp_gpu_memory_alloc(sp_gpu_memory_pool_type::default_buffers, desc._size_in_bytes, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+		buffer._data_cpu = nullptr;
+		buffer._size_in_bytes = desc._size_in_bytes;
+	}
 
-	buffer._name = name;
+	// The page's buffer is shared so it can't be named after this one
+	buffer._resource = detail::sp_gpu_memory_get_buffer(buffer._memory_block);
 
-#if SP_DEBUG_RESOURCE_NAMING_ENABLED
-	buffer._resource->SetName(std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().from_bytes(name).c_str());
-#endif
+	buffer._name = name;
 
-	buffer._vertex_buffer_view.BufferLocation = buffer._resource->GetGPUVirtualAddress();
+	buffer._vertex_buffer_view.BufferLocation = detail::sp_gpu_memory_get_gpu_address(buffer._memory_block);
 	buffer._vertex_buffer_view.StrideInBytes = desc._stride_in_bytes;
 	buffer._vertex_buffer_view.SizeInBytes = desc._size_in_bytes;
 
@@ -71,19 +68,27 @@ void sp_vertex_buffer_update(const sp_vertex_buffer_handle& buffer_handle, const
 {
 	sp_vertex_buffer& buffer = detail::resource_pools::vertex_buffers[buffer_handle.index];
 
-	void* data_gpu;
-	CD3DX12_RANGE read_range(0, 0); // A range where end <= begin indicates we do not intend to read from this resource on the CPU.
-	HRESULT hr = buffer._resource->Map(0, &read_range, &data_gpu);
-	assert(SUCCEEDED(hr));
-	memcpy(data_gpu, data_cpu, size_bytes);
-	buffer._resource->Unmap(0, nullptr);
+	assert(size_bytes <= buffer._size_in_bytes);
+
+	if (buffer._data_cpu)
+	{
+		const int offset_bytes = buffer._size_in_bytes * detail::_sp._back_buffer_index;
+		memcpy(buffer._data_cpu + offset_bytes, data_cpu, size_bytes);
+		buffer._vertex_buffer_view.BufferLocation = detail::sp_gpu_memory_get_gpu_address(buffer._memory_block) + offset_bytes;
+		return;
+	}
+
+	detail::sp_upload_buffer_region(detail::_sp._upload_context, buffer._resource.Get(), buffer._memory_block._offset_bytes, data_cpu, size_bytes);
 }
 
 void sp_vertex_buffer_destroy(const sp_vertex_buffer_handle& buffer_handle)
 {
 	sp_vertex_buffer& buffer = detail::resource_pools::vertex_buffers[buffer_handle.index];
 
+	// The page's buffer stays alive regardless, it's only the block that has to wait for the GPU
 	buffer._resource = nullptr;
+	buffer._data_cpu = nullptr;
+	detail::sp_deferred_release(buffer._memory_block);
 
 	sp_handle_free(&detail::resource_pools::vertex_buffer_handles, buffer_handle);
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+// Cooks glTF models into the mesh file format from sparky/source/mesh_file.h so they can be loaded with a memory map instead of
+// parsing JSON and copying attributes around.
+//
+// mesh_cooker <input.gltf> <output.spmesh>
+//
+// Models are run through the mesh optimizer, given LODs, quantized and split into meshlets on the way. The vertex cache stats
+// from before and after, the triangles and error at each LOD, the worst quantization error, the vertex size and how well the
+// meshlets fill up and cull are reported along with how long the import, the LODs, the meshlet build and the cooked load each
+// took. Meshlets are built once on one thread and once on
+// every worker, which also checks the two come out the same.
+
+#include "../../../sparky/source/file_map_impl.h"
+#include "../../../sparky/source/job_impl.h"
+#include "../../../sparky/source/mesh_file_impl.h"
+#include "../../../sparky/source/mesh_gltf_impl.h"
+#include "../../../sparky/source/mesh_lod_impl.h"
+#include "../../../sparky/source/mesh_meshlet_impl.h"
+#include "../../../sparky/source/mesh_optimize_impl.h"
+#include "../../../sparky/source/mesh_quantize_impl.h"
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+
+int main(int argc, char** argv)
+{
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: mesh_cooker <input.gltf> <output.spmesh>\n");
+		return 1;
+	}
+
+	const char* input_path = argv[1];
+	const char* output_path = argv[2];
+
+	const auto import_start_time = std::chrono::high_resolution_clock::now();
+
+	sp_mesh mesh;
+	try
+	{
+		mesh = sp_mesh_create_from_gltf(input_path);
+	}
+	catch (const std::exception& exception)
+	{
+		fprintf(stderr, "%s: %s\n", input_path, exception.what());
+		return 1;
+	}
+
+	const double import_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - import_start_time).count();
+
+	const sp_mesh_vertex_cache_stats source_stats = sp_mesh_analyze_vertex_cache(mesh);
+
+	const auto optimize_start_time = std::chrono::high_resolution_clock::now();
+
+	sp_mesh_optimize(mesh, sp_mesh_optimize_desc());
+
+	const double optimize_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - optimize_start_time).count();
+
+	const sp_mesh_vertex_cache_stats optimized_stats = sp_mesh_analyze_vertex_cache(mesh);
+
+	printf("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %d -> %d vertices, optimized in %.1f ms\n",
+		input_path,
+		source_stats._acmr,
+		optimized_stats._acmr,
+		source_stats._atvr,
+		optimized_stats._atvr,
+		source_stats._vertex_count,
+		optimized_stats._vertex_count,
+		optimize_seconds * 1000.0);
+
+	sp_job_system_init();
+
+	const auto lod_start_time = std::chrono::high_resolution_clock::now();
+
+	sp_mesh_generate_lods(mesh, sp_mesh_lod_desc());
+
+	const double lod_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - lod_start_time).count();
+
+	// Submeshes that run out of LODs count at their coarsest
+	size_t lod_triangle_counts[k_mesh_lod_count_max + 1] = {};
+	float lod_errors[k_mesh_lod_count_max + 1] = {};
+
+	for (const sp_mesh_submesh& submesh : mesh._submeshes)
+	{
+		for (uint32_t i = 0; i <= k_mesh_lod_count_max; ++i)
+		{
+			const uint32_t lod_index = std::min(i, submesh._lod_count);
+			const sp_mesh_lod* lod = lod_index > 0 ? &mesh._lods[submesh._first_lod + lod_index - 1] : nullptr;
+
+			lod_triangle_counts[i] += (lod ? lod->_index_count : submesh._index_count) / 3;
+			lod_errors[i] = std::max(lod_errors[i], lod ? lod->_error : 0.0f);
+		}
+	}
+
+	printf("%s: LOD triangles", input_path);
+	for (int i = 0; i <= k_mesh_lod_count_max; ++i)
+	{
+		printf("%s %zu (error %g)", i > 0 ? "," : "", lod_triangle_counts[i], lod_errors[i]);
+	}
+	printf(", generated in %.1f ms\n", lod_seconds * 1000.0);
+
+	sp_mesh_quantize_report quantize_report;
+	const sp_mesh_quantized_vertices quantized_vertices = sp_mesh_quantize(mesh, sp_mesh_quantize_desc(), &quantize_report);
+
+	printf("%s: %d -> %u bytes per vertex, position error %g (%g of the bounds), normal error %.3f degrees, texcoord error %g%s%s\n",
+		input_path,
+		static_cast<int>(sizeof(sp_mesh_vertex)),
+		quantized_vertices._format._stride_bytes,
+		quantize_report._position_error_max,
+		quantize_report._position_error_max_relative,
+		quantize_report._normal_error_max_degrees,
+		quantize_report._texcoord_error_max,
+		quantized_vertices._format._texcoord == sp_mesh_attribute_format::float32x2 ? ", texcoords kept as floats" : "",
+		quantized_vertices._format._color == sp_mesh_attribute_format::none ? ", constant color dropped" : "");
+
+	// Bounds have to fit the positions the GPU ends up with
+	sp_mesh_dequantize(mesh, quantized_vertices);
+
+	sp_mesh_meshlet_desc serial_desc;
+	serial_desc.parallel = false;
+
+	sp_mesh serial_mesh = mesh;
+
+	const auto serial_start_time = std::chrono::high_resolution_clock::now();
+
+	sp_mesh_build_meshlets(serial_mesh, serial_desc);
+
+	const double serial_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - serial_start_time).count();
+
+	const auto parallel_start_time = std::chrono::high_resolution_clock::now();
+
+	sp_mesh_build_meshlets(mesh, sp_mesh_meshlet_desc());
+
+	const double parallel_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - parallel_start_time).count();
+
+	const int worker_count = sp_job_system_get_worker_count();
+
+	sp_job_system_shutdown();
+
+	const bool deterministic =
+		serial_mesh._indices == mesh._indices &&
+		serial_mesh._meshlet_vertices == mesh._meshlet_vertices &&
+		serial_mesh._meshlet_triangles == mesh._meshlet_triangles &&
+		serial_mesh._meshlets.size() == mesh._meshlets.size() &&
+		memcmp(serial_mesh._meshlets.data(), mesh._meshlets.data(), mesh._meshlets.size() * sizeof(sp_mesh_meshlet)) == 0;
+
+	if (!deterministic)
+	{
+		fprintf(stderr, "%s: meshlets built on %d workers don't match the ones built on one\n", input_path, worker_count);
+		return 1;
+	}
+
+	const sp_mesh_meshlet_stats meshlet_stats = sp_mesh_analyze_meshlets(mesh);
+
+	printf("%s: %d meshlets, %.0f%% vertex and %.0f%% triangle fill, %.2f vertices per triangle, radius %.3f of the model, cones %.1f degrees, %.1f%% backface culled\n",
+		input_path,
+		meshlet_stats._meshlet_count,
+		meshlet_stats._vertex_fill * 100.0f,
+		meshlet_stats._triangle_fill * 100.0f,
+		meshlet_stats._vertices_per_triangle,
+		meshlet_stats._radius_relative,
+		meshlet_stats._cone_angle_degrees,
+		meshlet_stats._backface_culled * 100.0f);
+
+	printf("%s: meshlets built in %.1f ms on 1 thread (%.1f M triangles/s), %.1f ms on %d (%.1f M triangles/s, %.1fx)\n",
+		input_path,
+		serial_seconds * 1000.0,
+		mesh._indices.size() / 3 / serial_seconds / 1e6,
+		parallel_seconds * 1000.0,
+		worker_count,
+		mesh._indices.size() / 3 / parallel_seconds / 1e6,
+		serial_seconds / parallel_seconds);
+
+	if (!sp_mesh_file_write(output_path, mesh, quantized_vertices))
+	{
+		fprintf(stderr, "%s: couldn't be written\n", output_path);
+		return 1;
+	}
+
+	// Touches every vertex and index the same way copying them into upload staging would, so the time includes the page faults
+	const auto load_start_time = std::chrono::high_resolution_clock::now();
+
+	sp_mesh_file mesh_file;
+	if (!sp_mesh_file_open(output_path, mesh_file))
+	{
+		fprintf(stderr, "%s: couldn't be read back\n", output_path);
+		return 1;
+	}
+
+	const size_t vertices_size_bytes = static_cast<size_t>(mesh_file._vertex_count) * mesh_file._vertex_format._stride_bytes;
+
+	std::vector<uint8_t> staging(vertices_size_bytes + mesh_file._index_count * sizeof(uint32_t));
+	memcpy(staging.data(), mesh_file._vertices, vertices_size_bytes);
+	memcpy(staging.data() + vertices_size_bytes, mesh_file._indices, mesh_file._index_count * sizeof(uint32_t));
+
+	const double load_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - load_start_time).count();
+
+	printf("%s -> %s: %d submeshes, %d vertices, %d triangles, %.1f MB, imported in %.1f ms, loads in %.2f ms (%.0fx)\n",
+		input_path,
+		output_path,
+		mesh_file._submesh_count,
+		mesh_file._vertex_count,
+		mesh_file._index_count / 3,
+		mesh_file._size_bytes / (1024.0 * 1024.0),
+		import_seconds * 1000.0,
+		load_seconds * 1000.0,
+		import_seconds / load_seconds);
+
+	sp_mesh_file_close(mesh_file);
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,557 @@
+// Times the parts of sparky that don't need a GPU: the job system, frustum culling and the bvh, sorting the render queue,
+// building mip chains and loading textures. Builds with Visual Studio or on its own anywhere else, e.g.
+//
+// g++ -std=c++17 -O2 -march=native -pthread -Ithird_party/stb tools/sparky_benchmark/source/main.cpp -o sparky_benchmark
+//
+// sparky_benchmark [image]
+//
+// Texture loading decodes the image (a PNG from the pbr demo if none is given, relative to the root of the repository) and
+// compares that with loading it cooked to DDS and KTX2. The cooked files are written to the working directory and deleted again.
+//
+// Every benchmark reports the best of a few runs so the numbers are stable enough to compare between builds.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include "../../../sparky/source/job_impl.h"
+#include "../../../sparky/source/bvh_impl.h"
+#include "../../../sparky/source/render_queue_impl.h"
+#include "../../../sparky/source/image_mips_impl.h"
+#include "../../../sparky/source/image_bc_impl.h"
+#include "../../../sparky/source/image_convert_impl.h"
+#include "../../../sparky/source/image_dds_impl.h"
+#include "../../../sparky/source/image_ktx2_impl.h"
+#include "../../../sparky/source/image_file_impl.h"
+#include "../../../sparky/source/file_map_impl.h"
+#include "../../../sparky/source/math.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+static double benchmark_best_ms(int run_count, const std::function<void()>& function)
+{
+	double best_ms = 1e30;
+	for (int run = 0; run < run_count; ++run)
+	{
+		const auto start_time = std::chrono::high_resolution_clock::now();
+		function();
+		best_ms = std::min(best_ms, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count() * 1000.0);
+	}
+	return best_ms;
+}
+
+// Enough arithmetic per element that the batches aren't just measuring the scheduler
+static float benchmark_job_work(int i)
+{
+	float x = static_cast<float>(i);
+	for (int k = 0; k < 64; ++k)
+	{
+		x = std::sqrt(x * 1.0001f + 1.0f);
+	}
+	return x;
+}
+
+static void benchmark_job_spawn_tree(int depth, std::atomic<int>& leaf_count)
+{
+	if (depth == 0)
+	{
+		benchmark_job_work(leaf_count.fetch_add(1, std::memory_order_relaxed));
+		return;
+	}
+
+	sp_job_counter counter;
+	for (int i = 0; i < 8; ++i)
+	{
+		sp_job_run([depth, &leaf_count]() { benchmark_job_spawn_tree(depth - 1, leaf_count); }, &counter);
+	}
+	sp_job_wait(counter);
+}
+
+// parallel_for over independent work, a tree of jobs that each wait on their children and jobs that park on a flag while
+// others run, with 1, 2, 4 and every hardware thread
+static void benchmark_job_system()
+{
+	const int hardware_thread_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	std::vector<int> worker_counts = { 1, 2, 4 };
+	if (hardware_thread_count > 4)
+	{
+		worker_counts.push_back(hardware_thread_count);
+	}
+
+	const int element_count = 1 << 20;
+	std::vector<float> results(element_count);
+
+	double parallel_for_ms_1 = 0.0;
+	double nested_ms_1 = 0.0;
+	double parking_ms_1 = 0.0;
+
+	for (int worker_count : worker_counts)
+	{
+		sp_job_system_init(worker_count - 1);
+
+		const double parallel_for_ms = benchmark_best_ms(5, [&results]() {
+			sp_job_parallel_for(static_cast<int>(results.size()), 0, [&results](int begin, int end) {
+				for (int i = begin; i < end; ++i)
+				{
+					results[i] = benchmark_job_work(i);
+				}
+			});
+		});
+
+		// 32768 leaves under 4680 jobs that wait on their children
+		const double nested_ms = benchmark_best_ms(5, []() {
+			std::atomic<int> leaf_count{ 0 };
+			benchmark_job_spawn_tree(5, leaf_count);
+		});
+
+		// Half the jobs wait for the other half to finish, so a worker that blocked instead of parking would deadlock or idle
+		const double parking_ms = benchmark_best_ms(5, []() {
+			const int pair_count = 1024;
+
+			std::vector<sp_job_counter> producer_counters(pair_count);
+			sp_job_counter counter;
+
+			for (int i = 0; i < pair_count; ++i)
+			{
+				sp_job_counter* producer_counter = &producer_counters[i];
+				sp_job_run([producer_counter]() {
+					sp_job_wait(*producer_counter);
+					for (int k = 0; k < 256; ++k)
+					{
+						benchmark_job_work(k);
+					}
+				}, &counter);
+			}
+
+			for (int i = 0; i < pair_count; ++i)
+			{
+				sp_job_run([i]() {
+					for (int k = 0; k < 256; ++k)
+					{
+						benchmark_job_work(i + k);
+					}
+				}, &producer_counters[i]);
+			}
+
+			sp_job_wait(counter);
+		});
+
+		sp_job_system_shutdown();
+
+		if (worker_count == 1)
+		{
+			parallel_for_ms_1 = parallel_for_ms;
+			nested_ms_1 = nested_ms;
+			parking_ms_1 = parking_ms;
+		}
+
+		printf("jobs, %2d workers: parallel_for %7.2f ms (%.2fx), nested waits %7.2f ms (%.2fx), parked waits %7.2f ms (%.2fx)\n",
+			worker_count,
+			parallel_for_ms,
+			parallel_for_ms_1 / parallel_for_ms,
+			nested_ms,
+			nested_ms_1 / nested_ms,
+			parking_ms,
+			parking_ms_1 / parking_ms);
+	}
+}
+
+// A hundred thousand boxes of a few meters scattered through a kilometer, looked at from outside one face, culled one at a time,
+// a batch at a time and through the hierarchy
+static void benchmark_culling()
+{
+	const int object_count = 100000;
+	const int repeat_count = 100;
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> random_position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> random_extent(0.5f, 4.0f);
+	std::uniform_real_distribution<float> random_movement(-20.0f, 20.0f);
+
+	std::vector<sp_bvh_bounds> object_bounds(object_count);
+	std::vector<float> centers[3];
+	std::vector<float> extents[3];
+	std::vector<float> radii(object_count);
+	for (int i = 0; i < object_count; ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			const float position = random_position(random);
+			const float extent = random_extent(random);
+			object_bounds[i]._min[k] = position - extent;
+			object_bounds[i]._max[k] = position + extent;
+			centers[k].push_back(position);
+			extents[k].push_back(extent);
+		}
+		radii[i] = math::length(math::vec<3>{ extents[0][i], extents[1][i], extents[2][i] });
+	}
+
+	const math::aabb_soa aabbs = { { centers[0].data(), centers[1].data(), centers[2].data() }, { extents[0].data(), extents[1].data(), extents[2].data() } };
+	const math::sphere_soa spheres = { { centers[0].data(), centers[1].data(), centers[2].data() }, radii.data() };
+
+	const math::mat<4> view_matrix = math::inverse(math::create_translation({ 0.0f, 0.0f, 600.0f }));
+	const math::mat<4> projection_matrix = math::create_perspective_fov_rh(math::pi / 3, 16.0f / 9.0f, 0.1f, 10000.0f);
+
+	float planes[6][4];
+	math::get_frustum_planes(math::multiply(view_matrix, projection_matrix), planes);
+
+#if defined(__AVX__)
+	const int batch_size = 8;
+#else
+	const int batch_size = 4;
+#endif
+
+	std::vector<uint32_t> visible(object_count);
+
+	// The best of repeat_count runs, in microseconds
+	auto time = [&](auto&& cull) {
+		double best_us = DBL_MAX;
+		for (int i = 0; i < repeat_count; ++i)
+		{
+			const auto start_time = std::chrono::high_resolution_clock::now();
+			cull();
+			best_us = std::min(best_us, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count() * 1000000.0);
+		}
+		return best_us;
+	};
+
+	int reference_visible_count = 0;
+	int visible_count = 0;
+	std::vector<uint32_t> reference_visible(object_count);
+
+	const double aabbs_reference_us = time([&] { reference_visible_count = math::frustum_cull_aabbs_reference(planes, aabbs, object_count, reference_visible.data()); });
+	const double aabbs_us = time([&] { visible_count = math::frustum_cull_aabbs(planes, aabbs, object_count, visible.data()); });
+	const bool aabbs_match = visible_count == reference_visible_count && std::equal(visible.begin(), visible.begin() + visible_count, reference_visible.begin());
+
+	printf("culling: %d of %d boxes visible, %.0f objects/us one at a time, %.0f objects/us %d at a time (%.1fx)%s\n",
+		visible_count, object_count, object_count / aabbs_reference_us, object_count / aabbs_us, batch_size,
+		aabbs_reference_us / aabbs_us, aabbs_match ? "" : ", DIFFERENT FROM THE REFERENCE");
+
+	const double spheres_reference_us = time([&] { reference_visible_count = math::frustum_cull_spheres_reference(planes, spheres, object_count, reference_visible.data()); });
+	const double spheres_us = time([&] { visible_count = math::frustum_cull_spheres(planes, spheres, object_count, visible.data()); });
+	const bool spheres_match = visible_count == reference_visible_count && std::equal(visible.begin(), visible.begin() + visible_count, reference_visible.begin());
+
+	printf("culling: %d of %d spheres visible, %.0f objects/us one at a time, %.0f objects/us %d at a time (%.1fx)%s\n",
+		visible_count, object_count, object_count / spheres_reference_us, object_count / spheres_us, batch_size,
+		spheres_reference_us / spheres_us, spheres_match ? "" : ", DIFFERENT FROM THE REFERENCE");
+
+	auto start_time = std::chrono::high_resolution_clock::now();
+
+	sp_bvh bvh;
+	sp_bvh_build(bvh, object_bounds.data(), object_count, sp_bvh_desc());
+
+	const double build_ms = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count() * 1000.0;
+	const float build_cost = sp_bvh_cost(bvh);
+
+	std::vector<uint32_t> bvh_visible;
+	const double bvh_us = time([&] { sp_bvh_cull_frustum(bvh, planes, bvh_visible); });
+
+	printf("culling: bvh built in %.1f ms, %d nodes, cost %.1f, %d boxes visible at %.0f objects/us\n",
+		build_ms, static_cast<int>(bvh._nodes.size()), build_cost, static_cast<int>(bvh_visible.size()), object_count / bvh_us);
+
+	for (auto& bounds : object_bounds)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			const float movement = random_movement(random);
+			bounds._min[k] += movement;
+			bounds._max[k] += movement;
+		}
+	}
+
+	start_time = std::chrono::high_resolution_clock::now();
+
+	sp_bvh_refit(bvh, object_bounds.data());
+
+	const double refit_ms = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count() * 1000.0;
+
+	printf("culling: bvh refitted after moving every object in %.2f ms, cost %.1f\n", refit_ms, sp_bvh_cost(bvh));
+}
+
+// A million draws over a few passes, pipelines and a thousand materials at random depths, an eighth of them transparent,
+// sorted by comparison and by the render queue on this thread and across the job system. Needs the job system running.
+static void benchmark_render_queue()
+{
+	const int item_count = 1000000;
+	const int repeat_count = 10;
+
+	std::mt19937 random(1);
+	std::uniform_int_distribution<uint32_t> random_pass(0, 3);
+	std::uniform_int_distribution<uint32_t> random_pipeline(0, 31);
+	std::uniform_int_distribution<uint32_t> random_material(0, 999);
+	std::uniform_real_distribution<float> random_depth(0.1f, 1000.0f);
+
+	sp_render_queue unsorted;
+	for (int i = 0; i < item_count; ++i)
+	{
+		const bool transparent = random() % 8 == 0;
+		const sp_render_queue_depth_order depth_order = transparent ? sp_render_queue_depth_order::back_to_front : sp_render_queue_depth_order::front_to_back;
+		sp_render_queue_push(unsorted, sp_render_queue_key(random_pass(random), random_pipeline(random), random_material(random), random_depth(random), depth_order), i);
+	}
+
+	// The best of repeat_count runs, in milliseconds, each starting from the same unsorted items
+	auto time = [&](sp_render_queue& queue, auto&& sort) {
+		double best_ms = DBL_MAX;
+		for (int i = 0; i < repeat_count; ++i)
+		{
+			queue._items = unsorted._items;
+			const auto start_time = std::chrono::high_resolution_clock::now();
+			sort();
+			best_ms = std::min(best_ms, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count() * 1000.0);
+		}
+		return best_ms;
+	};
+
+	sp_render_queue reference;
+	const double reference_ms = time(reference, [&] {
+		std::stable_sort(reference._items.begin(), reference._items.end(), [](const sp_render_queue_item& a, const sp_render_queue_item& b) {
+			return a._key < b._key;
+		});
+	});
+
+	auto matches_reference = [&](const sp_render_queue& queue) {
+		return std::equal(queue._items.begin(), queue._items.end(), reference._items.begin(), reference._items.end(), [](const sp_render_queue_item& a, const sp_render_queue_item& b) {
+			return a._key == b._key && a._payload == b._payload;
+		});
+	};
+
+	sp_render_queue serial;
+	sp_render_queue_sort_desc serial_desc;
+	serial_desc.parallel = false;
+	const double serial_ms = time(serial, [&] { sp_render_queue_sort(serial, serial_desc); });
+
+	sp_render_queue parallel;
+	const double parallel_ms = time(parallel, [&] { sp_render_queue_sort(parallel, sp_render_queue_sort_desc()); });
+
+	printf("render queue: %d keys, %.2f ms stable sort, %.2f ms radix sort (%.1fx)%s, %.2f ms radix sort over %d workers (%.1fx)%s\n",
+		item_count, reference_ms,
+		serial_ms, reference_ms / serial_ms, matches_reference(serial) ? "" : " DIFFERENT FROM THE REFERENCE",
+		parallel_ms, sp_job_system_get_worker_count(), reference_ms / parallel_ms, matches_reference(parallel) ? "" : " DIFFERENT FROM THE REFERENCE");
+}
+
+// A 2048x2048 8 bit image and a 2048x1024 float one, like an albedo map and an environment, built with both filters on this
+// thread and across the job system. MPixels/s counts the top level so it compares with decoding the image. Needs the job
+// system running.
+static void benchmark_image_mips()
+{
+	const int repeat_count = 5;
+
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int> random_byte(0, 255);
+	std::uniform_real_distribution<float> random_radiance(0.0f, 16.0f);
+
+	const int width_8 = 2048;
+	const int height_8 = 2048;
+	std::vector<uint8_t> image_8(static_cast<size_t>(width_8) * height_8 * 4);
+	for (uint8_t& value : image_8)
+	{
+		value = static_cast<uint8_t>(random_byte(random));
+	}
+
+	const int width_32 = 2048;
+	const int height_32 = 1024;
+	std::vector<float> image_32(static_cast<size_t>(width_32) * height_32 * 4);
+	for (float& value : image_32)
+	{
+		value = random_radiance(random);
+	}
+
+	struct image_mips_case
+	{
+		const char* name;
+		const void* data;
+		int width;
+		int height;
+		sp_image_format format;
+		sp_image_color_space color_space;
+		sp_image_mip_filter filter;
+	};
+
+	const image_mips_case cases[] = {
+		{ "r8g8b8a8 srgb box", image_8.data(), width_8, height_8, sp_image_format::r8g8b8a8, sp_image_color_space::srgb, sp_image_mip_filter::box },
+		{ "r8g8b8a8 srgb kaiser", image_8.data(), width_8, height_8, sp_image_format::r8g8b8a8, sp_image_color_space::srgb, sp_image_mip_filter::kaiser },
+		{ "r8g8b8a8 linear box", image_8.data(), width_8, height_8, sp_image_format::r8g8b8a8, sp_image_color_space::linear, sp_image_mip_filter::box },
+		{ "r32g32b32a32 box", image_32.data(), width_32, height_32, sp_image_format::r32g32b32a32, sp_image_color_space::linear, sp_image_mip_filter::box },
+		{ "r32g32b32a32 kaiser", image_32.data(), width_32, height_32, sp_image_format::r32g32b32a32, sp_image_color_space::linear, sp_image_mip_filter::kaiser },
+	};
+
+	for (const image_mips_case& image_case : cases)
+	{
+		sp_image_mip_chain_desc desc;
+		desc.format = image_case.format;
+		desc.color_space = image_case.color_space;
+		desc.filter = image_case.filter;
+
+		desc.parallel = false;
+		const double serial_ms = benchmark_best_ms(repeat_count, [&]() { sp_image_mip_chain_create(image_case.data, image_case.width, image_case.height, desc); });
+
+		desc.parallel = true;
+		const double parallel_ms = benchmark_best_ms(repeat_count, [&]() { sp_image_mip_chain_create(image_case.data, image_case.width, image_case.height, desc); });
+
+		const double megapixels = static_cast<double>(image_case.width) * image_case.height / 1000000.0;
+
+		printf("image mips: %dx%d %s, %.2f ms (%.1f MPixels/s) on this thread, %.2f ms (%.1f MPixels/s) over %d workers (%.1fx)\n",
+			image_case.width, image_case.height, image_case.name,
+			serial_ms, megapixels / (serial_ms / 1000.0),
+			parallel_ms, megapixels / (parallel_ms / 1000.0), sp_job_system_get_worker_count(), serial_ms / parallel_ms);
+	}
+}
+
+// sparky only reads KTX2 so this writes the least the reader needs: the header and level index, and no data format descriptor.
+// Levels are stored smallest first like every other KTX2 writer does.
+static bool benchmark_write_ktx2(const char* path, const sp_image_mip_chain& mip_chain, uint32_t vk_format)
+{
+	const int block_size_bytes = sp_image_format_get_block_size_bytes(mip_chain._format);
+
+	sp_image_ktx2_header header;
+	memcpy(header.identifier, k_image_ktx2_identifier, sizeof(header.identifier));
+	header.vk_format = vk_format;
+	header.type_size = 1;
+	header.pixel_width = mip_chain._mips[0]._width;
+	header.pixel_height = mip_chain._mips[0]._height;
+	header.face_count = 1;
+	header.level_count = mip_chain._mip_count;
+
+	std::vector<uint8_t> file_data(sizeof(header) + sizeof(sp_image_ktx2_level_index) * mip_chain._mip_count);
+	std::vector<sp_image_ktx2_level_index> level_indices(mip_chain._mip_count);
+
+	for (int mip = mip_chain._mip_count - 1; mip >= 0; --mip)
+	{
+		const sp_image_mip& level = mip_chain._mips[mip];
+		const size_t size_bytes = static_cast<size_t>(level._row_pitch_bytes) * sp_image_format_get_row_count(mip_chain._format, level._height);
+
+		file_data.resize((file_data.size() + block_size_bytes - 1) / block_size_bytes * block_size_bytes);
+
+		level_indices[mip].byte_offset = file_data.size();
+		level_indices[mip].byte_length = size_bytes;
+		level_indices[mip].uncompressed_byte_length = size_bytes;
+
+		file_data.insert(file_data.end(), mip_chain._data.begin() + level._offset_bytes, mip_chain._data.begin() + level._offset_bytes + size_bytes);
+	}
+
+	memcpy(file_data.data(), &header, sizeof(header));
+	memcpy(file_data.data() + sizeof(header), level_indices.data(), sizeof(sp_image_ktx2_level_index) * level_indices.size());
+
+	FILE* file = nullptr;
+#if defined(_WIN32)
+	if (fopen_s(&file, path, "wb") != 0)
+#else
+	if (!(file = fopen(path, "wb")))
+#endif
+	{
+		return false;
+	}
+
+	const bool written = fwrite(file_data.data(), 1, file_data.size(), file) == file_data.size();
+
+	return fclose(file) == 0 && written;
+}
+
+// What the pbr demo does for an image that hasn't been cooked, decoding it and building its mips on this thread, against opening
+// the BC7 DDS and KTX2 texture_cooker would make of it and copying every mip out as if into upload staging. The cooked files are
+// in the file cache after the first run, same as when a level is loaded again. Needs the job system running.
+static void benchmark_image_load(const char* path)
+{
+	const int repeat_count = 5;
+
+	int width, height, channels;
+	stbi_uc* image_data = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
+	if (!image_data)
+	{
+		printf("image load: skipped, %s: %s\n", path, stbi_failure_reason());
+		return;
+	}
+
+	if (width % 4 != 0 || height % 4 != 0)
+	{
+		printf("image load: skipped, %s is %dx%d which isn't a multiple of 4\n", path, width, height);
+		stbi_image_free(image_data);
+		return;
+	}
+
+	sp_image_mip_chain_desc desc;
+	desc.color_space = sp_image_color_space::srgb;
+	desc.parallel = false;
+
+	const sp_image_mip_chain cooked = sp_image_mip_chain_compress(sp_image_mip_chain_create(image_data, width, height, desc), sp_image_format::bc7);
+	stbi_image_free(image_data);
+
+	const char* dds_path = "sparky_benchmark_image_load.dds";
+	const char* ktx2_path = "sparky_benchmark_image_load.ktx2";
+
+	if (!sp_image_dds_write(dds_path, cooked, desc.color_space) || !benchmark_write_ktx2(ktx2_path, cooked, 146))	// VK_FORMAT_BC7_SRGB_BLOCK
+	{
+		printf("image load: skipped, the cooked files couldn't be written to the working directory\n");
+		std::remove(dds_path);
+		std::remove(ktx2_path);
+		return;
+	}
+
+	const double decode_ms = benchmark_best_ms(repeat_count, [&]() {
+		int decoded_width, decoded_height, decoded_channels;
+		stbi_uc* decoded_data = stbi_load(path, &decoded_width, &decoded_height, &decoded_channels, STBI_rgb_alpha);
+		sp_image_mip_chain_create(decoded_data, decoded_width, decoded_height, desc);
+		stbi_image_free(decoded_data);
+	});
+
+	std::vector<uint8_t> staging(cooked._data.size());
+
+	bool opened = true;
+	auto load_cooked = [&](const char* cooked_path) {
+		sp_image_file image_file;
+		if (!sp_image_file_open(cooked_path, image_file))
+		{
+			opened = false;
+			return;
+		}
+
+		size_t offset_bytes = 0;
+		for (int mip = 0; mip < image_file._mip_count; ++mip)
+		{
+			const size_t size_bytes = detail::sp_image_file_get_subresource_size_bytes(image_file, mip);
+			memcpy(staging.data() + offset_bytes, sp_image_file_get_data(image_file, mip, 0), size_bytes);
+			offset_bytes += size_bytes;
+		}
+
+		sp_image_file_close(image_file);
+	};
+
+	const double dds_ms = benchmark_best_ms(repeat_count, [&]() { load_cooked(dds_path); });
+	const double ktx2_ms = benchmark_best_ms(repeat_count, [&]() { load_cooked(ktx2_path); });
+
+	std::remove(dds_path);
+	std::remove(ktx2_path);
+
+	if (!opened)
+	{
+		printf("image load: the cooked files couldn't be read back\n");
+		return;
+	}
+
+	printf("image load: %dx%d, %.2f ms decoding and building mips, %.3f ms from BC7 DDS (%.0fx), %.3f ms from BC7 KTX2 (%.0fx)\n",
+		width, height, decode_ms, dds_ms, decode_ms / dds_ms, ktx2_ms, decode_ms / ktx2_ms);
+}
+
+int main(int argc, char** argv)
+{
+	benchmark_job_system();
+	benchmark_culling();
+
+	sp_job_system_init();
+	benchmark_render_queue();
+	benchmark_image_mips();
+	benchmark_image_load(argc > 1 ? argv[1] : "demos/pbr/models/littlest_tokyo/textures/Material_5516_baseColor.png");
+	sp_job_system_shutdown();
+
+	return 0;
+}
\ No newline at end of file
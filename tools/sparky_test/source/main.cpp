@@ -0,0 +1,1483 @@
+// Checks the parts of sparky that don't need a GPU. Builds with Visual Studio or on its own anywhere else, e.g.
+//
+// g++ -std=c++17 -O2 -pthread tools/sparky_test/source/main.cpp -o sparky_test
+//
+// sparky_test
+//
+// Prints every failed check and returns non-zero if there were any.
+
+#include "../../../sparky/source/job_impl.h"
+#include "../../../sparky/source/indirect_cull_impl.h"
+#include "../../../sparky/source/bvh_impl.h"
+#include "../../../sparky/source/render_queue_impl.h"
+#include "../../../sparky/source/ring_allocator_impl.h"
+#include "../../../sparky/source/image_mips_impl.h"
+#include "../../../sparky/source/image_convert_impl.h"
+#include "../../../sparky/source/image_bc_impl.h"
+#include "../../../sparky/source/math.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <random>
+#include <thread>
+#include <vector>
+
+static int g_check_count = 0;
+static int g_check_failed_count = 0;
+
+#define SP_TEST_CHECK(condition) \
+	do \
+	{ \
+		++g_check_count; \
+		if (!(condition)) \
+		{ \
+			++g_check_failed_count; \
+			fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+		} \
+	} while (false)
+
+// Spins without running any jobs so whatever finishes has to have been run by a worker. False if it took too long.
+static bool test_spin_until(const std::function<bool()>& predicate)
+{
+	const auto start_time = std::chrono::steady_clock::now();
+	while (!predicate())
+	{
+		if (std::chrono::steady_clock::now() - start_time > std::chrono::seconds(10))
+		{
+			return false;
+		}
+		std::this_thread::yield();
+	}
+	return true;
+}
+
+static void test_job_parallel_for()
+{
+	const int counts[] = { 1, 7, 1000, 100000 };
+	const int batch_sizes[] = { 0, 1, 3, 64, 1000000 };
+
+	for (int count : counts)
+	{
+		for (int batch_size : batch_sizes)
+		{
+			std::vector<std::atomic<int>> visits(count);
+
+			sp_job_parallel_for(count, batch_size, [&visits](int begin, int end) {
+				for (int i = begin; i < end; ++i)
+				{
+					visits[i].fetch_add(1, std::memory_order_relaxed);
+				}
+			});
+
+			int visited_once_count = 0;
+			for (const auto& visit : visits)
+			{
+				visited_once_count += visit.load() == 1 ? 1 : 0;
+			}
+
+			SP_TEST_CHECK(visited_once_count == count);
+		}
+	}
+
+	bool called = false;
+	sp_job_parallel_for(0, 0, [&called](int, int) { called = true; });
+	SP_TEST_CHECK(!called);
+}
+
+// Every job below the leaves runs its children and waits on them, so there are far more waits in flight than fibers
+static void test_job_spawn_tree(int depth, std::atomic<int>& leaf_count)
+{
+	if (depth == 0)
+	{
+		leaf_count.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	sp_job_counter counter;
+	for (int i = 0; i < 4; ++i)
+	{
+		sp_job_run([depth, &leaf_count]() { test_job_spawn_tree(depth - 1, leaf_count); }, &counter);
+	}
+	sp_job_wait(counter);
+}
+
+static void test_job_nested()
+{
+	std::atomic<int> leaf_count{ 0 };
+	test_job_spawn_tree(6, leaf_count);
+	SP_TEST_CHECK(leaf_count.load() == 4 * 4 * 4 * 4 * 4 * 4);
+
+	// A parallel_for inside jobs
+	std::atomic<int> sum{ 0 };
+	sp_job_counter counter;
+	for (int i = 0; i < 16; ++i)
+	{
+		sp_job_run([&sum]() {
+			sp_job_parallel_for(256, 8, [&sum](int begin, int end) { sum.fetch_add(end - begin, std::memory_order_relaxed); });
+		}, &counter);
+	}
+	sp_job_wait(counter);
+	SP_TEST_CHECK(sum.load() == 16 * 256);
+}
+
+// More jobs wait than there are workers. If waiting blocked a worker instead of parking its fiber nothing else could run.
+static void test_job_parking()
+{
+	const int worker_thread_count = sp_job_system_get_worker_count() - 1;
+	if (worker_thread_count == 0)
+	{
+		return;
+	}
+
+	std::atomic<bool> release{ false };
+	std::atomic<int> resumed_count{ 0 };
+	std::atomic<int> started_count{ 0 };
+
+	const int waiting_job_count = std::min(worker_thread_count * 2, k_job_fiber_count / 2);
+
+	sp_job_counter waiting_counter;
+	for (int i = 0; i < waiting_job_count; ++i)
+	{
+		sp_job_run([&]() {
+			if (sp_job_can_park())
+			{
+				started_count.fetch_add(1, std::memory_order_relaxed);
+			}
+			sp_job_wait_until([&release]() { return release.load(std::memory_order_acquire); });
+			resumed_count.fetch_add(1, std::memory_order_relaxed);
+		}, &waiting_counter);
+	}
+
+	SP_TEST_CHECK(test_spin_until([&]() { return started_count.load() == waiting_job_count; }));
+	SP_TEST_CHECK(!sp_job_can_park());
+
+	// Every waiting job is parked now so these can only run if the workers moved on to fresh fibers
+	std::atomic<int> other_count{ 0 };
+	sp_job_counter other_counter;
+	for (int i = 0; i < 64; ++i)
+	{
+		sp_job_run([&other_count]() { other_count.fetch_add(1, std::memory_order_relaxed); }, &other_counter);
+	}
+
+	SP_TEST_CHECK(test_spin_until([&other_counter]() { return sp_job_counter_is_done(other_counter); }));
+	SP_TEST_CHECK(other_count.load() == 64);
+	SP_TEST_CHECK(resumed_count.load() == 0);
+
+	release.store(true, std::memory_order_release);
+
+	SP_TEST_CHECK(test_spin_until([&waiting_counter]() { return sp_job_counter_is_done(waiting_counter); }));
+	SP_TEST_CHECK(resumed_count.load() == waiting_job_count);
+}
+
+static void test_job_main_thread()
+{
+	std::atomic<int> main_thread_count{ 0 };
+
+	sp_job_counter counter;
+	for (int i = 0; i < 8; ++i)
+	{
+		sp_job_run([&main_thread_count]() {
+			sp_job_counter main_thread_counter;
+			sp_job_run_on_main_thread([&main_thread_count]() {
+				main_thread_count.fetch_add(sp_job_is_main_thread() ? 1 : 0, std::memory_order_relaxed);
+			}, &main_thread_counter);
+			sp_job_wait(main_thread_counter);
+		}, &counter);
+	}
+
+	// Pumps the main thread jobs while it waits
+	sp_job_wait(counter);
+
+	SP_TEST_CHECK(main_thread_count.load() == 8);
+}
+
+static void test_job_system()
+{
+	const int hardware_thread_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	const int worker_thread_counts[] = { 0, 1, 3, hardware_thread_count - 1 };
+
+	for (int worker_thread_count : worker_thread_counts)
+	{
+		sp_job_system_init(worker_thread_count);
+
+		SP_TEST_CHECK(sp_job_system_get_worker_count() == worker_thread_count + 1);
+		SP_TEST_CHECK(sp_job_is_main_thread());
+
+		test_job_parallel_for();
+		test_job_nested();
+		test_job_parking();
+		test_job_main_thread();
+
+		sp_job_system_shutdown();
+	}
+}
+
+// One axis of the depth buffer pixels a pyramid texel keeps the farthest of, worked out one texel at a time
+static void test_depth_pyramid_footprint(const sp_depth_pyramid& pyramid, bool horizontal, int mip, int texel, int& begin, int& end)
+{
+	if (mip < 0)
+	{
+		begin = texel;
+		end = texel;
+		return;
+	}
+
+	const int size = horizontal ? pyramid._mip_widths[mip] : pyramid._mip_heights[mip];
+	const int source_size = mip == 0 ? (horizontal ? pyramid._depth_width : pyramid._depth_height) : (horizontal ? pyramid._mip_widths[mip - 1] : pyramid._mip_heights[mip - 1]);
+	const int source_begin = std::min(texel * 2, source_size - 1);
+	const int source_end = texel == size - 1 ? source_size - 1 : std::min(texel * 2 + 1, source_size - 1);
+
+	int unused = 0;
+	test_depth_pyramid_footprint(pyramid, horizontal, mip - 1, source_begin, begin, unused);
+	test_depth_pyramid_footprint(pyramid, horizontal, mip - 1, source_end, unused, end);
+}
+
+static void test_depth_pyramid()
+{
+	sp_depth_pyramid pyramid;
+
+	sp_depth_pyramid_init(pyramid, 1920, 1080);
+	SP_TEST_CHECK(pyramid._mip_count == 10);
+	SP_TEST_CHECK(pyramid._mip_widths[0] == 960 && pyramid._mip_heights[0] == 540);
+	SP_TEST_CHECK(pyramid._mip_widths[3] == 120 && pyramid._mip_heights[3] == 67);
+	SP_TEST_CHECK(pyramid._mip_widths[8] == 3 && pyramid._mip_heights[8] == 2);
+	SP_TEST_CHECK(pyramid._mip_widths[9] == 1 && pyramid._mip_heights[9] == 1);
+
+	sp_depth_pyramid_init(pyramid, 1, 1);
+	SP_TEST_CHECK(pyramid._mip_count == 1 && pyramid._depth_count == 1);
+
+	const int sizes[][2] = { { 64, 64 }, { 13, 7 }, { 5, 31 }, { 2, 1 }, { 1, 1 } };
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> random_depth(0.0f, 1.0f);
+
+	for (const auto& size : sizes)
+	{
+		const int width = size[0];
+		const int height = size[1];
+
+		std::vector<float> depth(width * height);
+		for (float& d : depth)
+		{
+			d = random_depth(random);
+		}
+
+		sp_depth_pyramid_build(pyramid, depth.data(), width, height);
+
+		SP_TEST_CHECK(pyramid._depths.size() == static_cast<size_t>(pyramid._depth_count));
+		SP_TEST_CHECK(pyramid._mip_widths[pyramid._mip_count - 1] == 1 && pyramid._mip_heights[pyramid._mip_count - 1] == 1);
+		SP_TEST_CHECK(pyramid._mip_offsets[pyramid._mip_count - 1] == pyramid._depth_count - 1);
+
+		// Every texel is the farthest of the depth buffer pixels under it, and every mip covers every pixel exactly once
+		int wrong_count = 0;
+		for (int mip = 0; mip < pyramid._mip_count; ++mip)
+		{
+			const int mip_width = pyramid._mip_widths[mip];
+			const int mip_height = pyramid._mip_heights[mip];
+
+			int next_x = 0;
+			for (int x = 0; x < mip_width; ++x)
+			{
+				int x_begin = 0, x_end = 0;
+				test_depth_pyramid_footprint(pyramid, true, mip, x, x_begin, x_end);
+				wrong_count += x_begin == next_x ? 0 : 1;
+				next_x = x_end + 1;
+
+				int next_y = 0;
+				for (int y = 0; y < mip_height; ++y)
+				{
+					int y_begin = 0, y_end = 0;
+					test_depth_pyramid_footprint(pyramid, false, mip, y, y_begin, y_end);
+					wrong_count += y_begin == next_y ? 0 : 1;
+					next_y = y_end + 1;
+
+					float depth_max = 0.0f;
+					for (int depth_y = y_begin; depth_y <= y_end; ++depth_y)
+					{
+						for (int depth_x = x_begin; depth_x <= x_end; ++depth_x)
+						{
+							depth_max = std::max(depth_max, depth[depth_y * width + depth_x]);
+						}
+					}
+
+					wrong_count += pyramid._depths[pyramid._mip_offsets[mip] + y * mip_width + x] == depth_max ? 0 : 1;
+				}
+				wrong_count += next_y == height ? 0 : 1;
+			}
+			wrong_count += next_x == width ? 0 : 1;
+		}
+
+		SP_TEST_CHECK(wrong_count == 0);
+	}
+}
+
+struct test_indirect_cull_camera
+{
+	math::mat<4> view_projection;
+	float planes[6][4];
+	float view_projection_rows[4][4];
+};
+
+// Looking down -z from the origin with a square, 90 degree field of view
+static test_indirect_cull_camera test_indirect_cull_camera_create()
+{
+	test_indirect_cull_camera camera;
+	camera.view_projection = math::create_perspective_fov_rh(math::pi / 2, 1.0f, 0.1f, 100.0f);
+	math::get_frustum_planes(camera.view_projection, camera.planes);
+	memcpy(camera.view_projection_rows, &camera.view_projection, sizeof(camera.view_projection_rows));
+	return camera;
+}
+
+// Culls the instances and checks the draw arguments hold exactly the ones expected visible, in instance order
+static void test_indirect_cull_check(const sp_indirect_cull_desc& desc, const std::vector<sp_indirect_cull_instance>& instances, const std::vector<bool>& expected_visible, int draw_count)
+{
+	// Each draw's range starts where the one before could end and the counts start out wrong to see they're reset
+	std::vector<sp_indirect_draw_args> draw_args(draw_count);
+	uint32_t first_instance = 0;
+	for (int draw = 0; draw < draw_count; ++draw)
+	{
+		draw_args[draw]._index_count = 36;
+		draw_args[draw]._first_index = draw * 36;
+		draw_args[draw]._base_vertex = -draw;
+		draw_args[draw]._instance_count = 12345;
+		draw_args[draw]._first_instance = first_instance;
+		first_instance += static_cast<uint32_t>(std::count_if(instances.begin(), instances.end(), [draw](const sp_indirect_cull_instance& instance) { return instance._draw == static_cast<uint32_t>(draw); }));
+	}
+
+	std::vector<uint32_t> visible(instances.size(), ~0u);
+	const int visible_count = sp_indirect_cull_reference(desc, instances.data(), static_cast<int>(instances.size()), draw_args.data(), draw_count, visible.data());
+
+	int expected_visible_count = 0;
+	int wrong_count = 0;
+	for (int draw = 0; draw < draw_count; ++draw)
+	{
+		std::vector<uint32_t> expected;
+		for (size_t i = 0; i < instances.size(); ++i)
+		{
+			if (instances[i]._draw == static_cast<uint32_t>(draw) && expected_visible[i])
+			{
+				expected.push_back(instances[i]._data);
+			}
+		}
+
+		expected_visible_count += static_cast<int>(expected.size());
+
+		const sp_indirect_draw_args& args = draw_args[draw];
+		wrong_count += args._index_count == 36 && args._first_index == static_cast<uint32_t>(draw * 36) && args._base_vertex == -draw ? 0 : 1;
+		wrong_count += args._instance_count == expected.size() ? 0 : 1;
+		wrong_count += std::equal(expected.begin(), expected.end(), visible.begin() + args._first_instance) ? 0 : 1;
+	}
+
+	SP_TEST_CHECK(visible_count == expected_visible_count);
+	SP_TEST_CHECK(wrong_count == 0);
+}
+
+static void test_indirect_cull_frustum()
+{
+	const test_indirect_cull_camera camera = test_indirect_cull_camera_create();
+
+	sp_indirect_cull_desc desc;
+	memcpy(desc.planes, camera.planes, sizeof(desc.planes));
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> random_position(-150.0f, 150.0f);
+	std::uniform_real_distribution<float> random_extent(0.1f, 5.0f);
+
+	const int draw_count = 7;
+
+	// Against every corner instead of the nearest one, so boxes are only culled when all of them are outside one plane
+	std::vector<sp_indirect_cull_instance> instances(10000);
+	std::vector<bool> expected_visible(instances.size());
+	for (size_t i = 0; i < instances.size(); ++i)
+	{
+		sp_indirect_cull_instance& instance = instances[i];
+		for (int k = 0; k < 3; ++k)
+		{
+			instance._center[k] = random_position(random);
+			instance._extent[k] = random_extent(random);
+		}
+		instance._draw = static_cast<uint32_t>(i % draw_count);
+		instance._data = static_cast<uint32_t>(i * 3);
+
+		bool outside = false;
+		for (int plane = 0; plane < 6 && !outside; ++plane)
+		{
+			int outside_corner_count = 0;
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				float distance = camera.planes[plane][3];
+				for (int k = 0; k < 3; ++k)
+				{
+					distance += camera.planes[plane][k] * (instance._center[k] + ((corner >> k) & 1 ? instance._extent[k] : -instance._extent[k]));
+				}
+				outside_corner_count += distance < 0.0f ? 1 : 0;
+			}
+			outside = outside_corner_count == 8;
+		}
+
+		expected_visible[i] = !outside;
+	}
+
+	const int expected_visible_count = static_cast<int>(std::count(expected_visible.begin(), expected_visible.end(), true));
+	SP_TEST_CHECK(expected_visible_count > 0 && expected_visible_count < static_cast<int>(instances.size()));
+
+	test_indirect_cull_check(desc, instances, expected_visible, draw_count);
+}
+
+static void test_indirect_cull_occlusion()
+{
+	const test_indirect_cull_camera camera = test_indirect_cull_camera_create();
+
+	// The left half of the screen is a wall 10 units away, the right half is empty
+	const int width = 64;
+	const int height = 48;
+	const float wall_depth = math::transform_point(camera.view_projection, { 0.0f, 0.0f, -10.0f }).z;
+
+	std::vector<float> depth(width * height, 1.0f);
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width / 2; ++x)
+		{
+			depth[y * width + x] = wall_depth;
+		}
+	}
+
+	sp_depth_pyramid pyramid;
+	sp_depth_pyramid_build(pyramid, depth.data(), width, height);
+
+	sp_indirect_cull_desc desc;
+	memcpy(desc.planes, camera.planes, sizeof(desc.planes));
+	memcpy(desc.view_projection, camera.view_projection_rows, sizeof(desc.view_projection));
+	desc.depth_pyramid = &pyramid;
+
+	struct test_case
+	{
+		float center[3];
+		float extent[3];
+		bool visible;
+	};
+
+	const test_case test_cases[] = {
+		{ { -10.0f, 0.0f, -20.0f }, { 1.0f, 1.0f, 1.0f }, false },		// Behind the wall
+		{ { -10.0f, 8.0f, -40.0f }, { 2.0f, 2.0f, 2.0f }, false },		// Further behind and off center
+		{ { -5.0f, 0.0f, -5.0f }, { 1.0f, 1.0f, 1.0f }, true },			// In front of it
+		{ { -10.0f, 0.0f, -10.0f }, { 1.0f, 1.0f, 1.0f }, true },		// Through it
+		{ { 10.0f, 0.0f, -20.0f }, { 1.0f, 1.0f, 1.0f }, true },		// Behind where the wall isn't
+		{ { -1.0f, 0.0f, -20.0f }, { 2.0f, 1.0f, 1.0f }, true },		// Behind the wall's edge, sticking out past it
+		{ { -1.0f, 0.0f, 0.5f }, { 1.0f, 1.0f, 1.0f }, true },			// Reaching behind the camera
+		{ { 0.0f, 0.0f, 20.0f }, { 1.0f, 1.0f, 1.0f }, false },			// Behind the camera, outside the frustum
+	};
+
+	const int draw_count = 2;
+
+	std::vector<sp_indirect_cull_instance> instances;
+	std::vector<bool> expected_visible;
+	for (int i = 0; i < static_cast<int>(sizeof(test_cases) / sizeof(test_cases[0])); ++i)
+	{
+		sp_indirect_cull_instance instance;
+		memcpy(instance._center, test_cases[i].center, sizeof(instance._center));
+		memcpy(instance._extent, test_cases[i].extent, sizeof(instance._extent));
+		instance._draw = static_cast<uint32_t>(i % draw_count);
+		instance._data = static_cast<uint32_t>(100 + i);
+
+		instances.push_back(instance);
+		expected_visible.push_back(test_cases[i].visible);
+
+		SP_TEST_CHECK(detail::sp_indirect_cull_outside_frustum(desc.planes, instance) || sp_depth_pyramid_occludes(pyramid, desc.view_projection, instance._center, instance._extent) == !test_cases[i].visible);
+	}
+
+	test_indirect_cull_check(desc, instances, expected_visible, draw_count);
+
+	// Without the pyramid only the frustum culls
+	desc.depth_pyramid = nullptr;
+	expected_visible.back() = false;
+	for (size_t i = 0; i + 1 < expected_visible.size(); ++i)
+	{
+		expected_visible[i] = true;
+	}
+	test_indirect_cull_check(desc, instances, expected_visible, draw_count);
+
+	// Nothing is hidden behind a depth buffer that's all far plane
+	std::fill(depth.begin(), depth.end(), 1.0f);
+	sp_depth_pyramid_build(pyramid, depth.data(), width, height);
+	desc.depth_pyramid = &pyramid;
+	test_indirect_cull_check(desc, instances, expected_visible, draw_count);
+}
+
+static void test_indirect_cull()
+{
+	test_depth_pyramid();
+	test_indirect_cull_frustum();
+	test_indirect_cull_occlusion();
+}
+
+// Against every corner like the indirect cull test, so a box is only outside when all of them are outside one plane
+static std::vector<uint32_t> test_bvh_cull_brute_force(const float (&planes)[6][4], const std::vector<sp_bvh_bounds>& object_bounds)
+{
+	std::vector<uint32_t> visible;
+	for (size_t i = 0; i < object_bounds.size(); ++i)
+	{
+		bool outside = false;
+		for (int plane = 0; plane < 6 && !outside; ++plane)
+		{
+			int outside_corner_count = 0;
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				float distance = planes[plane][3];
+				for (int k = 0; k < 3; ++k)
+				{
+					distance += planes[plane][k] * ((corner >> k) & 1 ? object_bounds[i]._max[k] : object_bounds[i]._min[k]);
+				}
+				outside_corner_count += distance < 0.0f ? 1 : 0;
+			}
+			outside = outside_corner_count == 8;
+		}
+
+		if (!outside)
+		{
+			visible.push_back(static_cast<uint32_t>(i));
+		}
+	}
+
+	return visible;
+}
+
+// Culls with the tree from a handful of cameras and checks it finds exactly the objects the brute force one does, each once
+// and in leaf order. Returns how many cameras saw some of the objects but not all of them.
+static int test_bvh_cull_check(const sp_bvh& bvh, const std::vector<sp_bvh_bounds>& object_bounds, std::mt19937& random)
+{
+	std::uniform_real_distribution<float> random_position(-200.0f, 200.0f);
+
+	std::vector<uint32_t> leaf_positions(object_bounds.size());
+	for (size_t i = 0; i < bvh._objects.size(); ++i)
+	{
+		leaf_positions[bvh._objects[i]] = static_cast<uint32_t>(i);
+	}
+
+	const math::mat<4> projection_matrix = math::create_perspective_fov_rh(math::pi / 3, 16.0f / 9.0f, 0.1f, 250.0f);
+
+	int partly_visible_count = 0;
+	int matching_count = 0;
+	const int camera_count = 16;
+	for (int camera = 0; camera < camera_count; ++camera)
+	{
+		// The last camera backs off far enough to see everything, so whole subtrees go in without being tested
+		const math::vec<3> eye = camera == camera_count - 1 ? math::vec<3>{ 0.0f, 0.0f, 1000.0f } : math::vec<3>{ random_position(random), random_position(random), random_position(random) };
+		const math::vec<3> at = camera == camera_count - 1 ? math::vec<3>{ 0.0f, 0.0f, 0.0f } : math::vec<3>{ random_position(random), random_position(random), random_position(random) };
+		const math::mat<4> view_matrix = math::create_look_at_rh(at, eye, { 0.0f, 1.0f, 0.0f });
+		const math::mat<4> far_projection_matrix = math::create_perspective_fov_rh(math::pi / 3, 1.0f, 0.1f, 5000.0f);
+
+		float planes[6][4];
+		math::get_frustum_planes(math::multiply(view_matrix, camera == camera_count - 1 ? far_projection_matrix : projection_matrix), planes);
+
+		std::vector<uint32_t> visible = { 12345 };
+		sp_bvh_cull_frustum(bvh, planes, visible);
+
+		bool leaf_order = true;
+		for (size_t i = 1; i < visible.size(); ++i)
+		{
+			leaf_order = leaf_order && leaf_positions[visible[i - 1]] < leaf_positions[visible[i]];
+		}
+
+		const std::vector<uint32_t> expected_visible = test_bvh_cull_brute_force(planes, object_bounds);
+
+		std::sort(visible.begin(), visible.end());
+		matching_count += leaf_order && visible == expected_visible ? 1 : 0;
+		partly_visible_count += !expected_visible.empty() && expected_visible.size() < object_bounds.size() ? 1 : 0;
+
+		if (camera == camera_count - 1)
+		{
+			SP_TEST_CHECK(expected_visible.size() == object_bounds.size());
+		}
+	}
+
+	SP_TEST_CHECK(matching_count == camera_count);
+
+	return partly_visible_count;
+}
+
+static void test_bvh()
+{
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> random_position(-150.0f, 150.0f);
+	std::uniform_real_distribution<float> random_extent(0.1f, 5.0f);
+	std::uniform_real_distribution<float> random_movement(-30.0f, 30.0f);
+
+	const int object_count = 5000;
+	std::vector<sp_bvh_bounds> object_bounds(object_count);
+	for (sp_bvh_bounds& bounds : object_bounds)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			const float position = random_position(random);
+			const float extent = random_extent(random);
+			bounds._min[k] = position - extent;
+			bounds._max[k] = position + extent;
+		}
+	}
+
+	// One object to a leaf as well as the default, which has leaves testing several
+	for (int leaf_object_count_max : { 1, 4 })
+	{
+		sp_bvh_desc desc;
+		desc.leaf_object_count_max = leaf_object_count_max;
+
+		sp_bvh bvh;
+		sp_bvh_build(bvh, object_bounds.data(), object_count, desc);
+
+		SP_TEST_CHECK(test_bvh_cull_check(bvh, object_bounds, random) > 0);
+
+		// Moved objects have to be found where they are now after refitting, however much worse the tree has got
+		std::vector<sp_bvh_bounds> moved_bounds = object_bounds;
+		for (sp_bvh_bounds& bounds : moved_bounds)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				const float movement = random_movement(random);
+				bounds._min[k] += movement;
+				bounds._max[k] += movement;
+			}
+		}
+
+		sp_bvh_refit(bvh, moved_bounds.data());
+
+		SP_TEST_CHECK(test_bvh_cull_check(bvh, moved_bounds, random) > 0);
+	}
+
+	// Every object in the same place, so there's nothing to split on
+	std::vector<sp_bvh_bounds> stacked_bounds(100, object_bounds[0]);
+
+	sp_bvh stacked_bvh;
+	sp_bvh_build(stacked_bvh, stacked_bounds.data(), static_cast<int>(stacked_bounds.size()), sp_bvh_desc());
+	test_bvh_cull_check(stacked_bvh, stacked_bounds, random);
+
+	sp_bvh empty_bvh;
+	sp_bvh_build(empty_bvh, nullptr, 0, sp_bvh_desc());
+
+	float planes[6][4];
+	math::get_frustum_planes(math::create_perspective_fov_rh(math::pi / 2, 1.0f, 0.1f, 100.0f), planes);
+
+	std::vector<uint32_t> visible = { 12345 };
+	sp_bvh_cull_frustum(empty_bvh, planes, visible);
+	SP_TEST_CHECK(visible.empty());
+}
+
+// Sorts the same items with std::stable_sort and the queue, on this thread and across the job system, and checks every key and
+// payload comes out in the same place
+static bool test_render_queue_sort_matches(const std::vector<sp_render_queue_item>& items)
+{
+	std::vector<sp_render_queue_item> reference = items;
+	std::stable_sort(reference.begin(), reference.end(), [](const sp_render_queue_item& a, const sp_render_queue_item& b) {
+		return a._key < b._key;
+	});
+
+	bool matching = true;
+	for (bool parallel : { false, true })
+	{
+		sp_render_queue queue;
+		for (const sp_render_queue_item& item : items)
+		{
+			sp_render_queue_push(queue, item._key, item._payload);
+		}
+
+		sp_render_queue_sort_desc desc;
+		desc.parallel = parallel;
+		sp_render_queue_sort(queue, desc);
+
+		matching = matching && std::equal(queue._items.begin(), queue._items.end(), reference.begin(), reference.end(), [](const sp_render_queue_item& a, const sp_render_queue_item& b) {
+			return a._key == b._key && a._payload == b._payload;
+		});
+	}
+
+	return matching;
+}
+
+static void test_render_queue()
+{
+	sp_job_system_init();
+
+	std::mt19937_64 random(1);
+	std::uniform_int_distribution<uint32_t> random_pass(0, 3);
+	std::uniform_int_distribution<uint32_t> random_pipeline(0, 31);
+	std::uniform_int_distribution<uint32_t> random_material(0, 99);
+	std::uniform_real_distribution<float> random_depth(0.1f, 1000.0f);
+
+	// Below the radix sort's minimum, at it, big enough for a few blocks on this thread and big enough to go to the job system
+	const int item_counts[] = { 0, 1, 1000, k_render_queue_radix_item_count_min, 20000, k_render_queue_parallel_item_count_min * 3 + 17 };
+
+	int matching_count = 0;
+	for (int item_count : item_counts)
+	{
+		// Keys built the way draws build them, with few enough materials and coarse enough depths that plenty are equal
+		std::vector<sp_render_queue_item> draws(item_count);
+		for (int i = 0; i < item_count; ++i)
+		{
+			const sp_render_queue_depth_order depth_order = random() % 8 == 0 ? sp_render_queue_depth_order::back_to_front : sp_render_queue_depth_order::front_to_back;
+			const float depth = std::floor(random_depth(random) / 100.0f) * 100.0f;
+			draws[i] = { sp_render_queue_key(random_pass(random), random_pipeline(random), random_material(random), depth, depth_order), static_cast<uint32_t>(i) };
+		}
+
+		// Every bit random so no digit gets skipped
+		std::vector<sp_render_queue_item> random_keys(item_count);
+		for (int i = 0; i < item_count; ++i)
+		{
+			random_keys[i] = { random(), static_cast<uint32_t>(i) };
+		}
+
+		// Every digit skipped, so only stability decides the order
+		std::vector<sp_render_queue_item> equal_keys(item_count);
+		for (int i = 0; i < item_count; ++i)
+		{
+			equal_keys[i] = { 0x0123456789ABCDEFull, static_cast<uint32_t>(item_count - i) };
+		}
+
+		matching_count += test_render_queue_sort_matches(draws) && test_render_queue_sort_matches(random_keys) && test_render_queue_sort_matches(equal_keys) ? 1 : 0;
+	}
+
+	SP_TEST_CHECK(matching_count == static_cast<int>(sizeof(item_counts) / sizeof(item_counts[0])));
+
+	// Pass before anything else, then state before depth for opaque draws and depth before state for transparent ones
+	const sp_render_queue_depth_order front_to_back = sp_render_queue_depth_order::front_to_back;
+	const sp_render_queue_depth_order back_to_front = sp_render_queue_depth_order::back_to_front;
+	SP_TEST_CHECK(sp_render_queue_key(0, 9, 9, 1000.0f, front_to_back) < sp_render_queue_key(1, 0, 0, 1.0f, front_to_back));
+	SP_TEST_CHECK(sp_render_queue_key(0, 1, 0, 1.0f, front_to_back) < sp_render_queue_key(0, 1, 1, 0.5f, front_to_back));
+	SP_TEST_CHECK(sp_render_queue_key(0, 1, 1, 1.0f, front_to_back) < sp_render_queue_key(0, 1, 1, 2.0f, front_to_back));
+	SP_TEST_CHECK(sp_render_queue_key(0, 1, 1, 2.0f, back_to_front) < sp_render_queue_key(0, 0, 0, 1.0f, back_to_front));
+	SP_TEST_CHECK(sp_render_queue_key(0, 1, 1, -1.0f, front_to_back) == sp_render_queue_key(0, 1, 1, 0.0f, front_to_back));
+	SP_TEST_CHECK(sp_render_queue_key_state(sp_render_queue_key(0, 1, 1, 1.0f, front_to_back)) == sp_render_queue_key_state(sp_render_queue_key(0, 1, 1, 2.0f, front_to_back)));
+
+	sp_job_system_shutdown();
+}
+
+static void test_ring_allocator()
+{
+	detail::sp_ring_allocator ring;
+	detail::sp_ring_allocator_init(ring, 1024);
+
+	SP_TEST_CHECK(detail::sp_ring_allocator_alloc(ring, 100, 16, 1) == 0);
+	SP_TEST_CHECK(detail::sp_ring_allocator_alloc(ring, 100, 256, 1) == 256);
+	SP_TEST_CHECK(detail::sp_ring_allocator_alloc(ring, 700, 16, 2) == detail::k_ring_allocator_full);
+	SP_TEST_CHECK(detail::sp_ring_allocator_alloc(ring, 600, 16, 2) == 368);
+
+	// Doesn't fit before the end so it wraps, and the first two are still in the way
+	SP_TEST_CHECK(detail::sp_ring_allocator_alloc(ring, 200, 16, 3) == detail::k_ring_allocator_full);
+	detail::sp_ring_allocator_retire(ring, 1);
+	SP_TEST_CHECK(ring._allocations.size() == 1);
+	SP_TEST_CHECK(detail::sp_ring_allocator_alloc(ring, 200, 16, 3) == 0);
+
+	// Nothing in flight with the head wrapped partway, and too big to fit in what's left of the ring after it
+	detail::sp_ring_allocator_init(ring, 1024);
+	SP_TEST_CHECK(detail::sp_ring_allocator_alloc(ring, 600, 4, 1) == 0);
+	SP_TEST_CHECK(detail::sp_ring_allocator_alloc(ring, 300, 4, 2) == 600);
+	detail::sp_ring_allocator_retire(ring, 2);
+	SP_TEST_CHECK(ring._allocations.empty());
+	SP_TEST_CHECK(detail::sp_ring_allocator_alloc(ring, 1000, 4, 3) == 0);
+	SP_TEST_CHECK(ring._head - ring._tail == 1000);
+
+	// The whole ring at once, wrapped or not
+	detail::sp_ring_allocator_retire(ring, 3);
+	SP_TEST_CHECK(detail::sp_ring_allocator_alloc(ring, 1024, 512, 4) == 0);
+	SP_TEST_CHECK(detail::sp_ring_allocator_alloc(ring, 1, 1, 4) == detail::k_ring_allocator_full);
+
+	// Random sizes and alignments, retired a few fence values behind. Everything in use has to be aligned, inside the ring and
+	// not overlap anything else in use.
+	struct live_allocation
+	{
+		uint64_t offset;
+		uint64_t size;
+		uint64_t fence_value;
+	};
+
+	detail::sp_ring_allocator_init(ring, 4096);
+
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int> random_size(1, 4096);
+	std::uniform_int_distribution<int> random_alignment_log2(0, 9);
+
+	std::deque<live_allocation> live;
+	uint64_t fence_value = 1;
+	int full_count = 0;
+	int wrong_count = 0;
+
+	for (int i = 0; i < 100000; ++i)
+	{
+		const uint64_t size = random() % 4 == 0 ? random_size(random) : random_size(random) / 16 + 1;
+		const uint64_t alignment = 1ull << random_alignment_log2(random);
+
+		uint64_t offset = detail::sp_ring_allocator_alloc(ring, size, alignment, fence_value);
+		if (offset == detail::k_ring_allocator_full)
+		{
+			++full_count;
+			wrong_count += ring._allocations.empty() ? 1 : 0;
+
+			// Wait for the oldest until there's room, which there has to be once nothing's in use
+			while (offset == detail::k_ring_allocator_full && !ring._allocations.empty())
+			{
+				const uint64_t oldest_fence_value = ring._allocations.front()._fence_value;
+				detail::sp_ring_allocator_retire(ring, oldest_fence_value);
+				while (!live.empty() && live.front().fence_value <= oldest_fence_value)
+				{
+					live.pop_front();
+				}
+
+				offset = detail::sp_ring_allocator_alloc(ring, size, alignment, fence_value);
+			}
+			wrong_count += offset == detail::k_ring_allocator_full ? 1 : 0;
+		}
+
+		wrong_count += offset % alignment == 0 && offset + size <= ring._size_bytes ? 0 : 1;
+		for (const live_allocation& other : live)
+		{
+			wrong_count += offset + size <= other.offset || other.offset + other.size <= offset ? 0 : 1;
+		}
+
+		live.push_back({ offset, size, fence_value });
+
+		if (random() % 3 == 0)
+		{
+			++fence_value;
+		}
+	}
+
+	SP_TEST_CHECK(full_count > 0);
+	SP_TEST_CHECK(wrong_count == 0);
+}
+
+// Interpolation weights for 4 bit BC6H and BC7 indices, from the format spec
+static const int k_test_bc_weights_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static float test_half_to_float(uint16_t half)
+{
+	const int exponent = (half >> 10) & 31;
+	const int mantissa = half & 1023;
+
+	float value;
+	if (exponent == 31)
+	{
+		value = mantissa ? NAN : INFINITY;
+	}
+	else if (exponent == 0)
+	{
+		value = std::ldexp(static_cast<float>(mantissa), -24);
+	}
+	else
+	{
+		value = std::ldexp(static_cast<float>(mantissa | 1024), exponent - 25);
+	}
+
+	return (half & 0x8000) ? -value : value;
+}
+
+// Reference decoders written from the D3D format specs rather than shared with the encoder, so a mistake in the bit layout
+// can't hide by being made twice. Only the modes the encoder writes are decoded, anything else fails the check.
+static uint32_t test_bc_bits_read(const uint8_t* block, int& position, int bit_count)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < bit_count; ++i, ++position)
+	{
+		value |= static_cast<uint32_t>((block[position >> 3] >> (position & 7)) & 1) << i;
+	}
+	return value;
+}
+
+static void test_bc1_decode_block(const uint8_t* block, uint8_t pixels[16][4])
+{
+	const uint16_t color_0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+	const uint16_t color_1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+
+	float palette[4][3];
+	const uint16_t colors[2] = { color_0, color_1 };
+	for (int e = 0; e < 2; ++e)
+	{
+		const int r = (colors[e] >> 11) & 31;
+		const int g = (colors[e] >> 5) & 63;
+		const int b = colors[e] & 31;
+		palette[e][0] = static_cast<float>((r << 3) | (r >> 2));
+		palette[e][1] = static_cast<float>((g << 2) | (g >> 4));
+		palette[e][2] = static_cast<float>((b << 3) | (b >> 2));
+	}
+
+	for (int c = 0; c < 3; ++c)
+	{
+		if (color_0 > color_1)
+		{
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2.0f;
+			palette[3][c] = 0.0f;
+		}
+	}
+
+	const uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+	for (int i = 0; i < 16; ++i)
+	{
+		const int index = (indices >> (i * 2)) & 3;
+		for (int c = 0; c < 3; ++c)
+		{
+			pixels[i][c] = static_cast<uint8_t>(std::lround(palette[index][c]));
+		}
+		pixels[i][3] = 255;
+	}
+}
+
+// BC7 mode 6: one subset, 7 bit RGBA endpoints with a p-bit each and 4 bit indices
+static bool test_bc7_decode_block(const uint8_t* block, uint8_t pixels[16][4])
+{
+	int position = 0;
+	if (test_bc_bits_read(block, position, 7) != (1 << 6))
+	{
+		return false;
+	}
+
+	int endpoints[2][4];
+	for (int c = 0; c < 4; ++c)
+	{
+		endpoints[0][c] = static_cast<int>(test_bc_bits_read(block, position, 7));
+		endpoints[1][c] = static_cast<int>(test_bc_bits_read(block, position, 7));
+	}
+
+	for (int e = 0; e < 2; ++e)
+	{
+		const int p_bit = static_cast<int>(test_bc_bits_read(block, position, 1));
+		for (int c = 0; c < 4; ++c)
+		{
+			endpoints[e][c] = (endpoints[e][c] << 1) | p_bit;
+		}
+	}
+
+	for (int i = 0; i < 16; ++i)
+	{
+		const int weight = k_test_bc_weights_4[test_bc_bits_read(block, position, i == 0 ? 3 : 4)];
+		for (int c = 0; c < 4; ++c)
+		{
+			pixels[i][c] = static_cast<uint8_t>(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+		}
+	}
+
+	return true;
+}
+
+// BC6H mode 11 (unsigned): one region, 10 bit RGB endpoints that aren't transformed and 4 bit indices
+static bool test_bc6h_decode_block(const uint8_t* block, float pixels[16][3])
+{
+	int position = 0;
+	if (test_bc_bits_read(block, position, 5) != 0x03)
+	{
+		return false;
+	}
+
+	int endpoints[2][3];
+	for (int e = 0; e < 2; ++e)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			const int value = static_cast<int>(test_bc_bits_read(block, position, 10));
+			endpoints[e][c] = value == 0 ? 0 : value == 1023 ? 0xFFFF : ((value << 16) + 0x8000) >> 10;
+		}
+	}
+
+	for (int i = 0; i < 16; ++i)
+	{
+		const int weight = k_test_bc_weights_4[test_bc_bits_read(block, position, i == 0 ? 3 : 4)];
+		for (int c = 0; c < 3; ++c)
+		{
+			const int interpolated = ((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6;
+			pixels[i][c] = test_half_to_float(static_cast<uint16_t>((interpolated * 31) >> 6));
+		}
+	}
+
+	return true;
+}
+
+static sp_image_mip_chain test_image_mip_chain_create(sp_image_format format, int width, int height, const void* data)
+{
+	sp_image_mip_chain mip_chain;
+	mip_chain._format = format;
+	mip_chain._mip_count = 1;
+	mip_chain._mips[0]._width = width;
+	mip_chain._mips[0]._height = height;
+	mip_chain._mips[0]._row_pitch_bytes = sp_image_format_get_row_pitch_bytes(format, width);
+
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	mip_chain._data.assign(bytes, bytes + static_cast<size_t>(mip_chain._mips[0]._row_pitch_bytes) * height);
+
+	return mip_chain;
+}
+
+struct test_bc_error
+{
+	bool decoded = true;
+	int max_error = 0;
+	double rms_error = 0.0;
+};
+
+// Encodes a 64x64 image and decodes it again, measuring the error over the channels the format keeps
+static test_bc_error test_bc_round_trip(sp_image_format format, const std::vector<uint8_t>& image, int channel_count)
+{
+	const int size = 64;
+	const sp_image_mip_chain compressed = sp_image_mip_chain_compress(test_image_mip_chain_create(sp_image_format::r8g8b8a8, size, size, image.data()), format);
+
+	test_bc_error error;
+	double squared_error_sum = 0.0;
+
+	for (int block_y = 0; block_y < size / 4; ++block_y)
+	{
+		for (int block_x = 0; block_x < size / 4; ++block_x)
+		{
+			const uint8_t* block = &compressed._data[static_cast<size_t>(block_y) * compressed._mips[0]._row_pitch_bytes + block_x * sp_image_format_get_block_size_bytes(format)];
+
+			uint8_t pixels[16][4];
+			if (format == sp_image_format::bc1)
+			{
+				test_bc1_decode_block(block, pixels);
+			}
+			else if (!test_bc7_decode_block(block, pixels))
+			{
+				error.decoded = false;
+				return error;
+			}
+
+			for (int i = 0; i < 16; ++i)
+			{
+				const uint8_t* source = &image[((block_y * 4 + i / 4) * size + block_x * 4 + i % 4) * 4];
+				for (int c = 0; c < channel_count; ++c)
+				{
+					const int difference = std::abs(pixels[i][c] - source[c]);
+					error.max_error = std::max(error.max_error, difference);
+					squared_error_sum += difference * difference;
+				}
+			}
+		}
+	}
+
+	error.rms_error = std::sqrt(squared_error_sum / (size * size * channel_count));
+
+	return error;
+}
+
+// Smooth gradients, a solid color per block and two random colors per block. Two colors are on a line so both formats should
+// get close, the rest of the error is the endpoint precision.
+static void test_image_bc_ldr()
+{
+	const int size = 64;
+
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int> random_byte(0, 255);
+
+	std::vector<uint8_t> smooth(size * size * 4);
+	std::vector<uint8_t> solid(size * size * 4);
+	std::vector<uint8_t> two_colors(size * size * 4);
+
+	std::vector<uint8_t> block_colors[2];
+	for (auto& colors : block_colors)
+	{
+		for (int i = 0; i < (size / 4) * (size / 4) * 4; ++i)
+		{
+			colors.push_back(static_cast<uint8_t>(random_byte(random)));
+		}
+	}
+
+	for (int y = 0; y < size; ++y)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			const int pixel = (y * size + x) * 4;
+			const int block = ((y / 4) * (size / 4) + x / 4) * 4;
+			const int pick = random_byte(random) & 1;
+
+			smooth[pixel + 0] = static_cast<uint8_t>(x * 4);
+			smooth[pixel + 1] = static_cast<uint8_t>(y * 4);
+			smooth[pixel + 2] = static_cast<uint8_t>(128 + 100 * std::sin(x * 0.1) * std::cos(y * 0.1));
+			smooth[pixel + 3] = static_cast<uint8_t>(255 - x - y);
+
+			for (int c = 0; c < 4; ++c)
+			{
+				solid[pixel + c] = block_colors[0][block + c];
+				two_colors[pixel + c] = block_colors[pick][block + c];
+			}
+		}
+	}
+
+	// Worst pixel and RMS error allowed. BC1 endpoints are 5:6:5 so a solid color can be off by half a step of 8, BC7 endpoints
+	// are 8 bit with the lowest bit shared between channels.
+	struct test_bc_case
+	{
+		sp_image_format format;
+		const std::vector<uint8_t>* image;
+		int channel_count;
+		int max_error;
+		double rms_error;
+	};
+
+	const test_bc_case cases[] = {
+		{ sp_image_format::bc1, &smooth, 3, 16, 4.5 },
+		{ sp_image_format::bc1, &solid, 3, 5, 3.0 },
+		{ sp_image_format::bc1, &two_colors, 3, 5, 3.0 },
+		{ sp_image_format::bc7, &smooth, 4, 12, 3.5 },
+		{ sp_image_format::bc7, &solid, 4, 2, 1.0 },
+		{ sp_image_format::bc7, &two_colors, 4, 2, 1.0 },
+	};
+
+	for (const test_bc_case& bc_case : cases)
+	{
+		const test_bc_error error = test_bc_round_trip(bc_case.format, *bc_case.image, bc_case.channel_count);
+		SP_TEST_CHECK(error.decoded);
+		SP_TEST_CHECK(error.max_error <= bc_case.max_error);
+		SP_TEST_CHECK(error.rms_error <= bc_case.rms_error);
+	}
+}
+
+// Smooth HDR gradients along the diagonal, one of them over several orders of magnitude, and a solid color per block. BC6H keeps about as many bits as a half,
+// less what the endpoints lose, so errors are relative.
+static void test_image_bc_hdr()
+{
+	const int size = 64;
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> random_exponent(-8.0f, 12.0f);
+
+	std::vector<float> smooth(size * size * 4);
+	std::vector<float> solid(size * size * 4);
+
+	std::vector<float> block_colors;
+	for (int i = 0; i < (size / 4) * (size / 4) * 3; ++i)
+	{
+		block_colors.push_back(std::exp2(random_exponent(random)));
+	}
+
+	for (int y = 0; y < size; ++y)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			const int pixel = (y * size + x) * 4;
+			const int block = ((y / 4) * (size / 4) + x / 4) * 3;
+
+			smooth[pixel + 0] = 1.0f + (x + y) * 0.25f;
+			smooth[pixel + 1] = std::exp2((x + y) * 0.1f - 4.0f);
+			smooth[pixel + 2] = 1.0f + 0.5f * std::sin((x + y) * 0.1f);
+			smooth[pixel + 3] = 1.0f;
+
+			for (int c = 0; c < 3; ++c)
+			{
+				solid[pixel + c] = block_colors[block + c];
+			}
+			solid[pixel + 3] = 1.0f;
+		}
+	}
+
+	// Worst and mean relative error allowed
+	struct test_bc6h_case
+	{
+		const std::vector<float>* image;
+		double max_error;
+		double mean_error;
+	};
+
+	const test_bc6h_case cases[] = {
+		{ &smooth, 0.08, 0.015 },
+		{ &solid, 0.03, 0.01 },
+	};
+
+	for (const test_bc6h_case& bc6h_case : cases)
+	{
+		const std::vector<float>* image = bc6h_case.image;
+
+		const sp_image_mip_chain compressed = sp_image_mip_chain_compress(test_image_mip_chain_create(sp_image_format::r32g32b32a32, size, size, image->data()), sp_image_format::bc6h);
+
+		bool decoded = true;
+		double max_relative_error = 0.0;
+		double relative_error_sum = 0.0;
+
+		for (int block_y = 0; block_y < size / 4; ++block_y)
+		{
+			for (int block_x = 0; block_x < size / 4; ++block_x)
+			{
+				float pixels[16][3];
+				decoded = decoded && test_bc6h_decode_block(&compressed._data[static_cast<size_t>(block_y) * compressed._mips[0]._row_pitch_bytes + block_x * 16], pixels);
+
+				for (int i = 0; i < 16; ++i)
+				{
+					const float* source = &(*image)[((block_y * 4 + i / 4) * size + block_x * 4 + i % 4) * 4];
+					for (int c = 0; c < 3; ++c)
+					{
+						const double relative_error = std::fabs(pixels[i][c] - source[c]) / source[c];
+						max_relative_error = std::max(max_relative_error, relative_error);
+						relative_error_sum += relative_error;
+					}
+				}
+			}
+		}
+
+		SP_TEST_CHECK(decoded);
+		SP_TEST_CHECK(max_relative_error <= bc6h_case.max_error);
+		SP_TEST_CHECK(relative_error_sum / (size * size * 3) <= bc6h_case.mean_error);
+	}
+
+	// Negative values are clamped to zero
+	const std::vector<float> negative(16 * 4, -1.0f);
+	const sp_image_mip_chain compressed = sp_image_mip_chain_compress(test_image_mip_chain_create(sp_image_format::r32g32b32a32, 4, 4, negative.data()), sp_image_format::bc6h);
+
+	float pixels[16][3];
+	SP_TEST_CHECK(test_bc6h_decode_block(compressed._data.data(), pixels));
+
+	int zero_count = 0;
+	for (const auto& pixel : pixels)
+	{
+		zero_count += pixel[0] == 0.0f && pixel[1] == 0.0f && pixel[2] == 0.0f ? 1 : 0;
+	}
+	SP_TEST_CHECK(zero_count == 16);
+}
+
+static void test_image_bc()
+{
+	sp_job_system_init();
+
+	test_image_bc_ldr();
+	test_image_bc_hdr();
+
+	sp_job_system_shutdown();
+}
+
+// The scalar conversion and the SSE one (F16C or not, depending on what the compiler targets) for one value
+static uint16_t test_float_to_half(float value, bool sse)
+{
+	if (!sse)
+	{
+		return detail::sp_image_float_to_half(value);
+	}
+
+	return static_cast<uint16_t>(_mm_cvtsi128_si32(detail::sp_image_float_to_half_sse(_mm_set1_ps(value))) & 0xFFFF);
+}
+
+static bool test_half_is_nan(uint16_t half)
+{
+	return (half & 0x7C00) == 0x7C00 && (half & 0x3FF) != 0;
+}
+
+// Every finite half has to come back as itself, denormals and signed zeros included, values halfway between two halves round
+// to the even one, anything too big (infinities too) clamps to the largest finite half and NaNs stay NaN
+static void test_image_half()
+{
+	for (int path = 0; path < 2; ++path)
+	{
+		const bool sse = path == 1;
+
+		int finite_count = 0;
+		int exact_count = 0;
+		int rounded_count = 0;
+
+		for (uint32_t half = 0; half < 0x10000; ++half)
+		{
+			if ((half & 0x7C00) == 0x7C00)
+			{
+				continue;
+			}
+
+			++finite_count;
+
+			const float value = test_half_to_float(static_cast<uint16_t>(half));
+			exact_count += test_float_to_half(value, sse) == half ? 1 : 0;
+
+			// Between this half and the next one away from zero, unless that's infinity
+			const uint32_t next = half + 1;
+			if ((next & 0x7C00) == 0x7C00)
+			{
+				++rounded_count;
+				continue;
+			}
+
+			const float next_value = test_half_to_float(static_cast<uint16_t>(next));
+			const float halfway = (value + next_value) * 0.5f;
+			const uint32_t even = (half & 1) ? next : half;
+
+			rounded_count +=
+				test_float_to_half(halfway, sse) == even &&
+				test_float_to_half(std::nextafter(halfway, value), sse) == half &&
+				test_float_to_half(std::nextafter(halfway, next_value), sse) == next ? 1 : 0;
+		}
+
+		SP_TEST_CHECK(exact_count == finite_count);
+		SP_TEST_CHECK(rounded_count == finite_count);
+
+		// Too small for even the smallest denormal
+		SP_TEST_CHECK(test_float_to_half(1e-30f, sse) == 0x0000);
+		SP_TEST_CHECK(test_float_to_half(-1e-30f, sse) == 0x8000);
+		SP_TEST_CHECK(test_float_to_half(std::numeric_limits<float>::denorm_min(), sse) == 0x0000);
+
+		SP_TEST_CHECK(test_float_to_half(65520.0f, sse) == 0x7BFF);
+		SP_TEST_CHECK(test_float_to_half(std::numeric_limits<float>::max(), sse) == 0x7BFF);
+		SP_TEST_CHECK(test_float_to_half(std::numeric_limits<float>::infinity(), sse) == 0x7BFF);
+		SP_TEST_CHECK(test_float_to_half(-std::numeric_limits<float>::infinity(), sse) == 0xFBFF);
+
+		SP_TEST_CHECK(test_half_is_nan(test_float_to_half(std::numeric_limits<float>::quiet_NaN(), sse)));
+		SP_TEST_CHECK(test_half_is_nan(test_float_to_half(-std::numeric_limits<float>::quiet_NaN(), sse)));
+		SP_TEST_CHECK(test_half_is_nan(test_float_to_half(std::numeric_limits<float>::signaling_NaN(), sse)));
+	}
+
+	// A whole image through the public conversion, which has to match the scalar one pixel for pixel
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> random_exponent(-30.0f, 20.0f);
+
+	const int width = 37;
+	const int height = 5;
+	std::vector<float> pixels(width * height * 4);
+	for (float& value : pixels)
+	{
+		value = (random() & 1 ? -1.0f : 1.0f) * std::exp2(random_exponent(random));
+	}
+	pixels[0] = std::numeric_limits<float>::infinity();
+	pixels[1] = std::numeric_limits<float>::quiet_NaN();
+
+	const sp_image_mip_chain converted = sp_image_mip_chain_convert(test_image_mip_chain_create(sp_image_format::r32g32b32a32, width, height, pixels.data()), sp_image_format::r16g16b16a16);
+
+	int matching_count = 0;
+	for (int i = 0; i < width * height * 4; ++i)
+	{
+		uint16_t half;
+		memcpy(&half, &converted._data[i * 2], sizeof(half));
+
+		const uint16_t expected = detail::sp_image_float_to_half(pixels[i]);
+		matching_count += half == expected || (test_half_is_nan(half) && test_half_is_nan(expected)) ? 1 : 0;
+	}
+
+	SP_TEST_CHECK(matching_count == width * height * 4);
+}
+
+static void test_r9g9b9e5_to_float(uint32_t packed, float* rgb)
+{
+	const float scale = std::ldexp(1.0f, static_cast<int>(packed >> 27) - 15 - 9);
+
+	rgb[0] = (packed & 511) * scale;
+	rgb[1] = ((packed >> 9) & 511) * scale;
+	rgb[2] = ((packed >> 18) & 511) * scale;
+}
+
+static std::vector<uint32_t> test_image_r9g9b9e5_convert(const std::vector<float>& pixels)
+{
+	const int width = static_cast<int>(pixels.size() / 4);
+
+	std::vector<uint32_t> packed(width);
+	detail::sp_image_convert_row_r9g9b9e5(pixels.data(), reinterpret_cast<uint8_t*>(packed.data()), width);
+
+	return packed;
+}
+
+// Values that fit exactly come back exactly, everything else is within half a step of the shared exponent, which is the
+// smallest that fits the largest channel. Negatives, NaNs and values too small for the smallest exponent come out as zero and
+// anything too big (infinities too) clamps to the largest value.
+static void test_image_r9g9b9e5()
+{
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int> random_exponent(0, 31);
+	std::uniform_int_distribution<int> random_mantissa(0, 511);
+	std::uniform_real_distribution<float> random_float_exponent(-20.0f, 17.0f);
+
+	// An odd number of pixels so the last group of four isn't full
+	const int pixel_count = 1001;
+
+	std::vector<float> exact(pixel_count * 4);
+	std::vector<float> inexact(pixel_count * 4);
+	for (int i = 0; i < pixel_count; ++i)
+	{
+		const float scale = std::ldexp(1.0f, random_exponent(random) - 15 - 9);
+		const int largest = random() % 3;
+
+		for (int c = 0; c < 3; ++c)
+		{
+			// The largest channel uses all 9 bits so nothing else could be picked for the exponent
+			const int mantissa = c == largest ? 256 + random_mantissa(random) / 2 : random_mantissa(random) / 2;
+			exact[i * 4 + c] = mantissa * scale;
+			inexact[i * 4 + c] = std::exp2(random_float_exponent(random));
+		}
+
+		exact[i * 4 + 3] = 1.0f;
+		inexact[i * 4 + 3] = 1.0f;
+	}
+
+	const std::vector<uint32_t> exact_packed = test_image_r9g9b9e5_convert(exact);
+	const std::vector<uint32_t> inexact_packed = test_image_r9g9b9e5_convert(inexact);
+
+	int exact_count = 0;
+	int inexact_count = 0;
+	for (int i = 0; i < pixel_count; ++i)
+	{
+		float rgb[3];
+		test_r9g9b9e5_to_float(exact_packed[i], rgb);
+		exact_count += rgb[0] == exact[i * 4 + 0] && rgb[1] == exact[i * 4 + 1] && rgb[2] == exact[i * 4 + 2] ? 1 : 0;
+
+		test_r9g9b9e5_to_float(inexact_packed[i], rgb);
+
+		const uint32_t packed = inexact_packed[i];
+		const float half_step = std::ldexp(0.5f, static_cast<int>(packed >> 27) - 15 - 9);
+		const int mantissa_max = std::max({ static_cast<int>(packed & 511), static_cast<int>((packed >> 9) & 511), static_cast<int>((packed >> 18) & 511) });
+
+		bool within_half_step = true;
+		for (int c = 0; c < 3; ++c)
+		{
+			const float expected = std::min(inexact[i * 4 + c], detail::k_image_r9g9b9e5_max);
+			within_half_step = within_half_step && std::fabs(rgb[c] - expected) <= half_step;
+		}
+
+		inexact_count += within_half_step && (mantissa_max >= 256 || (packed >> 27) == 0) ? 1 : 0;
+	}
+
+	SP_TEST_CHECK(exact_count == pixel_count);
+	SP_TEST_CHECK(inexact_count == pixel_count);
+
+	const float infinity = std::numeric_limits<float>::infinity();
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+
+	const std::vector<float> special = {
+		infinity, 1e10f, 0.5f, 1.0f,
+		-1.0f, -infinity, 0.0f, 1.0f,
+		nan, 2.0f, nan, 1.0f,
+		1e-30f, std::numeric_limits<float>::denorm_min(), 0.0f, 1.0f,
+	};
+
+	const std::vector<uint32_t> special_packed = test_image_r9g9b9e5_convert(special);
+
+	float rgb[4][3];
+	for (int i = 0; i < 4; ++i)
+	{
+		test_r9g9b9e5_to_float(special_packed[i], rgb[i]);
+	}
+
+	SP_TEST_CHECK(rgb[0][0] == detail::k_image_r9g9b9e5_max && rgb[0][1] == detail::k_image_r9g9b9e5_max);
+	SP_TEST_CHECK(rgb[1][0] == 0.0f && rgb[1][1] == 0.0f && rgb[1][2] == 0.0f);
+	SP_TEST_CHECK(rgb[2][0] == 0.0f && rgb[2][1] == 2.0f && rgb[2][2] == 0.0f);
+	SP_TEST_CHECK(rgb[3][0] == 0.0f && rgb[3][1] == 0.0f && rgb[3][2] == 0.0f);
+}
+
+static void test_image_convert()
+{
+	sp_job_system_init();
+
+	test_image_half();
+	test_image_r9g9b9e5();
+
+	sp_job_system_shutdown();
+}
+
+int main()
+{
+	test_job_system();
+	test_indirect_cull();
+	test_bvh();
+	test_render_queue();
+	test_ring_allocator();
+	test_image_bc();
+	test_image_convert();
+
+	printf("%d of %d checks passed\n", g_check_count - g_check_failed_count, g_check_count);
+
+	return g_check_failed_count == 0 ? 0 : 1;
+}
\ No newline at end of file
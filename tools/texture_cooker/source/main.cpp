@@ -0,0 +1,235 @@
+// Cooks PNG, JPG and HDR images into mipmapped, block compressed DDS files so they can be loaded without decoding anything.
+//
+// texture_cooker [--srgb] [--kaiser] [--wrap] <bc1|bc3|bc5|bc6h|bc7|r16g16b16a16|r9g9b9e5> <input> <output.dds>
+//
+// --srgb filters the mips in linear space and marks the file as sRGB. --wrap filters across the left and right edges, for
+// equirectangular environments. HDR inputs can only be cooked to bc6h, r16g16b16a16 or r9g9b9e5 and everything else to any of
+// the others.
+//
+// texture_cooker ibl <input.hdr|input.ibl> <output.ibl_cache>
+//
+// Bakes image based lighting from an equirectangular environment, or from the reflection image an sIBL descriptor points at
+// scaled by its multiplier, into the cache the PBR demo would otherwise bake the first time it runs.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include "../../../sparky/source/job_impl.h"
+#include "../../../sparky/source/image_mips_impl.h"
+#include "../../../sparky/source/image_bc_impl.h"
+#include "../../../sparky/source/image_convert_impl.h"
+#include "../../../sparky/source/image_dds_impl.h"
+#include "../../../sparky/source/image_ktx2_impl.h"
+#include "../../../sparky/source/image_file_impl.h"
+#include "../../../sparky/source/file_map_impl.h"
+#include "../../../sparky/source/image_ibl_impl.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	bool parse_format(const char* name, sp_image_format& format)
+	{
+		const struct { const char* name; sp_image_format format; } formats[] = {
+			{ "bc1", sp_image_format::bc1 },
+			{ "bc3", sp_image_format::bc3 },
+			{ "bc5", sp_image_format::bc5 },
+			{ "bc6h", sp_image_format::bc6h },
+			{ "bc7", sp_image_format::bc7 },
+			{ "r16g16b16a16", sp_image_format::r16g16b16a16 },
+			{ "r9g9b9e5", sp_image_format::r9g9b9e5 },
+		};
+
+		for (const auto& candidate : formats)
+		{
+			if (strcmp(name, candidate.name) == 0)
+			{
+				format = candidate.format;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	int print_usage()
+	{
+		fprintf(stderr, "usage: texture_cooker [--srgb] [--kaiser] [--wrap] <bc1|bc3|bc5|bc6h|bc7|r16g16b16a16|r9g9b9e5> <input> <output.dds>\n");
+		fprintf(stderr, "       texture_cooker ibl <input.hdr|input.ibl> <output.ibl_cache>\n");
+		return 1;
+	}
+
+	int bake_ibl(const char* input_path, const char* output_path)
+	{
+		sp_image_ibl_desc ibl_desc;
+
+		const size_t input_path_length = strlen(input_path);
+		const bool is_descriptor = input_path_length > 4 && strcmp(input_path + input_path_length - 4, ".ibl") == 0;
+
+		sp_image_ibl_descriptor descriptor;
+		if (is_descriptor)
+		{
+			if (!sp_image_ibl_descriptor_read(input_path, descriptor) || descriptor._reflection_path.empty())
+			{
+				fprintf(stderr, "%s: couldn't be read or has no reflection image\n", input_path);
+				return 1;
+			}
+
+			input_path = descriptor._reflection_path.c_str();
+			ibl_desc.scale = descriptor._reflection_multiplier;
+		}
+
+		int width, height, channels;
+		float* image_data = stbi_loadf(input_path, &width, &height, &channels, STBI_rgb_alpha);
+		if (!image_data)
+		{
+			fprintf(stderr, "%s: %s\n", input_path, stbi_failure_reason());
+			return 1;
+		}
+
+		if (width != height * 2 || height >> (k_image_ibl_specular_mip_count - 1) == 0)
+		{
+			fprintf(stderr, "%s: %dx%d isn't an equirectangular environment\n", input_path, width, height);
+			stbi_image_free(image_data);
+			return 1;
+		}
+
+		sp_job_system_init();
+
+		const auto start_time = std::chrono::high_resolution_clock::now();
+
+		const sp_image_ibl ibl = sp_image_ibl_bake(image_data, width, height, ibl_desc);
+		stbi_image_free(image_data);
+
+		const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+
+		sp_job_system_shutdown();
+
+		if (!sp_image_ibl_write(output_path, ibl))
+		{
+			fprintf(stderr, "%s: couldn't be written\n", output_path);
+			return 1;
+		}
+
+		printf("%s -> %s: %dx%d, %d specular mips in %.2f s\n", input_path, output_path, width, height, ibl._specular._mip_count, seconds);
+
+		return 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "ibl") == 0)
+	{
+		return argc == 4 ? bake_ibl(argv[2], argv[3]) : print_usage();
+	}
+
+	sp_image_mip_chain_desc mip_chain_desc;
+
+	int arg = 1;
+	for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; ++arg)
+	{
+		if (strcmp(argv[arg], "--srgb") == 0)
+		{
+			mip_chain_desc.color_space = sp_image_color_space::srgb;
+		}
+		else if (strcmp(argv[arg], "--kaiser") == 0)
+		{
+			mip_chain_desc.filter = sp_image_mip_filter::kaiser;
+		}
+		else if (strcmp(argv[arg], "--wrap") == 0)
+		{
+			mip_chain_desc.wrap_x = true;
+		}
+		else
+		{
+			return print_usage();
+		}
+	}
+
+	sp_image_format format;
+	if (argc - arg != 3 || !parse_format(argv[arg], format))
+	{
+		return print_usage();
+	}
+
+	const char* input_path = argv[arg + 1];
+	const char* output_path = argv[arg + 2];
+
+	const bool is_float_format = format == sp_image_format::bc6h || format == sp_image_format::r16g16b16a16 || format == sp_image_format::r9g9b9e5;
+
+	const bool is_hdr = stbi_is_hdr(input_path) != 0;
+	if (is_hdr != is_float_format)
+	{
+		fprintf(stderr, "%s: HDR images have to be cooked to bc6h, r16g16b16a16 or r9g9b9e5 and nothing else can be\n", input_path);
+		return 1;
+	}
+
+	int width, height, channels;
+	void* image_data = nullptr;
+	if (is_hdr)
+	{
+		image_data = stbi_loadf(input_path, &width, &height, &channels, STBI_rgb_alpha);
+		mip_chain_desc.format = sp_image_format::r32g32b32a32;
+		mip_chain_desc.color_space = sp_image_color_space::linear;
+	}
+	else
+	{
+		image_data = stbi_load(input_path, &width, &height, &channels, STBI_rgb_alpha);
+		mip_chain_desc.format = sp_image_format::r8g8b8a8;
+	}
+
+	if (!image_data)
+	{
+		fprintf(stderr, "%s: %s\n", input_path, stbi_failure_reason());
+		return 1;
+	}
+
+	// The GPU wants the top level to be whole blocks
+	if (sp_image_format_is_block_compressed(format) && (width % 4 != 0 || height % 4 != 0))
+	{
+		fprintf(stderr, "%s: %dx%d isn't a multiple of 4\n", input_path, width, height);
+		stbi_image_free(image_data);
+		return 1;
+	}
+
+	sp_job_system_init();
+
+	const auto start_time = std::chrono::high_resolution_clock::now();
+
+	const sp_image_mip_chain mip_chain = sp_image_mip_chain_create(image_data, width, height, mip_chain_desc);
+	stbi_image_free(image_data);
+
+	const sp_image_mip_chain compressed_mip_chain = sp_image_format_is_block_compressed(format) ? sp_image_mip_chain_compress(mip_chain, format) : sp_image_mip_chain_convert(mip_chain, format);
+
+	const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+
+	sp_job_system_shutdown();
+
+	if (!sp_image_dds_write(output_path, compressed_mip_chain, mip_chain_desc.color_space))
+	{
+		fprintf(stderr, "%s: couldn't be written\n", output_path);
+		return 1;
+	}
+
+	int64_t pixel_count = 0;
+	for (int i = 0; i < mip_chain._mip_count; ++i)
+	{
+		pixel_count += static_cast<int64_t>(mip_chain._mips[i]._width) * mip_chain._mips[i]._height;
+	}
+
+	printf("%s -> %s: %dx%d, %d mips, %.1f MB -> %.1f MB in %.2f s (%.1f MPixels/s)\n",
+		input_path,
+		output_path,
+		width,
+		height,
+		mip_chain._mip_count,
+		mip_chain._data.size() / (1024.0 * 1024.0),
+		compressed_mip_chain._data.size() / (1024.0 * 1024.0),
+		seconds,
+		pixel_count / seconds / 1000000.0);
+
+	return 0;
+}
\ No newline at end of file